@@ -1,19 +1,9 @@
 using March.Core.Diagnostics;
-using March.Core.Interop;
 using March.Core.Pool;
 using System.Runtime.InteropServices;
 
 namespace March.Core
 {
-    internal static partial class NativeJobUtility
-    {
-        [NativeMethod]
-        public static partial void Invoke(nint job, ulong index);
-
-        [NativeMethod]
-        public static partial void Release(nint job);
-    }
-
     /// <summary>
     /// WaitGroup
     /// </summary>
@@ -24,11 +14,10 @@ namespace March.Core
 
         private ulong m_Id;
         private ulong m_Countdown;
-        private Action<int>? m_ManagedJob;
-        private nint m_NativeJob;
+        private Action<int>? m_Job;
         private object? m_State;
 
-        public void Reset(ulong id, ulong count, Action<int>? managedJob, nint nativeJob, object? state)
+        public void Reset(ulong id, ulong count, Action<int> job, object? state)
         {
             if (count == 0)
             {
@@ -37,17 +26,14 @@ namespace March.Core
 
             m_Id = id;
             m_Countdown = count;
-            m_ManagedJob = managedJob;
-            m_NativeJob = nativeJob;
+            m_Job = job;
             m_State = state;
             m_Event.Reset();
         }
 
         public ulong Id => m_Id;
 
-        public Action<int>? ManagedJob => m_ManagedJob;
-
-        public nint NativeJob => m_NativeJob;
+        public Action<int>? Job => m_Job;
 
         public void Done()
         {
@@ -56,9 +42,7 @@ namespace March.Core
                 ulong id = m_Id;
                 object? state = m_State;
 
-                NativeJobUtility.Release(m_NativeJob);
-                m_ManagedJob = null;
-                m_NativeJob = nint.Zero;
+                m_Job = null;
                 m_State = null;
                 m_Event.Set();
 
@@ -121,22 +105,12 @@ namespace March.Core
         {
             JobWaitGroup wg = m_Group!;
 
-            if (wg.ManagedJob != null)
-            {
-                int startIndex = (int)m_StartIndex;
-                int endIndex = (int)m_EndIndex;
+            int startIndex = (int)m_StartIndex;
+            int endIndex = (int)m_EndIndex;
 
-                for (int i = startIndex; i < endIndex; i++)
-                {
-                    wg.ManagedJob(i);
-                }
-            }
-            else
+            for (int i = startIndex; i < endIndex; i++)
             {
-                for (ulong i = m_StartIndex; i < m_EndIndex; i++)
-                {
-                    NativeJobUtility.Invoke(wg.NativeJob, i);
-                }
+                wg.Job!(i);
             }
         }
     }
@@ -158,10 +132,10 @@ namespace March.Core
 
         public static JobHandle Schedule(int totalSize, int batchSize, Action<int> func)
         {
-            return ScheduleInternal((ulong)totalSize, (ulong)batchSize, func, nint.Zero);
+            return ScheduleInternal((ulong)totalSize, (ulong)batchSize, func);
         }
 
-        private static JobHandle ScheduleInternal(ulong totalSize, ulong batchSize, Action<int>? managedJob, nint nativeJob)
+        private static JobHandle ScheduleInternal(ulong totalSize, ulong batchSize, Action<int> func)
         {
             if (totalSize == 0)
             {
@@ -186,7 +160,7 @@ namespace March.Core
                     wg = new JobWaitGroup(OnGroupCompleted);
                 }
 
-                wg.Reset(groupId, itemCount, managedJob, nativeJob, items);
+                wg.Reset(groupId, itemCount, func, items);
 
                 for (ulong i = 0; i < itemCount; i++)
                 {
@@ -254,17 +228,5 @@ namespace March.Core
                 wg!.Wait();
             }
         }
-
-        [UnmanagedCallersOnly]
-        private static unsafe void NativeSchedule(JobHandle* handle, ulong totalSize, ulong batchSize, nint job)
-        {
-            *handle = ScheduleInternal(totalSize, batchSize, null, job);
-        }
-
-        [UnmanagedCallersOnly]
-        private static void NativeComplete(JobHandle handle)
-        {
-            Complete(handle);
-        }
     }
 }
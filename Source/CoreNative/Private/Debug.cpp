@@ -5,36 +5,68 @@
 
 namespace march
 {
-    LogLevel                Log::s_MinimumLevel = LogLevel::Trace;
-    std::deque<LogEntry>    Log::s_Entries{};
-    uint32_t                Log::s_Counts[]{};
-    std::mutex              Log::s_Mutex{};
-
-    LogLevel Log::GetMinimumLevel()
+    // 每个线程一个的单生产者单消费者队列，生产者是线程自己，消费者是持有 Log::s_Mutex 的线程
+    struct LogThreadQueue
     {
-        std::lock_guard<std::mutex> lock(s_Mutex);
+        static constexpr size_t Capacity = 256; // 必须是 2 的幂
+        static constexpr size_t InlineMessageSize = 200;
 
-        return s_MinimumLevel;
-    }
+        struct Item
+        {
+            LogLevel Level;
+            time_t Time;
+            const LogSourceLocation* Location;
+            size_t Length;
+            char InlineMessage[InlineMessageSize];
+            std::string LongMessage; // 超过 InlineMessageSize 时才使用
+        };
 
-    void Log::SetMinimumLevel(LogLevel level)
-    {
-        std::lock_guard<std::mutex> lock(s_Mutex);
+        Item Items[Capacity]{};
 
-        s_MinimumLevel = level;
-    }
+        alignas(64) std::atomic<size_t> Head{ 0 }; // 消费者写
+        alignas(64) std::atomic<size_t> Tail{ 0 }; // 生产者写
+        std::atomic<bool> IsAbandoned{ false };    // 线程已经退出，消费者取完以后删除队列
+    };
+
+    // 没有析构函数，线程退出的整个过程中都可以访问
+    // 其他 thread_local 对象在 t_LogQueueOwner 之后析构时还可能写日志，这时候不能再用队列
+    static thread_local bool t_IsLogQueueOwnerDestroyed = false;
 
-    bool Log::IsLevelEnabled(LogLevel level)
+    namespace
     {
-        std::lock_guard<std::mutex> lock(s_Mutex);
+        struct LogThreadQueueOwner
+        {
+            LogThreadQueue* Queue = nullptr;
 
-        return static_cast<int32_t>(level) >= static_cast<int32_t>(s_MinimumLevel);
+            ~LogThreadQueueOwner()
+            {
+                t_IsLogQueueOwnerDestroyed = true;
+
+                if (Queue != nullptr)
+                {
+                    // 标记以后消费者随时可能删除队列，不能再访问
+                    Queue->IsAbandoned.store(true, std::memory_order_release);
+                    Queue = nullptr;
+                }
+            }
+        };
     }
 
+    static thread_local LogThreadQueueOwner t_LogQueueOwner{};
+
+    std::atomic<LogLevel>           Log::s_MinimumLevel{ LogLevel::Trace };
+    LogEntry                        Log::s_Entries[]{};
+    size_t                          Log::s_FirstEntry = 0;
+    size_t                          Log::s_EntryCount = 0;
+    uint32_t                        Log::s_Counts[]{};
+    std::vector<LogThreadQueue*>    Log::s_ThreadQueues{};
+    std::mutex                      Log::s_Mutex{};
+
     uint32_t Log::GetCount(LogLevel level)
     {
         std::lock_guard<std::mutex> lock(s_Mutex);
 
+        DrainThreadQueues();
         return s_Counts[static_cast<int32_t>(level)];
     }
 
@@ -42,7 +74,9 @@ namespace march
     {
         std::lock_guard<std::mutex> lock(s_Mutex);
 
-        s_Entries.clear();
+        DrainThreadQueues();
+        s_FirstEntry = 0;
+        s_EntryCount = 0;
         ZeroMemory(s_Counts, sizeof(s_Counts));
     }
 
@@ -50,9 +84,11 @@ namespace march
     {
         std::lock_guard<std::mutex> lock(s_Mutex);
 
-        for (size_t i = 0; i < s_Entries.size(); i++)
+        DrainThreadQueues();
+
+        for (size_t i = 0; i < s_EntryCount; i++)
         {
-            action(static_cast<int32_t>(i), s_Entries[i]);
+            action(static_cast<int32_t>(i), s_Entries[(s_FirstEntry + i) % MaxEntries]);
         }
     }
 
@@ -60,12 +96,14 @@ namespace march
     {
         std::lock_guard<std::mutex> lock(s_Mutex);
 
-        if (i < 0 || static_cast<size_t>(i) >= s_Entries.size())
+        DrainThreadQueues();
+
+        if (i < 0 || static_cast<size_t>(i) >= s_EntryCount)
         {
             return false;
         }
 
-        action(s_Entries[static_cast<size_t>(i)]);
+        action(s_Entries[(s_FirstEntry + static_cast<size_t>(i)) % MaxEntries]);
         return true;
     }
 
@@ -73,60 +111,187 @@ namespace march
     {
         std::lock_guard<std::mutex> lock(s_Mutex);
 
-        if (s_Entries.empty())
+        DrainThreadQueues();
+
+        if (s_EntryCount == 0)
         {
             return false;
         }
 
-        action(s_Entries.back());
+        action(s_Entries[(s_FirstEntry + s_EntryCount - 1) % MaxEntries]);
         return true;
     }
 
     void Log::Message(LogLevel level, std::string&& message, std::vector<LogStackFrame>&& stackTrace)
     {
-        std::lock_guard<std::mutex> lock(s_Mutex);
-
-        if (static_cast<int32_t>(level) < static_cast<int32_t>(s_MinimumLevel))
+        if (!IsLevelEnabled(level))
         {
             return;
         }
 
-        while (s_Entries.size() > 9999)
-        {
-            s_Counts[static_cast<int32_t>(s_Entries.front().Level)]--;
-            s_Entries.pop_front();
-        }
+        std::lock_guard<std::mutex> lock(s_Mutex);
 
-        LogEntry& entry = s_Entries.emplace_back();
-        s_Counts[static_cast<int32_t>(level)]++;
+        // 先把队列里更早的日志取出来，保证顺序
+        DrainThreadQueues();
 
-        entry.Level = level;
-        entry.Time = time(NULL);
+        LogEntry& entry = AppendEntry(level, time(NULL));
         entry.Message = std::move(message);
+        entry.Location = nullptr;
         entry.StackTrace = std::move(stackTrace);
     }
 
     void Log::Message(LogLevel level, const std::string& message, std::vector<LogStackFrame>&& stackTrace)
     {
+        if (!IsLevelEnabled(level))
+        {
+            return;
+        }
+
         std::lock_guard<std::mutex> lock(s_Mutex);
 
-        if (static_cast<int32_t>(level) < static_cast<int32_t>(s_MinimumLevel))
+        DrainThreadQueues();
+
+        LogEntry& entry = AppendEntry(level, time(NULL));
+        entry.Message = message;
+        entry.Location = nullptr;
+        entry.StackTrace = std::move(stackTrace);
+    }
+
+    void Log::Enqueue(LogLevel level, const LogSourceLocation* location, std::string_view message)
+    {
+        LogThreadQueue* pQueue = GetThreadQueue();
+
+        if (pQueue == nullptr)
         {
+            // 线程正在退出，直接加锁写入
+            std::lock_guard<std::mutex> lock(s_Mutex);
+
+            DrainThreadQueues();
+
+            LogEntry& entry = AppendEntry(level, time(NULL));
+            entry.Message.assign(message);
+            entry.Location = location;
+            entry.StackTrace.clear();
             return;
         }
 
-        while (s_Entries.size() > 9999)
+        LogThreadQueue& queue = *pQueue;
+        size_t tail = queue.Tail.load(std::memory_order_relaxed);
+
+        if (tail - queue.Head.load(std::memory_order_acquire) >= LogThreadQueue::Capacity)
         {
-            s_Counts[static_cast<int32_t>(s_Entries.front().Level)]--;
-            s_Entries.pop_front();
+            // 队列满了，没人来取，自己当一次消费者
+            std::lock_guard<std::mutex> lock(s_Mutex);
+            DrainThreadQueues();
         }
 
-        LogEntry& entry = s_Entries.emplace_back();
-        s_Counts[static_cast<int32_t>(level)]++;
+        LogThreadQueue::Item& item = queue.Items[tail & (LogThreadQueue::Capacity - 1)];
+        item.Level = level;
+        item.Time = time(NULL);
+        item.Location = location;
+        item.Length = message.size();
 
-        entry.Level = level;
-        entry.Time = time(NULL);
-        entry.Message = message;
-        entry.StackTrace = std::move(stackTrace);
+        if (message.size() <= LogThreadQueue::InlineMessageSize)
+        {
+            message.copy(item.InlineMessage, message.size());
+        }
+        else
+        {
+            item.LongMessage.assign(message);
+        }
+
+        queue.Tail.store(tail + 1, std::memory_order_release);
+    }
+
+    LogThreadQueue* Log::GetThreadQueue()
+    {
+        if (t_IsLogQueueOwnerDestroyed)
+        {
+            // 不能再创建新的队列，否则没有人把它标记为 IsAbandoned，会一直泄漏
+            return nullptr;
+        }
+
+        if (t_LogQueueOwner.Queue == nullptr)
+        {
+            LogThreadQueue* queue = new LogThreadQueue();
+
+            {
+                std::lock_guard<std::mutex> lock(s_Mutex);
+                s_ThreadQueues.push_back(queue);
+            }
+
+            t_LogQueueOwner.Queue = queue;
+        }
+
+        return t_LogQueueOwner.Queue;
+    }
+
+    void Log::DrainThreadQueues()
+    {
+        // 调用前必须持有 s_Mutex
+        for (size_t i = 0; i < s_ThreadQueues.size();)
+        {
+            LogThreadQueue* queue = s_ThreadQueues[i];
+
+            // 先读 IsAbandoned，如果线程已经退出，之后读到的 Tail 就是最终的值
+            bool isAbandoned = queue->IsAbandoned.load(std::memory_order_acquire);
+            size_t head = queue->Head.load(std::memory_order_relaxed);
+            size_t tail = queue->Tail.load(std::memory_order_acquire);
+
+            for (; head != tail; head++)
+            {
+                LogThreadQueue::Item& item = queue->Items[head & (LogThreadQueue::Capacity - 1)];
+                LogEntry& entry = AppendEntry(item.Level, item.Time);
+
+                if (item.Length <= LogThreadQueue::InlineMessageSize)
+                {
+                    entry.Message.assign(item.InlineMessage, item.Length);
+                }
+                else
+                {
+                    // 交换以后，两边的 string 都能复用之前分配的内存
+                    entry.Message.swap(item.LongMessage);
+                }
+
+                entry.Location = item.Location;
+                entry.StackTrace.clear();
+            }
+
+            queue->Head.store(head, std::memory_order_release);
+
+            if (isAbandoned)
+            {
+                delete queue;
+                s_ThreadQueues[i] = s_ThreadQueues.back();
+                s_ThreadQueues.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    LogEntry& Log::AppendEntry(LogLevel level, time_t time)
+    {
+        LogEntry* entry;
+
+        if (s_EntryCount == MaxEntries)
+        {
+            // 覆盖最旧的日志
+            entry = &s_Entries[s_FirstEntry];
+            s_Counts[static_cast<int32_t>(entry->Level)]--;
+            s_FirstEntry = (s_FirstEntry + 1) % MaxEntries;
+        }
+        else
+        {
+            entry = &s_Entries[(s_FirstEntry + s_EntryCount) % MaxEntries];
+            s_EntryCount++;
+        }
+
+        s_Counts[static_cast<int32_t>(level)]++;
+        entry->Level = level;
+        entry->Time = time;
+        return *entry;
     }
 }
@@ -1,32 +1,365 @@
 #include "pch.h"
 #include "Engine/JobManager.h"
+#include "Engine/Misc/PlatformUtils.h"
 #include "Engine/Debug.h"
-#include "Engine/Scripting/DotNetRuntime.h"
-#include "Engine/Scripting/InteropServices.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <algorithm>
+#include <assert.h>
 
 namespace march
 {
+    struct JobGroup
+    {
+        JobBatchFunc Func;
+        size_t TotalSize;
+        size_t BatchSize;
+
+        std::atomic_size_t NumPendingBatches;
+        std::atomic_size_t NumPendingDependencies;
+        std::atomic_bool IsCompleted;
+
+        std::mutex Mutex; // 保护 Continuations 以及 IsCompleted 的写入
+        std::vector<std::shared_ptr<JobGroup>> Continuations;
+
+        // 执行期间保持自身存活，即使用户丢弃了 JobHandle
+        std::shared_ptr<JobGroup> Self;
+    };
+
+    struct JobBatch
+    {
+        JobGroup* Group;
+        size_t Begin;
+        size_t End;
+    };
+
+    // 每个 worker 一个队列，自己从尾部取（LIFO，缓存友好），其他线程从头部偷（FIFO）
+    class JobWorkQueue
+    {
+    public:
+        void Push(const JobBatch& batch)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Batches.push_back(batch);
+        }
+
+        bool Pop(JobBatch* pOutBatch)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (m_Batches.empty())
+            {
+                return false;
+            }
+
+            *pOutBatch = m_Batches.back();
+            m_Batches.pop_back();
+            return true;
+        }
+
+        bool Steal(JobBatch* pOutBatch)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (m_Batches.empty())
+            {
+                return false;
+            }
+
+            *pOutBatch = m_Batches.front();
+            m_Batches.pop_front();
+            return true;
+        }
+
+    private:
+        std::mutex m_Mutex;
+        std::deque<JobBatch> m_Batches;
+    };
+
+    static std::vector<std::unique_ptr<JobWorkQueue>> s_Queues{};
+    static std::vector<std::thread> s_Workers{};
+    static std::atomic_size_t s_NumQueuedBatches = 0;
+    static std::atomic_size_t s_NextQueueIndex = 0;
+    static std::atomic_bool s_IsQuitting = false;
+    static std::mutex s_WakeMutex{};
+    static std::condition_variable s_WakeCondition{};
+
+    // 非 worker 线程为 -1
+    static thread_local int32_t t_WorkerIndex = -1;
+
+    static bool TryGetBatch(JobBatch* pOutBatch)
+    {
+        size_t numQueues = s_Queues.size();
+        size_t start;
+
+        if (t_WorkerIndex >= 0)
+        {
+            if (s_Queues[t_WorkerIndex]->Pop(pOutBatch))
+            {
+                s_NumQueuedBatches.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            start = static_cast<size_t>(t_WorkerIndex) + 1;
+        }
+        else
+        {
+            start = s_NextQueueIndex.load(std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < numQueues; i++)
+        {
+            size_t victim = (start + i) % numQueues;
+
+            if (victim != static_cast<size_t>(t_WorkerIndex) && s_Queues[victim]->Steal(pOutBatch))
+            {
+                s_NumQueuedBatches.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static void WakeWorkers(size_t numBatches)
+    {
+        // 必须在加锁后通知，否则 worker 可能在检查条件和进入等待之间错过通知
+        std::lock_guard<std::mutex> lock(s_WakeMutex);
+
+        if (numBatches == 1)
+        {
+            s_WakeCondition.notify_one();
+        }
+        else
+        {
+            s_WakeCondition.notify_all();
+        }
+    }
+
+    static void ReleaseDependency(JobGroup* group);
+
+    static void FinishGroup(JobGroup* group)
+    {
+        std::vector<std::shared_ptr<JobGroup>> continuations{};
+        std::shared_ptr<JobGroup> self{}; // 函数返回时才释放 group
+
+        {
+            std::lock_guard<std::mutex> lock(group->Mutex);
+            group->IsCompleted.store(true, std::memory_order_release);
+            continuations.swap(group->Continuations);
+            self.swap(group->Self);
+        }
+
+        for (const std::shared_ptr<JobGroup>& c : continuations)
+        {
+            ReleaseDependency(c.get());
+        }
+    }
+
+    static void EnqueueGroup(JobGroup* group)
+    {
+        size_t numBatches = group->NumPendingBatches.load(std::memory_order_relaxed);
+
+        if (numBatches == 0)
+        {
+            FinishGroup(group);
+            return;
+        }
+
+        s_NumQueuedBatches.fetch_add(numBatches, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < numBatches; i++)
+        {
+            size_t begin = i * group->BatchSize;
+            size_t end = std::min(begin + group->BatchSize, group->TotalSize);
+            JobBatch batch{ group, begin, end };
+
+            if (t_WorkerIndex >= 0)
+            {
+                // worker 产生的 job 放在自己的队列里，其他线程空闲时会来偷
+                s_Queues[t_WorkerIndex]->Push(batch);
+            }
+            else
+            {
+                size_t index = s_NextQueueIndex.fetch_add(1, std::memory_order_relaxed) % s_Queues.size();
+                s_Queues[index]->Push(batch);
+            }
+        }
+
+        WakeWorkers(numBatches);
+    }
+
+    static void ReleaseDependency(JobGroup* group)
+    {
+        if (group->NumPendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            EnqueueGroup(group);
+        }
+    }
+
+    static void ExecuteBatch(const JobBatch& batch)
+    {
+        JobGroup* group = batch.Group;
+        group->Func(batch.Begin, batch.End);
+
+        if (group->NumPendingBatches.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            FinishGroup(group);
+        }
+    }
+
+    static void WorkerThreadProc(int32_t workerIndex)
+    {
+        t_WorkerIndex = workerIndex;
+        PlatformUtils::SetCurrentThreadName("JobWorker" + std::to_string(workerIndex));
+
+        JobBatch batch{};
+
+        while (true)
+        {
+            if (TryGetBatch(&batch))
+            {
+                ExecuteBatch(batch);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(s_WakeMutex);
+            s_WakeCondition.wait(lock, []
+            {
+                return s_IsQuitting.load(std::memory_order_relaxed) || s_NumQueuedBatches.load(std::memory_order_relaxed) > 0;
+            });
+
+            if (s_IsQuitting.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+    }
+
+    bool JobHandle::IsCompleted() const
+    {
+        return m_Group == nullptr || m_Group->IsCompleted.load(std::memory_order_acquire);
+    }
+
     void JobHandle::Complete()
     {
-        DotNet::RuntimeInvoke<void, JobHandle>(ManagedMethod::JobManager_NativeComplete, *this);
+        if (m_Group == nullptr)
+        {
+            return;
+        }
+
+        JobBatch batch{};
+
+        while (!m_Group->IsCompleted.load(std::memory_order_acquire))
+        {
+            if (TryGetBatch(&batch))
+            {
+                ExecuteBatch(batch);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        m_Group = nullptr;
     }
 
-    JobHandle JobManager::Schedule(size_t totalSize, size_t batchSize, const std::function<void(size_t)>& func)
+    void JobManager::Initialize(uint32_t numWorkers)
     {
-        JobData* data = MARCH_NEW JobData{ func };
-        JobHandle handle{};
+        assert(s_Workers.empty());
 
-        cs<JobHandle*> arg0;
-        cs_ulong arg1;
-        cs_ulong arg2;
-        cs_nint arg3;
+        if (numWorkers == 0)
+        {
+            numWorkers = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        }
 
-        arg0.assign(&handle); // 如果把这个参数写成返回值的话，C++ 编译器会做优化，导致函数指针和 C# 那边不一致
-        arg1.assign(totalSize);
-        arg2.assign(batchSize);
-        arg3.assign(data);
+        s_IsQuitting = false;
+        s_NumQueuedBatches = 0;
+        s_NextQueueIndex = 0;
 
-        DotNet::RuntimeInvoke<void>(ManagedMethod::JobManager_NativeSchedule, arg0.data, arg1.data, arg2.data, arg3.data);
+        for (uint32_t i = 0; i < numWorkers; i++)
+        {
+            s_Queues.push_back(std::make_unique<JobWorkQueue>());
+        }
+
+        for (uint32_t i = 0; i < numWorkers; i++)
+        {
+            s_Workers.emplace_back(WorkerThreadProc, static_cast<int32_t>(i));
+        }
+
+        LOG_TRACE("JobManager initialized with {} workers", numWorkers);
+    }
+
+    void JobManager::Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_WakeMutex);
+            s_IsQuitting = true;
+            s_WakeCondition.notify_all();
+        }
+
+        for (std::thread& t : s_Workers)
+        {
+            t.join();
+        }
+
+        if (size_t n = s_NumQueuedBatches.load(); n > 0)
+        {
+            LOG_WARNING("JobManager is shut down with {} batches not executed", n);
+        }
+
+        s_Workers.clear();
+        s_Queues.clear();
+    }
+
+    uint32_t JobManager::GetWorkerCount()
+    {
+        return static_cast<uint32_t>(s_Workers.size());
+    }
+
+    JobHandle JobManager::ScheduleBatch(size_t totalSize, size_t batchSize, JobBatchFunc func, std::initializer_list<JobHandle> dependencies)
+    {
+        assert(!s_Queues.empty());
+
+        if (batchSize == 0)
+        {
+            // 每个线程大约分到 4 个 batch，方便负载均衡
+            size_t numBatches = (static_cast<size_t>(s_Workers.size()) + 1) * 4;
+            batchSize = std::max<size_t>((totalSize + numBatches - 1) / numBatches, 1);
+        }
+
+        auto group = std::make_shared<JobGroup>();
+        group->Func = std::move(func);
+        group->TotalSize = totalSize;
+        group->BatchSize = batchSize;
+        group->NumPendingBatches = (totalSize + batchSize - 1) / batchSize;
+        group->NumPendingDependencies = 1; // 防止在注册依赖的过程中被提前执行
+        group->IsCompleted = false;
+        group->Self = group;
+
+        for (const JobHandle& dep : dependencies)
+        {
+            if (dep.m_Group == nullptr)
+            {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(dep.m_Group->Mutex);
+
+            if (!dep.m_Group->IsCompleted.load(std::memory_order_relaxed))
+            {
+                group->NumPendingDependencies.fetch_add(1, std::memory_order_relaxed);
+                dep.m_Group->Continuations.push_back(group);
+            }
+        }
+
+        JobHandle handle{};
+        handle.m_Group = group;
+        ReleaseDependency(group.get());
         return handle;
     }
 }
@@ -3,6 +3,8 @@
 #include "Engine/Memory/Allocator.h"
 #include "Engine/Misc/MathUtils.h"
 #include <limits>
+#include <algorithm>
+#include <numeric>
 #include <assert.h>
 
 namespace march
@@ -65,13 +67,30 @@ namespace march
     BuddyAllocator::BuddyAllocator(uint32_t minBlockSize, uint32_t maxBlockSize)
         : m_MinBlockSize(minBlockSize)
         , m_MaxBlockSize(maxBlockSize)
-        , m_FreeBlocks{}
         , m_TotalAllocatedSize(0)
+        , m_TotalRequestedSize(0)
+        , m_NumFreeBlocks(0)
+        , m_FreeBlocks{}
+        , m_NonEmptyOrders(0)
     {
         assert(MathUtils::IsDivisible(maxBlockSize, minBlockSize));
         assert(MathUtils::IsPowerOfTwo(maxBlockSize / minBlockSize));
 
         m_MaxOrder = UnitSizeToOrder(SizeToUnitSize(maxBlockSize));
+        m_FreeBlocks.resize(static_cast<size_t>(m_MaxOrder) + 1);
+
+        for (uint32_t order = 0; order <= m_MaxOrder; order++)
+        {
+            size_t numBits = static_cast<size_t>(1) << (m_MaxOrder - order);
+            std::vector<std::vector<uint64_t>>& levels = m_FreeBlocks[order].Levels;
+
+            do
+            {
+                numBits = (numBits + 63) / 64;
+                levels.emplace_back(numBits);
+            } while (numBits > 1);
+        }
+
         Reset();
     }
 
@@ -97,10 +116,114 @@ namespace march
 
     void BuddyAllocator::Reset()
     {
-        m_FreeBlocks.clear();
-        m_FreeBlocks.resize(static_cast<size_t>(m_MaxOrder) + 1);
-        m_FreeBlocks[m_MaxOrder].insert(0);
+        for (FreeBlockBitmap& bitmap : m_FreeBlocks)
+        {
+            for (std::vector<uint64_t>& level : bitmap.Levels)
+            {
+                std::fill(level.begin(), level.end(), 0);
+            }
+        }
+
+        m_NonEmptyOrders = 0;
+        m_NumFreeBlocks = 0;
+        AddFreeBlock(0, m_MaxOrder);
         m_TotalAllocatedSize = 0;
+        m_TotalRequestedSize = 0;
+    }
+
+    uint32_t BuddyAllocator::GetLargestFreeBlockSize() const
+    {
+        unsigned long order;
+
+        if (!_BitScanReverse64(&order, m_NonEmptyOrders))
+        {
+            return 0;
+        }
+
+        return OrderToUnitSize(static_cast<uint32_t>(order)) * m_MinBlockSize;
+    }
+
+    void BuddyAllocator::AddFreeBlock(uint32_t offset, uint32_t order)
+    {
+        FreeBlockBitmap& bitmap = m_FreeBlocks[order];
+        uint32_t index = offset >> order;
+
+        assert((bitmap.Levels[0][index / 64] & (1ull << (index % 64))) == 0);
+
+        // 上一层的位已经是 1 时不用再往上改
+        for (std::vector<uint64_t>& level : bitmap.Levels)
+        {
+            uint64_t& word = level[index / 64];
+            bool wasEmpty = word == 0;
+            word |= 1ull << (index % 64);
+
+            if (!wasEmpty)
+            {
+                break;
+            }
+
+            index /= 64;
+        }
+
+        m_NonEmptyOrders |= 1ull << order;
+        m_NumFreeBlocks++;
+    }
+
+    bool BuddyAllocator::RemoveFreeBlock(uint32_t offset, uint32_t order)
+    {
+        FreeBlockBitmap& bitmap = m_FreeBlocks[order];
+        uint32_t index = offset >> order;
+
+        if ((bitmap.Levels[0][index / 64] & (1ull << (index % 64))) == 0)
+        {
+            return false;
+        }
+
+        // word 变成 0 时才需要清除上一层的位
+        for (std::vector<uint64_t>& level : bitmap.Levels)
+        {
+            uint64_t& word = level[index / 64];
+            word &= ~(1ull << (index % 64));
+
+            if (word != 0)
+            {
+                break;
+            }
+
+            index /= 64;
+        }
+
+        if (bitmap.Levels.back()[0] == 0)
+        {
+            m_NonEmptyOrders &= ~(1ull << order);
+        }
+
+        m_NumFreeBlocks--;
+        return true;
+    }
+
+    uint32_t BuddyAllocator::PopFirstFreeBlock(uint32_t order)
+    {
+        const FreeBlockBitmap& bitmap = m_FreeBlocks[order];
+        size_t index = 0;
+
+        // 从最上面一层往下找，每层都选最低的位，得到 offset 最小的 block
+        for (size_t i = bitmap.Levels.size(); i-- > 0;)
+        {
+            unsigned long bit;
+
+            if (!_BitScanForward64(&bit, bitmap.Levels[i][index]))
+            {
+                assert(false && "m_NonEmptyOrders is out of sync with the bitmap");
+                return 0;
+            }
+
+            index = index * 64 + bit;
+        }
+
+        uint32_t offset = static_cast<uint32_t>(index) << order;
+        RemoveFreeBlock(offset, order);
+        return offset;
     }
 
     std::optional<uint32_t> BuddyAllocator::AllocateBlock(uint32_t order)
@@ -110,39 +233,44 @@ namespace march
             return std::nullopt;
         }
 
-        if (auto it = m_FreeBlocks[order].begin(); it != m_FreeBlocks[order].end())
+        unsigned long freeOrder;
+
+        // 找到不小于 order 的最小的有空闲 block 的 order
+        if (!_BitScanForward64(&freeOrder, m_NonEmptyOrders >> order))
         {
-            uint32_t offset = *it;
-            m_FreeBlocks[order].erase(it);
-            return offset;
+            return std::nullopt;
         }
 
-        std::optional<uint32_t> left = AllocateBlock(order + 1);
+        freeOrder += order;
+        uint32_t offset = PopFirstFreeBlock(static_cast<uint32_t>(freeOrder));
 
-        if (left)
+        // 一路拆分下来，左半边继续拆，右半边放回空闲列表
+        while (freeOrder > order)
         {
-            uint32_t size = OrderToUnitSize(order); // unit 为 m_MinBlockSize 的个数
-            uint32_t right = *left + size;
-            m_FreeBlocks[order].insert(right);
+            freeOrder--;
+            AddFreeBlock(offset + OrderToUnitSize(static_cast<uint32_t>(freeOrder)), static_cast<uint32_t>(freeOrder));
         }
 
-        return left;
+        return offset;
     }
 
     void BuddyAllocator::ReleaseBlock(uint32_t offset, uint32_t order)
     {
-        uint32_t size = OrderToUnitSize(order);
-        uint32_t buddy = GetBuddyOffset(offset, size);
-
-        if (auto it = m_FreeBlocks[order].find(buddy); it != m_FreeBlocks[order].end())
-        {
-            ReleaseBlock(std::min(offset, buddy), order + 1);
-            m_FreeBlocks[order].erase(it);
-        }
-        else
+        // 一路往上合并，直到 buddy 不是空闲的
+        while (order < m_MaxOrder)
         {
-            m_FreeBlocks[order].insert(offset);
+            uint32_t buddy = GetBuddyOffset(offset, OrderToUnitSize(order));
+
+            if (!RemoveFreeBlock(buddy, order))
+            {
+                break;
+            }
+
+            offset = std::min(offset, buddy);
+            order++;
         }
+
+        AddFreeBlock(offset, order);
     }
 
     std::optional<uint32_t> BuddyAllocator::Allocate(uint32_t sizeInBytes, uint32_t alignment, BuddyAllocation* pOutAllocation)
@@ -167,6 +295,7 @@ namespace march
         uint32_t byteOffset = *offset * m_MinBlockSize;
         uint32_t allocatedSize = OrderToUnitSize(order) * m_MinBlockSize;
         m_TotalAllocatedSize += allocatedSize;
+        m_TotalRequestedSize += sizeInBytes;
 
         if (alignment != 0 && byteOffset % alignment != 0)
         {
@@ -179,6 +308,7 @@ namespace march
         pOutAllocation->Owner = this;
         pOutAllocation->Offset = *offset;
         pOutAllocation->Order = order;
+        pOutAllocation->RequestedSize = sizeInBytes;
         return byteOffset;
     }
 
@@ -187,6 +317,7 @@ namespace march
         assert(allocation.Owner == this);
         ReleaseBlock(allocation.Offset, allocation.Order);
         m_TotalAllocatedSize -= OrderToUnitSize(allocation.Order) * m_MinBlockSize;
+        m_TotalRequestedSize -= allocation.RequestedSize;
     }
 
     MultiBuddyAllocator::MultiBuddyAllocator(const std::string& name, uint32_t minBlockSize, uint32_t defaultMaxBlockSize, const AppendPageFunc& appendPageFunc)
@@ -253,4 +384,667 @@ namespace march
         m_PageAllocators.emplace_back(std::make_unique<BuddyAllocator>(m_MinBlockSize, maxBlockSize));
         LOG_TRACE("{} creates new page; MinBlockSize={}; MaxBlockSize={}", m_Name, m_MinBlockSize, maxBlockSize);
     }
+
+    AllocatorFragmentationStats MultiBuddyAllocator::GetFragmentationStats() const
+    {
+        AllocatorFragmentationStats stats{};
+        stats.NumPages = static_cast<uint32_t>(m_PageAllocators.size());
+
+        for (const std::unique_ptr<BuddyAllocator>& page : m_PageAllocators)
+        {
+            stats.TotalSize += page->GetMaxSize();
+            stats.AllocatedSize += page->GetTotalAllocatedSize();
+            stats.RequestedSize += page->GetTotalRequestedSize();
+            stats.LargestFreeBlockSize = std::max<uint64_t>(stats.LargestFreeBlockSize, page->GetLargestFreeBlockSize());
+            stats.NumFreeBlocks += page->GetNumFreeBlocks();
+        }
+
+        return stats;
+    }
+
+    TlsfAllocator::TlsfAllocator(uint32_t minBlockSize, uint32_t maxSize)
+        : m_MinBlockSize(minBlockSize)
+        , m_MaxSize(maxSize)
+        , m_TotalAllocatedSize(0)
+        , m_TotalRequestedSize(0)
+        , m_NumFreeBlocks(0)
+        , m_Masks{}
+        , m_FreeHeads{}
+        , m_Blocks{}
+        , m_UnusedBlockHead(InvalidIndex)
+    {
+        assert(minBlockSize > 0 && MathUtils::IsPowerOfTwo(minBlockSize));
+        assert(maxSize >= minBlockSize && MathUtils::IsDivisible(maxSize, minBlockSize));
+
+        Reset();
+    }
+
+    void TlsfAllocator::MapInsertBucket(uint32_t units, uint32_t* pOutFirstLevel, uint32_t* pOutSecondLevel)
+    {
+        assert(units > 0);
+
+        unsigned long msb;
+        _BitScanReverse(&msb, units);
+
+        // 小的 block 都放在第 0 级，每个大小一个 bucket
+        if (msb < TlsfBucketMasks::NumSecondLevelBits)
+        {
+            *pOutFirstLevel = 0;
+            *pOutSecondLevel = units;
+        }
+        else
+        {
+            uint32_t shift = static_cast<uint32_t>(msb) - TlsfBucketMasks::NumSecondLevelBits;
+            *pOutFirstLevel = shift + 1;
+            *pOutSecondLevel = (units >> shift) - TlsfBucketMasks::NumSecondLevels;
+        }
+    }
+
+    bool TlsfAllocator::MapSearchBucket(uint32_t units, uint32_t* pOutFirstLevel, uint32_t* pOutSecondLevel)
+    {
+        assert(units > 0);
+
+        unsigned long msb;
+        _BitScanReverse(&msb, units);
+
+        if (msb >= TlsfBucketMasks::NumSecondLevelBits)
+        {
+            uint32_t round = (1u << (static_cast<uint32_t>(msb) - TlsfBucketMasks::NumSecondLevelBits)) - 1;
+
+            if (units > std::numeric_limits<uint32_t>::max() - round)
+            {
+                return false;
+            }
+
+            units += round;
+        }
+
+        MapInsertBucket(units, pOutFirstLevel, pOutSecondLevel);
+        return *pOutFirstLevel < TlsfBucketMasks::NumFirstLevels;
+    }
+
+    bool TlsfAllocator::FindNonEmptyBucket(const TlsfBucketMasks& masks, uint32_t* pInOutFirstLevel, uint32_t* pInOutSecondLevel)
+    {
+        uint32_t firstLevel = *pInOutFirstLevel;
+        uint32_t secondLevelMask = masks.SecondLevels[firstLevel] & (~0u << *pInOutSecondLevel);
+
+        if (secondLevelMask == 0)
+        {
+            // 更大的 first level 里任何一个 block 都足够大
+            uint32_t firstLevelMask = firstLevel + 1 < 32 ? masks.FirstLevel & (~0u << (firstLevel + 1)) : 0;
+            unsigned long fl;
+
+            if (!_BitScanForward(&fl, firstLevelMask))
+            {
+                return false;
+            }
+
+            firstLevel = static_cast<uint32_t>(fl);
+            secondLevelMask = masks.SecondLevels[firstLevel];
+        }
+
+        unsigned long sl;
+        _BitScanForward(&sl, secondLevelMask);
+
+        *pInOutFirstLevel = firstLevel;
+        *pInOutSecondLevel = static_cast<uint32_t>(sl);
+        return true;
+    }
+
+    uint32_t TlsfAllocator::GetSearchUnits(uint32_t minBlockSize, uint32_t sizeInBytes, uint32_t alignment)
+    {
+        uint64_t units = std::max<uint64_t>((static_cast<uint64_t>(sizeInBytes) + minBlockSize - 1) / minBlockSize, 1);
+
+        // offset 总是 minBlockSize 的整数倍，alignment 不能整除 minBlockSize 时，多找一些空间，分配时把前面多出来的部分放回去
+        // structured buffer 的 alignment 是 stride，不一定是 2 的幂
+        if (alignment != 0 && minBlockSize % alignment != 0)
+        {
+            units += alignment / std::gcd(minBlockSize, alignment) - 1;
+        }
+
+        return static_cast<uint32_t>(std::min<uint64_t>(units, std::numeric_limits<uint32_t>::max()));
+    }
+
+    std::optional<uint64_t> TlsfAllocator::GetGuaranteedBlockSize(uint32_t minBlockSize, uint32_t sizeInBytes, uint32_t alignment)
+    {
+        uint32_t fl, sl;
+
+        if (!MapSearchBucket(GetSearchUnits(minBlockSize, sizeInBytes, alignment), &fl, &sl))
+        {
+            return std::nullopt;
+        }
+
+        // 搜索的 bucket 中最小的 block
+        uint64_t units = fl == 0 ? sl : (static_cast<uint64_t>(sl + TlsfBucketMasks::NumSecondLevels) << (fl - 1));
+        return units * minBlockSize;
+    }
+
+    void TlsfAllocator::Reset()
+    {
+        m_TotalAllocatedSize = 0;
+        m_TotalRequestedSize = 0;
+        m_NumFreeBlocks = 0;
+        m_Masks = {};
+
+        for (auto& heads : m_FreeHeads)
+        {
+            std::fill(std::begin(heads), std::end(heads), InvalidIndex);
+        }
+
+        m_Blocks.clear();
+        m_UnusedBlockHead = InvalidIndex;
+
+        uint32_t index = NewBlock();
+        Block& block = m_Blocks[index];
+        block.Offset = 0;
+        block.Size = m_MaxSize / m_MinBlockSize;
+        AddFreeBlock(index);
+    }
+
+    uint32_t TlsfAllocator::NewBlock()
+    {
+        uint32_t index;
+
+        if (m_UnusedBlockHead != InvalidIndex)
+        {
+            index = m_UnusedBlockHead;
+            m_UnusedBlockHead = m_Blocks[index].NextFree;
+        }
+        else
+        {
+            index = static_cast<uint32_t>(m_Blocks.size());
+            m_Blocks.emplace_back();
+        }
+
+        Block& block = m_Blocks[index];
+        block.Offset = 0;
+        block.Size = 0;
+        block.RequestedSize = 0;
+        block.PrevPhysical = InvalidIndex;
+        block.NextPhysical = InvalidIndex;
+        block.PrevFree = InvalidIndex;
+        block.NextFree = InvalidIndex;
+        block.IsFree = false;
+        return index;
+    }
+
+    void TlsfAllocator::DeleteBlock(uint32_t index)
+    {
+        m_Blocks[index].NextFree = m_UnusedBlockHead;
+        m_UnusedBlockHead = index;
+    }
+
+    void TlsfAllocator::AddFreeBlock(uint32_t index)
+    {
+        Block& block = m_Blocks[index];
+        assert(!block.IsFree);
+
+        uint32_t fl, sl;
+        MapInsertBucket(block.Size, &fl, &sl);
+
+        block.IsFree = true;
+        block.PrevFree = InvalidIndex;
+        block.NextFree = m_FreeHeads[fl][sl];
+
+        if (block.NextFree != InvalidIndex)
+        {
+            m_Blocks[block.NextFree].PrevFree = index;
+        }
+
+        m_FreeHeads[fl][sl] = index;
+        m_Masks.FirstLevel |= 1u << fl;
+        m_Masks.SecondLevels[fl] |= 1u << sl;
+        m_NumFreeBlocks++;
+    }
+
+    void TlsfAllocator::RemoveFreeBlock(uint32_t index)
+    {
+        Block& block = m_Blocks[index];
+        assert(block.IsFree);
+
+        uint32_t fl, sl;
+        MapInsertBucket(block.Size, &fl, &sl);
+
+        if (block.PrevFree != InvalidIndex)
+        {
+            m_Blocks[block.PrevFree].NextFree = block.NextFree;
+        }
+        else
+        {
+            m_FreeHeads[fl][sl] = block.NextFree;
+        }
+
+        if (block.NextFree != InvalidIndex)
+        {
+            m_Blocks[block.NextFree].PrevFree = block.PrevFree;
+        }
+
+        if (m_FreeHeads[fl][sl] == InvalidIndex)
+        {
+            if ((m_Masks.SecondLevels[fl] &= ~(1u << sl)) == 0)
+            {
+                m_Masks.FirstLevel &= ~(1u << fl);
+            }
+        }
+
+        block.IsFree = false;
+        block.PrevFree = InvalidIndex;
+        block.NextFree = InvalidIndex;
+        m_NumFreeBlocks--;
+    }
+
+    uint32_t TlsfAllocator::SplitBlock(uint32_t index, uint32_t size)
+    {
+        uint32_t newIndex = NewBlock(); // 可能导致 m_Blocks 扩容，之后再取引用
+
+        Block& block = m_Blocks[index];
+        Block& newBlock = m_Blocks[newIndex];
+        assert(size > 0 && size < block.Size);
+
+        newBlock.Offset = block.Offset + size;
+        newBlock.Size = block.Size - size;
+        newBlock.PrevPhysical = index;
+        newBlock.NextPhysical = block.NextPhysical;
+
+        if (block.NextPhysical != InvalidIndex)
+        {
+            m_Blocks[block.NextPhysical].PrevPhysical = newIndex;
+        }
+
+        block.Size = size;
+        block.NextPhysical = newIndex;
+        return newIndex;
+    }
+
+    void TlsfAllocator::MergeWithNextBlock(uint32_t index)
+    {
+        Block& block = m_Blocks[index];
+        uint32_t nextIndex = block.NextPhysical;
+        Block& next = m_Blocks[nextIndex];
+
+        block.Size += next.Size;
+        block.NextPhysical = next.NextPhysical;
+
+        if (next.NextPhysical != InvalidIndex)
+        {
+            m_Blocks[next.NextPhysical].PrevPhysical = index;
+        }
+
+        DeleteBlock(nextIndex);
+    }
+
+    std::optional<uint32_t> TlsfAllocator::Allocate(uint32_t sizeInBytes, uint32_t alignment, TlsfAllocation* pOutAllocation)
+    {
+        uint32_t units = GetSearchUnits(m_MinBlockSize, sizeInBytes, 0);
+        uint32_t searchUnits = GetSearchUnits(m_MinBlockSize, sizeInBytes, alignment);
+
+        uint32_t fl, sl;
+
+        if (!MapSearchBucket(searchUnits, &fl, &sl) || !FindNonEmptyBucket(m_Masks, &fl, &sl))
+        {
+            return std::nullopt;
+        }
+
+        uint32_t index = m_FreeHeads[fl][sl];
+        RemoveFreeBlock(index);
+
+        // 前面为了对齐多出来的部分放回去，前一个 block 一定不是空闲的，不用合并
+        if (alignment != 0 && m_MinBlockSize % alignment != 0)
+        {
+            uint32_t offset = m_Blocks[index].Offset;
+            uint32_t padding = 0;
+
+            // 最多循环 alignment / gcd(minBlockSize, alignment) - 1 次
+            while ((static_cast<uint64_t>(offset) + padding) * m_MinBlockSize % alignment != 0)
+            {
+                padding++;
+            }
+
+            if (padding > 0)
+            {
+                uint32_t alignedIndex = SplitBlock(index, padding);
+                AddFreeBlock(index);
+                index = alignedIndex;
+            }
+        }
+
+        // 后面多出来的部分放回去，后一个 block 一定不是空闲的，不用合并
+        if (m_Blocks[index].Size > units)
+        {
+            uint32_t remainderIndex = SplitBlock(index, units);
+            AddFreeBlock(remainderIndex);
+        }
+
+        Block& block = m_Blocks[index];
+        block.RequestedSize = sizeInBytes;
+        m_TotalAllocatedSize += block.Size * m_MinBlockSize;
+        m_TotalRequestedSize += sizeInBytes;
+
+        pOutAllocation->Owner = this;
+        pOutAllocation->BlockIndex = index;
+        pOutAllocation->PageIndex = 0;
+        return block.Offset * m_MinBlockSize;
+    }
+
+    void TlsfAllocator::Release(const TlsfAllocation& allocation)
+    {
+        assert(allocation.Owner == this);
+
+        uint32_t index = allocation.BlockIndex;
+        assert(!m_Blocks[index].IsFree);
+
+        m_TotalAllocatedSize -= m_Blocks[index].Size * m_MinBlockSize;
+        m_TotalRequestedSize -= m_Blocks[index].RequestedSize;
+        m_Blocks[index].RequestedSize = 0;
+
+        // 和前后空闲的 block 合并
+        if (uint32_t nextIndex = m_Blocks[index].NextPhysical; nextIndex != InvalidIndex && m_Blocks[nextIndex].IsFree)
+        {
+            RemoveFreeBlock(nextIndex);
+            MergeWithNextBlock(index);
+        }
+
+        if (uint32_t prevIndex = m_Blocks[index].PrevPhysical; prevIndex != InvalidIndex && m_Blocks[prevIndex].IsFree)
+        {
+            RemoveFreeBlock(prevIndex);
+            MergeWithNextBlock(prevIndex);
+            index = prevIndex;
+        }
+
+        AddFreeBlock(index);
+    }
+
+    uint32_t TlsfAllocator::GetLargestFreeBlockSize() const
+    {
+        unsigned long fl;
+
+        if (!_BitScanReverse(&fl, m_Masks.FirstLevel))
+        {
+            return 0;
+        }
+
+        unsigned long sl;
+        _BitScanReverse(&sl, m_Masks.SecondLevels[fl]);
+
+        // 同一个 bucket 里的 block 大小不一定相同
+        uint32_t maxSize = 0;
+
+        for (uint32_t index = m_FreeHeads[fl][sl]; index != InvalidIndex; index = m_Blocks[index].NextFree)
+        {
+            maxSize = std::max(maxSize, m_Blocks[index].Size);
+        }
+
+        return maxSize * m_MinBlockSize;
+    }
+
+    MultiTlsfAllocator::MultiTlsfAllocator(const std::string& name, uint32_t minBlockSize, uint32_t defaultPageSize, const AppendPageFunc& appendPageFunc)
+        : m_Name(name)
+        , m_MinBlockSize(minBlockSize)
+        , m_DefaultPageSize(defaultPageSize)
+        , m_AppendPageFunc(appendPageFunc)
+        , m_PageAllocators{}
+        , m_IsPageAllocatable{}
+        , m_FreePageIndices{}
+        , m_Masks{}
+        , m_BucketPageCounts{}
+        , m_BucketPages{}
+    {
+    }
+
+    void MultiTlsfAllocator::Reset()
+    {
+        m_PageAllocators.clear();
+        m_IsPageAllocatable.clear();
+        m_FreePageIndices.clear();
+        m_Masks = {};
+
+        for (uint32_t fl = 0; fl < TlsfBucketMasks::NumFirstLevels; fl++)
+        {
+            for (uint32_t sl = 0; sl < TlsfBucketMasks::NumSecondLevels; sl++)
+            {
+                m_BucketPageCounts[fl][sl] = 0;
+                m_BucketPages[fl][sl].clear();
+            }
+        }
+    }
+
+    std::optional<size_t> MultiTlsfAllocator::FindPage(uint32_t searchUnits) const
+    {
+        uint32_t fl, sl;
+
+        if (!TlsfAllocator::MapSearchBucket(searchUnits, &fl, &sl) || !TlsfAllocator::FindNonEmptyBucket(m_Masks, &fl, &sl))
+        {
+            return std::nullopt;
+        }
+
+        const std::vector<uint64_t>& pages = m_BucketPages[fl][sl];
+
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            unsigned long bit;
+
+            if (_BitScanForward64(&bit, pages[i]))
+            {
+                return i * 64 + bit;
+            }
+        }
+
+        assert(false && "m_Masks is out of sync with m_BucketPages");
+        return std::nullopt;
+    }
+
+    TlsfBucketMasks MultiTlsfAllocator::GetIndexedBucketMasks(size_t pageIndex) const
+    {
+        if (m_PageAllocators[pageIndex] && m_IsPageAllocatable[pageIndex])
+        {
+            return m_PageAllocators[pageIndex]->GetBucketMasks();
+        }
+
+        return TlsfBucketMasks{};
+    }
+
+    void MultiTlsfAllocator::UpdatePageBuckets(size_t pageIndex, const TlsfBucketMasks& oldMasks, const TlsfBucketMasks& newMasks)
+    {
+        size_t word = pageIndex / 64;
+        uint64_t bit = 1ull << (pageIndex % 64);
+
+        // 只处理变化了的 bucket
+        for (uint32_t firstLevelMask = oldMasks.FirstLevel | newMasks.FirstLevel; firstLevelMask != 0; firstLevelMask &= firstLevelMask - 1)
+        {
+            unsigned long fl;
+            _BitScanForward(&fl, firstLevelMask);
+
+            for (uint32_t changed = oldMasks.SecondLevels[fl] ^ newMasks.SecondLevels[fl]; changed != 0; changed &= changed - 1)
+            {
+                unsigned long sl;
+                _BitScanForward(&sl, changed);
+
+                std::vector<uint64_t>& pages = m_BucketPages[fl][sl];
+                uint32_t& count = m_BucketPageCounts[fl][sl];
+
+                if (pages.size() <= word)
+                {
+                    pages.resize(word + 1, 0);
+                }
+
+                if ((newMasks.SecondLevels[fl] & (1u << sl)) != 0)
+                {
+                    pages[word] |= bit;
+                    count++;
+                }
+                else
+                {
+                    pages[word] &= ~bit;
+                    count--;
+                }
+
+                if (count > 0)
+                {
+                    m_Masks.SecondLevels[fl] |= 1u << sl;
+                    m_Masks.FirstLevel |= 1u << fl;
+                }
+                else if ((m_Masks.SecondLevels[fl] &= ~(1u << sl)) == 0)
+                {
+                    m_Masks.FirstLevel &= ~(1u << fl);
+                }
+            }
+        }
+    }
+
+    std::optional<uint32_t> MultiTlsfAllocator::Allocate(uint32_t sizeInBytes, uint32_t alignment, size_t* pOutPageIndex, TlsfAllocation* pOutAllocation, bool allowNewPage)
+    {
+        uint32_t searchUnits = TlsfAllocator::GetSearchUnits(m_MinBlockSize, sizeInBytes, alignment);
+        std::optional<size_t> pageIndex = FindPage(searchUnits);
+
+        if (!pageIndex)
+        {
+            if (!allowNewPage)
+            {
+                return std::nullopt;
+            }
+
+            // 新 page 只有一个 block，它要落在搜索的 bucket 里才能被找到，不用像 buddy 一样凑成 2 的幂
+            std::optional<uint64_t> sizeToAllocate = TlsfAllocator::GetGuaranteedBlockSize(m_MinBlockSize, sizeInBytes, alignment);
+
+            if (!sizeToAllocate || *sizeToAllocate > std::numeric_limits<uint32_t>::max())
+            {
+                LOG_ERROR("{} failed to allocate {} bytes", m_Name, sizeInBytes);
+                return std::nullopt;
+            }
+
+            pageIndex = ReclaimEmptyPage(*sizeToAllocate);
+
+            if (!pageIndex)
+            {
+                pageIndex = AppendNewPage(std::max(m_DefaultPageSize, static_cast<uint32_t>(*sizeToAllocate)));
+            }
+        }
+
+        std::optional<uint32_t> result = AllocateInPage(*pageIndex, sizeInBytes, alignment, pOutAllocation);
+        assert(result.has_value()); // 选出来的 bucket 里任何一个 block 都足够大
+
+        if (result)
+        {
+            *pOutPageIndex = *pageIndex;
+        }
+
+        return result;
+    }
+
+    std::optional<uint32_t> MultiTlsfAllocator::AllocateInPage(size_t pageIndex, uint32_t sizeInBytes, uint32_t alignment, TlsfAllocation* pOutAllocation)
+    {
+        assert(m_PageAllocators[pageIndex] != nullptr && m_IsPageAllocatable[pageIndex]);
+
+        TlsfAllocator* page = m_PageAllocators[pageIndex].get();
+        TlsfBucketMasks oldMasks = page->GetBucketMasks();
+        std::optional<uint32_t> result = page->Allocate(sizeInBytes, alignment, pOutAllocation);
+
+        if (result)
+        {
+            UpdatePageBuckets(pageIndex, oldMasks, page->GetBucketMasks());
+            pOutAllocation->PageIndex = static_cast<uint32_t>(pageIndex);
+        }
+
+        return result;
+    }
+
+    std::optional<size_t> MultiTlsfAllocator::ReclaimEmptyPage(uint64_t minSizeInBytes)
+    {
+        for (size_t i = 0; i < m_PageAllocators.size(); i++)
+        {
+            const TlsfAllocator* page = m_PageAllocators[i].get();
+
+            if (page == nullptr || m_IsPageAllocatable[i] || page->GetTotalAllocatedSize() != 0 || page->GetMaxSize() < minSizeInBytes)
+            {
+                continue;
+            }
+
+            SetPageAllocatable(i, true);
+            LOG_TRACE("{} reclaims empty page; Index={}; Size={}", m_Name, i, page->GetMaxSize());
+            return i;
+        }
+
+        return std::nullopt;
+    }
+
+    void MultiTlsfAllocator::Release(const TlsfAllocation& allocation)
+    {
+        assert(m_PageAllocators[allocation.PageIndex].get() == allocation.Owner);
+
+        TlsfBucketMasks oldMasks = GetIndexedBucketMasks(allocation.PageIndex);
+        allocation.Owner->Release(allocation);
+        UpdatePageBuckets(allocation.PageIndex, oldMasks, GetIndexedBucketMasks(allocation.PageIndex));
+    }
+
+    void MultiTlsfAllocator::SetPageAllocatable(size_t pageIndex, bool allocatable)
+    {
+        assert(m_PageAllocators[pageIndex] != nullptr);
+
+        if (m_IsPageAllocatable[pageIndex] == allocatable)
+        {
+            return;
+        }
+
+        TlsfBucketMasks oldMasks = GetIndexedBucketMasks(pageIndex);
+        m_IsPageAllocatable[pageIndex] = allocatable;
+        UpdatePageBuckets(pageIndex, oldMasks, GetIndexedBucketMasks(pageIndex));
+    }
+
+    void MultiTlsfAllocator::ReleasePage(size_t pageIndex)
+    {
+        TlsfAllocator* page = m_PageAllocators[pageIndex].get();
+        assert(page != nullptr && page->GetTotalAllocatedSize() == 0);
+
+        UpdatePageBuckets(pageIndex, GetIndexedBucketMasks(pageIndex), TlsfBucketMasks{});
+        LOG_TRACE("{} releases page; Index={}; Size={}", m_Name, pageIndex, page->GetMaxSize());
+
+        m_PageAllocators[pageIndex] = nullptr;
+        m_IsPageAllocatable[pageIndex] = false;
+        m_FreePageIndices.push_back(pageIndex);
+    }
+
+    size_t MultiTlsfAllocator::AppendNewPage(uint32_t sizeInBytes)
+    {
+        size_t pageIndex;
+
+        if (!m_FreePageIndices.empty())
+        {
+            pageIndex = m_FreePageIndices.back();
+            m_FreePageIndices.pop_back();
+        }
+        else
+        {
+            pageIndex = m_PageAllocators.size();
+            m_PageAllocators.emplace_back();
+            m_IsPageAllocatable.push_back(false);
+        }
+
+        m_AppendPageFunc(pageIndex, sizeInBytes);
+        m_PageAllocators[pageIndex] = std::make_unique<TlsfAllocator>(m_MinBlockSize, sizeInBytes);
+        m_IsPageAllocatable[pageIndex] = true;
+        UpdatePageBuckets(pageIndex, TlsfBucketMasks{}, GetIndexedBucketMasks(pageIndex));
+        LOG_TRACE("{} creates new page; MinBlockSize={}; Size={}", m_Name, m_MinBlockSize, sizeInBytes);
+        return pageIndex;
+    }
+
+    AllocatorFragmentationStats MultiTlsfAllocator::GetFragmentationStats() const
+    {
+        AllocatorFragmentationStats stats{};
+        for (const std::unique_ptr<TlsfAllocator>& page : m_PageAllocators)
+        {
+            if (!page)
+            {
+                continue;
+            }
+
+            stats.NumPages++;
+            stats.TotalSize += page->GetMaxSize();
+            stats.AllocatedSize += page->GetTotalAllocatedSize();
+            stats.RequestedSize += page->GetTotalRequestedSize();
+            stats.LargestFreeBlockSize = std::max<uint64_t>(stats.LargestFreeBlockSize, page->GetLargestFreeBlockSize());
+            stats.NumFreeBlocks += page->GetNumFreeBlocks();
+        }
+
+        return stats;
+    }
 }
@@ -0,0 +1,204 @@
+#include "pch.h"
+#include "Engine/Memory/DefragmentationPlanner.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace march
+{
+    void DefragmentationPlanner::Plan(const std::vector<DefragPageInfo>& pages,
+        const std::vector<DefragFreeBlock>& freeBlocks,
+        const std::vector<DefragAllocationInfo>& allocations,
+        const DefragBudget& budget)
+    {
+        size_t numPages = pages.size();
+
+        m_EvacuatedPages.clear();
+        m_Moves.clear();
+        m_Stats = {};
+
+        if (numPages < 2)
+        {
+            return;
+        }
+
+        m_PageMovableBytes.assign(numPages, 0);
+        m_PageNumAllocations.assign(numPages, 0);
+        m_PageHasImmovable.assign(numPages, false);
+        m_IsPageEvacuated.assign(numPages, false);
+        m_IsPageDestination.assign(numPages, false);
+        m_SortedAllocations.clear();
+
+        for (size_t i = 0; i < allocations.size(); i++)
+        {
+            const DefragAllocationInfo& allocation = allocations[i];
+            assert(allocation.PageIndex < numPages);
+
+            if (allocation.IsMovable)
+            {
+                m_PageMovableBytes[allocation.PageIndex] += allocation.Size;
+                m_PageNumAllocations[allocation.PageIndex]++;
+                m_SortedAllocations.push_back(i);
+            }
+            else
+            {
+                m_PageHasImmovable[allocation.PageIndex] = true;
+            }
+        }
+
+        // 同一个 page 的分配排在一起，大的先放，更不容易失败
+        std::sort(m_SortedAllocations.begin(), m_SortedAllocations.end(), [&allocations](size_t a, size_t b)
+        {
+            if (allocations[a].PageIndex != allocations[b].PageIndex)
+            {
+                return allocations[a].PageIndex < allocations[b].PageIndex;
+            }
+
+            if (allocations[a].RequiredBlockSize != allocations[b].RequiredBlockSize)
+            {
+                return allocations[a].RequiredBlockSize > allocations[b].RequiredBlockSize;
+            }
+
+            return a < b;
+        });
+
+        m_PageFirstAllocation.assign(numPages + 1, 0);
+
+        for (size_t i = 0; i < numPages; i++)
+        {
+            m_PageFirstAllocation[i + 1] = m_PageFirstAllocation[i] + m_PageNumAllocations[i];
+        }
+
+        m_FreeBlocks.assign(freeBlocks.begin(), freeBlocks.end());
+
+        // 最小的先试（best-fit），一样大时按 page，保证结果稳定
+        std::sort(m_FreeBlocks.begin(), m_FreeBlocks.end(), [](const DefragFreeBlock& a, const DefragFreeBlock& b)
+        {
+            if (a.Size != b.Size)
+            {
+                return a.Size < b.Size;
+            }
+
+            return a.PageIndex < b.PageIndex;
+        });
+
+        m_CandidatePages.clear();
+
+        for (size_t i = 0; i < numPages; i++)
+        {
+            const DefragPageInfo& page = pages[i];
+
+            if (m_PageHasImmovable[i] || page.Size == 0)
+            {
+                continue;
+            }
+
+            if (static_cast<double>(page.AllocatedSize) > static_cast<double>(page.Size) * budget.MaxPageUsage)
+            {
+                continue;
+            }
+
+            m_CandidatePages.push_back(i);
+        }
+
+        // 最空的 page 优先，一样空时按下标，保证结果稳定
+        std::sort(m_CandidatePages.begin(), m_CandidatePages.end(), [&pages](size_t a, size_t b)
+        {
+            if (pages[a].AllocatedSize != pages[b].AllocatedSize)
+            {
+                return pages[a].AllocatedSize < pages[b].AllocatedSize;
+            }
+
+            return a < b;
+        });
+
+        uint64_t remainingBytes = budget.MaxBytesToMove;
+        uint32_t remainingMoves = budget.MaxMoves;
+
+        for (size_t pageIndex : m_CandidatePages)
+        {
+            // 至少保留一个 page 接收数据
+            if (m_EvacuatedPages.size() + 1 >= numPages)
+            {
+                break;
+            }
+
+            // 已经接收了其他 page 的数据
+            if (m_IsPageDestination[pageIndex])
+            {
+                continue;
+            }
+
+            uint64_t moveBytes = m_PageMovableBytes[pageIndex];
+            uint32_t numMoves = m_PageNumAllocations[pageIndex];
+
+            if (moveBytes > remainingBytes || numMoves > remainingMoves)
+            {
+                continue;
+            }
+
+            if (!TryEvacuatePage(pageIndex, allocations))
+            {
+                continue;
+            }
+
+            remainingBytes -= moveBytes;
+            remainingMoves -= numMoves;
+
+            m_IsPageEvacuated[pageIndex] = true;
+            m_EvacuatedPages.push_back(pageIndex);
+
+            m_Stats.NumEvacuatedPages++;
+            m_Stats.NumMoves += numMoves;
+            m_Stats.MovedBytes += moveBytes;
+            m_Stats.ReleasedBytes += pages[pageIndex].Size;
+        }
+    }
+
+    bool DefragmentationPlanner::TryEvacuatePage(size_t pageIndex, const std::vector<DefragAllocationInfo>& allocations)
+    {
+        m_TrialBlocks.assign(m_FreeBlocks.begin(), m_FreeBlocks.end());
+        m_TrialMoves.clear();
+
+        for (size_t i = m_PageFirstAllocation[pageIndex]; i < m_PageFirstAllocation[pageIndex + 1]; i++)
+        {
+            size_t allocationIndex = m_SortedAllocations[i];
+            uint64_t requiredSize = allocations[allocationIndex].RequiredBlockSize;
+
+            auto it = std::lower_bound(m_TrialBlocks.begin(), m_TrialBlocks.end(), requiredSize, [](const DefragFreeBlock& block, uint64_t size)
+            {
+                return block.Size < size;
+            });
+
+            // 不能放回自己或者其他要清空的 page
+            while (it != m_TrialBlocks.end() && (it->PageIndex == pageIndex || m_IsPageEvacuated[it->PageIndex]))
+            {
+                ++it;
+            }
+
+            if (it == m_TrialBlocks.end())
+            {
+                return false;
+            }
+
+            m_TrialMoves.push_back(DefragMove{ allocationIndex, it->PageIndex });
+
+            // 剩下的部分还能继续用，往前挪保持有序
+            it->Size -= requiredSize;
+
+            for (; it != m_TrialBlocks.begin() && (it - 1)->Size > it->Size; --it)
+            {
+                std::iter_swap(it - 1, it);
+            }
+        }
+
+        m_FreeBlocks.swap(m_TrialBlocks);
+
+        for (const DefragMove& move : m_TrialMoves)
+        {
+            m_IsPageDestination[move.DestinationPageIndex] = true;
+            m_Moves.push_back(move);
+        }
+
+        return true;
+    }
+}
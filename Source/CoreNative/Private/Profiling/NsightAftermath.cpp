@@ -8,6 +8,7 @@
 #include "GFSDK_Aftermath_GpuCrashDump.h"
 #include "GFSDK_Aftermath_GpuCrashDumpDecoding.h"
 #include <type_traits>
+#include <string.h>
 #include <fstream>
 #include <filesystem>
 #include <chrono>
@@ -295,7 +296,7 @@ namespace march
         AFTERMATH_CHECK_ERROR(GFSDK_Aftermath_ReleaseContextHandle(handle));
     }
 
-    void NsightAftermath::SetEventMarker(void* contextHandle, const std::string& label)
+    void NsightAftermath::SetEventMarker(void* contextHandle, const char* label)
     {
         if (!IsInitializedAndFeatureEnabled(GFSDK_Aftermath_FeatureFlags_EnableMarkers))
         {
@@ -303,7 +304,7 @@ namespace march
         }
 
         auto handle = reinterpret_cast<GFSDK_Aftermath_ContextHandle>(contextHandle);
-        uint32_t dataSize = static_cast<uint32_t>(label.size() + 1); // 需要加上 '\0' 字符
-        AFTERMATH_CHECK_ERROR(GFSDK_Aftermath_SetEventMarker(handle, label.c_str(), dataSize));
+        uint32_t dataSize = static_cast<uint32_t>(strlen(label) + 1); // 需要加上 '\0' 字符
+        AFTERMATH_CHECK_ERROR(GFSDK_Aftermath_SetEventMarker(handle, label, dataSize));
     }
 }
@@ -0,0 +1,328 @@
+#include "pch.h"
+#include "Engine/Rendering/BoundingVolumeHierarchy.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace march
+{
+    static BoundingBox MergeBounds(const BoundingBox& a, const BoundingBox& b)
+    {
+        BoundingBox result{};
+        BoundingBox::CreateMerged(result, a, b);
+        return result;
+    }
+
+    static float GetSurfaceArea(const BoundingBox& bounds)
+    {
+        const XMFLOAT3& e = bounds.Extents;
+        return 8.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    uint32_t BoundingVolumeHierarchy::Insert(const BoundingBox& bounds, void* userData)
+    {
+        uint32_t leaf = AllocateNode();
+        Node& node = m_Nodes[leaf];
+        node.Bounds = bounds;
+        node.ObjectBounds = bounds;
+        node.Bounds.Extents.x += BoundsMargin;
+        node.Bounds.Extents.y += BoundsMargin;
+        node.Bounds.Extents.z += BoundsMargin;
+        node.UserData = userData;
+        node.Height = 0;
+
+        InsertLeaf(leaf);
+        m_LeafCount++;
+        return leaf;
+    }
+
+    void BoundingVolumeHierarchy::Remove(uint32_t leaf)
+    {
+        assert(m_Nodes[leaf].IsLeaf());
+
+        RemoveLeaf(leaf);
+        FreeNode(leaf);
+        m_LeafCount--;
+    }
+
+    bool BoundingVolumeHierarchy::Update(uint32_t leaf, const BoundingBox& bounds)
+    {
+        Node& node = m_Nodes[leaf];
+        assert(node.IsLeaf());
+
+        node.ObjectBounds = bounds;
+
+        if (node.Bounds.Contains(bounds) == ContainmentType::CONTAINS)
+        {
+            return false;
+        }
+
+        BoundingBox fatBounds = bounds;
+        fatBounds.Extents.x += BoundsMargin;
+        fatBounds.Extents.y += BoundsMargin;
+        fatBounds.Extents.z += BoundsMargin;
+
+        if (node.Bounds.Intersects(fatBounds))
+        {
+            // 移动得不远，原地修改，只需要向上 refit
+            node.Bounds = fatBounds;
+            RefitAncestors(node.Parent);
+        }
+        else
+        {
+            // 已经离开原来的位置了，继续放在原来的子树里会让祖先节点越来越大，重新插入
+            RemoveLeaf(leaf);
+            m_Nodes[leaf].Bounds = fatBounds;
+            InsertLeaf(leaf);
+        }
+
+        return true;
+    }
+
+    void BoundingVolumeHierarchy::CollectSubtrees(size_t minCount, std::vector<uint32_t>& outRoots) const
+    {
+        outRoots.clear();
+
+        if (m_Root == NullIndex)
+        {
+            return;
+        }
+
+        outRoots.push_back(m_Root);
+
+        // 每次把第一个非叶子节点换成它的两个子节点，越靠近根的越先拆
+        for (size_t i = 0; i < outRoots.size() && outRoots.size() < minCount;)
+        {
+            const Node& node = m_Nodes[outRoots[i]];
+
+            if (node.IsLeaf())
+            {
+                i++;
+                continue;
+            }
+
+            outRoots[i] = node.Children[0];
+            outRoots.push_back(node.Children[1]);
+        }
+    }
+
+    uint32_t BoundingVolumeHierarchy::AllocateNode()
+    {
+        uint32_t index;
+
+        if (m_FreeList != NullIndex)
+        {
+            index = m_FreeList;
+            m_FreeList = m_Nodes[index].Parent;
+        }
+        else
+        {
+            index = static_cast<uint32_t>(m_Nodes.size());
+            m_Nodes.emplace_back();
+        }
+
+        Node& node = m_Nodes[index];
+        node.UserData = nullptr;
+        node.Parent = NullIndex;
+        node.Children[0] = NullIndex;
+        node.Children[1] = NullIndex;
+        node.Height = 0;
+        return index;
+    }
+
+    void BoundingVolumeHierarchy::FreeNode(uint32_t index)
+    {
+        Node& node = m_Nodes[index];
+        node.UserData = nullptr;
+        node.Parent = m_FreeList;
+        node.Height = -1;
+        m_FreeList = index;
+    }
+
+    void BoundingVolumeHierarchy::InsertLeaf(uint32_t leaf)
+    {
+        if (m_Root == NullIndex)
+        {
+            m_Root = leaf;
+            m_Nodes[leaf].Parent = NullIndex;
+            return;
+        }
+
+        // 用表面积启发式（SAH）找到合适的兄弟节点
+        const BoundingBox leafBounds = m_Nodes[leaf].Bounds;
+        uint32_t index = m_Root;
+
+        while (!m_Nodes[index].IsLeaf())
+        {
+            const Node& node = m_Nodes[index];
+            float area = GetSurfaceArea(node.Bounds);
+            float combinedArea = GetSurfaceArea(MergeBounds(node.Bounds, leafBounds));
+
+            // 在这里创建新的父节点的代价
+            float cost = 2.0f * combinedArea;
+
+            // 继续往下走时，这个节点的 Bounds 也会增大
+            float inheritanceCost = 2.0f * (combinedArea - area);
+
+            float childCosts[2];
+
+            for (int i = 0; i < 2; i++)
+            {
+                const Node& child = m_Nodes[node.Children[i]];
+                float childArea = GetSurfaceArea(MergeBounds(child.Bounds, leafBounds));
+
+                if (!child.IsLeaf())
+                {
+                    childArea -= GetSurfaceArea(child.Bounds);
+                }
+
+                childCosts[i] = childArea + inheritanceCost;
+            }
+
+            if (cost < childCosts[0] && cost < childCosts[1])
+            {
+                break;
+            }
+
+            index = node.Children[childCosts[0] < childCosts[1] ? 0 : 1];
+        }
+
+        uint32_t sibling = index;
+        uint32_t oldParent = m_Nodes[sibling].Parent;
+        uint32_t newParent = AllocateNode(); // 可能会导致 m_Nodes 扩容，之前的引用都失效了
+
+        Node& parentNode = m_Nodes[newParent];
+        parentNode.Parent = oldParent;
+        parentNode.Bounds = MergeBounds(leafBounds, m_Nodes[sibling].Bounds);
+        parentNode.Height = m_Nodes[sibling].Height + 1;
+        parentNode.Children[0] = sibling;
+        parentNode.Children[1] = leaf;
+
+        if (oldParent != NullIndex)
+        {
+            Node& oldParentNode = m_Nodes[oldParent];
+            oldParentNode.Children[oldParentNode.Children[0] == sibling ? 0 : 1] = newParent;
+        }
+        else
+        {
+            m_Root = newParent;
+        }
+
+        m_Nodes[sibling].Parent = newParent;
+        m_Nodes[leaf].Parent = newParent;
+
+        RefitAncestors(newParent);
+    }
+
+    void BoundingVolumeHierarchy::RemoveLeaf(uint32_t leaf)
+    {
+        if (leaf == m_Root)
+        {
+            m_Root = NullIndex;
+            return;
+        }
+
+        uint32_t parent = m_Nodes[leaf].Parent;
+        uint32_t grandParent = m_Nodes[parent].Parent;
+        uint32_t sibling = m_Nodes[parent].Children[m_Nodes[parent].Children[0] == leaf ? 1 : 0];
+
+        // 用兄弟节点替换父节点
+        if (grandParent != NullIndex)
+        {
+            Node& grandParentNode = m_Nodes[grandParent];
+            grandParentNode.Children[grandParentNode.Children[0] == parent ? 0 : 1] = sibling;
+            m_Nodes[sibling].Parent = grandParent;
+            FreeNode(parent);
+            RefitAncestors(grandParent);
+        }
+        else
+        {
+            m_Root = sibling;
+            m_Nodes[sibling].Parent = NullIndex;
+            FreeNode(parent);
+        }
+
+        m_Nodes[leaf].Parent = NullIndex;
+    }
+
+    void BoundingVolumeHierarchy::RefitAncestors(uint32_t index)
+    {
+        while (index != NullIndex)
+        {
+            index = Balance(index);
+
+            Node& node = m_Nodes[index];
+            const Node& child0 = m_Nodes[node.Children[0]];
+            const Node& child1 = m_Nodes[node.Children[1]];
+
+            node.Height = 1 + std::max(child0.Height, child1.Height);
+            node.Bounds = MergeBounds(child0.Bounds, child1.Bounds);
+
+            index = node.Parent;
+        }
+    }
+
+    uint32_t BoundingVolumeHierarchy::Balance(uint32_t iA)
+    {
+        // 如果一边比另一边高 2 层以上，就把高的那个子节点转上来，返回新的子树根节点
+        // 被转上来的节点的两个子节点中，高的留在它下面，矮的给原来的根节点
+
+        Node& A = m_Nodes[iA];
+
+        if (A.IsLeaf() || A.Height < 2)
+        {
+            return iA;
+        }
+
+        int32_t balance = m_Nodes[A.Children[1]].Height - m_Nodes[A.Children[0]].Height;
+
+        if (balance >= -1 && balance <= 1)
+        {
+            return iA;
+        }
+
+        // up 是要转上来的节点，down 是另一边的子节点
+        int upSide = balance > 1 ? 1 : 0;
+        uint32_t iUp = A.Children[upSide];
+        uint32_t iDown = A.Children[1 - upSide];
+        Node& up = m_Nodes[iUp];
+        Node& down = m_Nodes[iDown];
+
+        // up 替代 A 的位置，A 成为 up 的子节点
+        up.Parent = A.Parent;
+        A.Parent = iUp;
+
+        if (up.Parent != NullIndex)
+        {
+            Node& parent = m_Nodes[up.Parent];
+            parent.Children[parent.Children[0] == iA ? 0 : 1] = iUp;
+        }
+        else
+        {
+            m_Root = iUp;
+        }
+
+        uint32_t iX = up.Children[0];
+        uint32_t iY = up.Children[1];
+
+        if (m_Nodes[iX].Height < m_Nodes[iY].Height)
+        {
+            std::swap(iX, iY);
+        }
+
+        Node& X = m_Nodes[iX];
+        Node& Y = m_Nodes[iY];
+
+        up.Children[0] = iA;
+        up.Children[1] = iX;
+        A.Children[upSide] = iY;
+        Y.Parent = iA;
+
+        A.Bounds = MergeBounds(down.Bounds, Y.Bounds);
+        A.Height = 1 + std::max(down.Height, Y.Height);
+        up.Bounds = MergeBounds(A.Bounds, X.Bounds);
+        up.Height = 1 + std::max(A.Height, X.Height);
+
+        return iUp;
+    }
+}
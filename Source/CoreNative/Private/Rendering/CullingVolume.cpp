@@ -0,0 +1,314 @@
+#include "pch.h"
+#include "Engine/Rendering/CullingVolume.h"
+#include <Windows.h>
+#include <math.h>
+
+#if defined(_XM_SSE_INTRINSICS_) || defined(_XM_AVX2_INTRINSICS_)
+#include <immintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace march
+{
+    void BoundingBoxSoA::Clear()
+    {
+        m_CenterX.clear();
+        m_CenterY.clear();
+        m_CenterZ.clear();
+        m_ExtentX.clear();
+        m_ExtentY.clear();
+        m_ExtentZ.clear();
+    }
+
+    void BoundingBoxSoA::Add(const BoundingBox& bounds)
+    {
+        m_CenterX.push_back(bounds.Center.x);
+        m_CenterY.push_back(bounds.Center.y);
+        m_CenterZ.push_back(bounds.Center.z);
+        m_ExtentX.push_back(bounds.Extents.x);
+        m_ExtentY.push_back(bounds.Extents.y);
+        m_ExtentZ.push_back(bounds.Extents.z);
+    }
+
+    CullingVolume::CullingVolume(const BoundingFrustum& frustum) : m_IsSphere(false), m_Sphere{}
+    {
+        XMVECTOR planes[NumPlanes];
+        frustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+
+        for (size_t i = 0; i < NumPlanes; i++)
+        {
+            SetPlane(i, planes[i]);
+        }
+    }
+
+    CullingVolume::CullingVolume(const BoundingBox& box) : m_IsSphere(false), m_Sphere{}
+    {
+        const float* center = &box.Center.x;
+        const float* extents = &box.Extents.x;
+
+        for (size_t axis = 0; axis < 3; axis++)
+        {
+            XMFLOAT4 normal{ 0.0f, 0.0f, 0.0f, 0.0f };
+            (&normal.x)[axis] = 1.0f;
+
+            normal.w = -(center[axis] + extents[axis]);
+            SetPlane(axis * 2 + 0, XMLoadFloat4(&normal));
+
+            (&normal.x)[axis] = -1.0f;
+            normal.w = center[axis] - extents[axis];
+            SetPlane(axis * 2 + 1, XMLoadFloat4(&normal));
+        }
+    }
+
+    CullingVolume::CullingVolume(const BoundingOrientedBox& box) : m_IsSphere(false), m_Sphere{}
+    {
+        XMVECTOR center = XMLoadFloat3(&box.Center);
+        XMVECTOR orientation = XMLoadFloat4(&box.Orientation);
+        const float* extents = &box.Extents.x;
+
+        for (size_t axis = 0; axis < 3; axis++)
+        {
+            XMFLOAT4 localAxis{ 0.0f, 0.0f, 0.0f, 0.0f };
+            (&localAxis.x)[axis] = 1.0f;
+
+            XMVECTOR normal = XMVector3Rotate(XMLoadFloat4(&localAxis), orientation);
+            float distance = XMVectorGetX(XMVector3Dot(normal, center));
+
+            SetPlane(axis * 2 + 0, XMVectorSetW(normal, -(distance + extents[axis])));
+            SetPlane(axis * 2 + 1, XMVectorSetW(XMVectorNegate(normal), distance - extents[axis]));
+        }
+    }
+
+    CullingVolume::CullingVolume(const BoundingSphere& sphere) : m_IsSphere(true), m_Sphere(sphere)
+    {
+        for (size_t i = 0; i < NumPlanes; i++)
+        {
+            SetPlane(i, XMVectorZero());
+        }
+    }
+
+    void CullingVolume::SetPlane(size_t index, FXMVECTOR plane)
+    {
+        XMFLOAT4 p{};
+        XMStoreFloat4(&p, plane);
+
+        m_PlaneNormalX[index] = p.x;
+        m_PlaneNormalY[index] = p.y;
+        m_PlaneNormalZ[index] = p.z;
+        m_PlaneDistance[index] = p.w;
+    }
+
+    size_t CullingVolume::Cull(const BoundingBoxSoA& boxes, size_t begin, size_t end, uint32_t* pOutIndices) const
+    {
+        return m_IsSphere ? CullSphere(boxes, begin, end, pOutIndices) : CullPlanes(boxes, begin, end, pOutIndices);
+    }
+
+    // 把一个 packet 的可见掩码展开成索引，不需要原子操作
+    static __forceinline size_t AppendVisibleIndices(unsigned long mask, size_t base, uint32_t* pOutIndices, size_t count)
+    {
+        unsigned long bit;
+
+        while (_BitScanForward(&bit, mask))
+        {
+            pOutIndices[count++] = static_cast<uint32_t>(base + bit);
+            mask &= mask - 1;
+        }
+
+        return count;
+    }
+
+    size_t CullingVolume::CullPlanes(const BoundingBoxSoA& boxes, size_t begin, size_t end, uint32_t* pOutIndices) const
+    {
+        const float* cx = boxes.GetCenterX();
+        const float* cy = boxes.GetCenterY();
+        const float* cz = boxes.GetCenterZ();
+        const float* ex = boxes.GetExtentX();
+        const float* ey = boxes.GetExtentY();
+        const float* ez = boxes.GetExtentZ();
+
+        size_t i = begin;
+        size_t count = 0;
+
+        // 对每个平面，AABB 在法线方向上的投影半径是 |n| * extents
+        // 如果中心到平面的距离减去投影半径还大于 0，那整个 AABB 都在外面
+
+#if defined(_XM_AVX2_INTRINSICS_)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+            for (; i + 8 <= end; i += 8)
+            {
+                __m256 centerX = _mm256_loadu_ps(cx + i);
+                __m256 centerY = _mm256_loadu_ps(cy + i);
+                __m256 centerZ = _mm256_loadu_ps(cz + i);
+                __m256 extentX = _mm256_loadu_ps(ex + i);
+                __m256 extentY = _mm256_loadu_ps(ey + i);
+                __m256 extentZ = _mm256_loadu_ps(ez + i);
+                __m256 outside = zero;
+
+                for (size_t p = 0; p < NumPlanes; p++)
+                {
+                    __m256 nx = _mm256_set1_ps(m_PlaneNormalX[p]);
+                    __m256 ny = _mm256_set1_ps(m_PlaneNormalY[p]);
+                    __m256 nz = _mm256_set1_ps(m_PlaneNormalZ[p]);
+
+                    __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(nx, centerX), _mm256_mul_ps(ny, centerY)), _mm256_mul_ps(nz, centerZ)), _mm256_set1_ps(m_PlaneDistance[p]));
+                    __m256 radius = _mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(_mm256_andnot_ps(signMask, nx), extentX),
+                        _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), extentY)),
+                        _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), extentZ));
+
+                    outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_sub_ps(dist, radius), zero, _CMP_GT_OQ));
+                }
+
+                unsigned long mask = static_cast<unsigned long>(~_mm256_movemask_ps(outside) & 0xFF);
+                count = AppendVisibleIndices(mask, i, pOutIndices, count);
+            }
+        }
+#endif
+
+#if defined(_XM_SSE_INTRINSICS_)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 signMask = _mm_set1_ps(-0.0f);
+
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 centerX = _mm_loadu_ps(cx + i);
+                __m128 centerY = _mm_loadu_ps(cy + i);
+                __m128 centerZ = _mm_loadu_ps(cz + i);
+                __m128 extentX = _mm_loadu_ps(ex + i);
+                __m128 extentY = _mm_loadu_ps(ey + i);
+                __m128 extentZ = _mm_loadu_ps(ez + i);
+                __m128 outside = zero;
+
+                for (size_t p = 0; p < NumPlanes; p++)
+                {
+                    __m128 nx = _mm_set1_ps(m_PlaneNormalX[p]);
+                    __m128 ny = _mm_set1_ps(m_PlaneNormalY[p]);
+                    __m128 nz = _mm_set1_ps(m_PlaneNormalZ[p]);
+
+                    __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(nx, centerX), _mm_mul_ps(ny, centerY)), _mm_mul_ps(nz, centerZ)), _mm_set1_ps(m_PlaneDistance[p]));
+                    __m128 radius = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(_mm_andnot_ps(signMask, nx), extentX),
+                        _mm_mul_ps(_mm_andnot_ps(signMask, ny), extentY)),
+                        _mm_mul_ps(_mm_andnot_ps(signMask, nz), extentZ));
+
+                    outside = _mm_or_ps(outside, _mm_cmpgt_ps(_mm_sub_ps(dist, radius), zero));
+                }
+
+                unsigned long mask = static_cast<unsigned long>(~_mm_movemask_ps(outside) & 0xF);
+                count = AppendVisibleIndices(mask, i, pOutIndices, count);
+            }
+        }
+#endif
+
+        // 剩下不够一个 packet 的，或者不支持 SIMD 的情况
+        for (; i < end; i++)
+        {
+            bool outside = false;
+
+            for (size_t p = 0; p < NumPlanes; p++)
+            {
+                float nx = m_PlaneNormalX[p];
+                float ny = m_PlaneNormalY[p];
+                float nz = m_PlaneNormalZ[p];
+
+                float dist = nx * cx[i] + ny * cy[i] + nz * cz[i] + m_PlaneDistance[p];
+                float radius = fabsf(nx) * ex[i] + fabsf(ny) * ey[i] + fabsf(nz) * ez[i];
+                outside |= (dist - radius > 0.0f);
+            }
+
+            if (!outside)
+            {
+                pOutIndices[count++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        return count;
+    }
+
+    size_t CullingVolume::CullSphere(const BoundingBoxSoA& boxes, size_t begin, size_t end, uint32_t* pOutIndices) const
+    {
+        const float* cx = boxes.GetCenterX();
+        const float* cy = boxes.GetCenterY();
+        const float* cz = boxes.GetCenterZ();
+        const float* ex = boxes.GetExtentX();
+        const float* ey = boxes.GetExtentY();
+        const float* ez = boxes.GetExtentZ();
+
+        const float sx = m_Sphere.Center.x;
+        const float sy = m_Sphere.Center.y;
+        const float sz = m_Sphere.Center.z;
+        const float radiusSq = m_Sphere.Radius * m_Sphere.Radius;
+
+        size_t i = begin;
+        size_t count = 0;
+
+        // 球心到 AABB 的最近距离不超过半径就是相交
+        // 每个轴上的距离是 max(|s - c| - e, 0)
+
+#if defined(_XM_AVX2_INTRINSICS_)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 signMask = _mm256_set1_ps(-0.0f);
+            const __m256 sphereX = _mm256_set1_ps(sx);
+            const __m256 sphereY = _mm256_set1_ps(sy);
+            const __m256 sphereZ = _mm256_set1_ps(sz);
+            const __m256 sphereRadiusSq = _mm256_set1_ps(radiusSq);
+
+            for (; i + 8 <= end; i += 8)
+            {
+                __m256 dx = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signMask, _mm256_sub_ps(sphereX, _mm256_loadu_ps(cx + i))), _mm256_loadu_ps(ex + i)), zero);
+                __m256 dy = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signMask, _mm256_sub_ps(sphereY, _mm256_loadu_ps(cy + i))), _mm256_loadu_ps(ey + i)), zero);
+                __m256 dz = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signMask, _mm256_sub_ps(sphereZ, _mm256_loadu_ps(cz + i))), _mm256_loadu_ps(ez + i)), zero);
+                __m256 distSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+                unsigned long mask = static_cast<unsigned long>(_mm256_movemask_ps(_mm256_cmp_ps(distSq, sphereRadiusSq, _CMP_LE_OQ)));
+                count = AppendVisibleIndices(mask, i, pOutIndices, count);
+            }
+        }
+#endif
+
+#if defined(_XM_SSE_INTRINSICS_)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 signMask = _mm_set1_ps(-0.0f);
+            const __m128 sphereX = _mm_set1_ps(sx);
+            const __m128 sphereY = _mm_set1_ps(sy);
+            const __m128 sphereZ = _mm_set1_ps(sz);
+            const __m128 sphereRadiusSq = _mm_set1_ps(radiusSq);
+
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signMask, _mm_sub_ps(sphereX, _mm_loadu_ps(cx + i))), _mm_loadu_ps(ex + i)), zero);
+                __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signMask, _mm_sub_ps(sphereY, _mm_loadu_ps(cy + i))), _mm_loadu_ps(ey + i)), zero);
+                __m128 dz = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signMask, _mm_sub_ps(sphereZ, _mm_loadu_ps(cz + i))), _mm_loadu_ps(ez + i)), zero);
+                __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+                unsigned long mask = static_cast<unsigned long>(_mm_movemask_ps(_mm_cmple_ps(distSq, sphereRadiusSq)));
+                count = AppendVisibleIndices(mask, i, pOutIndices, count);
+            }
+        }
+#endif
+
+        // 剩下不够一个 packet 的，或者不支持 SIMD 的情况
+        for (; i < end; i++)
+        {
+            float dx = fmaxf(fabsf(sx - cx[i]) - ex[i], 0.0f);
+            float dy = fmaxf(fabsf(sy - cy[i]) - ey[i], 0.0f);
+            float dz = fmaxf(fabsf(sz - cz[i]) - ez[i], 0.0f);
+
+            if (dx * dx + dy * dy + dz * dz <= radiusSq)
+            {
+                pOutIndices[count++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        return count;
+    }
+}
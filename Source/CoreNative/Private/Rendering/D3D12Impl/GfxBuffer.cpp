@@ -170,7 +170,9 @@ namespace march
         , m_CounterOffsetInBytes(0)
         , m_Allocator(nullptr)
         , m_Allocation{}
+        , m_DescriptorResourceVersion(0)
         , m_UavDescriptors{}
+        , m_DescriptorMutex{}
     {
     }
 
@@ -225,6 +227,20 @@ namespace march
         }
 
         AllocateResourceIfNot();
+
+        std::lock_guard<std::mutex> lock(m_DescriptorMutex);
+
+        // 碎片整理换掉了底层的 resource，旧的 view 都失效了
+        if (m_DescriptorResourceVersion != m_Resource->GetVersion())
+        {
+            for (GfxOfflineDescriptor& descriptor : m_UavDescriptors)
+            {
+                descriptor.DeferredRelease();
+            }
+
+            m_DescriptorResourceVersion = m_Resource->GetVersion();
+        }
+
         GfxOfflineDescriptor& uav = m_UavDescriptors[static_cast<size_t>(element)];
 
         if (!uav)
@@ -340,16 +356,10 @@ namespace march
         if (GfxBufferAllocUtils::IsHeapCpuAccessible(m_Desc.GetAllocStrategy()))
         {
             // CPU 可以直接写入，但为了避免和 GPU 竞争，每次都会重新分配资源
-            D3D12_RANGE resourceRange = ReallocateResource();
-            assert(m_Resource->IsHeapCpuAccessible());
-
-            // https://learn.microsoft.com/en-us/windows/win32/api/d3d12/nf-d3d12-id3d12resource-map
-            // https://learn.microsoft.com/en-us/windows/win32/api/d3d12/nf-d3d12-id3d12resource-unmap
-
-            uint8_t* pMappedData = nullptr;
-            ID3D12Resource* d3dResource = m_Resource->GetD3DResource();
-            D3D12_RANGE readRange = CD3DX12_RANGE(0, 0);
-            CHECK_HR(d3dResource->Map(0, &readRange, reinterpret_cast<void**>(&pMappedData))); // Write-Only
+            // upload heap 的 buffer 一直 map 着，不需要 Map 和 Unmap
+            ReallocateResource();
+            uint8_t* pMappedData = m_Resource->GetMappedData();
+            assert(pMappedData != nullptr);
 
             if (pData)
             {
@@ -373,8 +383,6 @@ namespace march
                     LOG_WARNING("GfxBuffer::SetData: buffer does not have counter");
                 }
             }
-
-            d3dResource->Unmap(0, &resourceRange);
         }
         else
         {
@@ -463,7 +471,7 @@ namespace march
         }
     }
 
-    D3D12_RANGE GfxBuffer::ReallocateResource()
+    void GfxBuffer::ReallocateResource()
     {
         ReleaseResource();
 
@@ -519,7 +527,7 @@ namespace march
 
         m_DataOffsetInBytes = resourceOffsetInBytes + dataOffsetInResource;
         m_CounterOffsetInBytes = resourceOffsetInBytes + 0; // Counter 永远在最前面
-        return CD3DX12_RANGE(resourceOffsetInBytes, resourceOffsetInBytes + sizeInBytes);
+        m_DescriptorResourceVersion = m_Resource->GetVersion();
     }
 
     GfxBuffer::GfxBuffer(GfxBuffer&& other) noexcept
@@ -531,7 +539,9 @@ namespace march
         , m_CounterOffsetInBytes(other.m_CounterOffsetInBytes)
         , m_Allocator(std::exchange(other.m_Allocator, nullptr))
         , m_Allocation(other.m_Allocation)
+        , m_DescriptorResourceVersion(other.m_DescriptorResourceVersion)
         , m_UavDescriptors{}
+        , m_DescriptorMutex{}
     {
         for (size_t i = 0; i < std::size(m_UavDescriptors); i++)
         {
@@ -553,6 +563,7 @@ namespace march
             m_CounterOffsetInBytes = other.m_CounterOffsetInBytes;
             m_Allocator = std::exchange(other.m_Allocator, nullptr);
             m_Allocation = other.m_Allocation;
+            m_DescriptorResourceVersion = other.m_DescriptorResourceVersion;
 
             for (size_t i = 0; i < std::size(m_UavDescriptors); i++)
             {
@@ -570,6 +581,7 @@ namespace march
         : m_Device(pageAllocator->GetDevice())
         , m_Pages{}
         , m_ReleaseQueue{}
+        , m_Mutex{}
     {
         auto appendPageFunc = [this, pageAllocator](uint32_t sizeInBytes)
         {
@@ -590,6 +602,7 @@ namespace march
         uint32_t* pOutOffsetInBytes,
         GfxBufferSubAllocation* pOutAllocation)
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
         size_t pageIndex = 0;
 
         if (std::optional<uint32_t> offset = m_Allocator->Allocate(sizeInBytes, dataPlacementAlignment, &pageIndex, &pOutAllocation->Buddy))
@@ -603,11 +616,14 @@ namespace march
 
     void GfxBufferMultiBuddySubAllocator::DeferredRelease(const GfxBufferSubAllocation& allocation)
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
         m_ReleaseQueue.emplace(m_Device->GetNextFence(), allocation);
     }
 
     void GfxBufferMultiBuddySubAllocator::CleanUpAllocations()
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
         while (!m_ReleaseQueue.empty() && m_Device->IsFenceCompleted(m_ReleaseQueue.front().first))
         {
             m_Allocator->Release(m_ReleaseQueue.front().second.Buddy);
@@ -615,86 +631,184 @@ namespace march
         }
     }
 
-    GfxBufferLinearSubAllocator::GfxBufferLinearSubAllocator(
+    AllocatorFragmentationStats GfxBufferMultiBuddySubAllocator::GetFragmentationStats()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Allocator->GetFragmentationStats();
+    }
+
+    GfxBufferMultiTlsfSubAllocator::GfxBufferMultiTlsfSubAllocator(
         const std::string& name,
-        const GfxBufferLinearSubAllocatorDesc& desc,
-        GfxResourceAllocator* pageAllocator,
-        GfxResourceAllocator* largePageAllocator)
+        const GfxBufferMultiTlsfSubAllocatorDesc& desc,
+        GfxResourceAllocator* pageAllocator)
         : m_Device(pageAllocator->GetDevice())
         , m_Pages{}
-        , m_LargePages{}
         , m_ReleaseQueue{}
+        , m_Mutex{}
     {
-        auto requestPageFunc = [this, pageAllocator, largePageAllocator](uint32_t sizeInBytes, bool large, bool* pOutIsNew) -> size_t
+        auto appendPageFunc = [this, pageAllocator](size_t pageIndex, uint32_t sizeInBytes)
         {
-            std::vector<RefCountPtr<GfxResource>>& pages = large ? m_LargePages : m_Pages;
+            assert(pageIndex == m_Pages.size()); // 不会调用 ReleasePage，所以总是添加在最后
 
-            if (!large && !m_ReleaseQueue.empty() && m_Device->IsFenceCompleted(m_ReleaseQueue.front().first))
-            {
-                *pOutIsNew = false;
+            UINT64 pageWidth = static_cast<UINT64>(sizeInBytes);
+            std::string pageName = m_Allocator->GetName() + "Page";
+            D3D12_RESOURCE_STATES pageState = D3D12_RESOURCE_STATE_GENERIC_READ;
+            D3D12_RESOURCE_DESC pageDesc = CD3DX12_RESOURCE_DESC::Buffer(pageWidth);
+            RefCountPtr<GfxResource>& page = m_Pages.emplace_back(pageAllocator->Allocate(pageName, &pageDesc, pageState));
+            page->LockState(true); // 所有子资源会共享一个状态，所以禁止修改
+        };
 
-                pages.emplace_back(std::move(m_ReleaseQueue.front().second));
-                m_ReleaseQueue.pop();
-            }
-            else
-            {
-                *pOutIsNew = true;
+        m_Allocator = std::make_unique<MultiTlsfAllocator>(name, desc.MinBlockSize, desc.DefaultPageSize, appendPageFunc);
+    }
 
-                GfxResourceAllocator* allocator;
-                std::string pageName;
+    RefCountPtr<GfxResource> GfxBufferMultiTlsfSubAllocator::Allocate(
+        uint32_t sizeInBytes,
+        uint32_t dataPlacementAlignment,
+        uint32_t* pOutOffsetInBytes,
+        GfxBufferSubAllocation* pOutAllocation)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        size_t pageIndex = 0;
 
-                if (large)
-                {
-                    allocator = largePageAllocator;
-                    pageName = m_Allocator->GetName() + "Page (Large)";
-                }
-                else
-                {
-                    allocator = pageAllocator;
-                    pageName = m_Allocator->GetName() + "Page";
-                }
+        if (std::optional<uint32_t> offset = m_Allocator->Allocate(sizeInBytes, dataPlacementAlignment, &pageIndex, &pOutAllocation->Tlsf))
+        {
+            *pOutOffsetInBytes = *offset;
+            return m_Pages[pageIndex];
+        }
 
-                UINT64 pageWidth = static_cast<UINT64>(sizeInBytes);
-                D3D12_RESOURCE_STATES pageState = D3D12_RESOURCE_STATE_GENERIC_READ;
-                D3D12_RESOURCE_DESC pageDesc = CD3DX12_RESOURCE_DESC::Buffer(pageWidth);
-                RefCountPtr<GfxResource>& page = pages.emplace_back(allocator->Allocate(pageName, &pageDesc, pageState));
-                page->LockState(true); // 所有子资源会共享一个状态，所以禁止修改
-            }
+        return nullptr;
+    }
 
-            return pages.size() - 1;
-        };
+    void GfxBufferMultiTlsfSubAllocator::DeferredRelease(const GfxBufferSubAllocation& allocation)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_ReleaseQueue.emplace(m_Device->GetNextFence(), allocation);
+    }
 
-        m_Allocator = std::make_unique<LinearAllocator>(name, desc.PageSize, requestPageFunc);
+    void GfxBufferMultiTlsfSubAllocator::CleanUpAllocations()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        while (!m_ReleaseQueue.empty() && m_Device->IsFenceCompleted(m_ReleaseQueue.front().first))
+        {
+            m_Allocator->Release(m_ReleaseQueue.front().second.Tlsf);
+            m_ReleaseQueue.pop();
+        }
     }
 
-    RefCountPtr<GfxResource> GfxBufferLinearSubAllocator::Allocate(
+    AllocatorFragmentationStats GfxBufferMultiTlsfSubAllocator::GetFragmentationStats()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Allocator->GetFragmentationStats();
+    }
+
+    GfxBufferRingSubAllocator::GfxBufferRingSubAllocator(
+        const std::string& name,
+        const GfxBufferRingSubAllocatorDesc& desc,
+        GfxResourceAllocator* ringAllocator,
+        GfxResourceAllocator* fallbackAllocator)
+        : m_Device(ringAllocator->GetDevice())
+        , m_Name(name)
+        , m_FallbackAllocator(fallbackAllocator)
+        , m_Ring(nullptr)
+        , m_Capacity(static_cast<uint64_t>(desc.Capacity))
+        , m_Head(0)
+        , m_Tail(0)
+        , m_FrameEnds{}
+        , m_FrameAllocatedBytes(0)
+        , m_FrameWastedBytes(0)
+        , m_FrameFallbackBytes(0)
+        , m_FrameNumAllocations(0)
+        , m_FrameNumFallbacks(0)
+        , m_LastFrameStats{}
+    {
+        D3D12_RESOURCE_STATES ringState = D3D12_RESOURCE_STATE_GENERIC_READ;
+        D3D12_RESOURCE_DESC ringDesc = CD3DX12_RESOURCE_DESC::Buffer(m_Capacity);
+        m_Ring = ringAllocator->Allocate(name + "Ring", &ringDesc, ringState);
+        m_Ring->LockState(true); // 所有子资源会共享一个状态，所以禁止修改
+        assert(m_Ring->GetMappedData() != nullptr);
+    }
+
+    RefCountPtr<GfxResource> GfxBufferRingSubAllocator::Allocate(
         uint32_t sizeInBytes,
         uint32_t dataPlacementAlignment,
         uint32_t* pOutOffsetInBytes,
         GfxBufferSubAllocation* pOutAllocation)
     {
-        size_t pageIndex = 0;
-        bool large = false;
-        *pOutOffsetInBytes = m_Allocator->Allocate(sizeInBytes, dataPlacementAlignment, &pageIndex, &large);
-        return (large ? m_LargePages : m_Pages)[pageIndex];
+        uint64_t size = static_cast<uint64_t>(sizeInBytes);
+        uint64_t alignment = static_cast<uint64_t>(dataPlacementAlignment);
+        uint64_t reservedSize = size + alignment - 1; // 不管从哪里开始，对齐以后都放得下
+
+        // 要求 m_Capacity 是 alignment 的整数倍，这样位置对齐后，在 buffer 中的偏移也是对齐的
+        assert(m_Capacity % alignment == 0);
+
+        while (reservedSize <= m_Capacity)
+        {
+            uint64_t start = m_Head.fetch_add(reservedSize, std::memory_order_relaxed);
+            uint64_t alignedStart = (start + alignment - 1) / alignment * alignment;
+            uint64_t end = alignedStart + size;
+
+            // 会覆盖 GPU 可能还在使用的数据，预留的这一段浪费掉
+            if (end - m_Tail.load(std::memory_order_acquire) > m_Capacity)
+            {
+                m_FrameWastedBytes.fetch_add(reservedSize, std::memory_order_relaxed);
+                break;
+            }
+
+            uint64_t offset = alignedStart % m_Capacity;
+
+            // 跨过了 buffer 的末尾，这一段浪费掉，重新分配
+            if (offset + size > m_Capacity)
+            {
+                m_FrameWastedBytes.fetch_add(reservedSize, std::memory_order_relaxed);
+                continue;
+            }
+
+            m_FrameAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+            m_FrameWastedBytes.fetch_add(reservedSize - size, std::memory_order_relaxed);
+            m_FrameNumAllocations.fetch_add(1, std::memory_order_relaxed);
+            *pOutOffsetInBytes = static_cast<uint32_t>(offset);
+            return m_Ring;
+        }
+
+        *pOutOffsetInBytes = 0;
+        return AllocateFallback(sizeInBytes);
+    }
+
+    RefCountPtr<GfxResource> GfxBufferRingSubAllocator::AllocateFallback(uint32_t sizeInBytes)
+    {
+        m_FrameFallbackBytes.fetch_add(static_cast<uint64_t>(sizeInBytes), std::memory_order_relaxed);
+        m_FrameNumFallbacks.fetch_add(1, std::memory_order_relaxed);
+
+        // 由 GfxBuffer 持有，释放时和其他资源一样延迟释放
+        UINT64 width = static_cast<UINT64>(sizeInBytes);
+        D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_GENERIC_READ;
+        D3D12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Buffer(width);
+        RefCountPtr<GfxResource> resource = m_FallbackAllocator->Allocate(m_Name + "Fallback", &desc, state);
+        resource->LockState(true); // 和环形 buffer 保持一致
+        return resource;
     }
 
-    void GfxBufferLinearSubAllocator::DeferredRelease(const GfxBufferSubAllocation& allocation)
+    void GfxBufferRingSubAllocator::DeferredRelease(const GfxBufferSubAllocation& allocation)
     {
         // Do Nothing
     }
 
-    void GfxBufferLinearSubAllocator::CleanUpAllocations()
+    void GfxBufferRingSubAllocator::CleanUpAllocations()
     {
-        uint64_t nextFence = m_Device->GetNextFence();
+        // 在帧末调用，这时没有其他线程在分配
+        m_FrameEnds.emplace(m_Device->GetNextFence(), m_Head.load(std::memory_order_relaxed));
 
-        for (RefCountPtr<GfxResource>& page : m_Pages)
+        while (!m_FrameEnds.empty() && m_Device->IsFenceCompleted(m_FrameEnds.front().first))
         {
-            m_ReleaseQueue.emplace(nextFence, std::move(page));
+            m_Tail.store(m_FrameEnds.front().second, std::memory_order_release);
+            m_FrameEnds.pop();
         }
 
-        m_Allocator->Reset();
-        m_Pages.clear();
-        m_LargePages.clear();
+        m_LastFrameStats.AllocatedBytes = m_FrameAllocatedBytes.exchange(0, std::memory_order_relaxed);
+        m_LastFrameStats.WastedBytes = m_FrameWastedBytes.exchange(0, std::memory_order_relaxed);
+        m_LastFrameStats.FallbackBytes = m_FrameFallbackBytes.exchange(0, std::memory_order_relaxed);
+        m_LastFrameStats.NumAllocations = m_FrameNumAllocations.exchange(0, std::memory_order_relaxed);
+        m_LastFrameStats.NumFallbacks = m_FrameNumFallbacks.exchange(0, std::memory_order_relaxed);
     }
 }
@@ -2,6 +2,7 @@
 #include "Engine/Rendering/D3D12Impl/GfxCommand.h"
 #include "Engine/Rendering/D3D12Impl/GfxDevice.h"
 #include "Engine/Rendering/D3D12Impl/GfxResource.h"
+#include "Engine/Rendering/D3D12Impl/GfxResourceState.h"
 #include "Engine/Rendering/D3D12Impl/GfxMesh.h"
 #include "Engine/Rendering/D3D12Impl/Material.h"
 #include "Engine/Rendering/D3D12Impl/ShaderUtils.h"
@@ -10,6 +11,7 @@
 #include "Engine/Debug.h"
 #include "Engine/Transform.h"
 #include <assert.h>
+#include <algorithm>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-but-set-variable"
@@ -74,8 +76,12 @@ namespace march
         , m_Type(type)
         , m_CommandAllocator(nullptr)
         , m_CommandList(nullptr)
+        , m_CommandList4(nullptr)
         , m_ResourceBarriers{}
         , m_SyncPointsToWait{}
+        , m_PendingSplitTransitions{}
+        , m_UseLocalResourceStates(false)
+        , m_LocalResourceStates{}
         , m_GraphicsViewCache(device)
         , m_ComputeViewCache(device)
         , m_ViewHeap(nullptr)
@@ -87,6 +93,7 @@ namespace march
         , m_NumScissorRects(0)
         , m_ScissorRects{}
         , m_OutputDesc{}
+        , m_RenderPass{}
         , m_CurrentPredicationBuffer(nullptr)
         , m_CurrentPredicationOffset(0)
         , m_CurrentPredicationOperation(D3D12_PREDICATION_OP_EQUAL_ZERO)
@@ -98,6 +105,7 @@ namespace march
         , m_GlobalTextures{}
         , m_GlobalBuffers{}
         , m_InstanceBuffer{ device, "_InstanceBuffer" }
+        , m_CurrentInstanceBuffer(&m_InstanceBuffer)
         , m_NsightAftermathHandle(nullptr)
     {
     }
@@ -119,6 +127,7 @@ namespace march
         {
             CHECK_HR(m_Device->GetD3DDevice4()->CreateCommandList(0, queue->GetType(),
                 m_CommandAllocator.Get(), nullptr, IID_PPV_ARGS(&m_CommandList)));
+            CHECK_HR(m_CommandList.As(&m_CommandList4));
 
             m_NsightAftermathHandle = NsightAftermath::CreateContextHandle(m_CommandList.Get());
         }
@@ -133,7 +142,14 @@ namespace march
         GfxCommandManager* manager = m_Device->GetCommandManager();
         GfxCommandQueue* queue = manager->GetQueue(m_Type);
 
+        if (m_RenderPass.IsActive)
+        {
+            LOG_WARNING("Render pass is not ended before submitting");
+            EndRenderPass();
+        }
+
         // 准备好所有命令，然后关闭
+        EndAllPendingSplitTransitions();
         FlushResourceBarriers();
         CHECK_HR(m_CommandList->Close());
 
@@ -152,6 +168,8 @@ namespace march
         m_CommandAllocator = nullptr;
         m_ResourceBarriers.clear();
         m_SyncPointsToWait.clear();
+        m_UseLocalResourceStates = false;
+        m_LocalResourceStates.clear();
         m_GraphicsViewCache.Reset();
         m_ComputeViewCache.Reset();
         m_ViewHeap = nullptr;
@@ -161,6 +179,7 @@ namespace march
         m_NumViewports = 0;
         m_NumScissorRects = 0;
         m_OutputDesc = {};
+        m_RenderPass = {};
         m_CurrentPredicationBuffer = nullptr;
         m_CurrentPredicationOffset = 0;
         m_CurrentPredicationOperation = D3D12_PREDICATION_OP_EQUAL_ZERO;
@@ -172,15 +191,16 @@ namespace march
         m_GlobalTextures.clear();
         m_GlobalBuffers.clear();
         m_InstanceBuffer.ReleaseResource();
+        m_CurrentInstanceBuffer = &m_InstanceBuffer;
 
         // 回收
         manager->RecycleContext(this);
         return syncPoint;
     }
 
-    void GfxCommandContext::BeginEvent(const std::string& name)
+    void GfxCommandContext::BeginEvent(const char* name)
     {
-        PIXBeginEvent(m_CommandList.Get(), 0, name.c_str());
+        PIXBeginEvent(m_CommandList.Get(), 0, name);
         NsightAftermath::SetEventMarker(m_NsightAftermathHandle, name);
     }
 
@@ -190,27 +210,47 @@ namespace march
         NsightAftermath::SetEventMarker(m_NsightAftermathHandle, "EndEvent");
     }
 
-    static bool NeedTransition(D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+    void GfxCommandContext::TransitionResource(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter)
     {
-        if (stateAfter == D3D12_RESOURCE_STATE_COMMON)
+        if (m_UseLocalResourceStates && !resource->IsStateLocked())
         {
-            // https://learn.microsoft.com/en-us/windows/win32/api/d3d12/ne-d3d12-d3d12_resource_states
-            // D3D12_RESOURCE_STATE_COMMON 为 0，要特殊处理
-            return stateBefore != stateAfter;
-        }
-        else
-        {
-            return (stateBefore & stateAfter) != stateAfter;
+            LocalResourceState& local = GetLocalResourceState(resource);
+
+            // 所有 subresource 都需要从同一个 state 转换时，只用一个 barrier
+            D3D12_RESOURCE_STATES stateBefore = local.CurrentStates[0];
+            bool canMerge = stateBefore != GfxResourceStateUtils::LocalStateUnknown && GfxResourceStateUtils::NeedTransition(stateBefore, stateAfter);
+
+            for (size_t i = 1; canMerge && i < local.CurrentStates.size(); i++)
+            {
+                canMerge = local.CurrentStates[i] == stateBefore;
+            }
+
+            if (canMerge)
+            {
+                ID3D12Resource* res = resource->GetD3DResource();
+                m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, stateBefore, stateAfter));
+                std::fill(local.CurrentStates.begin(), local.CurrentStates.end(), stateAfter);
+                std::fill(local.HasBarriers.begin(), local.HasBarriers.end(), true);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < resource->GetSubresourceCount(); i++)
+                {
+                    TransitionLocalSubresource(local, i, stateAfter);
+                }
+            }
+
+            return;
         }
-    }
 
-    void GfxCommandContext::TransitionResource(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter)
-    {
+        // 还在 split barrier 中间的资源要先结束转换
+        EndPendingSplitTransition(resource.Get());
+
         if (resource->AreAllSubresourceStatesSame())
         {
             D3D12_RESOURCE_STATES stateBefore = resource->GetState(0);
 
-            if (NeedTransition(stateBefore, stateAfter))
+            if (GfxResourceStateUtils::NeedTransition(stateBefore, stateAfter))
             {
                 ID3D12Resource* res = resource->GetD3DResource();
                 m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, stateBefore, stateAfter));
@@ -244,9 +284,17 @@ namespace march
 
     void GfxCommandContext::TransitionSubresource(RefCountPtr<GfxResource> resource, uint32_t subresource, D3D12_RESOURCE_STATES stateAfter)
     {
+        if (m_UseLocalResourceStates && !resource->IsStateLocked())
+        {
+            TransitionLocalSubresource(GetLocalResourceState(resource), subresource, stateAfter);
+            return;
+        }
+
+        EndPendingSplitTransition(resource.Get());
+
         D3D12_RESOURCE_STATES stateBefore = resource->GetState(subresource);
 
-        if (NeedTransition(stateBefore, stateAfter))
+        if (GfxResourceStateUtils::NeedTransition(stateBefore, stateAfter))
         {
             ID3D12Resource* res = resource->GetD3DResource();
             m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, stateBefore, stateAfter, static_cast<UINT>(subresource)));
@@ -265,12 +313,232 @@ namespace march
 
         if (!m_ResourceBarriers.empty())
         {
+            // render pass 中不能有 barrier
+            if (m_RenderPass.IsRecording)
+            {
+                m_CommandList4->EndRenderPass();
+                m_RenderPass.IsRecording = false;
+            }
+
             UINT count = static_cast<UINT>(m_ResourceBarriers.size());
             m_CommandList->ResourceBarrier(count, m_ResourceBarriers.data());
             m_ResourceBarriers.clear();
+
+            for (PendingSplitTransition& pending : m_PendingSplitTransitions)
+            {
+                pending.BarrierIndex = static_cast<size_t>(-1);
+            }
+        }
+    }
+
+    void GfxCommandContext::BeginSplitTransition(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter)
+    {
+        // 在多个线程中录制时，资源的 state 要到 ResolveLocalResourceStates 才知道
+        if (m_UseLocalResourceStates || resource->IsStateLocked() || !resource->AreAllSubresourceStatesSame())
+        {
+            return;
+        }
+
+        EndPendingSplitTransition(resource.Get());
+
+        D3D12_RESOURCE_STATES stateBefore = resource->GetState(0);
+
+        if (!GfxResourceStateUtils::NeedTransition(stateBefore, stateAfter))
+        {
+            return;
+        }
+
+        ID3D12Resource* res = resource->GetD3DResource();
+        m_PendingSplitTransitions.push_back({ resource, stateBefore, stateAfter, m_ResourceBarriers.size() });
+        m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, stateBefore, stateAfter,
+            D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+
+        // Begin 和 End 之间不会使用这个资源，提前记录最终的 state
+        resource->SetState(stateAfter);
+    }
+
+    void GfxCommandContext::EndSplitTransition(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter)
+    {
+        // 没有对应的 Begin 时，TransitionResource 就是普通的转换
+        TransitionResource(resource, stateAfter);
+    }
+
+    void GfxCommandContext::EndPendingSplitTransition(GfxResource* resource)
+    {
+        for (size_t i = 0; i < m_PendingSplitTransitions.size(); i++)
+        {
+            PendingSplitTransition& pending = m_PendingSplitTransitions[i];
+
+            if (pending.Resource.Get() != resource)
+            {
+                continue;
+            }
+
+            if (pending.BarrierIndex != static_cast<size_t>(-1))
+            {
+                // begin barrier 还没提交，直接改成普通的 barrier
+                m_ResourceBarriers[pending.BarrierIndex].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            }
+            else
+            {
+                ID3D12Resource* res = resource->GetD3DResource();
+                m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, pending.StateBefore, pending.StateAfter,
+                    D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+            }
+
+            m_PendingSplitTransitions[i] = std::move(m_PendingSplitTransitions.back());
+            m_PendingSplitTransitions.pop_back();
+            return;
+        }
+    }
+
+    void GfxCommandContext::EndAllPendingSplitTransitions()
+    {
+        while (!m_PendingSplitTransitions.empty())
+        {
+            EndPendingSplitTransition(m_PendingSplitTransitions.back().Resource.Get());
         }
     }
 
+    void GfxCommandContext::AliasingBarrier(RefCountPtr<GfxResource> resourceAfter)
+    {
+        if (m_UseLocalResourceStates && !resourceAfter->IsStateLocked())
+        {
+            // aliasing 之后资源的内容无效，之后的 barrier 直接从创建时的 state 开始转换，不需要补 barrier
+            LocalResourceState& local = GetLocalResourceState(resourceAfter);
+
+            for (uint32_t i = 0; i < resourceAfter->GetSubresourceCount(); i++)
+            {
+                if (local.CurrentStates[i] == GfxResourceStateUtils::LocalStateUnknown)
+                {
+                    local.CurrentStates[i] = resourceAfter->GetState(i);
+                }
+            }
+        }
+
+        // before 为 nullptr 表示可能和任何 placed resource 重叠
+        m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resourceAfter->GetD3DResource()));
+    }
+
+    void GfxCommandContext::EnableLocalResourceStates()
+    {
+        assert(m_LocalResourceStates.empty());
+        m_UseLocalResourceStates = true;
+    }
+
+    void GfxCommandContext::ResolveLocalResourceStates(GfxCommandContext* previous)
+    {
+        assert(m_UseLocalResourceStates);
+
+        for (auto& [_, local] : m_LocalResourceStates)
+        {
+            GfxResource* resource = local.Resource.Get();
+            ID3D12Resource* res = resource->GetD3DResource();
+            uint32_t count = resource->GetSubresourceCount();
+
+            // barrier 要补在 previous 的末尾，所以要先结束 previous 中的 split barrier
+            previous->EndPendingSplitTransition(resource);
+
+            auto resolve = [resource, &local](uint32_t i)
+            {
+                return GfxResourceStateUtils::ResolveLocalState(resource->GetState(i), local.FirstStates[i], local.CurrentStates[i], local.HasBarriers[i]);
+            };
+
+            // 所有 subresource 都需要从同一个 state 转换到同一个 state 时，只用一个 barrier
+            D3D12_RESOURCE_STATES firstState = local.FirstStates[0];
+            bool isUniform = resource->AreAllSubresourceStatesSame();
+
+            for (uint32_t i = 0; isUniform && i < count; i++)
+            {
+                isUniform = resolve(i).NeedBarrier && local.FirstStates[i] == firstState;
+            }
+
+            if (isUniform)
+            {
+                previous->m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, resource->GetState(0), firstState));
+            }
+            else
+            {
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    if (resolve(i).NeedBarrier)
+                    {
+                        D3D12_RESOURCE_STATES stateBefore = resource->GetState(i);
+                        D3D12_RESOURCE_STATES stateAfter = local.FirstStates[i];
+                        previous->m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, stateBefore, stateAfter, static_cast<UINT>(i)));
+                    }
+                }
+            }
+
+            // 写回最终的 state
+            D3D12_RESOURCE_STATES lastState = resolve(0).FinalState;
+            bool isLastUniform = true;
+
+            for (uint32_t i = 1; isLastUniform && i < count; i++)
+            {
+                isLastUniform = resolve(i).FinalState == lastState;
+            }
+
+            if (isLastUniform)
+            {
+                resource->SetState(lastState);
+            }
+            else
+            {
+                // 每个 subresource 只读写自己的 state，可以边算边写
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    resource->SetState(resolve(i).FinalState, i);
+                }
+            }
+        }
+
+        m_LocalResourceStates.clear();
+        m_UseLocalResourceStates = false;
+    }
+
+    GfxCommandContext::LocalResourceState& GfxCommandContext::GetLocalResourceState(const RefCountPtr<GfxResource>& resource)
+    {
+        auto [it, isNew] = m_LocalResourceStates.try_emplace(resource.Get());
+
+        if (isNew)
+        {
+            it->second.Resource = resource;
+            it->second.FirstStates.assign(resource->GetSubresourceCount(), GfxResourceStateUtils::LocalStateUnknown);
+            it->second.CurrentStates.assign(resource->GetSubresourceCount(), GfxResourceStateUtils::LocalStateUnknown);
+            it->second.HasBarriers.assign(resource->GetSubresourceCount(), false);
+        }
+
+        return it->second;
+    }
+
+    void GfxCommandContext::TransitionLocalSubresource(LocalResourceState& local, uint32_t subresource, D3D12_RESOURCE_STATES stateAfter)
+    {
+        D3D12_RESOURCE_STATES stateBefore = local.CurrentStates[subresource];
+
+        if (stateBefore == GfxResourceStateUtils::LocalStateUnknown)
+        {
+            // 第一次使用，barrier 在 ResolveLocalResourceStates 中补上
+            local.FirstStates[subresource] = stateAfter;
+            local.CurrentStates[subresource] = stateAfter;
+        }
+        else if (GfxResourceStateUtils::NeedTransition(stateBefore, stateAfter))
+        {
+            ID3D12Resource* res = local.Resource->GetD3DResource();
+            m_ResourceBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(res, stateBefore, stateAfter, static_cast<UINT>(subresource)));
+            local.CurrentStates[subresource] = stateAfter;
+            local.HasBarriers[subresource] = true;
+        }
+    }
+
+    void GfxCommandContext::DiscardResource(RefCountPtr<GfxResource> resource)
+    {
+        // Discard 要求资源已经在 RENDER_TARGET 或 DEPTH_WRITE 状态
+        InterruptRenderPass();
+        FlushResourceBarriers();
+        m_CommandList->DiscardResource(resource->GetD3DResource(), nullptr);
+    }
+
     void GfxCommandContext::WaitOnGpu(const GfxSyncPoint& syncPoint)
     {
         m_SyncPointsToWait.push_back(syncPoint);
@@ -337,7 +605,7 @@ namespace march
         SetRenderTargets(numColorTargets, colorTargets, &depthStencilTarget);
     }
 
-    void GfxCommandContext::SetRenderTargets(uint32_t numColorTargets, const GfxRenderTargetDesc* colorTargets, const GfxRenderTargetDesc* depthStencilTarget)
+    void GfxCommandContext::SetRenderTargets(uint32_t numColorTargets, const GfxRenderTargetDesc* colorTargets, const GfxRenderTargetDesc* depthStencilTarget, bool bindOutputMerger)
     {
         assert(numColorTargets <= D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
 
@@ -347,6 +615,17 @@ namespace march
             return;
         }
 
+        if (bindOutputMerger && m_RenderPass.IsActive)
+        {
+            // 已经由 render pass 绑定了
+            if (IsRenderPassTargets(numColorTargets, colorTargets, depthStencilTarget))
+            {
+                return;
+            }
+
+            AbortRenderPass();
+        }
+
         bool isDirty = false;
 
         if (m_OutputDesc.NumRTV != numColorTargets)
@@ -404,12 +683,230 @@ namespace march
         if (isDirty)
         {
             m_OutputDesc.MarkDirty();
+        }
 
+        if (isDirty && bindOutputMerger)
+        {
             const D3D12_CPU_DESCRIPTOR_HANDLE* pDsv = (depthStencilTarget != nullptr) ? &dsv : nullptr;
             m_CommandList->OMSetRenderTargets(static_cast<UINT>(numColorTargets), rtv, FALSE, pDsv);
         }
     }
 
+    void GfxCommandContext::ResetRenderTargetBindings()
+    {
+        // render pass 结束后 render target 不再绑定，下次 SetRenderTargets 时要重新设置
+        memset(m_ColorTargets, 0, sizeof(m_ColorTargets));
+        m_DepthStencilTarget = RenderTargetData{};
+        m_OutputDesc.NumRTV = 0;
+        m_OutputDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+        m_OutputDesc.MarkDirty();
+    }
+
+    static bool IsSameRenderTarget(const GfxRenderTargetDesc& a, const GfxRenderTargetDesc& b)
+    {
+        return a.Texture == b.Texture && a.Face == b.Face && a.WOrArraySlice == b.WOrArraySlice && a.MipSlice == b.MipSlice;
+    }
+
+    bool GfxCommandContext::IsRenderPassTargets(uint32_t numColorTargets, const GfxRenderTargetDesc* colorTargets, const GfxRenderTargetDesc* depthStencilTarget) const
+    {
+        if (numColorTargets != m_RenderPass.NumColorTargets || (depthStencilTarget != nullptr) != m_RenderPass.HasDepthStencilTarget)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < numColorTargets; i++)
+        {
+            if (!IsSameRenderTarget(colorTargets[i], m_RenderPass.ColorTargets[i].Target))
+            {
+                return false;
+            }
+        }
+
+        return depthStencilTarget == nullptr || IsSameRenderTarget(*depthStencilTarget, m_RenderPass.DepthStencilTarget.Target);
+    }
+
+    static D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE GetBeginningAccessType(GfxRenderPassBeginAccess access)
+    {
+        switch (access)
+        {
+        case GfxRenderPassBeginAccess::Discard:
+            return D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_DISCARD;
+        case GfxRenderPassBeginAccess::Clear:
+            return D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR;
+        default:
+            return D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+        }
+    }
+
+    void GfxCommandContext::BeginRenderPass(uint32_t numColorTargets, const GfxRenderPassColorTarget* colorTargets, const GfxRenderPassDepthStencilTarget* depthStencilTarget)
+    {
+        assert(numColorTargets <= D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT);
+
+        if (m_RenderPass.IsActive)
+        {
+            LOG_WARNING("Render pass is not ended before beginning a new one");
+            EndRenderPass();
+        }
+
+        GfxRenderTargetDesc targets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+        GfxRenderTargetDesc depthStencil{};
+
+        m_RenderPass.NumColorTargets = numColorTargets;
+        m_RenderPass.HasDepthStencilTarget = depthStencilTarget != nullptr;
+        m_RenderPass.NeedClear = false;
+
+        for (uint32_t i = 0; i < numColorTargets; i++)
+        {
+            targets[i] = colorTargets[i].Target;
+            m_RenderPass.ColorTargets[i] = colorTargets[i];
+            m_RenderPass.NeedClear |= colorTargets[i].BeginAccess == GfxRenderPassBeginAccess::Clear;
+        }
+
+        if (depthStencilTarget != nullptr)
+        {
+            depthStencil = depthStencilTarget->Target;
+            m_RenderPass.DepthStencilTarget = *depthStencilTarget;
+            m_RenderPass.NeedClear |= depthStencilTarget->BeginAccess == GfxRenderPassBeginAccess::Clear;
+        }
+
+        // 不绑定到 OM，只转换 state 和更新 m_OutputDesc，render pass 开始时会绑定
+        // 在 render pass 外提交 barrier
+        SetRenderTargets(numColorTargets, targets, depthStencilTarget != nullptr ? &depthStencil : nullptr, /* bindOutputMerger */ false);
+        FlushResourceBarriers();
+
+        m_RenderPass.IsActive = true;
+        m_RenderPass.IsRecording = false;
+        m_RenderPass.IsFirstSegment = true;
+    }
+
+    void GfxCommandContext::EndRenderPass()
+    {
+        if (!m_RenderPass.IsActive)
+        {
+            LOG_WARNING("EndRenderPass called without BeginRenderPass");
+            return;
+        }
+
+        InterruptRenderPass();
+
+        m_RenderPass.IsActive = false;
+        ResetRenderTargetBindings();
+
+        // 之后不再使用的 render target，告诉驱动不用保留内容
+        for (uint32_t i = 0; i < m_RenderPass.NumColorTargets; i++)
+        {
+            const GfxRenderPassColorTarget& target = m_RenderPass.ColorTargets[i];
+
+            if (target.EndAccess == GfxRenderPassEndAccess::Discard)
+            {
+                DiscardResource(target.Target.Texture->GetUnderlyingResource());
+            }
+        }
+
+        if (m_RenderPass.HasDepthStencilTarget && m_RenderPass.DepthStencilTarget.EndAccess == GfxRenderPassEndAccess::Discard)
+        {
+            DiscardResource(m_RenderPass.DepthStencilTarget.Target.Texture->GetUnderlyingResource());
+        }
+    }
+
+    void GfxCommandContext::ResumeRenderPass()
+    {
+        if (!m_RenderPass.IsActive || m_RenderPass.IsRecording)
+        {
+            return;
+        }
+
+        // 第一次开始时使用 BeginAccess，之后都是被打断后继续，要保留之前的内容
+        bool isFirst = m_RenderPass.IsFirstSegment;
+
+        D3D12_RENDER_PASS_RENDER_TARGET_DESC rtDescs[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+
+        for (uint32_t i = 0; i < m_RenderPass.NumColorTargets; i++)
+        {
+            const GfxRenderPassColorTarget& target = m_RenderPass.ColorTargets[i];
+            D3D12_RENDER_PASS_RENDER_TARGET_DESC& desc = rtDescs[i];
+
+            desc.cpuDescriptor = m_ColorTargets[i].RtvDsv;
+            desc.BeginningAccess.Type = isFirst ? GetBeginningAccessType(target.BeginAccess) : D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+            desc.EndingAccess.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+
+            if (desc.BeginningAccess.Type == D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR)
+            {
+                D3D12_CLEAR_VALUE& clearValue = desc.BeginningAccess.Clear.ClearValue;
+                clearValue.Format = target.Target.Texture->GetDesc().GetRtvDsvDXGIFormat();
+                std::copy_n(target.ClearColor, 4, clearValue.Color);
+            }
+        }
+
+        D3D12_RENDER_PASS_DEPTH_STENCIL_DESC dsDesc{};
+
+        if (m_RenderPass.HasDepthStencilTarget)
+        {
+            const GfxRenderPassDepthStencilTarget& target = m_RenderPass.DepthStencilTarget;
+            const GfxTextureDesc& texDesc = target.Target.Texture->GetDesc();
+
+            dsDesc.cpuDescriptor = m_DepthStencilTarget.RtvDsv;
+            dsDesc.DepthBeginningAccess.Type = isFirst ? GetBeginningAccessType(target.BeginAccess) : D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+            dsDesc.DepthEndingAccess.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+
+            if (dsDesc.DepthBeginningAccess.Type == D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR)
+            {
+                D3D12_CLEAR_VALUE& clearValue = dsDesc.DepthBeginningAccess.Clear.ClearValue;
+                clearValue.Format = texDesc.GetRtvDsvDXGIFormat();
+                clearValue.DepthStencil.Depth = target.ClearDepth;
+                clearValue.DepthStencil.Stencil = static_cast<UINT8>(target.ClearStencil);
+            }
+
+            if (texDesc.HasStencil())
+            {
+                dsDesc.StencilBeginningAccess = dsDesc.DepthBeginningAccess;
+                dsDesc.StencilEndingAccess = dsDesc.DepthEndingAccess;
+            }
+            else
+            {
+                dsDesc.StencilBeginningAccess.Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS;
+                dsDesc.StencilEndingAccess.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_NO_ACCESS;
+            }
+        }
+
+        const D3D12_RENDER_PASS_DEPTH_STENCIL_DESC* pDsDesc = m_RenderPass.HasDepthStencilTarget ? &dsDesc : nullptr;
+        m_CommandList4->BeginRenderPass(static_cast<UINT>(m_RenderPass.NumColorTargets), rtDescs, pDsDesc, D3D12_RENDER_PASS_FLAG_NONE);
+
+        m_RenderPass.IsRecording = true;
+        m_RenderPass.IsFirstSegment = false;
+    }
+
+    void GfxCommandContext::InterruptRenderPass()
+    {
+        if (!m_RenderPass.IsActive)
+        {
+            return;
+        }
+
+        // 还没有 draw，但之后的操作可能用到 render target，所以要先 clear
+        if (m_RenderPass.IsFirstSegment && m_RenderPass.NeedClear)
+        {
+            FlushResourceBarriers();
+            ResumeRenderPass();
+        }
+
+        if (m_RenderPass.IsRecording)
+        {
+            m_CommandList4->EndRenderPass();
+            m_RenderPass.IsRecording = false;
+        }
+
+        m_RenderPass.IsFirstSegment = false;
+    }
+
+    void GfxCommandContext::AbortRenderPass()
+    {
+        // 换了 render target，之后不再使用 render pass，也不能丢弃内容
+        InterruptRenderPass();
+        m_RenderPass.IsActive = false;
+        ResetRenderTargetBindings();
+    }
+
     D3D12_CPU_DESCRIPTOR_HANDLE GfxCommandContext::GetRtvDsvFromRenderTargetDesc(const GfxRenderTargetDesc& desc)
     {
         switch (desc.Texture->GetDesc().Dimension)
@@ -442,6 +939,7 @@ namespace march
 
         if (clearColor || clearDepthStencil != 0)
         {
+            InterruptRenderPass();
             FlushResourceBarriers();
 
             if (clearColor)
@@ -467,6 +965,7 @@ namespace march
             return;
         }
 
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         m_CommandList->ClearRenderTargetView(m_ColorTargets[index].RtvDsv, color, 0, nullptr);
@@ -480,6 +979,7 @@ namespace march
             return;
         }
 
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         constexpr D3D12_CLEAR_FLAGS flags = D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL;
@@ -600,6 +1100,7 @@ namespace march
             if (buffer != nullptr)
             {
                 TransitionResource(buffer->GetUnderlyingResource(), D3D12_RESOURCE_STATE_PREDICATION);
+                InterruptRenderPass();
                 FlushResourceBarriers();
 
                 m_CommandList->SetPredication(buffer->GetUnderlyingD3DResource(), static_cast<UINT64>(alignedOffset), operation);
@@ -656,7 +1157,14 @@ namespace march
         return nullptr;
     }
 
-    static int32_t g_InstanceBufferId = ShaderUtils::GetIdFromString("_InstanceBuffer");
+    // 不能在静态初始化时查 id，那时 ShaderUtils 里的表可能还没构造
+    static constexpr ShaderStringKey g_InstanceBufferKey("_InstanceBuffer");
+
+    static int32_t GetInstanceBufferId()
+    {
+        static int32_t id = ShaderUtils::GetIdFromString(g_InstanceBufferKey);
+        return id;
+    }
 
     GfxBuffer* GfxCommandContext::FindGraphicsBuffer(int32_t id, bool isConstantBuffer, Material* material, size_t passIndex, GfxBufferElement* pOutElement)
     {
@@ -670,10 +1178,10 @@ namespace march
         }
         else
         {
-            if (id == g_InstanceBufferId)
+            if (id == GetInstanceBufferId())
             {
                 *pOutElement = GfxBufferElement::StructuredData;
-                return &m_InstanceBuffer;
+                return m_CurrentInstanceBuffer;
             }
         }
 
@@ -689,6 +1197,7 @@ namespace march
         desc.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
 
         m_InstanceBuffer.SetData(desc, instances);
+        m_CurrentInstanceBuffer = &m_InstanceBuffer;
     }
 
     void GfxCommandContext::SetGraphicsPipelineParameters(Material* material, size_t passIndex)
@@ -720,10 +1229,11 @@ namespace march
         SetResolvedRenderState(material->GetResolvedRenderState(passIndex));
     }
 
-    void GfxCommandContext::UpdateGraphicsPipelineInstanceDataParameter(uint32_t numInstances, const MeshRendererBatch::InstanceData* instances)
+    void GfxCommandContext::UpdateGraphicsPipelineInstanceDataParameter(uint32_t firstInstance)
     {
-        SetInstanceBufferData(numInstances, instances);
-        m_GraphicsViewCache.UpdateSrvCbvBuffer(g_InstanceBufferId, &m_InstanceBuffer, GfxBufferElement::StructuredData);
+        // SV_InstanceID 不包括 StartInstanceLocation，所以把偏移加到 root srv 的地址上
+        uint32_t offset = firstInstance * static_cast<uint32_t>(sizeof(MeshRendererBatch::InstanceData));
+        m_GraphicsViewCache.UpdateSrvCbvBuffer(GetInstanceBufferId(), m_CurrentInstanceBuffer, GfxBufferElement::StructuredData, offset);
     }
 
     void GfxCommandContext::ApplyGraphicsPipelineParameters(ID3D12PipelineState* pso)
@@ -888,6 +1398,7 @@ namespace march
         SetVertexBuffer(subMesh.VertexBuffer);
         SetIndexBuffer(subMesh.IndexBuffer);
         FlushResourceBarriers();
+        ResumeRenderPass();
 
         m_CommandList->DrawIndexedInstanced(
             static_cast<UINT>(subMesh.SubMesh.IndexCount),
@@ -920,7 +1431,10 @@ namespace march
         const GfxInputDesc& inputDesc = batch.GetMeshInputDesc();
         SetPrimitiveTopology(inputDesc.GetPrimitiveTopology());
 
-        for (const auto& [drawCall, instances] : batch.GetDrawCalls())
+        // 所有 instance 在 Rebuild 时已经上传好了，每个 draw call 只需要修改起始位置
+        m_CurrentInstanceBuffer = batch.GetInstanceBuffer();
+
+        for (const MeshRendererBatch::DrawCall& drawCall : batch.GetDrawCalls())
         {
             // Shader Break
             if (Shader* s = drawCall.Mat->GetShader(); shader != s)
@@ -935,7 +1449,7 @@ namespace march
                 continue;
             }
 
-            uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+            uint32_t instanceCount = drawCall.InstanceCount;
 
             // Material Break
             if (material != drawCall.Mat)
@@ -947,14 +1461,11 @@ namespace march
                 material = drawCall.Mat;
                 pso = nullptr; // Break PSO
 
-                SetInstanceBufferData(instanceCount, instances.data());
                 SetGraphicsPipelineParameters(material, *passIndex);
             }
-            else
-            {
-                // Material 相同的话，只需要修改 InstanceBuffer，其他参数都和之前一样
-                UpdateGraphicsPipelineInstanceDataParameter(instanceCount, instances.data());
-            }
+
+            // Material 相同的话，只需要修改 InstanceBuffer 的起始位置，其他参数都和之前一样
+            UpdateGraphicsPipelineInstanceDataParameter(drawCall.FirstInstance);
 
             // Mesh Break
             if (mesh != drawCall.Mesh)
@@ -984,6 +1495,7 @@ namespace march
 
             ApplyGraphicsPipelineParameters(pso);
             FlushResourceBarriers();
+            ResumeRenderPass();
 
             const GfxSubMesh& subMesh = drawCall.Mesh->GetSubMesh(drawCall.SubMeshIndex);
             m_CommandList->DrawIndexedInstanced(
@@ -994,6 +1506,8 @@ namespace march
                 0);
         }
 
+        m_CurrentInstanceBuffer = &m_InstanceBuffer;
+
         if (material != nullptr) EndEvent();
         EndEvent();
     }
@@ -1014,6 +1528,7 @@ namespace march
     void GfxCommandContext::DispatchCompute(ComputeShader* shader, size_t kernelIndex, uint32_t threadGroupCountX, uint32_t threadGroupCountY, uint32_t threadGroupCountZ)
     {
         SetAndApplyComputePipelineParameters(shader->GetPSO(kernelIndex), shader, kernelIndex);
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         m_CommandList->Dispatch(
@@ -1051,6 +1566,7 @@ namespace march
     {
         TransitionResource(source->GetUnderlyingResource(), D3D12_RESOURCE_STATE_RESOLVE_SOURCE);
         TransitionResource(destination->GetUnderlyingResource(), D3D12_RESOURCE_STATE_RESOLVE_DEST);
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         m_CommandList->ResolveSubresource(
@@ -1096,6 +1612,7 @@ namespace march
 
         TransitionResource(sourceBuffer->GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_SOURCE);
         TransitionResource(destinationBuffer->GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_DEST);
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         uint32_t srcOffset = sourceBuffer->GetOffsetInBytes(sourceElement) + sourceOffsetInBytes;
@@ -1123,6 +1640,7 @@ namespace march
 
         TransitionResource(tempBuffer.GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_SOURCE);
         TransitionResource(destination, D3D12_RESOURCE_STATE_COPY_DEST);
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         ::UpdateSubresources(
@@ -1150,6 +1668,7 @@ namespace march
 
         TransitionResource(sourceTexture->GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_SOURCE);
         TransitionResource(destinationTexture->GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_DEST);
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         CD3DX12_TEXTURE_COPY_LOCATION src(sourceTexture->GetUnderlyingD3DResource(), static_cast<UINT>(srcSubresource));
@@ -1174,6 +1693,7 @@ namespace march
 
         TransitionResource(sourceTexture->GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_SOURCE);
         TransitionResource(destinationTexture->GetUnderlyingResource(), D3D12_RESOURCE_STATE_COPY_DEST);
+        InterruptRenderPass();
         FlushResourceBarriers();
 
         CD3DX12_TEXTURE_COPY_LOCATION src(sourceTexture->GetUnderlyingD3DResource(), static_cast<UINT>(srcSubresource));
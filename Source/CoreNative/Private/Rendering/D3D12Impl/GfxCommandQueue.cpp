@@ -15,6 +15,7 @@ namespace march
         , m_Type(desc.Type)
         , m_Queue(nullptr)
         , m_CommandAllocators{}
+        , m_CommandAllocatorMutex{}
     {
         D3D12_COMMAND_QUEUE_DESC queueDesc{};
         queueDesc.Type = desc.Type;
@@ -46,11 +47,18 @@ namespace march
     {
         ComPtr<ID3D12CommandAllocator> result = nullptr;
 
-        if (!m_CommandAllocators.empty() && m_Fence->IsCompleted(m_CommandAllocators.front().first))
         {
-            result = m_CommandAllocators.front().second;
-            m_CommandAllocators.pop();
+            std::lock_guard<std::mutex> lock(m_CommandAllocatorMutex);
 
+            if (!m_CommandAllocators.empty() && m_Fence->IsCompleted(m_CommandAllocators.front().first))
+            {
+                result = m_CommandAllocators.front().second;
+                m_CommandAllocators.pop();
+            }
+        }
+
+        if (result != nullptr)
+        {
             // Reuse the memory associated with command recording.
             // We can only reset when the associated command lists have finished execution on the GPU.
             CHECK_HR(result->Reset());
@@ -66,6 +74,8 @@ namespace march
     GfxSyncPoint GfxCommandQueue::ReleaseCommandAllocator(ComPtr<ID3D12CommandAllocator> allocator)
     {
         GfxSyncPoint syncPoint = CreateSyncPoint();
+
+        std::lock_guard<std::mutex> lock(m_CommandAllocatorMutex);
         m_CommandAllocators.emplace(syncPoint.m_Value, allocator);
         return syncPoint;
     }
@@ -73,6 +83,7 @@ namespace march
     GfxCommandManager::GfxCommandManager(GfxDevice* device)
         : m_Device(device)
         , m_ContextStore{}
+        , m_ContextMutex{}
         , m_CompletedFrameFence(0)
     {
         GfxCommandQueueDesc queueDesc{};
@@ -114,26 +125,32 @@ namespace march
 
     GfxCommandContext* GfxCommandManager::RequestAndOpenContext(GfxCommandType type)
     {
-        std::queue<GfxCommandContext*>& q = m_QueueData[static_cast<size_t>(type)].FreeContexts;
         GfxCommandContext* result;
 
-        if (!q.empty())
-        {
-            result = q.front();
-            q.pop();
-        }
-        else
         {
-            m_ContextStore.push_back(std::make_unique<GfxCommandContext>(m_Device, type));
-            result = m_ContextStore.back().get();
+            std::lock_guard<std::mutex> lock(m_ContextMutex);
+            std::queue<GfxCommandContext*>& q = m_QueueData[static_cast<size_t>(type)].FreeContexts;
+
+            if (!q.empty())
+            {
+                result = q.front();
+                q.pop();
+            }
+            else
+            {
+                m_ContextStore.push_back(std::make_unique<GfxCommandContext>(m_Device, type));
+                result = m_ContextStore.back().get();
+            }
         }
 
+        // Open 只访问 context 自己的数据，不需要持有锁
         result->Open();
         return result;
     }
 
     void GfxCommandManager::RecycleContext(GfxCommandContext* context)
     {
+        std::lock_guard<std::mutex> lock(m_ContextMutex);
         m_QueueData[static_cast<size_t>(context->GetType())].FreeContexts.push(context);
     }
 
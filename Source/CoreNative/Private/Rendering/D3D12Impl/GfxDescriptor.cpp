@@ -86,11 +86,13 @@ namespace march
         , m_NextDescriptorIndex(0)
         , m_Pages{}
         , m_ReleaseQueue{}
+        , m_Mutex{}
     {
     }
 
     GfxOfflineDescriptor GfxOfflineDescriptorAllocator::Allocate()
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
         D3D12_CPU_DESCRIPTOR_HANDLE handle;
 
         if (!m_ReleaseQueue.empty() && m_Device->IsFenceCompleted(m_ReleaseQueue.front().first))
@@ -123,6 +125,7 @@ namespace march
 
     void GfxOfflineDescriptorAllocator::DeferredRelease(D3D12_CPU_DESCRIPTOR_HANDLE handle)
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
         m_ReleaseQueue.emplace(m_Device->GetNextFence(), handle);
     }
 
@@ -427,6 +430,7 @@ namespace march
         , m_Factory(factory)
         , m_CurrentAllocator(nullptr)
         , m_ReleaseQueue{}
+        , m_Mutex{}
     {
         Rollover();
     }
@@ -438,6 +442,8 @@ namespace march
         D3D12_GPU_DESCRIPTOR_HANDLE* pOutResults,
         GfxDescriptorHeap** ppOutHeap)
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
         if (m_CurrentAllocator->AllocateMany(numAllocations, offlineDescriptors, numDescriptors, pOutResults))
         {
             *ppOutHeap = m_CurrentAllocator->GetHeap();
@@ -449,11 +455,14 @@ namespace march
 
     void GfxOnlineDescriptorMultiAllocator::CleanUpAllocations()
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
         m_CurrentAllocator->CleanUpAllocations();
     }
 
     void GfxOnlineDescriptorMultiAllocator::Rollover()
     {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
         if (m_CurrentAllocator != nullptr)
         {
             // 切换 descriptor heap 会有性能开销
@@ -22,6 +22,7 @@ namespace march
 
     GfxDevice::GfxDevice(const GfxDeviceDesc& desc)
         : m_ReleaseQueue{}
+        , m_ReleaseQueueMutex{}
     {
         // 开启调试层
         if (desc.EnableDebugLayer)
@@ -101,52 +102,57 @@ namespace march
         uploadHeapCommittedDesc.HeapFlags = D3D12_HEAP_FLAG_NONE;
         m_UploadHeapCommittedAllocator = std::make_unique<GfxCommittedResourceAllocator>(this, uploadHeapCommittedDesc);
 
+        GfxCommittedResourceAllocatorDesc readbackHeapCommittedDesc{};
+        readbackHeapCommittedDesc.HeapType = D3D12_HEAP_TYPE_READBACK;
+        readbackHeapCommittedDesc.HeapFlags = D3D12_HEAP_FLAG_NONE;
+        m_ReadbackHeapCommittedAllocator = std::make_unique<GfxCommittedResourceAllocator>(this, readbackHeapCommittedDesc);
+
         GfxPlacedResourceAllocatorDesc defaultHeapPlacedBufferDesc{};
-        defaultHeapPlacedBufferDesc.DefaultMaxBlockSize = 16 * 1024 * 1024; // 16MB
+        defaultHeapPlacedBufferDesc.DefaultPageSize = 16 * 1024 * 1024; // 16MB
         defaultHeapPlacedBufferDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
         defaultHeapPlacedBufferDesc.HeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
         defaultHeapPlacedBufferDesc.MSAA = false;
         m_DefaultHeapPlacedAllocatorBuffer = std::make_unique<GfxPlacedResourceAllocator>(this, "DefaultHeapPlacedBufferAllocator", defaultHeapPlacedBufferDesc);
 
         GfxPlacedResourceAllocatorDesc defaultHeapPlacedTextureDesc{};
-        defaultHeapPlacedTextureDesc.DefaultMaxBlockSize = 16 * 1024 * 1024; // 16MB
+        defaultHeapPlacedTextureDesc.DefaultPageSize = 16 * 1024 * 1024; // 16MB
         defaultHeapPlacedTextureDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
         defaultHeapPlacedTextureDesc.HeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
         defaultHeapPlacedTextureDesc.MSAA = false;
         m_DefaultHeapPlacedAllocatorTexture = std::make_unique<GfxPlacedResourceAllocator>(this, "DefaultHeapPlacedTextureAllocator", defaultHeapPlacedTextureDesc);
 
         GfxPlacedResourceAllocatorDesc defaultHeapPlacedRenderTextureDesc{};
-        defaultHeapPlacedRenderTextureDesc.DefaultMaxBlockSize = 16 * 1024 * 1024; // 16MB
+        defaultHeapPlacedRenderTextureDesc.DefaultPageSize = 16 * 1024 * 1024; // 16MB
         defaultHeapPlacedRenderTextureDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
         defaultHeapPlacedRenderTextureDesc.HeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
         defaultHeapPlacedRenderTextureDesc.MSAA = false;
         m_DefaultHeapPlacedAllocatorRenderTexture = std::make_unique<GfxPlacedResourceAllocator>(this, "DefaultHeapPlacedRenderTextureAllocator", defaultHeapPlacedRenderTextureDesc);
 
         GfxPlacedResourceAllocatorDesc defaultHeapPlacedRenderTextureMSDesc{};
-        defaultHeapPlacedRenderTextureMSDesc.DefaultMaxBlockSize = 64 * 1024 * 1024; // 64MB
+        defaultHeapPlacedRenderTextureMSDesc.DefaultPageSize = 64 * 1024 * 1024; // 64MB
         defaultHeapPlacedRenderTextureMSDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
         defaultHeapPlacedRenderTextureMSDesc.HeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
         defaultHeapPlacedRenderTextureMSDesc.MSAA = true;
         m_DefaultHeapPlacedAllocatorRenderTextureMS = std::make_unique<GfxPlacedResourceAllocator>(this, "DefaultHeapPlacedRenderTextureMultisampleAllocator", defaultHeapPlacedRenderTextureMSDesc);
 
         GfxPlacedResourceAllocatorDesc uploadHeapPlacedBufferDesc{};
-        uploadHeapPlacedBufferDesc.DefaultMaxBlockSize = 16 * 1024 * 1024; // 16MB
+        uploadHeapPlacedBufferDesc.DefaultPageSize = 16 * 1024 * 1024; // 16MB
         uploadHeapPlacedBufferDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
         uploadHeapPlacedBufferDesc.HeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
         uploadHeapPlacedBufferDesc.MSAA = false;
         m_UploadHeapPlacedAllocatorBuffer = std::make_unique<GfxPlacedResourceAllocator>(this, "UploadHeapPlacedBufferAllocator", uploadHeapPlacedBufferDesc);
 
-        GfxBufferMultiBuddySubAllocatorDesc uploadHeapSubBufferDesc{};
+        GfxBufferMultiTlsfSubAllocatorDesc uploadHeapSubBufferDesc{};
         uploadHeapSubBufferDesc.MinBlockSize = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT; // 目前主要用来分配 constant buffer
-        uploadHeapSubBufferDesc.DefaultMaxBlockSize = 16 * 1024 * 1024; // 16MB
-        m_UploadHeapBufferSubAllocator = std::make_unique<GfxBufferMultiBuddySubAllocator>("UploadHeapBufferSubAllocator", uploadHeapSubBufferDesc,
+        uploadHeapSubBufferDesc.DefaultPageSize = 16 * 1024 * 1024; // 16MB
+        m_UploadHeapBufferSubAllocator = std::make_unique<GfxBufferMultiTlsfSubAllocator>("UploadHeapBufferSubAllocator", uploadHeapSubBufferDesc,
             /* page allocator */ m_UploadHeapCommittedAllocator.get());
 
-        GfxBufferLinearSubAllocatorDesc uploadHeapSubBufferFastOneFrameDesc{};
-        uploadHeapSubBufferFastOneFrameDesc.PageSize = 16 * 1024 * 1024; // 16MB
-        m_UploadHeapBufferSubAllocatorFastOneFrame = std::make_unique<GfxBufferLinearSubAllocator>("UploadHeapBufferSubAllocatorFastOneFrame", uploadHeapSubBufferFastOneFrameDesc,
-            /* page allocator */ m_UploadHeapCommittedAllocator.get(),
-            /* large page allocator */ m_UploadHeapPlacedAllocatorBuffer.get());
+        GfxBufferRingSubAllocatorDesc uploadHeapSubBufferFastOneFrameDesc{};
+        uploadHeapSubBufferFastOneFrameDesc.Capacity = 64 * 1024 * 1024; // 64MB
+        m_UploadHeapBufferSubAllocatorFastOneFrame = std::make_unique<GfxBufferRingSubAllocator>("UploadHeapBufferSubAllocatorFastOneFrame", uploadHeapSubBufferFastOneFrameDesc,
+            /* ring allocator */ m_UploadHeapCommittedAllocator.get(),
+            /* fallback allocator */ m_UploadHeapPlacedAllocatorBuffer.get());
     }
 
     GfxDevice::~GfxDevice()
@@ -158,17 +164,56 @@ namespace march
 
     void GfxDevice::CleanupResources()
     {
-        while (!m_ReleaseQueue.empty() && m_CommandManager->IsFrameFenceCompleted(m_ReleaseQueue.front().first))
+        std::vector<RefCountPtr<RefCountedObject>> objects{};
+
         {
-            m_ReleaseQueue.pop();
+            std::lock_guard<std::mutex> lock(m_ReleaseQueueMutex);
+
+            while (!m_ReleaseQueue.empty() && m_CommandManager->IsFrameFenceCompleted(m_ReleaseQueue.front().first))
+            {
+                objects.push_back(std::move(m_ReleaseQueue.front().second));
+                m_ReleaseQueue.pop();
+            }
         }
 
+        // 析构时可能再调用 DeferredRelease，所以在锁外面释放
+        objects.clear();
+
         m_OnlineViewAllocator->CleanUpAllocations();
         m_OnlineSamplerAllocator->CleanUpAllocations();
         m_UploadHeapBufferSubAllocator->CleanUpAllocations();
         m_UploadHeapBufferSubAllocatorFastOneFrame->CleanUpAllocations();
     }
 
+    void GfxDevice::DefragmentHeaps()
+    {
+        DefragBudget budget{};
+        budget.MaxBytesToMove = 8 * 1024 * 1024; // 8MB
+        budget.MaxMoves = 64;
+        budget.MaxPageUsage = 0.5f;
+
+        constexpr double maxCpuMicroseconds = 500;
+
+        // MSAA 的资源不能在 copy queue 上复制，所以不整理
+        GfxPlacedResourceAllocator* allocators[] =
+        {
+            m_DefaultHeapPlacedAllocatorBuffer.get(),
+            m_DefaultHeapPlacedAllocatorTexture.get(),
+            m_DefaultHeapPlacedAllocatorRenderTexture.get(),
+        };
+
+        for (GfxPlacedResourceAllocator* allocator : allocators)
+        {
+            DefragStats stats = allocator->Defragment(budget, maxCpuMicroseconds / std::size(allocators));
+
+            if (stats.NumMoves > 0 || stats.ReleasedBytes > 0)
+            {
+                LOG_TRACE("{} defragments; Moves={}; MovedBytes={}; EvacuatedPages={}; ReleasedBytes={}",
+                    allocator->GetName(), stats.NumMoves, stats.MovedBytes, stats.NumEvacuatedPages, stats.ReleasedBytes);
+            }
+        }
+    }
+
     GfxCommandContext* GfxDevice::RequestContext(GfxCommandType type)
     {
         return m_CommandManager->RequestAndOpenContext(type);
@@ -197,6 +242,8 @@ namespace march
             return m_DefaultHeapCommittedAllocator.get();
         case D3D12_HEAP_TYPE_UPLOAD:
             return m_UploadHeapCommittedAllocator.get();
+        case D3D12_HEAP_TYPE_READBACK:
+            return m_ReadbackHeapCommittedAllocator.get();
         default:
             throw std::invalid_argument("GfxDevice::GetCommittedAllocator: Invalid heap type");
         }
@@ -247,8 +294,14 @@ namespace march
         return m_UploadHeapBufferSubAllocator.get();
     }
 
+    const GfxBufferRingStats& GfxDevice::GetUploadHeapBufferRingStats() const
+    {
+        return m_UploadHeapBufferSubAllocatorFastOneFrame->GetLastFrameStats();
+    }
+
     void GfxDevice::DeferredRelease(RefCountPtr<RefCountedObject> obj)
     {
+        std::lock_guard<std::mutex> lock(m_ReleaseQueueMutex);
         m_ReleaseQueue.emplace(m_CommandManager->GetNextFrameFence(), obj);
     }
 
@@ -21,6 +21,8 @@ namespace march
         return inputDesc;
     }
 
+    uint32_t GfxMesh::s_BoundsVersion = 0;
+
     GfxMesh* GfxMesh::GetGeometry(GfxMeshGeometry geometry)
     {
         cs<GfxMeshGeometry> csGeometry{};
@@ -164,5 +166,6 @@ namespace march
     void GfxMesh::RecalculateBounds()
     {
         BoundingBox::CreateFromPoints(m_Bounds, m_Vertices.size(), &m_Vertices.data()->Position, sizeof(GfxMeshVertex));
+        s_BoundsVersion++;
     }
 }
@@ -1,10 +1,13 @@
 #include "pch.h"
 #include "Engine/Rendering/D3D12Impl/GfxResource.h"
 #include "Engine/Rendering/D3D12Impl/GfxDevice.h"
+#include "Engine/Rendering/D3D12Impl/GfxCommand.h"
 #include "Engine/Rendering/D3D12Impl/GfxException.h"
 #include "Engine/Rendering/D3D12Impl/GfxUtils.h"
 #include "Engine/Profiling/NsightAftermath.h"
 #include "Engine/Debug.h"
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 #include <assert.h>
 
@@ -31,6 +34,28 @@ namespace march
         return mipLevels * arraySize * planeCount;
     }
 
+    static uint8_t* MapUploadBuffer(ID3D12Resource* resource)
+    {
+        if (resource->GetDesc().Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+        {
+            return nullptr;
+        }
+
+        D3D12_HEAP_PROPERTIES heapProperties{};
+
+        if (FAILED(resource->GetHeapProperties(&heapProperties, nullptr)) || heapProperties.Type != D3D12_HEAP_TYPE_UPLOAD)
+        {
+            return nullptr;
+        }
+
+        // https://learn.microsoft.com/en-us/windows/win32/direct3d12/memory-management-strategies
+        // upload heap 可以一直 map 着，只要保证 GPU 使用时 CPU 不再写入
+        uint8_t* pData = nullptr;
+        D3D12_RANGE readRange = CD3DX12_RANGE(0, 0); // Write-Only
+        CHECK_HR(resource->Map(0, &readRange, reinterpret_cast<void**>(&pData)));
+        return pData;
+    }
+
     GfxResource::GfxResource(GfxDevice* device, ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES state)
         : m_Device(device)
         , m_Resource(resource)
@@ -41,6 +66,8 @@ namespace march
         , m_State(state)
         , m_SubresourceStates(nullptr)
         , m_NsightAftermathHandle(NsightAftermath::RegisterResource(resource.Get()))
+        , m_Version(0)
+        , m_MappedData(MapUploadBuffer(resource.Get()))
     {
         m_SubresourceCount = CalcSubresourceCount(m_Device->GetD3DDevice4(), m_Resource.Get());
         assert(m_SubresourceCount >= 1);
@@ -56,6 +83,8 @@ namespace march
         , m_State(state)
         , m_SubresourceStates(nullptr)
         , m_NsightAftermathHandle(NsightAftermath::RegisterResource(resource.Get()))
+        , m_Version(0)
+        , m_MappedData(MapUploadBuffer(resource.Get()))
     {
         m_SubresourceCount = CalcSubresourceCount(m_Device->GetD3DDevice4(), m_Resource.Get());
         assert(m_SubresourceCount >= 1);
@@ -78,6 +107,12 @@ namespace march
         //}
 #endif
 
+        if (m_MappedData)
+        {
+            m_Resource->Unmap(0, nullptr);
+            m_MappedData = nullptr;
+        }
+
         m_Device = nullptr;
         m_Resource = nullptr;
 
@@ -217,6 +252,25 @@ namespace march
         m_SubresourceStates[subresource] = state;
     }
 
+    void GfxResource::SwapStorage(GfxResource* other)
+    {
+        assert(m_Allocator == other->m_Allocator);
+        assert(m_SubresourceCount == other->m_SubresourceCount);
+
+        std::swap(m_Resource, other->m_Resource);
+        std::swap(m_Allocation, other->m_Allocation);
+        std::swap(m_NsightAftermathHandle, other->m_NsightAftermathHandle);
+        std::swap(m_MappedData, other->m_MappedData);
+
+        // 复制完以后，两个底层 resource 的 state 分别记录在持有它们的对象里
+        std::swap(m_AllStatesSame, other->m_AllStatesSame);
+        std::swap(m_State, other->m_State);
+        std::swap(m_SubresourceStates, other->m_SubresourceStates);
+
+        m_Version++;
+        other->m_Version++;
+    }
+
     GfxResourceAllocator::GfxResourceAllocator(GfxDevice* device, D3D12_HEAP_TYPE heapType, D3D12_HEAP_FLAGS heapFlags)
         : m_Device(device)
         , m_HeapType(heapType)
@@ -267,8 +321,18 @@ namespace march
         : GfxResourceAllocator(device, desc.HeapType, desc.HeapFlags)
         , m_MSAA(desc.MSAA)
         , m_HeapPages{}
+        , m_LiveResources{}
+        , m_EvacuatingPages{}
+        , m_Mutex{}
+        , m_DefragPlanner{}
+        , m_DefragPages{}
+        , m_DefragFreeBlocks{}
+        , m_DefragPageIndices{}
+        , m_DefragPageRemap{}
+        , m_DefragAllocations{}
+        , m_DefragResources{}
     {
-        auto appendPageFunc = [this](uint32_t sizeInBytes)
+        auto appendPageFunc = [this](size_t pageIndex, uint32_t sizeInBytes)
         {
             D3D12_HEAP_DESC desc{};
             desc.SizeInBytes = static_cast<UINT64>(sizeInBytes);
@@ -278,11 +342,17 @@ namespace march
 
             ComPtr<ID3D12Heap> heap = nullptr;
             CHECK_HR(GetDevice()->GetD3DDevice4()->CreateHeap(&desc, IID_PPV_ARGS(&heap)));
-            m_HeapPages.push_back(heap);
+
+            if (pageIndex >= m_HeapPages.size())
+            {
+                m_HeapPages.resize(pageIndex + 1);
+            }
+
+            m_HeapPages[pageIndex] = heap;
         };
 
         uint32_t minBlockSize = GetResourcePlacementAlignment(desc.MSAA);
-        m_Allocator = std::make_unique<MultiBuddyAllocator>(name, minBlockSize, desc.DefaultMaxBlockSize, appendPageFunc);
+        m_Allocator = std::make_unique<MultiTlsfAllocator>(name, minBlockSize, desc.DefaultPageSize, appendPageFunc);
     }
 
     RefCountPtr<GfxResource> GfxPlacedResourceAllocator::Allocate(
@@ -290,6 +360,36 @@ namespace march
         const D3D12_RESOURCE_DESC* pDesc,
         D3D12_RESOURCE_STATES initialState,
         const D3D12_CLEAR_VALUE* pOptimizedClearValue)
+    {
+        GfxResourceAllocation allocation{};
+        uint32_t sizeInBytes = 0;
+        uint32_t alignment = 0;
+        ComPtr<ID3D12Resource> resource = AllocatePlacedResource(pDesc, initialState, pOptimizedClearValue, /* allowNewPage */ true, std::nullopt, &allocation, &sizeInBytes, &alignment);
+
+        if (!resource)
+        {
+            return nullptr;
+        }
+
+        RefCountPtr<GfxResource> result = MakeResource(name, resource, initialState, allocation);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_LiveResources[GetLiveResourceKey(allocation.Tlsf)] = LiveResource{ result.Get(), sizeInBytes, alignment };
+        }
+
+        return result;
+    }
+
+    ComPtr<ID3D12Resource> GfxPlacedResourceAllocator::AllocatePlacedResource(
+        const D3D12_RESOURCE_DESC* pDesc,
+        D3D12_RESOURCE_STATES initialState,
+        const D3D12_CLEAR_VALUE* pOptimizedClearValue,
+        bool allowNewPage,
+        std::optional<size_t> destinationPageIndex,
+        GfxResourceAllocation* pOutAllocation,
+        uint32_t* pOutSizeInBytes,
+        uint32_t* pOutAlignment)
     {
         ID3D12Device4* device = GetDevice()->GetD3DDevice4();
         D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, pDesc);
@@ -297,23 +397,412 @@ namespace march
         uint32_t alignment = static_cast<uint32_t>(info.Alignment);
 
         size_t pageIndex = 0;
-        GfxResourceAllocation allocation{};
+        std::optional<uint32_t> offset = std::nullopt;
+        ID3D12Heap* heap = nullptr;
 
-        if (std::optional<uint32_t> offset = m_Allocator->Allocate(sizeInBytes, alignment, &pageIndex, &allocation.Buddy))
         {
-            ID3D12Heap* heap = m_HeapPages[pageIndex].Get();
-            UINT64 heapOffset = static_cast<UINT64>(*offset);
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (destinationPageIndex)
+            {
+                pageIndex = *destinationPageIndex;
+
+                if (m_Allocator->GetPage(pageIndex) != nullptr && m_Allocator->IsPageAllocatable(pageIndex))
+                {
+                    offset = m_Allocator->AllocateInPage(pageIndex, sizeInBytes, alignment, &pOutAllocation->Tlsf);
+                }
+            }
+            else
+            {
+                offset = m_Allocator->Allocate(sizeInBytes, alignment, &pageIndex, &pOutAllocation->Tlsf, allowNewPage);
+            }
 
-            ComPtr<ID3D12Resource> resource = nullptr;
-            CHECK_HR(device->CreatePlacedResource(heap, heapOffset, pDesc, initialState, pOptimizedClearValue, IID_PPV_ARGS(&resource)));
-            return MakeResource(name, resource, initialState, allocation);
+            if (offset)
+            {
+                heap = m_HeapPages[pageIndex].Get();
+            }
+        }
+
+        if (!offset)
+        {
+            return nullptr;
         }
 
-        return nullptr;
+        UINT64 heapOffset = static_cast<UINT64>(*offset);
+
+        ComPtr<ID3D12Resource> resource = nullptr;
+        CHECK_HR(device->CreatePlacedResource(heap, heapOffset, pDesc, initialState, pOptimizedClearValue, IID_PPV_ARGS(&resource)));
+        *pOutSizeInBytes = sizeInBytes;
+        *pOutAlignment = alignment;
+        return resource;
     }
 
     void GfxPlacedResourceAllocator::Release(const GfxResourceAllocation& allocation)
     {
-        m_Allocator->Release(allocation.Buddy);
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_LiveResources.erase(GetLiveResourceKey(allocation.Tlsf));
+        m_Allocator->Release(allocation.Tlsf);
+    }
+
+    AllocatorFragmentationStats GfxPlacedResourceAllocator::GetFragmentationStats()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Allocator->GetFragmentationStats();
+    }
+
+    uint64_t GfxPlacedResourceAllocator::GetLiveResourceKey(const TlsfAllocation& allocation)
+    {
+        return (static_cast<uint64_t>(allocation.PageIndex) << 32) | static_cast<uint64_t>(allocation.BlockIndex);
+    }
+
+    bool GfxPlacedResourceAllocator::IsMovable(GfxResource* resource)
+    {
+        // acceleration structure 的地址会写进其他数据里
+        if (resource->HasAnyStates(D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE))
+        {
+            return false;
+        }
+
+        D3D12_RESOURCE_DESC desc = resource->GetD3DResourceDesc();
+
+        if (resource->IsStateLocked())
+        {
+            // 锁定 state 的 buffer 被当作 sub-allocator 的 page 使用，里面的地址已经被其他 buffer 引用了
+            return IsCopiedOnDirectQueue(resource);
+        }
+
+        // copy queue 不支持 MSAA 和 depth stencil
+        return desc.SampleDesc.Count <= 1 && (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) == 0;
+    }
+
+    bool GfxPlacedResourceAllocator::IsCopiedOnDirectQueue(GfxResource* resource)
+    {
+        // 外部导入的 texture 一直锁定在 GENERIC_READ，不能转换成 COMMON 给 copy queue 用
+        // GENERIC_READ 包含 COPY_SOURCE，可以直接在 direct queue 上复制，GPU 只会读它，复制期间也不会被修改
+        if (!resource->IsStateLocked() || !resource->AreAllSubresourceStatesSame())
+        {
+            return false;
+        }
+
+        D3D12_RESOURCE_DESC desc = resource->GetD3DResourceDesc();
+        return desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER
+            && desc.SampleDesc.Count <= 1
+            && resource->HasAllStates(D3D12_RESOURCE_STATE_COPY_SOURCE)
+            && (resource->GetState(0) & ~D3D12_RESOURCE_STATE_GENERIC_READ) == 0;
+    }
+
+    void GfxPlacedResourceAllocator::StopEvacuatingPage(size_t pageIndex)
+    {
+        // 调用前必须持有 m_Mutex
+        if (m_Allocator->GetPage(pageIndex) != nullptr)
+        {
+            m_Allocator->SetPageAllocatable(pageIndex, true);
+        }
+
+        m_EvacuatingPages.erase(std::remove_if(m_EvacuatingPages.begin(), m_EvacuatingPages.end(),
+            [pageIndex](const EvacuatingPage& page) { return page.PageIndex == pageIndex; }), m_EvacuatingPages.end());
+    }
+
+    static double GetCpuMicroseconds()
+    {
+        static const double microsecondsPerCount = []()
+        {
+            LARGE_INTEGER freq;
+            QueryPerformanceFrequency(&freq);
+            return 1000000.0 / static_cast<double>(freq.QuadPart);
+        }();
+
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return static_cast<double>(counter.QuadPart) * microsecondsPerCount;
+    }
+
+    DefragStats GfxPlacedResourceAllocator::Defragment(const DefragBudget& budget, double maxCpuMicroseconds)
+    {
+        if (GetHeapProperties().Type != D3D12_HEAP_TYPE_DEFAULT)
+        {
+            return DefragStats{};
+        }
+
+        double startTime = GetCpuMicroseconds();
+
+        struct Move
+        {
+            RefCountPtr<GfxResource> Resource;
+            RefCountPtr<GfxResource> Destination;
+            std::optional<size_t> DestinationPageIndex; // 没有值时放到任何一个放得下的 page
+            bool IsDirectQueue;
+        };
+
+        std::vector<Move> moves{};
+        uint32_t numEvacuatedPages = 0;
+        uint64_t releasedBytes = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            for (size_t i = 0; i < m_EvacuatingPages.size();)
+            {
+                EvacuatingPage& evacuating = m_EvacuatingPages[i];
+                const TlsfAllocator* page = m_Allocator->GetPage(evacuating.PageIndex);
+
+                // 分配时缺少空间，已经被重新启用了
+                if (page == nullptr || m_Allocator->IsPageAllocatable(evacuating.PageIndex))
+                {
+                    m_EvacuatingPages[i] = m_EvacuatingPages.back();
+                    m_EvacuatingPages.pop_back();
+                    continue;
+                }
+
+                if (page->GetTotalAllocatedSize() != 0)
+                {
+                    evacuating.NumEmptyFrames = 0;
+                    i++;
+                    continue;
+                }
+
+                // 旧的资源都已经在 frame fence 之后释放了，但要空一段时间再销毁 heap
+                if (++evacuating.NumEmptyFrames < MinEmptyFramesBeforeRelease)
+                {
+                    i++;
+                    continue;
+                }
+
+                releasedBytes += page->GetMaxSize();
+                m_Allocator->ReleasePage(evacuating.PageIndex);
+                m_HeapPages[evacuating.PageIndex] = nullptr;
+                m_EvacuatingPages[i] = m_EvacuatingPages.back();
+                m_EvacuatingPages.pop_back();
+            }
+
+            m_DefragPages.clear();
+            m_DefragFreeBlocks.clear();
+            m_DefragPageIndices.clear();
+            m_DefragPageRemap.assign(m_Allocator->GetNumPages(), 0);
+
+            for (size_t i = 0; i < m_Allocator->GetNumPages(); i++)
+            {
+                const TlsfAllocator* page = m_Allocator->GetPage(i);
+
+                // 正在清空的 page 不参与计划
+                if (page != nullptr && m_Allocator->IsPageAllocatable(i))
+                {
+                    size_t defragPageIndex = m_DefragPages.size();
+                    m_DefragPageRemap[i] = defragPageIndex;
+                    m_DefragPageIndices.push_back(i);
+                    m_DefragPages.push_back(DefragPageInfo{ page->GetMaxSize(), page->GetTotalAllocatedSize() });
+
+                    page->ForEachFreeBlock([this, defragPageIndex](uint64_t size)
+                    {
+                        m_DefragFreeBlocks.push_back(DefragFreeBlock{ defragPageIndex, size });
+                    });
+                }
+            }
+
+            m_DefragAllocations.clear();
+            m_DefragResources.clear();
+
+            uint32_t minBlockSize = GetResourcePlacementAlignment(m_MSAA);
+            uint64_t remainingBytes = budget.MaxBytesToMove;
+            uint32_t remainingMoves = budget.MaxMoves;
+            std::vector<size_t> pagesToRestore{};
+
+            for (const auto& [key, live] : m_LiveResources)
+            {
+                size_t pageIndex = static_cast<size_t>(key >> 32);
+                bool isMovable = IsMovable(live.Resource);
+
+                if (!m_Allocator->IsPageAllocatable(pageIndex))
+                {
+                    if (!isMovable)
+                    {
+                        // 选中以后 state 被锁定了，这个 page 清空不了
+                        pagesToRestore.push_back(pageIndex);
+                    }
+                    else if (live.SizeInBytes <= remainingBytes && remainingMoves > 0)
+                    {
+                        // 上一帧没搬完的先搬
+                        moves.push_back(Move{ live.Resource, nullptr, std::nullopt, IsCopiedOnDirectQueue(live.Resource) });
+                        remainingBytes -= live.SizeInBytes;
+                        remainingMoves--;
+                    }
+                }
+                else
+                {
+                    std::optional<uint64_t> requiredSize = TlsfAllocator::GetGuaranteedBlockSize(minBlockSize, live.SizeInBytes, live.Alignment);
+
+                    DefragAllocationInfo& allocation = m_DefragAllocations.emplace_back();
+                    allocation.PageIndex = m_DefragPageRemap[pageIndex];
+                    allocation.Size = live.SizeInBytes;
+                    allocation.RequiredBlockSize = requiredSize.value_or(std::numeric_limits<uint64_t>::max());
+                    allocation.IsMovable = isMovable && requiredSize.has_value();
+                    m_DefragResources.push_back(live.Resource);
+                }
+            }
+
+            for (size_t pageIndex : pagesToRestore)
+            {
+                StopEvacuatingPage(pageIndex);
+            }
+
+            DefragBudget remainingBudget = budget;
+            remainingBudget.MaxBytesToMove = remainingBytes;
+            remainingBudget.MaxMoves = remainingMoves;
+            m_DefragPlanner.Plan(m_DefragPages, m_DefragFreeBlocks, m_DefragAllocations, remainingBudget);
+
+            for (size_t i : m_DefragPlanner.GetEvacuatedPages())
+            {
+                size_t pageIndex = m_DefragPageIndices[i];
+                m_Allocator->SetPageAllocatable(pageIndex, false);
+                m_EvacuatingPages.push_back(EvacuatingPage{ pageIndex, 0 });
+            }
+
+            for (const DefragMove& move : m_DefragPlanner.GetMoves())
+            {
+                GfxResource* resource = m_DefragResources[move.AllocationIndex];
+                moves.push_back(Move{ resource, nullptr, m_DefragPageIndices[move.DestinationPageIndex], IsCopiedOnDirectQueue(resource) });
+            }
+
+            numEvacuatedPages = m_DefragPlanner.GetStats().NumEvacuatedPages;
+        }
+
+        DefragStats stats{};
+        stats.NumEvacuatedPages = numEvacuatedPages;
+        stats.ReleasedBytes = releasedBytes;
+
+        // 在规划好的 page 里创建新的资源，超时的留到下一帧
+        size_t numMoves = 0;
+        bool hasCopyQueueMoves = false;
+        bool hasDirectQueueMoves = false;
+
+        for (; numMoves < moves.size(); numMoves++)
+        {
+            if (GetCpuMicroseconds() - startTime > maxCpuMicroseconds)
+            {
+                break;
+            }
+
+            Move& move = moves[numMoves];
+            ID3D12Resource* source = move.Resource->GetD3DResource();
+            D3D12_RESOURCE_DESC desc = source->GetDesc();
+            D3D12_RESOURCE_STATES initialState = move.IsDirectQueue ? D3D12_RESOURCE_STATE_COPY_DEST : D3D12_RESOURCE_STATE_COMMON;
+
+            GfxResourceAllocation allocation{};
+            uint32_t sizeInBytes = 0;
+            uint32_t alignment = 0;
+            ComPtr<ID3D12Resource> resource = AllocatePlacedResource(&desc, initialState, nullptr, /* allowNewPage */ false, move.DestinationPageIndex, &allocation, &sizeInBytes, &alignment);
+
+            if (!resource && move.DestinationPageIndex)
+            {
+                // 规划是保守的，实际放不下时再试试其他 page
+                resource = AllocatePlacedResource(&desc, initialState, nullptr, /* allowNewPage */ false, std::nullopt, &allocation, &sizeInBytes, &alignment);
+            }
+
+            if (!resource)
+            {
+                // 其他 page 放不下，这个 page 暂时清空不了，恢复分配
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                StopEvacuatingPage(static_cast<size_t>(move.Resource->GetAllocation().Tlsf.PageIndex));
+                break;
+            }
+
+#ifdef ENABLE_GFX_DEBUG_NAME
+            wchar_t name[256];
+            UINT size = sizeof(name);
+            if (SUCCEEDED(source->GetPrivateData(WKPDID_D3DDebugObjectNameW, &size, name)))
+            {
+                resource->SetName(name);
+            }
+#endif
+
+            move.Destination = MARCH_MAKE_REF(GfxResource, this, allocation, resource, initialState);
+            hasCopyQueueMoves |= !move.IsDirectQueue;
+            hasDirectQueueMoves |= move.IsDirectQueue;
+        }
+
+        if (numMoves == 0)
+        {
+            return stats;
+        }
+
+        GfxCommandManager* manager = GetDevice()->GetCommandManager();
+        GfxCommandContext* direct = GetDevice()->RequestContext(GfxCommandType::Direct);
+
+        for (size_t i = 0; i < numMoves; i++)
+        {
+            // copy queue 只能使用 COMMON、COPY_SOURCE 和 COPY_DEST，所以先在 direct queue 上转换为 COMMON
+            // 锁定在 GENERIC_READ 的资源已经可以作为 COPY_SOURCE，不需要转换
+            if (!moves[i].IsDirectQueue)
+            {
+                direct->TransitionResource(moves[i].Resource, D3D12_RESOURCE_STATE_COMMON);
+            }
+        }
+
+        direct->FlushResourceBarriers();
+
+        for (size_t i = 0; i < numMoves; i++)
+        {
+            if (moves[i].IsDirectQueue)
+            {
+                direct->GetList()->CopyResource(moves[i].Destination->GetD3DResource(), moves[i].Resource->GetD3DResource());
+                direct->TransitionResource(moves[i].Destination, moves[i].Resource->GetState(0));
+            }
+        }
+
+        GfxSyncPoint directSyncPoint = direct->SubmitAndRelease();
+
+        if (hasDirectQueueMoves)
+        {
+            manager->GetQueue(GfxCommandType::AsyncCompute)->WaitOnGpu(directSyncPoint);
+        }
+
+        if (hasCopyQueueMoves)
+        {
+            // COMMON 会被隐式提升为 COPY_SOURCE 和 COPY_DEST，执行完以后再衰减为 COMMON，所以不需要 barrier
+            GfxCommandContext* copy = GetDevice()->RequestContext(GfxCommandType::AsyncCopy);
+            copy->WaitOnGpu(directSyncPoint);
+            copy->WaitOnGpu(manager->GetQueue(GfxCommandType::AsyncCompute)->CreateSyncPoint());
+
+            for (size_t i = 0; i < numMoves; i++)
+            {
+                if (!moves[i].IsDirectQueue)
+                {
+                    copy->GetList()->CopyResource(moves[i].Destination->GetD3DResource(), moves[i].Resource->GetD3DResource());
+                }
+            }
+
+            GfxSyncPoint copySyncPoint = copy->SubmitAndRelease();
+            manager->GetQueue(GfxCommandType::Direct)->WaitOnGpu(copySyncPoint);
+            manager->GetQueue(GfxCommandType::AsyncCompute)->WaitOnGpu(copySyncPoint);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            for (size_t i = 0; i < numMoves; i++)
+            {
+                GfxResource* resource = moves[i].Resource.Get();
+                GfxResource* destination = moves[i].Destination.Get();
+
+                uint64_t oldKey = GetLiveResourceKey(resource->GetAllocation().Tlsf);
+                uint64_t newKey = GetLiveResourceKey(destination->GetAllocation().Tlsf);
+                LiveResource live = m_LiveResources[oldKey];
+
+                resource->SwapStorage(destination);
+                m_LiveResources.erase(oldKey);
+                m_LiveResources[newKey] = live;
+
+                stats.NumMoves++;
+                stats.MovedBytes += live.SizeInBytes;
+            }
+        }
+
+        // 旧的 resource 现在由 Destination 持有，GPU 不再使用后释放
+        for (size_t i = 0; i < numMoves; i++)
+        {
+            GetDevice()->DeferredRelease(std::move(moves[i].Destination));
+        }
+
+        return stats;
     }
 }
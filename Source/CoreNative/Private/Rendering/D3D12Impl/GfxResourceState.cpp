@@ -0,0 +1,43 @@
+#include "pch.h"
+#include "Engine/Rendering/D3D12Impl/GfxResourceState.h"
+
+namespace march
+{
+    bool GfxResourceStateUtils::NeedTransition(D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+    {
+        if (stateAfter == D3D12_RESOURCE_STATE_COMMON)
+        {
+            // https://learn.microsoft.com/en-us/windows/win32/api/d3d12/ne-d3d12-d3d12_resource_states
+            // D3D12_RESOURCE_STATE_COMMON 为 0，要特殊处理
+            return stateBefore != stateAfter;
+        }
+        else
+        {
+            return (stateBefore & stateAfter) != stateAfter;
+        }
+    }
+
+    GfxLocalStateResolveResult GfxResourceStateUtils::ResolveLocalState(D3D12_RESOURCE_STATES stateBefore,
+        D3D12_RESOURCE_STATES firstState, D3D12_RESOURCE_STATES currentState, bool hasLocalBarriers)
+    {
+        if (firstState == LocalStateUnknown)
+        {
+            // 没有用过，或者 aliasing 之后直接从创建时的 state 开始
+            return { false, currentState == LocalStateUnknown ? stateBefore : currentState };
+        }
+
+        if (hasLocalBarriers)
+        {
+            // 之后的 barrier 记录的 before 是 firstState，即使 stateBefore 已经包含 firstState 也要转换过去
+            return { stateBefore != firstState, currentState };
+        }
+
+        // 没有其他 barrier 时和普通的 TransitionResource 一样，stateBefore 已经满足要求就保持不变
+        if (NeedTransition(stateBefore, firstState))
+        {
+            return { true, firstState };
+        }
+
+        return { false, stateBefore };
+    }
+}
@@ -27,10 +27,12 @@ namespace march
         , m_Desc{}
         , m_MipLevels{}
         , m_SampleQuality{}
+        , m_DescriptorResourceVersion(0)
         , m_SrvDescriptors{}
         , m_UavDescriptors{}
         , m_RtvDsvDescriptors{}
         , m_SamplerDescriptor{}
+        , m_DescriptorMutex{}
     {
     }
 
@@ -45,10 +47,12 @@ namespace march
         , m_Desc(other.m_Desc)
         , m_MipLevels(other.m_MipLevels)
         , m_SampleQuality(other.m_SampleQuality)
+        , m_DescriptorResourceVersion(other.m_DescriptorResourceVersion)
         , m_SrvDescriptors{}
         , m_UavDescriptors{}
         , m_RtvDsvDescriptors(std::move(other.m_RtvDsvDescriptors))
         , m_SamplerDescriptor(std::move(other.m_SamplerDescriptor))
+        , m_DescriptorMutex{}
     {
         for (size_t i = 0; i < std::size(m_SrvDescriptors); i++)
         {
@@ -72,6 +76,7 @@ namespace march
             m_Desc = other.m_Desc;
             m_MipLevels = other.m_MipLevels;
             m_SampleQuality = other.m_SampleQuality;
+            m_DescriptorResourceVersion = other.m_DescriptorResourceVersion;
 
             for (size_t i = 0; i < std::size(m_SrvDescriptors); i++)
             {
@@ -112,12 +117,35 @@ namespace march
         m_SamplerDescriptor.reset();
     }
 
+    void GfxTexture::ReleaseDescriptorsIfResourceChanged()
+    {
+        if (m_DescriptorResourceVersion == m_Resource->GetVersion())
+        {
+            return;
+        }
+
+        // 碎片整理换掉了底层的 resource，旧的 view 都失效了，sampler 和 resource 无关
+        for (std::unordered_map<uint32_t, GfxOfflineDescriptor>& srvMap : m_SrvDescriptors)
+        {
+            srvMap.clear();
+        }
+
+        for (std::unordered_map<uint32_t, GfxOfflineDescriptor>& uavMap : m_UavDescriptors)
+        {
+            uavMap.clear();
+        }
+
+        m_RtvDsvDescriptors.clear();
+        m_DescriptorResourceVersion = m_Resource->GetVersion();
+    }
+
     void GfxTexture::Reset(const GfxTextureDesc& desc, RefCountPtr<GfxResource> resource)
     {
         ReleaseResource();
 
         m_Desc = desc;
         m_Resource = resource;
+        m_DescriptorResourceVersion = m_Resource->GetVersion();
 
         D3D12_RESOURCE_DESC resDesc = m_Resource->GetD3DResourceDesc();
         m_MipLevels = static_cast<uint32_t>(resDesc.MipLevels);
@@ -162,6 +190,8 @@ namespace march
             mipLevels = 1;
         }
 
+        std::lock_guard<std::mutex> lock(m_DescriptorMutex);
+        ReleaseDescriptorsIfResourceChanged();
         GfxOfflineDescriptor& srv = m_SrvDescriptors[GetSrvUavIndex(m_Desc, element)][mipSlice.value_or(-1)];
 
         if (!srv)
@@ -259,6 +289,8 @@ namespace march
             mipSlice = 0;
         }
 
+        std::lock_guard<std::mutex> lock(m_DescriptorMutex);
+        ReleaseDescriptorsIfResourceChanged();
         GfxOfflineDescriptor& uav = m_UavDescriptors[GetSrvUavIndex(m_Desc, element)][mipSlice];
 
         if (!uav)
@@ -349,6 +381,9 @@ namespace march
         }
 
         RtvDsvQuery query = { wOrArraySlice, wOrArraySize, mipSlice };
+
+        std::lock_guard<std::mutex> lock(m_DescriptorMutex);
+        ReleaseDescriptorsIfResourceChanged();
         auto [it, isNew] = m_RtvDsvDescriptors.try_emplace(query);
 
         if (isNew)
@@ -479,9 +514,12 @@ namespace march
 
     // 根据 hash 复用 sampler
     static std::unordered_map<size_t, GfxOfflineDescriptor> g_SamplerCache{};
+    static std::mutex g_SamplerCacheMutex{};
 
     D3D12_CPU_DESCRIPTOR_HANDLE GfxTexture::GetSampler()
     {
+        std::lock_guard<std::mutex> lock(m_DescriptorMutex);
+
         if (!m_SamplerDescriptor)
         {
             D3D12_SAMPLER_DESC samplerDesc = {};
@@ -560,6 +598,8 @@ namespace march
 
             DefaultHash hash{};
             hash.Append(samplerDesc);
+
+            std::lock_guard<std::mutex> cacheLock(g_SamplerCacheMutex);
             auto [it, isNew] = g_SamplerCache.try_emplace(*hash);
 
             if (isNew)
@@ -629,6 +669,10 @@ namespace march
 
     GfxTexture* GfxTexture::GetDefault(GfxDefaultTexture texture, GfxTextureDimension dimension)
     {
+        // C# 端会 lazy 创建默认贴图，不是线程安全的，并行录制 command list 时可能在多个线程中调用
+        static std::mutex mutex{};
+        std::lock_guard<std::mutex> lock(mutex);
+
         cs<GfxDefaultTexture> csTexture{};
         csTexture.assign(texture);
         cs<GfxTextureDimension> csDimension{};
@@ -638,6 +682,7 @@ namespace march
 
     void GfxTexture::ClearSamplerCache()
     {
+        std::lock_guard<std::mutex> lock(g_SamplerCacheMutex);
         g_SamplerCache.clear();
     }
 
@@ -944,8 +989,12 @@ namespace march
         GetUnderlyingResource()->LockState(true);
     }
 
-    GfxRenderTexture::GfxRenderTexture(GfxDevice* device, const std::string& name, const GfxTextureDesc& desc, GfxTextureAllocStrategy allocationStrategy)
-        : GfxTexture(device)
+    static void GetRenderTextureResourceDesc(
+        GfxDevice* device,
+        const GfxTextureDesc& desc,
+        D3D12_RESOURCE_DESC* pOutResDesc,
+        D3D12_CLEAR_VALUE* pOutClearValue,
+        D3D12_RESOURCE_STATES* pOutInitialState)
     {
         D3D12_RESOURCE_DESC resDesc = {};
         resDesc.Alignment = 0;
@@ -1009,6 +1058,19 @@ namespace march
             initialState = D3D12_RESOURCE_STATE_COMMON;
         }
 
+        *pOutResDesc = resDesc;
+        *pOutClearValue = clearValue;
+        *pOutInitialState = initialState;
+    }
+
+    GfxRenderTexture::GfxRenderTexture(GfxDevice* device, const std::string& name, const GfxTextureDesc& desc, GfxTextureAllocStrategy allocationStrategy)
+        : GfxTexture(device)
+    {
+        D3D12_RESOURCE_DESC resDesc;
+        D3D12_CLEAR_VALUE clearValue;
+        D3D12_RESOURCE_STATES initialState;
+        GetRenderTextureResourceDesc(device, desc, &resDesc, &clearValue, &initialState);
+
         GfxResourceAllocator* allocator;
 
         switch (allocationStrategy)
@@ -1025,4 +1087,30 @@ namespace march
 
         Reset(desc, allocator->Allocate(name, &resDesc, initialState, &clearValue));
     }
+
+    GfxRenderTexture::GfxRenderTexture(GfxDevice* device, const std::string& name, const GfxTextureDesc& desc, ID3D12Heap* heap, uint64_t heapOffset)
+        : GfxTexture(device)
+    {
+        D3D12_RESOURCE_DESC resDesc;
+        D3D12_CLEAR_VALUE clearValue;
+        D3D12_RESOURCE_STATES initialState;
+        GetRenderTextureResourceDesc(device, desc, &resDesc, &clearValue, &initialState);
+
+        // placed resource 会持有 heap 的引用，所以不需要额外管理 heap 的生命周期
+        ComPtr<ID3D12Resource> resource = nullptr;
+        CHECK_HR(device->GetD3DDevice4()->CreatePlacedResource(heap, static_cast<UINT64>(heapOffset), &resDesc, initialState, &clearValue, IID_PPV_ARGS(&resource)));
+        GfxUtils::SetName(resource.Get(), name);
+
+        Reset(desc, MARCH_MAKE_REF(GfxResource, device, resource, initialState));
+    }
+
+    D3D12_RESOURCE_ALLOCATION_INFO GfxRenderTexture::GetAllocationInfo(GfxDevice* device, const GfxTextureDesc& desc)
+    {
+        D3D12_RESOURCE_DESC resDesc;
+        D3D12_CLEAR_VALUE clearValue;
+        D3D12_RESOURCE_STATES initialState;
+        GetRenderTextureResourceDesc(device, desc, &resDesc, &clearValue, &initialState);
+
+        return device->GetD3DDevice4()->GetResourceAllocationInfo(0, 1, &resDesc);
+    }
 }
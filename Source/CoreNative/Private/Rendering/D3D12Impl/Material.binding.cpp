@@ -89,7 +89,7 @@ struct IntProperty
 
 NATIVE_EXPORT_AUTO Material_GetAllInts(cs<Material*> pMaterial)
 {
-    const std::unordered_map<int32_t, int32_t> rawInts = MaterialInternalUtility::GetRawInts(pMaterial);
+    const MaterialPropertyList<int32_t>& rawInts = MaterialInternalUtility::GetRawInts(pMaterial);
     std::unordered_map<int32_t, int32_t> allValues(rawInts.begin(), rawInts.end());
 
     if (pMaterial->GetShader() != nullptr)
@@ -125,7 +125,7 @@ struct FloatProperty
 
 NATIVE_EXPORT_AUTO Material_GetAllFloats(cs<Material*> pMaterial)
 {
-    const std::unordered_map<int32_t, float> rawFloats = MaterialInternalUtility::GetRawFloats(pMaterial);
+    const MaterialPropertyList<float>& rawFloats = MaterialInternalUtility::GetRawFloats(pMaterial);
     std::unordered_map<int32_t, float> allValues(rawFloats.begin(), rawFloats.end());
 
     if (pMaterial->GetShader() != nullptr)
@@ -161,7 +161,7 @@ struct VectorProperty
 
 NATIVE_EXPORT_AUTO Material_GetAllVectors(cs<Material*> pMaterial)
 {
-    const std::unordered_map<int32_t, XMFLOAT4> rawVectors = MaterialInternalUtility::GetRawVectors(pMaterial);
+    const MaterialPropertyList<XMFLOAT4>& rawVectors = MaterialInternalUtility::GetRawVectors(pMaterial);
     std::unordered_map<int32_t, XMFLOAT4> allValues(rawVectors.begin(), rawVectors.end());
 
     if (pMaterial->GetShader() != nullptr)
@@ -197,7 +197,7 @@ struct ColorProperty
 
 NATIVE_EXPORT_AUTO Material_GetAllColors(cs<Material*> pMaterial)
 {
-    const std::unordered_map<int32_t, XMFLOAT4> rawColors = MaterialInternalUtility::GetRawColors(pMaterial);
+    const MaterialPropertyList<XMFLOAT4>& rawColors = MaterialInternalUtility::GetRawColors(pMaterial);
     std::unordered_map<int32_t, XMFLOAT4> allValues(rawColors.begin(), rawColors.end());
 
     if (pMaterial->GetShader() != nullptr)
@@ -233,7 +233,7 @@ struct TextureProperty
 
 NATIVE_EXPORT_AUTO Material_GetAllTextures(cs<Material*> pMaterial)
 {
-    const std::unordered_map<int32_t, GfxTexture*> rawTextures = MaterialInternalUtility::GetRawTextures(pMaterial);
+    const MaterialPropertyList<GfxTexture*>& rawTextures = MaterialInternalUtility::GetRawTextures(pMaterial);
     std::unordered_map<int32_t, GfxTexture*> allValues(rawTextures.begin(), rawTextures.end());
 
     if (pMaterial->GetShader() != nullptr)
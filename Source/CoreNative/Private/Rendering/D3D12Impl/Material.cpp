@@ -9,6 +9,8 @@
 #include "Engine/Misc/HashUtils.h"
 #include "Engine/Debug.h"
 #include <vector>
+#include <algorithm>
+#include <string.h>
 #include <wrl.h>
 
 using namespace Microsoft::WRL;
@@ -16,6 +18,47 @@ using namespace DirectX;
 
 namespace march
 {
+    template <typename ListType>
+    static auto LowerBoundProperty(ListType& props, int32_t id)
+    {
+        return std::lower_bound(props.begin(), props.end(), id, [](const auto& p, int32_t id) { return p.first < id; });
+    }
+
+    template <typename T>
+    static const T* FindProperty(const MaterialPropertyList<T>& props, int32_t id)
+    {
+        auto it = LowerBoundProperty(props, id);
+        return (it != props.end() && it->first == id) ? &it->second : nullptr;
+    }
+
+    static bool IsPropertyValueEqual(int32_t a, int32_t b) { return a == b; }
+    static bool IsPropertyValueEqual(float a, float b) { return a == b; }
+    static bool IsPropertyValueEqual(const XMFLOAT4& a, const XMFLOAT4& b) { return XMVector4Equal(XMLoadFloat4(&a), XMLoadFloat4(&b)); }
+    static bool IsPropertyValueEqual(GfxTexture* a, GfxTexture* b) { return a == b; }
+
+    // 返回值是否有变化
+    template <typename T>
+    static bool SetProperty(MaterialPropertyList<T>& props, int32_t id, const T& value)
+    {
+        auto it = LowerBoundProperty(props, id);
+
+        if (it != props.end() && it->first == id)
+        {
+            if (IsPropertyValueEqual(it->second, value))
+            {
+                return false;
+            }
+
+            it->second = value;
+        }
+        else
+        {
+            props.emplace(it, id, value);
+        }
+
+        return true;
+    }
+
     void Material::Reset()
     {
         m_Shader = nullptr;
@@ -30,6 +73,8 @@ namespace march
         m_Colors.clear();
         m_Textures.clear();
 
+        m_ConstantBufferData.clear();
+        m_IsConstantBufferLayoutDirty = true;
         m_ConstantBuffer = nullptr;
         m_IsConstantBufferDirty = true;
 
@@ -39,59 +84,47 @@ namespace march
 
     void Material::SetInt(int32_t id, int32_t value)
     {
-        if (auto it = m_Ints.find(id); it != m_Ints.end() && it->second == value)
+        if (SetProperty(m_Ints, id, value))
         {
-            return;
+            WriteConstantBufferData(id, ShaderPropertyType::Int, value);
+            ++m_ResolvedRenderStateVersion; // 解析时用到了 Int 和 Float，强制重新解析
         }
-
-        m_Ints[id] = value;
-        m_IsConstantBufferDirty = true;
-        ++m_ResolvedRenderStateVersion; // 解析时用到了 Int 和 Float，强制重新解析
     }
 
     void Material::SetFloat(int32_t id, float value)
     {
-        if (auto it = m_Floats.find(id); it != m_Floats.end() && it->second == value)
+        if (SetProperty(m_Floats, id, value))
         {
-            return;
+            WriteConstantBufferData(id, ShaderPropertyType::Float, value);
+            ++m_ResolvedRenderStateVersion; // 解析时用到了 Int 和 Float，强制重新解析
         }
-
-        m_Floats[id] = value;
-        m_IsConstantBufferDirty = true;
-        ++m_ResolvedRenderStateVersion; // 解析时用到了 Int 和 Float，强制重新解析
     }
 
     void Material::SetVector(int32_t id, const XMFLOAT4& value)
     {
-        if (auto it = m_Vectors.find(id); it != m_Vectors.end() && XMVector4Equal(XMLoadFloat4(&it->second), XMLoadFloat4(&value)))
+        if (SetProperty(m_Vectors, id, value))
         {
-            return;
+            WriteConstantBufferData(id, ShaderPropertyType::Vector, value);
         }
-
-        m_Vectors[id] = value;
-        m_IsConstantBufferDirty = true;
     }
 
     void Material::SetColor(int32_t id, const XMFLOAT4& value)
     {
-        if (auto it = m_Colors.find(id); it != m_Colors.end() && XMVector4Equal(XMLoadFloat4(&it->second), XMLoadFloat4(&value)))
+        if (SetProperty(m_Colors, id, value))
         {
-            return;
+            WriteConstantBufferData(id, ShaderPropertyType::Color, GfxUtils::GetShaderColor(value));
         }
-
-        m_Colors[id] = value;
-        m_IsConstantBufferDirty = true;
     }
 
     void Material::SetTexture(int32_t id, GfxTexture* texture)
     {
-        if (texture == nullptr)
+        if (texture != nullptr)
         {
-            m_Textures.erase(id);
+            SetProperty(m_Textures, id, texture);
         }
-        else
+        else if (auto it = LowerBoundProperty(m_Textures, id); it != m_Textures.end() && it->first == id)
         {
-            m_Textures[id] = texture;
+            m_Textures.erase(it);
         }
     }
 
@@ -122,9 +155,9 @@ namespace march
 
     bool Material::GetInt(int32_t id, int32_t* outValue) const
     {
-        if (auto prop = m_Ints.find(id); prop != m_Ints.end())
+        if (const auto* value = FindProperty(m_Ints, id))
         {
-            *outValue = prop->second;
+            *outValue = *value;
             return true;
         }
 
@@ -144,9 +177,9 @@ namespace march
 
     bool Material::GetFloat(int32_t id, float* outValue) const
     {
-        if (auto prop = m_Floats.find(id); prop != m_Floats.end())
+        if (const auto* value = FindProperty(m_Floats, id))
         {
-            *outValue = prop->second;
+            *outValue = *value;
             return true;
         }
 
@@ -166,9 +199,9 @@ namespace march
 
     bool Material::GetVector(int32_t id, XMFLOAT4* outValue) const
     {
-        if (auto prop = m_Vectors.find(id); prop != m_Vectors.end())
+        if (const auto* value = FindProperty(m_Vectors, id))
         {
-            *outValue = prop->second;
+            *outValue = *value;
             return true;
         }
 
@@ -188,9 +221,9 @@ namespace march
 
     bool Material::GetColor(int32_t id, XMFLOAT4* outValue) const
     {
-        if (auto prop = m_Colors.find(id); prop != m_Colors.end())
+        if (const auto* value = FindProperty(m_Colors, id))
         {
-            *outValue = prop->second;
+            *outValue = *value;
             return true;
         }
 
@@ -210,9 +243,9 @@ namespace march
 
     bool Material::GetTexture(int32_t id, GfxTexture** outValue) const
     {
-        if (auto prop = m_Textures.find(id); prop != m_Textures.end())
+        if (const auto* value = FindProperty(m_Textures, id))
         {
-            *outValue = prop->second;
+            *outValue = *value;
             return true;
         }
 
@@ -270,7 +303,7 @@ namespace march
         m_Shader = shader;
         m_ShaderVersion = shader == nullptr ? 0 : shader->GetVersion();
         m_IsKeywordDirty = true;
-        m_IsConstantBufferDirty = true;
+        m_IsConstantBufferLayoutDirty = true;
         m_ResolvedRenderStates.clear();
         m_ResolvedRenderStateVersion = 0;
 
@@ -298,6 +331,7 @@ namespace march
 
     const ShaderKeywordSet& Material::GetKeywords()
     {
+        std::lock_guard<std::recursive_mutex> lock(m_CacheMutex);
         UpdateKeywords();
         return m_Keywords.GetKeywords();
     }
@@ -333,99 +367,139 @@ namespace march
         DisableKeyword(ShaderUtils::GetIdFromString(keyword));
     }
 
-    template<typename T>
-    static void SetConstantBufferProperty(uint8_t* p, Shader* shader, int32_t id, const T& value)
+    // 返回值是否有变化
+    template <typename T>
+    static bool CopyConstantBufferProperty(uint8_t* p, const ShaderConstantBufferProperty& prop, const T& value)
     {
-        const auto& locations = shader->GetPropertyLocations();
-        if (const auto it = locations.find(id); it != locations.end())
+        assert(sizeof(T) >= prop.Size); // 有时候会把 Vector4 绑定到 Vector3 上，所以用 >=
+
+        if (memcmp(p + prop.Offset, &value, prop.Size) == 0)
         {
-            assert(sizeof(T) >= it->second.Size); // 有时候会把 Vector4 绑定到 Vector3 上，所以用 >=
-            memcpy(p + it->second.Offset, &value, it->second.Size);
+            return false;
         }
+
+        memcpy(p + prop.Offset, &value, prop.Size);
+        return true;
     }
 
-    GfxBuffer* Material::GetConstantBuffer(size_t passIndex)
+    template <typename T>
+    void Material::WriteConstantBufferData(int32_t id, ShaderPropertyType type, const T& value)
     {
-        CheckShaderVersion();
+        // 布局要重建时会重新填充所有数据
+        if (m_IsConstantBufferLayoutDirty || m_Shader == nullptr || m_ShaderVersion != m_Shader->GetVersion())
+        {
+            return;
+        }
 
-        if (m_Shader == nullptr || m_Shader->GetMaterialConstantBufferSize() == 0)
+        // 类型不一致时 cbuffer 用的是 shader 的默认值，和重建时的结果保持一致
+        const ShaderConstantBufferProperty* prop = m_Shader->FindConstantBufferProperty(id);
+
+        if (prop == nullptr || prop->Type != type)
         {
-            return nullptr;
+            return;
         }
 
-        if (m_ConstantBuffer == nullptr)
+        assert(prop->Offset + prop->Size <= m_ConstantBufferData.size());
+
+        if (CopyConstantBufferProperty(m_ConstantBufferData.data(), *prop, value))
         {
-            m_ConstantBuffer = std::make_unique<GfxBuffer>(GetGfxDevice(), "MaterialConstantBuffer");
             m_IsConstantBufferDirty = true;
         }
+    }
 
-        if (m_IsConstantBufferDirty)
+    void Material::RebuildConstantBufferData()
+    {
+        m_ConstantBufferData.assign(m_Shader->GetMaterialConstantBufferSize(), 0);
+        uint8_t* p = m_ConstantBufferData.data();
+
+        for (const ShaderConstantBufferProperty& prop : m_Shader->GetConstantBufferProperties())
         {
-            uint32_t size = m_Shader->GetMaterialConstantBufferSize();
-            std::vector<uint8_t> data(size);
+            assert(prop.Offset + prop.Size <= m_ConstantBufferData.size());
 
-            // 初始化 cbuffer
-            for (const auto& [id, prop] : m_Shader->GetProperties())
+            switch (prop.Type)
             {
-                switch (prop.Type)
-                {
-                case ShaderPropertyType::Float:
+            case ShaderPropertyType::Float:
+            {
+                float value;
+                if (GetFloat(prop.Id, &value))
                 {
-                    float value;
-                    if (GetFloat(id, &value))
-                    {
-                        SetConstantBufferProperty(data.data(), m_Shader, id, value);
-                    }
-                    break;
+                    CopyConstantBufferProperty(p, prop, value);
                 }
+                break;
+            }
 
-                case ShaderPropertyType::Int:
+            case ShaderPropertyType::Int:
+            {
+                int32_t value;
+                if (GetInt(prop.Id, &value))
                 {
-                    int32_t value;
-                    if (GetInt(id, &value))
-                    {
-                        SetConstantBufferProperty(data.data(), m_Shader, id, value);
-                    }
-                    break;
+                    CopyConstantBufferProperty(p, prop, value);
                 }
+                break;
+            }
 
-                case ShaderPropertyType::Color:
+            case ShaderPropertyType::Color:
+            {
+                XMFLOAT4 value;
+                if (GetColor(prop.Id, &value))
                 {
-                    XMFLOAT4 value;
-                    if (GetColor(id, &value))
-                    {
-                        SetConstantBufferProperty(data.data(), m_Shader, id, GfxUtils::GetShaderColor(value));
-                    }
-                    break;
+                    CopyConstantBufferProperty(p, prop, GfxUtils::GetShaderColor(value));
                 }
+                break;
+            }
 
-                case ShaderPropertyType::Vector:
+            case ShaderPropertyType::Vector:
+            {
+                XMFLOAT4 value;
+                if (GetVector(prop.Id, &value))
                 {
-                    XMFLOAT4 value;
-                    if (GetVector(id, &value))
-                    {
-                        SetConstantBufferProperty(data.data(), m_Shader, id, value);
-                    }
-                    break;
+                    CopyConstantBufferProperty(p, prop, value);
                 }
+                break;
+            }
 
-                case ShaderPropertyType::Texture:
-                    // Ignore
-                    break;
-
-                default:
-                    LOG_ERROR("Unknown shader property type");
-                    break;
-                }
+            default:
+                LOG_ERROR("Unknown shader property type");
+                break;
             }
+        }
+
+        m_IsConstantBufferLayoutDirty = false;
+        m_IsConstantBufferDirty = true;
+    }
+
+    GfxBuffer* Material::GetConstantBuffer(size_t passIndex)
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_CacheMutex);
+
+        CheckShaderVersion();
 
+        if (m_Shader == nullptr || m_Shader->GetMaterialConstantBufferSize() == 0)
+        {
+            return nullptr;
+        }
+
+        if (m_IsConstantBufferLayoutDirty)
+        {
+            RebuildConstantBufferData();
+        }
+
+        if (m_ConstantBuffer == nullptr)
+        {
+            m_ConstantBuffer = std::make_unique<GfxBuffer>(GetGfxDevice(), "MaterialConstantBuffer");
+            m_IsConstantBufferDirty = true;
+        }
+
+        if (m_IsConstantBufferDirty)
+        {
             GfxBufferDesc desc{};
-            desc.Stride = size;
+            desc.Stride = static_cast<uint32_t>(m_ConstantBufferData.size());
             desc.Count = 1;
             desc.Usages = GfxBufferUsages::Constant;
             desc.Flags = GfxBufferFlags::Dynamic;
 
-            m_ConstantBuffer->SetData(desc, data.data());
+            // Dynamic buffer 每次写入都会分配新的内存，避免和 GPU 竞争，所以整个副本一次 memcpy 上传
+            m_ConstantBuffer->SetData(desc, m_ConstantBufferData.data());
             m_IsConstantBufferDirty = false;
         }
 
@@ -446,6 +520,8 @@ namespace march
 
     const ShaderPassRenderState& Material::GetResolvedRenderState(size_t passIndex, size_t* outHash)
     {
+        std::lock_guard<std::recursive_mutex> lock(m_CacheMutex);
+
         CheckShaderVersion();
         ResolvedRenderState& rrs = m_ResolvedRenderStates[passIndex];
 
@@ -564,6 +640,8 @@ namespace march
 
     ID3D12PipelineState* Material::GetPSO(size_t passIndex, bool hasOddNegativeScaling, const GfxInputDesc& inputDesc, const GfxOutputDesc& outputDesc)
     {
+        std::lock_guard<std::recursive_mutex> lock(m_CacheMutex);
+
         if (m_Shader == nullptr)
         {
             return nullptr;
@@ -582,6 +660,16 @@ namespace march
         hash.Append(inputDesc.GetHash());
         hash.Append(outputDesc.GetHash());
 
+        {
+            std::shared_lock<std::shared_mutex> psoLock(pass->m_PipelineStateMutex);
+
+            if (auto it = pass->m_PipelineStates.find(*hash); it != pass->m_PipelineStates.end())
+            {
+                return it->second.Get();
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> psoLock(pass->m_PipelineStateMutex);
         ComPtr<ID3D12PipelineState>& result = pass->m_PipelineStates[*hash];
 
         if (result == nullptr)
@@ -677,27 +765,27 @@ namespace march
         return result.Get();
     }
 
-    const std::unordered_map<int32_t, int32_t>& MaterialInternalUtility::GetRawInts(Material* m)
+    const MaterialPropertyList<int32_t>& MaterialInternalUtility::GetRawInts(Material* m)
     {
         return m->m_Ints;
     }
 
-    const std::unordered_map<int32_t, float>& MaterialInternalUtility::GetRawFloats(Material* m)
+    const MaterialPropertyList<float>& MaterialInternalUtility::GetRawFloats(Material* m)
     {
         return m->m_Floats;
     }
 
-    const std::unordered_map<int32_t, XMFLOAT4>& MaterialInternalUtility::GetRawVectors(Material* m)
+    const MaterialPropertyList<XMFLOAT4>& MaterialInternalUtility::GetRawVectors(Material* m)
     {
         return m->m_Vectors;
     }
 
-    const std::unordered_map<int32_t, XMFLOAT4>& MaterialInternalUtility::GetRawColors(Material* m)
+    const MaterialPropertyList<XMFLOAT4>& MaterialInternalUtility::GetRawColors(Material* m)
     {
         return m->m_Colors;
     }
 
-    const std::unordered_map<int32_t, GfxTexture*>& MaterialInternalUtility::GetRawTextures(Material* m)
+    const MaterialPropertyList<GfxTexture*>& MaterialInternalUtility::GetRawTextures(Material* m)
     {
         return m->m_Textures;
     }
@@ -11,6 +11,7 @@ NATIVE_EXPORT_AUTO MeshRenderer_New()
 NATIVE_EXPORT_AUTO MeshRenderer_SetMesh(cs<MeshRenderer*> self, cs<GfxMesh*> pMesh)
 {
     self->Mesh = pMesh;
+    self->MarkBoundsDirty();
 }
 
 NATIVE_EXPORT_AUTO MeshRenderer_SetMaterials(cs<MeshRenderer*> self, cs<cs<Material*>[]> materials)
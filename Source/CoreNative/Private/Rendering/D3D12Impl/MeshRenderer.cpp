@@ -1,10 +1,13 @@
 #include "pch.h"
 #include "Engine/Rendering/D3D12Impl/MeshRenderer.h"
 #include "Engine/Rendering/D3D12Impl/Material.h"
+#include "Engine/Rendering/D3D12Impl/GfxDevice.h"
+#include "Engine/Rendering/BoundingVolumeHierarchy.h"
+#include "Engine/Rendering/RenderPipeline.h"
 #include "Engine/Misc/MathUtils.h"
 #include "Engine/Transform.h"
 #include "Engine/JobManager.h"
-#include <atomic>
+#include <algorithm>
 
 using namespace DirectX;
 
@@ -14,6 +17,10 @@ namespace march
         : Mesh(nullptr)
         , Materials{}
         , m_PrevLocalToWorldMatrix(MathUtils::Identity4x4())
+        , m_Pipeline(nullptr)
+        , m_PipelineIndex(InvalidIndex)
+        , m_DirtyIndex(InvalidIndex)
+        , m_BVHLeaf(InvalidIndex)
     {
     }
 
@@ -45,20 +52,17 @@ namespace march
         m_PrevLocalToWorldMatrix = GetTransform()->GetLocalToWorldMatrix();
     }
 
-    bool MeshRendererBatch::DrawCall::operator<(const DrawCall& other) const
+    void MeshRenderer::MarkBoundsDirty()
     {
-        Shader* shader1 = Mat->GetShader();
-        Shader* shader2 = other.Mat->GetShader();
-
-        // 按 Shader / Material / Mesh / HasOddNegativeScaling / SubMeshIndex 排序
-
-        if (shader1 != shader2) return shader1 < shader2;
-        if (Mat != other.Mat) return Mat < other.Mat;
-        if (Mesh != other.Mesh) return Mesh < other.Mesh;
-        if (HasOddNegativeScaling != other.HasOddNegativeScaling) return HasOddNegativeScaling < other.HasOddNegativeScaling;
-        if (SubMeshIndex != other.SubMeshIndex) return SubMeshIndex < other.SubMeshIndex;
+        if (m_Pipeline != nullptr)
+        {
+            m_Pipeline->MarkMeshRendererDirty(this);
+        }
+    }
 
-        return false;
+    void MeshRenderer::OnTransformChanged()
+    {
+        MarkBoundsDirty();
     }
 
     MeshRendererBatch::InstanceData MeshRendererBatch::InstanceData::Create(const MeshRenderer* renderer)
@@ -70,89 +74,220 @@ namespace march
 
     MeshRendererBatch::InstanceData MeshRendererBatch::InstanceData::Create(const XMFLOAT4X4& currMatrix, const XMFLOAT4X4& prevMatrix)
     {
-        XMFLOAT4X4 currMatrixIT{};
-        XMVECTOR det{};
-        XMStoreFloat4x4(&currMatrixIT, XMMatrixTranspose(XMMatrixInverse(&det, XMLoadFloat4x4(&currMatrix))));
+        // DirectX 用的行向量，XMStoreFloat3x4 会转置，得到列向量约定的前三行
+        InstanceData data{};
+        XMStoreFloat3x4(&data.Matrix, XMLoadFloat4x4(&currMatrix));
+        XMStoreFloat3x4(&data.MatrixPrev, XMLoadFloat4x4(&prevMatrix));
+        return data;
+    }
+
+    bool MeshRendererBatch::InstanceData::HasOddNegativeScaling() const
+    {
+        // 左上角 3x3 的行列式小于 0，和 shader 里的 GetOddNegativeScale 一致
+        const auto& m = Matrix.m;
+        float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+            - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+            + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        return det < 0.0f;
+    }
 
-        XMFLOAT4 params{};
-        params.x = std::copysignf(1.0f, XMVectorGetX(det)); // det < 0 时，x = -1.0f，否则 x = 1.0f
+    static bool IsDrawable(const MeshRenderer* renderer)
+    {
+        if (!renderer->GetIsActiveAndEnabled())
+        {
+            return false;
+        }
 
-        return MeshRendererBatch::InstanceData{ currMatrix, currMatrixIT, prevMatrix, params };
+        return renderer->Mesh != nullptr && renderer->Mesh->GetSubMeshCount() > 0 && !renderer->Materials.empty();
     }
 
-    static void CullMeshRenderers(std::vector<MeshRenderer*>& results, const MeshRendererBatch::FrustumType& frustum, size_t numRenderers, MeshRenderer* const* renderers)
+    template <typename Volume>
+    void MeshRendererBatch::CullSubtree(CullContext& context, const Volume& volume, const CullingVolume& cullingVolume, const BoundingVolumeHierarchy& bvh, uint32_t root)
     {
-        std::atomic_size_t count = 0;
-        results.resize(numRenderers);
+        context.Results.clear();
+        context.Candidates.clear();
+        context.CandidateBounds.Clear();
 
-        auto func = [&](size_t index)
+        bvh.Query(volume, root, [&context](const BoundingVolumeHierarchy::Node& leaf, bool isContained)
         {
             // MeshRenderer 不是线程安全的，这里绝对不能修改 renderer
-            const MeshRenderer* renderer = renderers[index];
+            MeshRenderer* renderer = static_cast<MeshRenderer*>(leaf.UserData);
 
-            if (!renderer->GetIsActiveAndEnabled())
+            if (!IsDrawable(renderer))
             {
                 return;
             }
 
-            if (renderer->Mesh == nullptr || renderer->Mesh->GetSubMeshCount() == 0 || renderer->Materials.empty())
+            if (isContained)
             {
-                return;
+                context.Results.push_back(renderer);
+            }
+            else
+            {
+                context.Candidates.push_back(renderer);
+                context.CandidateBounds.Add(leaf.ObjectBounds);
             }
+        });
+
+        // 剩下的叶子收集成 SoA 后一次测试多个
+        const size_t numCandidates = context.Candidates.size();
+        context.VisibleIndices.resize(numCandidates);
+        size_t numVisible = cullingVolume.Cull(context.CandidateBounds, 0, numCandidates, context.VisibleIndices.data());
 
-            ContainmentType containment = std::visit([renderer](auto&& f)
+        for (size_t i = 0; i < numVisible; i++)
+        {
+            context.Results.push_back(context.Candidates[context.VisibleIndices[i]]);
+        }
+    }
+
+    void MeshRendererBatch::CullMeshRenderers(const FrustumType& frustum, const BoundingVolumeHierarchy& bvh)
+    {
+        m_VisibleRenderers.clear();
+
+        // 只在最外面 visit 一次，遍历 BVH 时直接用具体的类型
+        std::visit([this, &bvh](auto&& volume)
+        {
+            CullingVolume cullingVolume(volume);
+            constexpr size_t minParallelCount = 256; // 太少的话不值得并行
+
+            if (bvh.GetLeafCount() < minParallelCount)
             {
-                return f.Contains(renderer->GetBounds());
-            }, frustum);
+                m_CullSubtrees.assign(1, bvh.GetRoot());
+            }
+            else
+            {
+                // 拆成若干棵子树，每个线程各自遍历，结果写到各自的 context 里，最后按顺序拼起来
+                bvh.CollectSubtrees((static_cast<size_t>(JobManager::GetWorkerCount()) + 1) * 4, m_CullSubtrees);
+            }
 
-            if (containment == ContainmentType::DISJOINT)
+            const size_t numSubtrees = m_CullSubtrees.size();
+
+            if (m_CullContexts.size() < numSubtrees)
             {
-                return;
+                m_CullContexts.resize(numSubtrees);
+            }
+
+            if (numSubtrees == 1)
+            {
+                CullSubtree(m_CullContexts[0], volume, cullingVolume, bvh, m_CullSubtrees[0]);
+            }
+            else
+            {
+                JobManager::ParallelFor(numSubtrees, 1, [this, &bvh, &volume, &cullingVolume](size_t i)
+                {
+                    CullSubtree(m_CullContexts[i], volume, cullingVolume, bvh, m_CullSubtrees[i]);
+                });
+            }
+
+            for (size_t i = 0; i < numSubtrees; i++)
+            {
+                const std::vector<MeshRenderer*>& results = m_CullContexts[i].Results;
+                m_VisibleRenderers.insert(m_VisibleRenderers.end(), results.begin(), results.end());
             }
+        }, frustum);
+    }
+
+    static Material* GetSubMeshMaterial(const MeshRenderer* renderer, uint32_t subMesh)
+    {
+        return (subMesh < renderer->Materials.size()) ? renderer->Materials[subMesh] : renderer->Materials.back();
+    }
+
+    void MeshRendererBatch::Rebuild(const FrustumType& frustum, const BoundingVolumeHierarchy& bvh)
+    {
+        // 所有容器都只 clear，保留上一帧的内存
+        m_DrawCalls.clear();
+        m_Instances.clear();
+        m_Sorter.Clear();
+
+        CullMeshRenderers(frustum, bvh);
 
-            results[count++] = const_cast<MeshRenderer*>(renderer);
+        // 每个 renderer 的 InstanceData 只需要算一次，数量多时并行
+        const size_t numVisible = m_VisibleRenderers.size();
+        m_RendererInstances.resize(numVisible);
+
+        auto createInstance = [this](size_t i)
+        {
+            m_RendererInstances[i] = InstanceData::Create(m_VisibleRenderers[i]);
         };
 
-        constexpr size_t jobBatchSize = 4;
+        constexpr size_t minParallelCount = 64; // 太少的话不值得并行
 
-        if (numRenderers > jobBatchSize)
+        if (numVisible > minParallelCount)
         {
-            JobManager::Schedule(numRenderers, jobBatchSize, func).Complete();
+            JobManager::ParallelFor(numVisible, 0, createInstance);
         }
         else
         {
-            for (size_t i = 0; i < numRenderers; i++)
+            for (size_t i = 0; i < numVisible; i++)
             {
-                func(i);
+                createInstance(i);
             }
         }
 
-        results.resize(count);
-    }
-
-    void MeshRendererBatch::Rebuild(const FrustumType& frustum, size_t numRenderers, MeshRenderer* const* renderers)
-    {
-        m_DrawCalls.clear();
-
-        static std::vector<MeshRenderer*> visibleRenderers{};
-        CullMeshRenderers(visibleRenderers, frustum, numRenderers, renderers);
-
-        for (MeshRenderer* renderer : visibleRenderers)
+        for (uint32_t i = 0; i < numVisible; i++)
         {
+            const MeshRenderer* renderer = m_VisibleRenderers[i];
+            bool hasOddNegativeScaling = m_RendererInstances[i].HasOddNegativeScaling();
+
             for (uint32_t subMesh = 0; subMesh < renderer->Mesh->GetSubMeshCount(); subMesh++)
             {
-                Material* material = (subMesh < renderer->Materials.size())
-                    ? renderer->Materials[subMesh] : renderer->Materials.back();
+                Material* material = GetSubMeshMaterial(renderer, subMesh);
 
-                if (material == nullptr || material->GetShader() == nullptr)
+                if (material == nullptr)
                 {
                     continue;
                 }
 
-                InstanceData instanceData = InstanceData::Create(renderer);
-                DrawCall drawCall{ material, renderer->Mesh, subMesh, instanceData.HasOddNegativeScaling() };
-                m_DrawCalls[drawCall].push_back(instanceData);
+                Shader* shader = material->GetShader();
+
+                if (shader == nullptr)
+                {
+                    continue;
+                }
+
+                m_Sorter.Add(shader, material, renderer->Mesh, hasOddNegativeScaling, subMesh, i);
             }
         }
+
+        m_Sorter.Sort();
+
+        // 排序后相同 key 的 instance 是连续的，每一段就是一个 draw call
+        const std::vector<DrawCallSortItem>& items = m_Sorter.GetItems();
+        m_Instances.resize(items.size());
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(items.size()); i++)
+        {
+            const DrawCallSortItem& item = items[i];
+            const InstanceData& instance = m_RendererInstances[item.RendererIndex];
+            m_Instances[i] = instance;
+
+            if (i == 0 || !m_Sorter.IsSameDrawCall(items[i - 1], item))
+            {
+                MeshRenderer* renderer = m_VisibleRenderers[item.RendererIndex];
+                Material* material = GetSubMeshMaterial(renderer, item.SubMeshIndex);
+                m_DrawCalls.push_back(DrawCall{ item.Key, material, renderer->Mesh, item.SubMeshIndex, instance.HasOddNegativeScaling(), i, 0 });
+            }
+
+            m_DrawCalls.back().InstanceCount++;
+        }
+
+        if (m_Instances.empty())
+        {
+            return;
+        }
+
+        if (m_InstanceBuffer == nullptr)
+        {
+            m_InstanceBuffer = std::make_unique<GfxBuffer>(GetGfxDevice(), "_InstanceBuffer");
+        }
+
+        // 整个 batch 只分配和上传一次，所有 pass 共用
+        GfxBufferDesc desc{};
+        desc.Stride = sizeof(InstanceData);
+        desc.Count = static_cast<uint32_t>(m_Instances.size());
+        desc.Usages = GfxBufferUsages::Structured;
+        desc.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
+
+        m_InstanceBuffer->SetData(desc, m_Instances.data());
     }
 }
@@ -184,6 +184,7 @@ namespace march
         {
             pShader->m_Version++;
             pShader->m_Properties.clear();
+            pShader->RebuildConstantBufferProperties();
         }
 
         inline static void SetName(Shader* pShader, cs_string name)
@@ -221,6 +222,8 @@ namespace march
                 LOG_ERROR("Unknown shader property type: {}", prop->Type.data);
                 break;
             }
+
+            pShader->RebuildConstantBufferProperties();
         }
 
         inline static void SetPasses(Shader* pShader, cs<CSharpShaderPass[]> passes)
@@ -564,6 +567,8 @@ namespace march
                 const auto& mp = locations[i];
                 pShader->m_PropertyLocations[ShaderUtils::GetIdFromString(mp.Name)] = { mp.Offset, mp.Size };
             }
+
+            pShader->RebuildConstantBufferProperties();
         }
     };
 }
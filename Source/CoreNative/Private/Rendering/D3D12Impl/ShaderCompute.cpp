@@ -116,6 +116,16 @@ namespace march
         const ShaderKeywordSet& keywords = m_KeywordSet.GetKeywords();
 
         size_t hash = kernel->GetProgramMatch(keywords).Hash;
+        {
+            std::shared_lock<std::shared_mutex> lock(kernel->m_PipelineStateMutex);
+
+            if (auto it = kernel->m_PipelineStates.find(hash); it != kernel->m_PipelineStates.end())
+            {
+                return it->second.Get();
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(kernel->m_PipelineStateMutex);
         ComPtr<ID3D12PipelineState>& result = kernel->m_PipelineStates[hash];
 
         if (result == nullptr)
@@ -7,7 +7,7 @@
 
 namespace march
 {
-    static constexpr auto MaterialConstantBufferName = "cbMaterial";
+    static constexpr ShaderStringKey MaterialConstantBufferName("cbMaterial");
 
     GfxTexture* ShaderProperty::GetDefaultTexture() const
     {
@@ -116,7 +116,7 @@ namespace march
             CHECK_HR(cbuffer->GetDesc(&bufferDesc));
 
             // 记录 material 的 shader property location
-            if (strcmp(bufferDesc.Name, MaterialConstantBufferName) == 0 && bufferDesc.Size > 0)
+            if (MaterialConstantBufferName.Str == bufferDesc.Name && bufferDesc.Size > 0)
             {
                 m_MaterialConstantBufferSize = std::max(m_MaterialConstantBufferSize, static_cast<uint32_t>(bufferDesc.Size));
 
@@ -135,7 +135,39 @@ namespace march
 
         m_Version++;
         ShaderPass* pass = GetPass(passIndex);
-        return pass->Compile(m_KeywordSpace.get(), filename, source, pragmas, warnings, error, recordConstantBufferCallback);
+        bool result = pass->Compile(m_KeywordSpace.get(), filename, source, pragmas, warnings, error, recordConstantBufferCallback);
+        RebuildConstantBufferProperties();
+        return result;
+    }
+
+    void Shader::RebuildConstantBufferProperties()
+    {
+        m_ConstantBufferProperties.clear();
+
+        for (const auto& [id, loc] : m_PropertyLocations)
+        {
+            // 只记录有 shader property 的，material 只会写入这些
+            if (auto it = m_Properties.find(id); it != m_Properties.end() && it->second.Type != ShaderPropertyType::Texture)
+            {
+                m_ConstantBufferProperties.push_back({ id, it->second.Type, loc.Offset, loc.Size });
+            }
+        }
+
+        std::sort(m_ConstantBufferProperties.begin(), m_ConstantBufferProperties.end(),
+            [](const ShaderConstantBufferProperty& a, const ShaderConstantBufferProperty& b) { return a.Id < b.Id; });
+    }
+
+    const ShaderConstantBufferProperty* Shader::FindConstantBufferProperty(int32_t id) const
+    {
+        auto it = std::lower_bound(m_ConstantBufferProperties.begin(), m_ConstantBufferProperties.end(), id,
+            [](const ShaderConstantBufferProperty& prop, int32_t id) { return prop.Id < id; });
+
+        if (it != m_ConstantBufferProperties.end() && it->Id == id)
+        {
+            return &(*it);
+        }
+
+        return nullptr;
     }
 
     std::optional<size_t> Shader::GetFirstPassIndexWithTagValue(const std::string& tag, const std::string& value) const
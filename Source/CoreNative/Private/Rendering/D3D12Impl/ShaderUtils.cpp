@@ -3,6 +3,9 @@
 #include "Engine/Rendering/D3D12Impl/ShaderUtils.h"
 #include "Engine/Misc/StringUtils.h"
 #include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <stdexcept>
 #include <wrl.h>
 
@@ -10,26 +13,112 @@ using namespace Microsoft::WRL;
 
 namespace march
 {
-    static std::unordered_map<std::string, int32> g_StringIdMap{};
-    static int32 g_NextStringId = 0;
+    // id -> string 按 id 分块存储，块一旦分配就不会移动，所以读的时候不需要加锁
+    static constexpr int32 g_StringChunkSizeLog2 = 10;
+    static constexpr int32 g_StringChunkSize = 1 << g_StringChunkSizeLog2;
+    static constexpr int32 g_MaxStringChunks = 4096;
 
-    int32 ShaderUtils::GetIdFromString(const std::string& str)
+    static std::atomic<std::string*> g_StringChunks[g_MaxStringChunks]{}; // 程序结束前一直有效，不释放
+    static std::atomic<int32> g_NextStringId = 0;
+
+    // string -> id 按 hash 分片，不同分片的读写互不影响
+    struct StringIdShard
+    {
+        struct Key
+        {
+            uint64 Hash;
+            std::string_view Str; // 指向 g_StringChunks 中的 string
+
+            bool operator==(const Key& other) const { return Hash == other.Hash && Str == other.Str; }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const { return static_cast<size_t>(key.Hash); }
+        };
+
+        std::shared_mutex Mutex{};
+        std::unordered_map<Key, int32, KeyHash> Map{};
+    };
+
+    static constexpr size_t g_NumStringIdShards = 16;
+    static StringIdShard g_StringIdShards[g_NumStringIdShards]{};
+
+    static std::string& GetStringSlot(int32 id)
+    {
+        std::atomic<std::string*>& chunk = g_StringChunks[id >> g_StringChunkSizeLog2];
+        std::string* strings = chunk.load(std::memory_order_acquire);
+
+        if (strings == nullptr)
+        {
+            std::string* newStrings = new std::string[g_StringChunkSize];
+
+            if (chunk.compare_exchange_strong(strings, newStrings, std::memory_order_acq_rel))
+            {
+                strings = newStrings;
+            }
+            else
+            {
+                delete[] newStrings; // 被其他线程抢先分配了
+            }
+        }
+
+        return strings[id & (g_StringChunkSize - 1)];
+    }
+
+    int32 ShaderUtils::GetIdFromString(std::string_view str)
     {
-        auto p = g_StringIdMap.try_emplace(str, g_NextStringId);
-        if (p.second) ++g_NextStringId;
-        return p.first->second;
+        return GetIdFromString(ShaderStringKey(str));
+    }
+
+    int32 ShaderUtils::GetIdFromString(const ShaderStringKey& key)
+    {
+        // 高位用来选分片，低位留给 unordered_map
+        StringIdShard& shard = g_StringIdShards[(key.Hash >> 59) & (g_NumStringIdShards - 1)];
+        StringIdShard::Key mapKey{ key.Hash, key.Str };
+
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.Mutex);
+
+            if (auto it = shard.Map.find(mapKey); it != shard.Map.end())
+            {
+                return it->second;
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(shard.Mutex);
+
+        if (auto it = shard.Map.find(mapKey); it != shard.Map.end())
+        {
+            return it->second;
+        }
+
+        // 先检查再加 1，满了以后 g_NextStringId 不会继续增长，GetStringFromId 也就不会越界
+        int32 id = g_NextStringId.load(std::memory_order_relaxed);
+
+        do
+        {
+            if (id >= g_StringChunkSize * g_MaxStringChunks)
+            {
+                throw std::runtime_error("Too many shader strings");
+            }
+        } while (!g_NextStringId.compare_exchange_weak(id, id + 1, std::memory_order_relaxed));
+
+        std::string& slot = GetStringSlot(id);
+        slot.assign(key.Str);
+
+        // key 必须指向自己保存的 string，因为参数可能是临时的
+        shard.Map.emplace(StringIdShard::Key{ key.Hash, slot }, id);
+        return id;
     }
 
     const std::string& ShaderUtils::GetStringFromId(int32 id)
     {
-        if (id < g_NextStringId)
+        if (id >= 0 && id < g_NextStringId.load(std::memory_order_acquire))
         {
-            for (const auto& p : g_StringIdMap)
+            if (std::string* strings = g_StringChunks[id >> g_StringChunkSizeLog2].load(std::memory_order_acquire))
             {
-                if (p.second == id)
-                {
-                    return p.first;
-                }
+                return strings[id & (g_StringChunkSize - 1)];
             }
         }
 
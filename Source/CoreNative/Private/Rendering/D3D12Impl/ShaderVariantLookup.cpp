@@ -0,0 +1,262 @@
+#include "pch.h"
+#include "Engine/Rendering/D3D12Impl/ShaderVariantLookup.h"
+#include <algorithm>
+#include <limits>
+
+namespace march
+{
+    void ShaderVariantLookup::Reset()
+    {
+        m_Variants.clear();
+        m_IsBuilt = false;
+    }
+
+    void ShaderVariantLookup::Add(const ShaderKeywordSet& keywords)
+    {
+        m_Variants.push_back(keywords);
+        m_IsBuilt = false;
+    }
+
+    std::optional<size_t> ShaderVariantLookup::Find(const ShaderKeywordSet& keywords)
+    {
+        if (m_Variants.empty())
+        {
+            return std::nullopt;
+        }
+
+        if (!m_IsBuilt)
+        {
+            Build();
+        }
+
+        // 差异为 0 的 variant keyword 完全相同，map 里存的是第一个
+        if (auto it = m_ExactMatches.find(keywords); it != m_ExactMatches.end())
+        {
+            return it->second;
+        }
+
+        if (m_IsCartesianProduct)
+        {
+            if (std::optional<size_t> index = FindInCartesianProduct(keywords))
+            {
+                return index;
+            }
+        }
+
+        // 不规则的 variant 集合，只能线性查找
+        return FindLinear(keywords);
+    }
+
+    void ShaderVariantLookup::Build()
+    {
+        using BitsType = ShaderKeywordSet::BitsType;
+
+        m_IsBuilt = true;
+        m_ExactMatches.clear();
+        m_IsCartesianProduct = false;
+        m_KeywordSpace = nullptr;
+        m_Dimensions.clear();
+        m_DimensionHasEmptyOption.clear();
+
+        if (m_Variants.empty())
+        {
+            return;
+        }
+
+        BitsType allKeywords{};
+        BitsType coOccurrences[ShaderKeywordSpace::NumMaxKeywords]{};
+
+        for (size_t i = 0; i < m_Variants.size(); i++)
+        {
+            m_ExactMatches.try_emplace(m_Variants[i], i); // keyword 相同时使用第一个
+        }
+
+        for (const ShaderKeywordSet& ks : m_Variants)
+        {
+            if (ks.GetSpace() != m_Variants[0].GetSpace())
+            {
+                return;
+            }
+
+            const BitsType& bits = ks.GetBits();
+            allKeywords |= bits;
+
+            for (size_t k = 0; k < bits.size(); k++)
+            {
+                if (bits[k])
+                {
+                    coOccurrences[k] |= bits;
+                }
+            }
+        }
+
+        // 同一个 multi_compile 中的 keyword 不会同时出现，不同维度的 keyword 一定会同时出现
+        BitsType remaining = allKeywords;
+        size_t numCombinations = 1;
+
+        for (size_t k = 0; k < remaining.size(); k++)
+        {
+            if (!remaining[k])
+            {
+                continue;
+            }
+
+            BitsType group = remaining & ~coOccurrences[k];
+            group.set(k);
+            remaining &= ~group;
+
+            std::vector<size_t>& dimension = m_Dimensions.emplace_back();
+
+            for (size_t g = 0; g < group.size(); g++)
+            {
+                if (!group[g])
+                {
+                    continue;
+                }
+
+                // 组内的 keyword 必须两两不同时出现
+                if ((coOccurrences[g] & group) != BitsType{}.set(g))
+                {
+                    return;
+                }
+
+                dimension.push_back(g);
+            }
+
+            bool hasEmptyOption = std::any_of(m_Variants.begin(), m_Variants.end(),
+                [&group](const ShaderKeywordSet& ks) { return (ks.GetBits() & group).none(); });
+            m_DimensionHasEmptyOption.push_back(hasEmptyOption);
+
+            numCombinations *= dimension.size() + (hasEmptyOption ? 1 : 0);
+
+            if (numCombinations > m_ExactMatches.size())
+            {
+                return;
+            }
+        }
+
+        // 每个 variant 在每个维度中最多选一个 keyword，所以只要数量对得上，所有组合就都存在
+        m_IsCartesianProduct = (numCombinations == m_ExactMatches.size());
+        m_KeywordSpace = m_Variants[0].GetSpace();
+    }
+
+    std::optional<size_t> ShaderVariantLookup::FindInCartesianProduct(const ShaderKeywordSet& keywords) const
+    {
+        using BitsType = ShaderKeywordSet::BitsType;
+        static constexpr size_t EmptyOption = std::numeric_limits<size_t>::max();
+
+        // 差异可以拆成每个维度的差异之和，不在任何维度中的 keyword 对所有 variant 的影响都一样
+        BitsType target{};
+
+        if (keywords.GetSpace() == m_KeywordSpace)
+        {
+            target = keywords.GetBits();
+        }
+
+        // 每个维度中差异最小的选项可能有好几个，要在这些组合里找索引最小的 variant
+        std::vector<std::vector<size_t>> tiedOptions(m_Dimensions.size());
+        size_t numCombinations = 1;
+
+        for (size_t d = 0; d < m_Dimensions.size(); d++)
+        {
+            size_t numTargetKeywords = 0;
+
+            for (size_t k : m_Dimensions[d])
+            {
+                numTargetKeywords += target[k] ? 1 : 0;
+            }
+
+            std::vector<size_t>& options = tiedOptions[d];
+            size_t minDiff = std::numeric_limits<size_t>::max();
+
+            if (m_DimensionHasEmptyOption[d])
+            {
+                minDiff = numTargetKeywords;
+                options.push_back(EmptyOption);
+            }
+
+            for (size_t k : m_Dimensions[d])
+            {
+                size_t diff = numTargetKeywords + 1 - (target[k] ? 2 : 0);
+
+                if (diff < minDiff)
+                {
+                    minDiff = diff;
+                    options.clear();
+                }
+
+                if (diff == minDiff)
+                {
+                    options.push_back(k);
+                }
+            }
+
+            numCombinations *= options.size();
+
+            if (numCombinations > MaxTiedCombinations)
+            {
+                return std::nullopt;
+            }
+        }
+
+        std::optional<size_t> result = std::nullopt;
+        std::vector<size_t> choices(m_Dimensions.size(), 0);
+
+        for (size_t c = 0; c < numCombinations; c++)
+        {
+            BitsType bits{};
+
+            for (size_t d = 0; d < m_Dimensions.size(); d++)
+            {
+                if (size_t option = tiedOptions[d][choices[d]]; option != EmptyOption)
+                {
+                    bits.set(option);
+                }
+            }
+
+            ShaderKeywordSet ks{};
+            ks.Reset(m_KeywordSpace);
+            ks.SetBits(bits);
+
+            if (auto it = m_ExactMatches.find(ks); it != m_ExactMatches.end())
+            {
+                result = result ? std::min(*result, it->second) : it->second;
+            }
+
+            // 下一个组合
+            for (size_t d = 0; d < choices.size(); d++)
+            {
+                if (++choices[d] < tiedOptions[d].size())
+                {
+                    break;
+                }
+
+                choices[d] = 0;
+            }
+        }
+
+        return result;
+    }
+
+    std::optional<size_t> ShaderVariantLookup::FindLinear(const ShaderKeywordSet& keywords) const
+    {
+        std::optional<size_t> index = std::nullopt;
+        size_t minDiff = std::numeric_limits<size_t>::max();
+        size_t targetKeywordCount = keywords.GetNumEnabledKeywords();
+
+        for (size_t j = 0; j < m_Variants.size(); j++)
+        {
+            const ShaderKeywordSet& ks = m_Variants[j];
+            size_t matchingCount = ks.GetNumMatchingKeywords(keywords);
+            size_t currentKeywordCount = ks.GetNumEnabledKeywords();
+
+            if (size_t diff = targetKeywordCount + currentKeywordCount - 2 * matchingCount; diff < minDiff)
+            {
+                minDiff = diff;
+                index = j;
+            }
+        }
+
+        return index;
+    }
+}
@@ -0,0 +1,263 @@
+#include "pch.h"
+#include "Engine/Rendering/DrawCallSorter.h"
+#include "Engine/JobManager.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace march
+{
+    uint32_t DrawCallSorter::PointerIdMap::GetOrAdd(const void* ptr)
+    {
+        // 负载因子不超过 0.5
+        if ((m_Count + 1) * 2 > m_Slots.size())
+        {
+            Grow();
+        }
+
+        const size_t mask = m_Slots.size() - 1;
+        size_t i = static_cast<size_t>((reinterpret_cast<uintptr_t>(ptr) >> 4) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+
+        while (true)
+        {
+            std::pair<const void*, uint32_t>& slot = m_Slots[i];
+
+            if (slot.first == ptr)
+            {
+                return slot.second;
+            }
+
+            if (slot.first == nullptr)
+            {
+                slot = std::make_pair(ptr, m_Count);
+                return m_Count++;
+            }
+
+            i = (i + 1) & mask;
+        }
+    }
+
+    void DrawCallSorter::PointerIdMap::Clear()
+    {
+        if (m_Count > 0)
+        {
+            std::fill(m_Slots.begin(), m_Slots.end(), std::make_pair(nullptr, 0u));
+            m_Count = 0;
+        }
+    }
+
+    void DrawCallSorter::PointerIdMap::Grow()
+    {
+        std::vector<std::pair<const void*, uint32_t>> oldSlots(std::max<size_t>(m_Slots.size() * 2, 64), std::make_pair(nullptr, 0u));
+        oldSlots.swap(m_Slots);
+
+        const size_t mask = m_Slots.size() - 1;
+
+        for (const std::pair<const void*, uint32_t>& slot : oldSlots)
+        {
+            if (slot.first == nullptr)
+            {
+                continue;
+            }
+
+            size_t i = static_cast<size_t>((reinterpret_cast<uintptr_t>(slot.first) >> 4) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+
+            while (m_Slots[i].first != nullptr)
+            {
+                i = (i + 1) & mask;
+            }
+
+            m_Slots[i] = slot;
+        }
+    }
+
+    void DrawCallSorter::Clear()
+    {
+        m_ShaderIds.Clear();
+        m_MaterialIds.Clear();
+        m_MeshIds.Clear();
+        m_Items.clear();
+        m_WideKeys.clear();
+        m_IsKeyOverflowed = false;
+    }
+
+    static constexpr uint64_t LowBitsMask(uint32_t bits)
+    {
+        return (1ull << bits) - 1;
+    }
+
+    void DrawCallSorter::Add(const void* shader, const void* material, const void* mesh, bool hasOddNegativeScaling, uint32_t subMeshIndex, uint32_t rendererIndex)
+    {
+        uint64_t shaderId = m_ShaderIds.GetOrAdd(shader);
+        uint64_t materialId = m_MaterialIds.GetOrAdd(material);
+        uint64_t meshId = m_MeshIds.GetOrAdd(mesh);
+        uint64_t oddNegativeScaling = hasOddNegativeScaling ? 1 : 0;
+        assert(subMeshIndex < (1u << 31)); // WideKey 中 SubMeshIndex 只有 31 位
+
+        if (!m_IsKeyOverflowed && (shaderId > LowBitsMask(ShaderIdBits) || materialId > LowBitsMask(MaterialIdBits)
+            || meshId > LowBitsMask(MeshIdBits) || subMeshIndex > LowBitsMask(SubMeshIndexBits)))
+        {
+            // 之前的键都没有溢出，可以拆回各个字段，之后这一帧都用 WideKey
+            m_WideKeys.resize(m_Items.size());
+
+            for (size_t i = 0; i < m_Items.size(); i++)
+            {
+                uint64_t key = m_Items[i].Key;
+                uint64_t subMesh = key & LowBitsMask(SubMeshIndexBits);
+                key >>= SubMeshIndexBits;
+                uint64_t odd = key & LowBitsMask(OddNegativeScalingBits);
+                key >>= OddNegativeScalingBits;
+                uint64_t mesh = key & LowBitsMask(MeshIdBits);
+                key >>= MeshIdBits;
+                uint64_t mat = key & LowBitsMask(MaterialIdBits);
+                key >>= MaterialIdBits;
+
+                m_WideKeys[i] = WideKey{ (key << 32) | mat, (mesh << 32) | (odd << 31) | subMesh };
+                m_Items[i].Key = i;
+            }
+
+            m_IsKeyOverflowed = true;
+        }
+
+        if (m_IsKeyOverflowed)
+        {
+            m_WideKeys.push_back(WideKey{ (shaderId << 32) | materialId, (meshId << 32) | (oddNegativeScaling << 31) | subMeshIndex });
+            m_Items.push_back(DrawCallSortItem{ m_Items.size(), rendererIndex, subMeshIndex });
+            return;
+        }
+
+        uint64_t key = shaderId;
+        key = (key << MaterialIdBits) | materialId;
+        key = (key << MeshIdBits) | meshId;
+        key = (key << OddNegativeScalingBits) | oddNegativeScaling;
+        key = (key << SubMeshIndexBits) | subMeshIndex;
+
+        m_Items.push_back(DrawCallSortItem{ key, rendererIndex, subMeshIndex });
+    }
+
+    void DrawCallSorter::Sort()
+    {
+        if (m_IsKeyOverflowed)
+        {
+            // 只有极端的场景才会走到这里，不追求速度
+            WideSort();
+            return;
+        }
+
+        if (m_Items.size() < 256)
+        {
+            // 数量少时基数排序的固定开销反而更大
+            std::sort(m_Items.begin(), m_Items.end(), [](const DrawCallSortItem& a, const DrawCallSortItem& b)
+            {
+                return a.Key < b.Key || (a.Key == b.Key && a.RendererIndex < b.RendererIndex);
+            });
+            return;
+        }
+
+        RadixSort();
+    }
+
+    bool DrawCallSorter::IsSameDrawCall(const DrawCallSortItem& a, const DrawCallSortItem& b) const
+    {
+        return m_IsKeyOverflowed ? m_WideKeys[a.Key] == m_WideKeys[b.Key] : a.Key == b.Key;
+    }
+
+    void DrawCallSorter::WideSort()
+    {
+        // Key 是 Add 的顺序，键相同时按它排，和基数排序一样是稳定的
+        std::sort(m_Items.begin(), m_Items.end(), [this](const DrawCallSortItem& a, const DrawCallSortItem& b)
+        {
+            const WideKey& ka = m_WideKeys[a.Key];
+            const WideKey& kb = m_WideKeys[b.Key];
+            return ka < kb || (ka == kb && a.Key < b.Key);
+        });
+    }
+
+    void DrawCallSorter::RadixSort()
+    {
+        const size_t count = m_Items.size();
+
+        // 只有不同 key 之间有差异的字节才需要排序
+        uint64_t diffBits = 0;
+
+        for (const DrawCallSortItem& item : m_Items)
+        {
+            diffBits |= item.Key ^ m_Items[0].Key;
+        }
+
+        // 每个 chunk 有自己的直方图，histogram 和 scatter 都可以并行，且结果是稳定的
+        constexpr size_t minItemsPerChunk = 2048;
+        const size_t numChunks = std::clamp<size_t>(count / minItemsPerChunk, 1, static_cast<size_t>(JobManager::GetWorkerCount()) + 1);
+        const size_t chunkSize = (count + numChunks - 1) / numChunks;
+
+        m_Scratch.resize(count);
+        m_Histograms.resize(numChunks * 256);
+
+        DrawCallSortItem* src = m_Items.data();
+        DrawCallSortItem* dst = m_Scratch.data();
+
+        auto forEachChunk = [numChunks](auto&& func)
+        {
+            if (numChunks > 1)
+            {
+                JobManager::ParallelFor(numChunks, 1, func);
+            }
+            else
+            {
+                func(0);
+            }
+        };
+
+        for (uint32_t shift = 0; shift < 64; shift += 8)
+        {
+            if (((diffBits >> shift) & 0xFF) == 0)
+            {
+                continue;
+            }
+
+            std::fill(m_Histograms.begin(), m_Histograms.end(), 0);
+
+            forEachChunk([&](size_t chunk)
+            {
+                uint32_t* histogram = m_Histograms.data() + chunk * 256;
+                size_t end = std::min(count, (chunk + 1) * chunkSize);
+
+                for (size_t i = chunk * chunkSize; i < end; i++)
+                {
+                    histogram[(src[i].Key >> shift) & 0xFF]++;
+                }
+            });
+
+            // 转换为每个 chunk 中每个 digit 的起始位置
+            uint32_t offset = 0;
+
+            for (size_t digit = 0; digit < 256; digit++)
+            {
+                for (size_t chunk = 0; chunk < numChunks; chunk++)
+                {
+                    uint32_t& value = m_Histograms[chunk * 256 + digit];
+                    uint32_t n = value;
+                    value = offset;
+                    offset += n;
+                }
+            }
+
+            forEachChunk([&](size_t chunk)
+            {
+                uint32_t* offsets = m_Histograms.data() + chunk * 256;
+                size_t end = std::min(count, (chunk + 1) * chunkSize);
+
+                for (size_t i = chunk * chunkSize; i < end; i++)
+                {
+                    dst[offsets[(src[i].Key >> shift) & 0xFF]++] = src[i];
+                }
+            });
+
+            std::swap(src, dst);
+        }
+
+        if (src != m_Items.data())
+        {
+            m_Items.swap(m_Scratch);
+        }
+    }
+}
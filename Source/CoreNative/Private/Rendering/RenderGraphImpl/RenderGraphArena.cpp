@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphArena.h"
+#include <limits>
+
+namespace march
+{
+    RenderGraphArena::RenderGraphArena(uint32_t pageSize)
+        : m_Allocator("RenderGraphArena", pageSize, [this](uint32_t sizeInBytes, bool large, bool* pOutIsNew)
+        {
+            return RequestPage(sizeInBytes, large, pOutIsNew);
+        })
+        , m_Pages{}
+        , m_NumUsedPages(0)
+        , m_LargePages{}
+    {
+    }
+
+    void RenderGraphArena::Reset()
+    {
+        m_Allocator.Reset();
+        m_NumUsedPages = 0;
+
+        for (LargePage& page : m_LargePages)
+        {
+            page.IsUsed = false;
+        }
+    }
+
+    void* RenderGraphArena::Allocate(size_t sizeInBytes, size_t alignment)
+    {
+        // 页的起始地址是按 new 的默认对齐方式对齐的
+        assert(alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        assert(sizeInBytes <= std::numeric_limits<uint32_t>::max());
+
+        size_t pageIndex = 0;
+        bool large = false;
+        uint32_t offset = m_Allocator.Allocate(static_cast<uint32_t>(sizeInBytes), static_cast<uint32_t>(alignment), &pageIndex, &large);
+
+        uint8_t* page = large ? m_LargePages[pageIndex].Data.get() : m_Pages[pageIndex].get();
+        return page + offset;
+    }
+
+    std::string_view RenderGraphArena::AllocateString(std::string_view str)
+    {
+        char* data = AllocateArray<char>(str.size() + 1);
+        str.copy(data, str.size());
+        data[str.size()] = '\0';
+        return std::string_view(data, str.size());
+    }
+
+    size_t RenderGraphArena::RequestPage(uint32_t sizeInBytes, bool large, bool* pOutIsNew)
+    {
+        if (!large)
+        {
+            *pOutIsNew = m_NumUsedPages == m_Pages.size();
+
+            if (*pOutIsNew)
+            {
+                m_Pages.push_back(std::make_unique<uint8_t[]>(sizeInBytes));
+            }
+
+            return m_NumUsedPages++;
+        }
+
+        // 找一个放得下的最小的页
+        size_t bestIndex = std::numeric_limits<size_t>::max();
+
+        for (size_t i = 0; i < m_LargePages.size(); i++)
+        {
+            const LargePage& page = m_LargePages[i];
+
+            if (page.IsUsed || page.SizeInBytes < sizeInBytes)
+            {
+                continue;
+            }
+
+            if (bestIndex == std::numeric_limits<size_t>::max() || page.SizeInBytes < m_LargePages[bestIndex].SizeInBytes)
+            {
+                bestIndex = i;
+            }
+        }
+
+        *pOutIsNew = bestIndex == std::numeric_limits<size_t>::max();
+
+        if (*pOutIsNew)
+        {
+            bestIndex = m_LargePages.size();
+            m_LargePages.push_back({ std::make_unique<uint8_t[]>(sizeInBytes), sizeInBytes, false });
+        }
+
+        m_LargePages[bestIndex].IsUsed = true;
+        return bestIndex;
+    }
+}
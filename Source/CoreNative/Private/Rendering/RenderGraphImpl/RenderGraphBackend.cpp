@@ -0,0 +1,42 @@
+#include "pch.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+#include <algorithm>
+
+namespace march
+{
+    uint64_t RenderGraphD3D12Backend::GetFrameIndex() const
+    {
+        return GetGfxDevice()->GetNextFence();
+    }
+
+    D3D12_RESOURCE_ALLOCATION_INFO RenderGraphD3D12Backend::GetTextureAllocationInfo(const GfxTextureDesc& desc) const
+    {
+        return GfxRenderTexture::GetAllocationInfo(GetGfxDevice(), desc);
+    }
+
+    D3D12_RESOURCE_ALLOCATION_INFO RenderGraphNullBackend::GetTextureAllocationInfo(const GfxTextureDesc& desc) const
+    {
+        // 没有 device，只能估算，不考虑 tiling 的额外开销
+        uint64_t numSlices = desc.DepthOrArraySize;
+
+        if (desc.Dimension == GfxTextureDimension::Cube || desc.Dimension == GfxTextureDimension::CubeArray)
+        {
+            numSlices *= 6;
+        }
+
+        uint64_t bitsPerPixel = std::max<uint64_t>(DirectX::BitsPerPixel(desc.GetResDXGIFormat()), 8);
+        uint64_t size = static_cast<uint64_t>(desc.Width) * desc.Height * numSlices * std::max(desc.MSAASamples, 1u) * bitsPerPixel / 8;
+
+        if (desc.HasFlag(GfxTextureFlags::Mipmaps))
+        {
+            size += size / 3;
+        }
+
+        UINT64 alignment = desc.MSAASamples > 1 ? D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+        D3D12_RESOURCE_ALLOCATION_INFO info{};
+        info.SizeInBytes = (static_cast<UINT64>(size) + alignment - 1) & ~(alignment - 1);
+        info.Alignment = alignment;
+        return info;
+    }
+}
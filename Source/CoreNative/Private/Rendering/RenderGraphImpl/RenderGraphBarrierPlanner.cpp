@@ -0,0 +1,155 @@
+#include "pch.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBarrierPlanner.h"
+#include <algorithm>
+
+namespace march
+{
+    static RenderGraphBarrierState CombineStates(RenderGraphBarrierState a, RenderGraphBarrierState b)
+    {
+        return static_cast<RenderGraphBarrierState>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+    }
+
+    bool RenderGraphBarrierPlanner::IsReadOnlyState(RenderGraphBarrierState state)
+    {
+        constexpr uint32_t readOnlyStates
+            = static_cast<uint32_t>(RenderGraphBarrierState::ShaderResource)
+            | static_cast<uint32_t>(RenderGraphBarrierState::DepthRead);
+
+        uint32_t value = static_cast<uint32_t>(state);
+        return value != 0 && (value & ~readOnlyStates) == 0;
+    }
+
+    void RenderGraphBarrierPlanner::Plan(const std::vector<RenderGraphBarrierPassInfo>& passes, const std::vector<RenderGraphBarrierUse>& uses)
+    {
+        m_Barriers.clear();
+        m_Stats = {};
+
+        m_SortedUses.clear();
+        for (size_t i = 0; i < uses.size(); i++)
+        {
+            if (!passes[uses[i].PassIndex].IsCulled)
+            {
+                m_SortedUses.push_back(i);
+            }
+        }
+
+        // 同一个资源的使用按 pass 的顺序排在一起
+        std::stable_sort(m_SortedUses.begin(), m_SortedUses.end(), [&uses](size_t a, size_t b)
+        {
+            if (uses[a].ResourceIndex != uses[b].ResourceIndex)
+            {
+                return uses[a].ResourceIndex < uses[b].ResourceIndex;
+            }
+
+            return uses[a].PassIndex < uses[b].PassIndex;
+        });
+
+        auto isPlannable = [&passes](const RenderGraphBarrierUse& use)
+        {
+            return use.State != RenderGraphBarrierState::Unknown && !passes[use.PassIndex].IsAsyncCompute;
+        };
+
+        for (size_t i = 0; i < m_SortedUses.size();)
+        {
+            const size_t resourceIndex = uses[m_SortedUses[i]].ResourceIndex;
+
+            bool hasPreviousUse = false;
+            size_t previousPassIndex = 0;
+            RenderGraphBarrierState previousState = RenderGraphBarrierState::Unknown; // 上次使用后的 state，Unknown 表示编译时不知道
+
+            for (; i < m_SortedUses.size() && uses[m_SortedUses[i]].ResourceIndex == resourceIndex; i++)
+            {
+                const RenderGraphBarrierUse& use = uses[m_SortedUses[i]];
+
+                if (!isPlannable(use))
+                {
+                    // 交给录制时的 TransitionResource 处理，之后的 state 也不确定
+                    hasPreviousUse = true;
+                    previousPassIndex = use.PassIndex;
+                    previousState = RenderGraphBarrierState::Unknown;
+                    continue;
+                }
+
+                RenderGraphBarrierState state = use.State;
+
+                if (IsReadOnlyState(state))
+                {
+                    if (IsReadOnlyState(previousState))
+                    {
+                        // 已经合并到前面的 barrier 里了
+                        m_Stats.NumFoldedTransitions++;
+                        previousPassIndex = use.PassIndex;
+                        continue;
+                    }
+
+                    // 把后面连续的只读使用合并成一个 barrier
+                    for (size_t j = i + 1; j < m_SortedUses.size(); j++)
+                    {
+                        const RenderGraphBarrierUse& next = uses[m_SortedUses[j]];
+
+                        if (next.ResourceIndex != resourceIndex || !isPlannable(next) || !IsReadOnlyState(next.State))
+                        {
+                            break;
+                        }
+
+                        state = CombineStates(state, next.State);
+                    }
+                }
+                else if (state == previousState)
+                {
+                    m_Stats.NumFoldedTransitions++;
+                    previousPassIndex = use.PassIndex;
+                    continue;
+                }
+
+                if (hasPreviousUse && CanSplit(passes, previousPassIndex, use.PassIndex))
+                {
+                    m_Barriers.push_back({ resourceIndex, previousPassIndex, state, RenderGraphBarrierType::BeginSplit });
+                    m_Barriers.push_back({ resourceIndex, use.PassIndex, state, RenderGraphBarrierType::EndSplit });
+                    m_Stats.NumSplitBarriers++;
+                }
+                else
+                {
+                    m_Barriers.push_back({ resourceIndex, use.PassIndex, state, RenderGraphBarrierType::Full });
+                    m_Stats.NumFullBarriers++;
+                }
+
+                hasPreviousUse = true;
+                previousPassIndex = use.PassIndex;
+                previousState = state;
+            }
+        }
+    }
+
+    bool RenderGraphBarrierPlanner::CanSplit(const std::vector<RenderGraphBarrierPassInfo>& passes, size_t fromPassIndex, size_t toPassIndex) const
+    {
+        if (passes[fromPassIndex].IsAsyncCompute || passes[toPassIndex].IsAsyncCompute)
+        {
+            return false;
+        }
+
+        // 中间至少要有一个 pass，否则 split barrier 没有意义
+        bool hasIdlePass = false;
+
+        for (size_t i = fromPassIndex + 1; i <= toPassIndex; i++)
+        {
+            if (passes[i].IsCulled)
+            {
+                continue;
+            }
+
+            // begin 和 end 必须在同一个 command list 里
+            if (passes[i].StartsCommandList)
+            {
+                return false;
+            }
+
+            if (i != toPassIndex)
+            {
+                hasIdlePass = true;
+            }
+        }
+
+        return hasIdlePass;
+    }
+}
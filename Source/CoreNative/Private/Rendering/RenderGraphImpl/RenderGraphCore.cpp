@@ -1,7 +1,10 @@
 #include "pch.h"
 #include "Engine/Rendering/RenderGraphImpl/RenderGraphCore.h"
+#include "Engine/JobManager.h"
 #include "Engine/Debug.h"
 #include <utility>
+#include <algorithm>
+#include <chrono>
 #include <assert.h>
 
 namespace march
@@ -16,7 +19,7 @@ namespace march
         assert(usages != RenderGraphPassResourceUsages::None);
 
         RenderGraphPass& pass = GetPass();
-        RenderGraphPassResourceUsages& lastUsages = pass.ResourcesIn[resourceIndex];
+        RenderGraphPassResourceUsages& lastUsages = pass.ResourcesIn.GetOrAdd(resourceIndex, m_Graph->m_Arena);
 
         // 处理新的资源
         if (lastUsages == RenderGraphPassResourceUsages::None)
@@ -25,7 +28,12 @@ namespace march
 
             if (producerPassIndex)
             {
-                m_Graph->m_Passes[*producerPassIndex].NextPassIndices.insert(m_PassIndex);
+                RenderGraphSmallVector<size_t, 4>& nextPassIndices = m_Graph->m_Passes[*producerPassIndex].NextPassIndices;
+
+                if (std::find(nextPassIndices.begin(), nextPassIndices.end(), m_PassIndex) == nextPassIndices.end())
+                {
+                    nextPassIndices.Append(m_PassIndex, m_Graph->m_Arena);
+                }
             }
             else if (!resourceManager->IsExternalResource(resourceIndex))
             {
@@ -52,13 +60,13 @@ namespace march
             return;
         }
 
-        RenderGraphPassResourceUsages& lastUsages = pass.ResourcesOut[resourceIndex];
+        RenderGraphPassResourceUsages& lastUsages = pass.ResourcesOut.GetOrAdd(resourceIndex, m_Graph->m_Arena);
 
         // 处理新的资源
         if (lastUsages == RenderGraphPassResourceUsages::None)
         {
             pass.HasSideEffects |= resourceManager->IsExternalResource(resourceIndex);
-            resourceManager->AddProducerPassIndex(resourceIndex, m_PassIndex);
+            resourceManager->AddProducerPassIndex(resourceIndex, m_PassIndex, m_Graph->m_Arena);
         }
 
         lastUsages |= usages;
@@ -79,6 +87,16 @@ namespace march
         GetPass().UseDefaultVariables = value;
     }
 
+    void RenderGraphBuilder::AllowParallelRecording(bool value)
+    {
+        GetPass().AllowParallelRecording = value;
+    }
+
+    void RenderGraphBuilder::SetEstimatedCost(double microseconds)
+    {
+        GetPass().EstimatedCost = std::max(microseconds, 0.0);
+    }
+
     void RenderGraphBuilder::In(const BufferHandle& buffer)
     {
         RenderGraphResourceManager* resourceManager = m_Graph->m_ResourceManager.get();
@@ -230,13 +248,11 @@ namespace march
         pass.Wireframe = value;
     }
 
-    void RenderGraphBuilder::SetRenderFunc(const std::function<void(RenderGraphContext&)>& func)
-    {
-        GetPass().RenderFunc = func;
-    }
-
     void RenderGraph::CompilePasses()
     {
+        // 先调整顺序，后面的计算都基于新的顺序
+        SchedulePasses();
+
         // 每个 pass 的计算都依赖后面的 pass，所以从后往前遍历
 
         // 所有 pass 结束后，有一个 m_PassIndexToWaitFallback
@@ -258,9 +274,331 @@ namespace march
             if (std::optional<std::pair<size_t, size_t>> lifetime = m_ResourceManager->GetLifetimePassIndexRange(i))
             {
                 std::pair<size_t, size_t> range = *lifetime;
-                m_Passes[range.first].ResourcesBorn.push_back(i);
-                m_Passes[range.second].ResourcesDead.push_back(i);
+                m_Passes[range.first].ResourcesBorn.Append(i, m_Arena);
+                m_Passes[range.second].ResourcesDead.Append(i, m_Arena);
+            }
+        }
+
+        PlanBarriers();
+        MergeRenderPasses();
+    }
+
+    double RenderGraph::GetEstimatedPassCost(const RenderGraphPass& pass) const
+    {
+        if (pass.EstimatedCost > 0)
+        {
+            return pass.EstimatedCost;
+        }
+
+        // 只用档位，保证调度结果和编译缓存的 key 一致
+        if (std::optional<uint32_t> bucket = m_ProfiledPassCosts.GetBucket(std::hash<std::string_view>{}(pass.Name)))
+        {
+            return RenderGraphPassCostBuckets::GetBucketCost(*bucket);
+        }
+
+        return DefaultPassCostMicroseconds;
+    }
+
+    void RenderGraph::SchedulePasses()
+    {
+        m_SchedulePassInfos.resize(m_Passes.size());
+
+        for (size_t passIndex = 0; passIndex < m_Passes.size(); passIndex++)
+        {
+            const RenderGraphPass& pass = m_Passes[passIndex];
+            RenderGraphSchedulePassInfo& info = m_SchedulePassInfos[passIndex];
+
+            info.Cost = GetEstimatedPassCost(pass);
+            info.IsAsyncComputeCandidate = pass.EnableAsyncCompute;
+        }
+
+        // NextPassIndices 只有写后读，调整顺序时还要保证读后写和写后写的顺序
+        size_t numResources = m_ResourceManager->GetNumResources();
+        m_ScheduleDependencies.clear();
+        m_ScheduleLastWriters.assign(numResources, std::nullopt);
+        m_ScheduleReaders.resize(std::max(m_ScheduleReaders.size(), numResources));
+
+        for (size_t i = 0; i < numResources; i++)
+        {
+            m_ScheduleReaders[i].clear();
+        }
+
+        for (size_t passIndex = 0; passIndex < m_Passes.size(); passIndex++)
+        {
+            const RenderGraphPass& pass = m_Passes[passIndex];
+
+            for (const auto& kv : pass.ResourcesIn)
+            {
+                size_t resourceIndex = kv.Key;
+
+                if (std::optional<size_t> writer = m_ScheduleLastWriters[resourceIndex])
+                {
+                    m_ScheduleDependencies.push_back({ *writer, passIndex });
+                }
+
+                m_ScheduleReaders[resourceIndex].push_back(passIndex);
+            }
+
+            for (const auto& kv : pass.ResourcesOut)
+            {
+                size_t resourceIndex = kv.Key;
+
+                if (std::optional<size_t> writer = m_ScheduleLastWriters[resourceIndex])
+                {
+                    m_ScheduleDependencies.push_back({ *writer, passIndex });
+                }
+
+                for (size_t reader : m_ScheduleReaders[resourceIndex])
+                {
+                    if (reader != passIndex)
+                    {
+                        m_ScheduleDependencies.push_back({ reader, passIndex });
+                    }
+                }
+
+                m_ScheduleReaders[resourceIndex].clear();
+                m_ScheduleLastWriters[resourceIndex] = passIndex;
+            }
+        }
+
+        m_Scheduler.Schedule(m_SchedulePassInfos, m_ScheduleDependencies);
+        m_CompileStats.NumHoistedPasses = m_Scheduler.GetStats().NumHoistedPasses;
+        m_CompileStats.CriticalPathCost = m_Scheduler.GetStats().CriticalPathCost;
+
+        if (!m_Scheduler.IsIdentity())
+        {
+            ReorderPasses(m_Scheduler.GetOrder());
+        }
+    }
+
+    void RenderGraph::ReorderPasses(const std::vector<size_t>& order)
+    {
+        assert(order.size() == m_Passes.size());
+
+        m_PassIndexRemap.resize(order.size());
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            m_PassIndexRemap[order[i]] = i;
+        }
+
+        // 两个 vector 交替使用，稳定以后不会再分配内存
+        m_PassScratch.clear();
+
+        for (size_t oldIndex : order)
+        {
+            m_PassScratch.push_back(std::move(m_Passes[oldIndex]));
+        }
+
+        m_Passes.swap(m_PassScratch);
+        m_PassScratch.clear();
+
+        // resource 里记录的 producer 只在构建时使用，不用更新
+        for (RenderGraphPass& pass : m_Passes)
+        {
+            for (size_t& adjIndex : pass.NextPassIndices)
+            {
+                adjIndex = m_PassIndexRemap[adjIndex];
+            }
+        }
+    }
+
+    RenderGraphBarrierState RenderGraph::GetPlannedBarrierState(const RenderGraphPass& pass, size_t resourceIndex)
+    {
+        // buffer 可能被当作 constant buffer、vertex buffer 等使用，只从 usage 看不出需要的 state，交给录制时处理
+        if (!m_ResourceManager->IsTextureResource(resourceIndex))
+        {
+            return RenderGraphBarrierState::Unknown;
+        }
+
+        const RenderGraphPassResourceUsages* inUsages = pass.ResourcesIn.Find(resourceIndex);
+        const RenderGraphPassResourceUsages* outUsages = pass.ResourcesOut.Find(resourceIndex);
+        RenderGraphPassResourceUsages usages = RenderGraphPassResourceUsages::None;
+
+        if (inUsages != nullptr)
+        {
+            usages |= *inUsages;
+        }
+
+        if (outUsages != nullptr)
+        {
+            usages |= *outUsages;
+        }
+
+        const bool isRenderTarget = (usages & RenderGraphPassResourceUsages::RenderTarget) == RenderGraphPassResourceUsages::RenderTarget;
+        const bool isVariable = (usages & RenderGraphPassResourceUsages::Variable) == RenderGraphPassResourceUsages::Variable;
+
+        if (isRenderTarget && isVariable)
+        {
+            // 同一个 pass 中有多种 state，不好提前转换
+            return RenderGraphBarrierState::Unknown;
+        }
+
+        if (isRenderTarget)
+        {
+            bool isDepthStencil = m_ResourceManager->GetTextureDesc(resourceIndex).IsDepthStencil();
+            return isDepthStencil ? RenderGraphBarrierState::DepthWrite : RenderGraphBarrierState::RenderTarget;
+        }
+
+        if (isVariable)
+        {
+            return outUsages != nullptr ? RenderGraphBarrierState::UnorderedAccess : RenderGraphBarrierState::ShaderResource;
+        }
+
+        return RenderGraphBarrierState::Unknown;
+    }
+
+    void RenderGraph::PlanBarriers()
+    {
+        m_BarrierPassInfos.clear();
+        m_BarrierUses.clear();
+
+        bool isPreviousAsyncCompute = false;
+
+        for (size_t passIndex = 0; passIndex < m_Passes.size(); passIndex++)
+        {
+            const RenderGraphPass& pass = m_Passes[passIndex];
+
+            // 这些 pass 会换一个 command list 录制，和 EnsurePassContext、CollectParallelPasses 保持一致
+            // 可以并行录制的 pass 不一定真的并行，这里保守处理
+            RenderGraphBarrierPassInfo& info = m_BarrierPassInfos.emplace_back();
+            info.IsCulled = pass.IsCulled;
+            info.IsAsyncCompute = pass.IsAsyncCompute;
+            info.StartsCommandList = pass.IsAsyncCompute || pass.PassIndexToWait || pass.AllowParallelRecording || isPreviousAsyncCompute;
+
+            if (pass.IsCulled)
+            {
+                continue;
+            }
+
+            isPreviousAsyncCompute = pass.IsAsyncCompute;
+
+            for (const auto& kv : pass.ResourcesIn)
+            {
+                m_BarrierUses.push_back({ kv.Key, passIndex, GetPlannedBarrierState(pass, kv.Key) });
+            }
+
+            for (const auto& kv : pass.ResourcesOut)
+            {
+                if (!pass.ResourcesIn.Contains(kv.Key))
+                {
+                    m_BarrierUses.push_back({ kv.Key, passIndex, GetPlannedBarrierState(pass, kv.Key) });
+                }
+            }
+        }
+
+        m_BarrierPlanner.Plan(m_BarrierPassInfos, m_BarrierUses);
+
+        for (const RenderGraphPlannedBarrier& barrier : m_BarrierPlanner.GetBarriers())
+        {
+            RenderGraphPass& pass = m_Passes[barrier.PassIndex];
+
+            if (barrier.Type == RenderGraphBarrierType::BeginSplit)
+            {
+                pass.BarriersAfter.Append(barrier, m_Arena);
+            }
+            else
+            {
+                pass.BarriersBefore.Append(barrier, m_Arena);
+            }
+        }
+    }
+
+    bool RenderGraph::IsRenderTargetOnly(const RenderGraphPass& pass, const RenderGraphPassRenderTarget& target) const
+    {
+        // 同时作为 variable 使用时需要在 pass 中转换 state，不能放在 render pass 里
+        const RenderGraphPassResourceUsages* inUsages = pass.ResourcesIn.Find(target.ResourceIndex);
+        const RenderGraphPassResourceUsages* outUsages = pass.ResourcesOut.Find(target.ResourceIndex);
+
+        if (inUsages != nullptr && *inUsages != RenderGraphPassResourceUsages::RenderTarget)
+        {
+            return false;
+        }
+
+        return outUsages == nullptr || *outUsages == RenderGraphPassResourceUsages::RenderTarget;
+    }
+
+    static bool IsSameRenderTarget(const RenderGraphPassRenderTarget& a, const RenderGraphPassRenderTarget& b)
+    {
+        if (a.IsSet != b.IsSet)
+        {
+            return false;
+        }
+
+        return !a.IsSet || (a.ResourceIndex == b.ResourceIndex && a.Face == b.Face && a.WOrArraySlice == b.WOrArraySlice && a.MipSlice == b.MipSlice);
+    }
+
+    bool RenderGraph::CanMergeRenderPasses(const RenderGraphPass& previous, const RenderGraphPass& next) const
+    {
+        auto isRasterPass = [](const RenderGraphPass& pass)
+        {
+            return pass.RenderFunc && !pass.IsAsyncCompute && !pass.AllowParallelRecording && (pass.NumColorTargets > 0 || pass.DepthStencilTarget.IsSet);
+        };
+
+        if (!isRasterPass(previous) || !isRasterPass(next))
+        {
+            return false;
+        }
+
+        // 必须在同一个 command list 中，并且中间不能有 barrier
+        if (next.PassIndexToWait || !previous.BarriersAfter.IsEmpty() || !next.BarriersBefore.IsEmpty())
+        {
+            return false;
+        }
+
+        if (previous.NumColorTargets != next.NumColorTargets || !IsSameRenderTarget(previous.DepthStencilTarget, next.DepthStencilTarget))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < next.NumColorTargets; i++)
+        {
+            if (!IsSameRenderTarget(previous.ColorTargets[i], next.ColorTargets[i]))
+            {
+                return false;
+            }
+        }
+
+        // render pass 中间不能 clear，Discard 当作 Load 处理
+        auto canMerge = [this, &previous, &next](const RenderGraphPassRenderTarget& target)
+        {
+            return !target.IsSet || (target.InitMode != RenderTargetInitMode::Clear && IsRenderTargetOnly(previous, target) && IsRenderTargetOnly(next, target));
+        };
+
+        for (uint32_t i = 0; i < next.NumColorTargets; i++)
+        {
+            if (!next.ColorTargets[i].IsSet || !canMerge(next.ColorTargets[i]))
+            {
+                return false;
+            }
+        }
+
+        return canMerge(next.DepthStencilTarget);
+    }
+
+    void RenderGraph::MergeRenderPasses()
+    {
+        m_CompileStats.NumMergedPasses = 0;
+
+        std::optional<size_t> previousPassIndex = std::nullopt; // 上一个没有被剔除的 pass
+
+        for (size_t passIndex = 0; passIndex < m_Passes.size(); passIndex++)
+        {
+            RenderGraphPass& pass = m_Passes[passIndex];
+
+            if (pass.IsCulled)
+            {
+                continue;
+            }
+
+            if (previousPassIndex && CanMergeRenderPasses(m_Passes[*previousPassIndex], pass))
+            {
+                m_Passes[*previousPassIndex].IsMergedWithNext = true;
+                pass.IsMergedWithPrevious = true;
+                m_CompileStats.NumMergedPasses++;
             }
+
+            previousPassIndex = passIndex;
         }
     }
 
@@ -305,7 +643,7 @@ namespace march
 
             for (const auto& kv : pass.ResourcesIn)
             {
-                size_t resourceIndex = kv.first;
+                size_t resourceIndex = kv.Key;
                 m_ResourceManager->SetAlive(resourceIndex, passIndex);
 
                 // async compute 需要延长资源的生命周期
@@ -317,7 +655,7 @@ namespace march
 
             for (const auto& kv : pass.ResourcesOut)
             {
-                size_t resourceIndex = kv.first;
+                size_t resourceIndex = kv.Key;
                 m_ResourceManager->SetAlive(resourceIndex, passIndex);
 
                 // async compute 需要延长资源的生命周期
@@ -342,10 +680,11 @@ namespace march
             return;
         }
 
-        size_t overlappedPassCount = AvoidAsyncComputeResourceHazard(passIndex, deadlineIndexExclusive);
+        double overlappedCost = 0;
+        size_t overlappedPassCount = AvoidAsyncComputeResourceHazard(passIndex, deadlineIndexExclusive, overlappedCost);
 
-        // 有重叠的 pass 时 async compute 才有意义
-        if (overlappedPassCount == 0)
+        // 有足够多重叠的工作时 async compute 才有意义，否则跨 queue 同步的开销比省下的时间还多
+        if (overlappedPassCount == 0 || overlappedCost < MinAsyncComputeOverlapMicroseconds)
         {
             pass.IsAsyncCompute = false;
             return;
@@ -374,7 +713,7 @@ namespace march
         }
     }
 
-    size_t RenderGraph::AvoidAsyncComputeResourceHazard(size_t passIndex, size_t& deadlineIndexExclusive)
+    size_t RenderGraph::AvoidAsyncComputeResourceHazard(size_t passIndex, size_t& deadlineIndexExclusive, double& overlappedCost)
     {
         const RenderGraphPass& pass = m_Passes[passIndex];
         assert(!pass.IsVisited);
@@ -399,10 +738,10 @@ namespace march
 
             for (const auto& kv : pass.ResourcesIn)
             {
-                size_t resourceIndex = kv.first;
+                size_t resourceIndex = kv.Key;
 
                 // 在没有 resource barrier 时允许两个同时读
-                if (overlappedPass.ResourcesIn.count(resourceIndex) > 0)
+                if (overlappedPass.ResourcesIn.Contains(resourceIndex))
                 {
                     // 如果不是 D3D12_RESOURCE_STATE_GENERIC_READ 的话，读取前可能会有一个 resource barrier
                     // 当两个 pass 在 GPU 上并行时，两个 barrier 的顺序不确定，可能导致状态损坏
@@ -414,7 +753,7 @@ namespace march
                 }
 
                 // 禁止一个读一个写
-                if (overlappedPass.ResourcesOut.count(resourceIndex) > 0)
+                if (overlappedPass.ResourcesOut.Contains(resourceIndex))
                 {
                     deadlineIndexExclusive = lastNonAsyncComputePassIndex;
                     goto End;
@@ -423,17 +762,17 @@ namespace march
 
             for (const auto& kv : pass.ResourcesOut)
             {
-                size_t resourceIndex = kv.first;
+                size_t resourceIndex = kv.Key;
 
                 // 禁止一个读一个写
-                if (overlappedPass.ResourcesIn.count(resourceIndex) > 0)
+                if (overlappedPass.ResourcesIn.Contains(resourceIndex))
                 {
                     deadlineIndexExclusive = lastNonAsyncComputePassIndex;
                     goto End;
                 }
 
                 // 禁止两个同时写
-                if (overlappedPass.ResourcesOut.count(resourceIndex) > 0)
+                if (overlappedPass.ResourcesOut.Contains(resourceIndex))
                 {
                     deadlineIndexExclusive = lastNonAsyncComputePassIndex;
                     goto End;
@@ -447,6 +786,7 @@ namespace march
             if (!overlappedPass.IsAsyncCompute)
             {
                 overlappedPassCount++;
+                overlappedCost += GetEstimatedPassCost(overlappedPass);
             }
         }
 
@@ -481,13 +821,13 @@ namespace march
 
                     for (const auto& kv : pass.ResourcesIn)
                     {
-                        size_t resourceIndex = kv.first;
+                        size_t resourceIndex = kv.Key;
                         m_ResourceManager->SetAlive(resourceIndex, firstAsyncComputePassIndexValue);
                     }
 
                     for (const auto& kv : pass.ResourcesOut)
                     {
-                        size_t resourceIndex = kv.first;
+                        size_t resourceIndex = kv.Key;
                         m_ResourceManager->SetAlive(resourceIndex, firstAsyncComputePassIndexValue);
                     }
                 }
@@ -516,84 +856,216 @@ namespace march
         }
     }
 
-    void RenderGraph::RequestPassResources(const RenderGraphPass& pass)
-    {
-        for (size_t resourceIndex : pass.ResourcesBorn)
-        {
-            m_ResourceManager->RequestResource(resourceIndex);
-        }
-    }
-
-    void RenderGraph::EnsureAsyncComputePassResourceStates(RenderGraphContext& context, size_t passIndex)
+    void RenderGraph::AliasTransientTextures()
     {
-        // https://microsoft.github.io/DirectX-Specs/d3d/CPUEfficiency.html#state-support-by-command-list-type
-        constexpr D3D12_RESOURCE_STATES disallowedComputeStates
-            = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER
-            | D3D12_RESOURCE_STATE_INDEX_BUFFER
-            | D3D12_RESOURCE_STATE_RENDER_TARGET
-            | D3D12_RESOURCE_STATE_DEPTH_WRITE
-            | D3D12_RESOURCE_STATE_DEPTH_READ
-            | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE
-            | D3D12_RESOURCE_STATE_STREAM_OUT
-            | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT
-            | D3D12_RESOURCE_STATE_RESOLVE_DEST
-            | D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
-
-        // 需要避免在 AsyncComputeCommandList 中使用含有 disallowedComputeStates 的 Resource Barriers，
-        // BeforeState 和 AfterState 都不行，否则会报错！！！
-        // 这里检查资源的状态，如果不符合要求，就提前在 DirectCommandList 中将资源转换成 Common 状态
-
-        bool hasValidDirectContext = false;
+        m_TransientTextureIndices.clear();
 
-        for (size_t i = passIndex; i < m_Passes.size(); i++)
+        for (size_t resourceIndex = 0; resourceIndex < m_ResourceManager->GetNumResources(); resourceIndex++)
         {
-            const RenderGraphPass& pass = m_Passes[i];
-
-            if (pass.IsCulled)
+            if (!m_ResourceManager->IsPooledTexture(resourceIndex))
             {
                 continue;
             }
 
-            // 如果合批的话，需要把 Resource Barrier 提前到第一个 async compute pass
-            if (!pass.IsAsyncCompute || (i != passIndex && !pass.IsBatchedWithPrevious))
+            std::optional<std::pair<size_t, size_t>> lifetime = m_ResourceManager->GetLifetimePassIndexRange(resourceIndex);
+
+            if (!lifetime)
             {
-                break;
+                continue;
             }
 
-            for (const auto& kv : pass.ResourcesIn)
+            // async compute pass 和 direct pass 在 GPU 上是并行的，按 pass 顺序算出来的生命周期不可靠，用到的资源不参与 aliasing
+            bool isUsedByAsyncCompute = false;
+
+            for (size_t passIndex = lifetime->first; passIndex <= lifetime->second; passIndex++)
             {
-                size_t resourceIndex = kv.first;
+                const RenderGraphPass& pass = m_Passes[passIndex];
 
-                // 如果既读又写，那么当作写，在下面一个循环中处理
-                if (pass.ResourcesOut.count(resourceIndex) > 0)
+                if (pass.IsCulled || !pass.IsAsyncCompute)
                 {
                     continue;
                 }
 
-                auto res = m_ResourceManager->GetUnderlyingResource(resourceIndex);
-
-                if (!res->HasAllStates(D3D12_RESOURCE_STATE_GENERIC_READ))
+                if (pass.ResourcesIn.Contains(resourceIndex) || pass.ResourcesOut.Contains(resourceIndex))
                 {
-                    if (!hasValidDirectContext)
-                    {
-                        context.Ensure(GfxCommandType::Direct);
-                        hasValidDirectContext = true;
-                    }
-
-                    // 只读的资源都转成 GENERIC_READ，避免两个并行的 pass 中出现 Resource Barrier
-                    context.GetCommandContext()->TransitionResource(res, D3D12_RESOURCE_STATE_GENERIC_READ);
+                    isUsedByAsyncCompute = true;
+                    break;
                 }
             }
 
-            for (const auto& kv : pass.ResourcesOut)
+            if (!isUsedByAsyncCompute)
             {
-                size_t resourceIndex = kv.first;
-                auto res = m_ResourceManager->GetUnderlyingResource(resourceIndex);
+                m_TransientTextureIndices.push_back(resourceIndex);
+            }
+        }
 
-                if (res->HasAnyStates(disallowedComputeStates))
-                {
-                    if (!hasValidDirectContext)
-                    {
+        m_ResourceManager->AliasTransientTextures(m_TransientTextureIndices);
+    }
+
+    void RenderGraph::RequestPassResources(const RenderGraphPass& pass)
+    {
+        for (size_t resourceIndex : pass.ResourcesBorn)
+        {
+            m_ResourceManager->RequestResource(resourceIndex);
+        }
+    }
+
+    static D3D12_RESOURCE_STATES ToD3D12ResourceStates(RenderGraphBarrierState state)
+    {
+        uint32_t value = static_cast<uint32_t>(state);
+        D3D12_RESOURCE_STATES result = D3D12_RESOURCE_STATE_COMMON;
+
+        if (value & static_cast<uint32_t>(RenderGraphBarrierState::ShaderResource))
+        {
+            // 不知道在哪个 shader stage 读取，两个都加上，之后 SetTexture 时就不需要再转换了
+            result |= D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+        }
+
+        if (value & static_cast<uint32_t>(RenderGraphBarrierState::DepthRead))
+        {
+            result |= D3D12_RESOURCE_STATE_DEPTH_READ;
+        }
+
+        if (value & static_cast<uint32_t>(RenderGraphBarrierState::UnorderedAccess))
+        {
+            result |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        }
+
+        if (value & static_cast<uint32_t>(RenderGraphBarrierState::RenderTarget))
+        {
+            result |= D3D12_RESOURCE_STATE_RENDER_TARGET;
+        }
+
+        if (value & static_cast<uint32_t>(RenderGraphBarrierState::DepthWrite))
+        {
+            result |= D3D12_RESOURCE_STATE_DEPTH_WRITE;
+        }
+
+        return result;
+    }
+
+    static bool IsResourceStateAllowed(const D3D12_RESOURCE_DESC& desc, RenderGraphBarrierState state)
+    {
+        switch (state)
+        {
+        case RenderGraphBarrierState::UnorderedAccess:
+            return (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS) != 0;
+        case RenderGraphBarrierState::RenderTarget:
+            return (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0;
+        case RenderGraphBarrierState::DepthWrite:
+            return (desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) != 0;
+        default:
+            return (desc.Flags & D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE) == 0;
+        }
+    }
+
+    void RenderGraph::ApplyPlannedBarriers(GfxCommandContext* cmd, const RenderGraphSmallVector<RenderGraphPlannedBarrier, 4>& barriers)
+    {
+        if (barriers.IsEmpty())
+        {
+            return;
+        }
+
+        for (const RenderGraphPlannedBarrier& barrier : barriers)
+        {
+            RefCountPtr<GfxResource> res = m_ResourceManager->GetUnderlyingResource(barrier.ResourceIndex);
+
+            // 状态被锁定的资源不能转换，格式不支持的 state 留给录制时报错
+            if (res->IsStateLocked() || !IsResourceStateAllowed(res->GetD3DResourceDesc(), barrier.StateAfter))
+            {
+                continue;
+            }
+
+            D3D12_RESOURCE_STATES state = ToD3D12ResourceStates(barrier.StateAfter);
+
+            switch (barrier.Type)
+            {
+            case RenderGraphBarrierType::Full:
+                cmd->TransitionResource(res, state);
+                break;
+            case RenderGraphBarrierType::BeginSplit:
+                cmd->BeginSplitTransition(res, state);
+                break;
+            case RenderGraphBarrierType::EndSplit:
+                cmd->EndSplitTransition(res, state);
+                break;
+            }
+        }
+
+        // 和 RenderFunc 里的 barrier 分开，一次提交
+        cmd->FlushResourceBarriers();
+    }
+
+    void RenderGraph::EnsureAsyncComputePassResourceStates(RenderGraphContext& context, size_t passIndex)
+    {
+        // https://microsoft.github.io/DirectX-Specs/d3d/CPUEfficiency.html#state-support-by-command-list-type
+        constexpr D3D12_RESOURCE_STATES disallowedComputeStates
+            = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER
+            | D3D12_RESOURCE_STATE_INDEX_BUFFER
+            | D3D12_RESOURCE_STATE_RENDER_TARGET
+            | D3D12_RESOURCE_STATE_DEPTH_WRITE
+            | D3D12_RESOURCE_STATE_DEPTH_READ
+            | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE
+            | D3D12_RESOURCE_STATE_STREAM_OUT
+            | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT
+            | D3D12_RESOURCE_STATE_RESOLVE_DEST
+            | D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+
+        // 需要避免在 AsyncComputeCommandList 中使用含有 disallowedComputeStates 的 Resource Barriers，
+        // BeforeState 和 AfterState 都不行，否则会报错！！！
+        // 这里检查资源的状态，如果不符合要求，就提前在 DirectCommandList 中将资源转换成 Common 状态
+
+        bool hasValidDirectContext = false;
+
+        for (size_t i = passIndex; i < m_Passes.size(); i++)
+        {
+            const RenderGraphPass& pass = m_Passes[i];
+
+            if (pass.IsCulled)
+            {
+                continue;
+            }
+
+            // 如果合批的话，需要把 Resource Barrier 提前到第一个 async compute pass
+            if (!pass.IsAsyncCompute || (i != passIndex && !pass.IsBatchedWithPrevious))
+            {
+                break;
+            }
+
+            for (const auto& kv : pass.ResourcesIn)
+            {
+                size_t resourceIndex = kv.Key;
+
+                // 如果既读又写，那么当作写，在下面一个循环中处理
+                if (pass.ResourcesOut.Contains(resourceIndex))
+                {
+                    continue;
+                }
+
+                auto res = m_ResourceManager->GetUnderlyingResource(resourceIndex);
+
+                if (!res->HasAllStates(D3D12_RESOURCE_STATE_GENERIC_READ))
+                {
+                    if (!hasValidDirectContext)
+                    {
+                        context.Ensure(GfxCommandType::Direct);
+                        hasValidDirectContext = true;
+                    }
+
+                    // 只读的资源都转成 GENERIC_READ，避免两个并行的 pass 中出现 Resource Barrier
+                    context.GetCommandContext()->TransitionResource(res, D3D12_RESOURCE_STATE_GENERIC_READ);
+                }
+            }
+
+            for (const auto& kv : pass.ResourcesOut)
+            {
+                size_t resourceIndex = kv.Key;
+                auto res = m_ResourceManager->GetUnderlyingResource(resourceIndex);
+
+                if (res->HasAnyStates(disallowedComputeStates))
+                {
+                    if (!hasValidDirectContext)
+                    {
                         context.Ensure(GfxCommandType::Direct);
                         hasValidDirectContext = true;
                     }
@@ -605,6 +1077,44 @@ namespace march
         }
     }
 
+    void RenderGraph::PrepareAliasedPassResources(GfxCommandContext* cmd, const RenderGraphPass& pass)
+    {
+        bool hasAliasedResources = false;
+
+        for (size_t resourceIndex : pass.ResourcesBorn)
+        {
+            if (m_ResourceManager->NeedAliasingBarrier(resourceIndex))
+            {
+                cmd->AliasingBarrier(m_ResourceManager->GetUnderlyingResource(resourceIndex));
+                hasAliasedResources = true;
+            }
+        }
+
+        if (!hasAliasedResources)
+        {
+            return;
+        }
+
+        // 内存里是其他资源留下的数据，要用 Discard 初始化一次，Discard 要求资源处于 RENDER_TARGET 或 DEPTH_WRITE 状态
+        for (size_t resourceIndex : pass.ResourcesBorn)
+        {
+            if (m_ResourceManager->NeedAliasingBarrier(resourceIndex))
+            {
+                bool isDepthStencil = m_ResourceManager->GetTextureDesc(resourceIndex).IsDepthStencil();
+                D3D12_RESOURCE_STATES state = isDepthStencil ? D3D12_RESOURCE_STATE_DEPTH_WRITE : D3D12_RESOURCE_STATE_RENDER_TARGET;
+                cmd->TransitionResource(m_ResourceManager->GetUnderlyingResource(resourceIndex), state);
+            }
+        }
+
+        for (size_t resourceIndex : pass.ResourcesBorn)
+        {
+            if (m_ResourceManager->NeedAliasingBarrier(resourceIndex))
+            {
+                cmd->DiscardResource(m_ResourceManager->GetUnderlyingResource(resourceIndex));
+            }
+        }
+    }
+
     GfxCommandContext* RenderGraph::EnsurePassContext(RenderGraphContext& context, size_t passIndex)
     {
         const RenderGraphPass& pass = m_Passes[passIndex];
@@ -651,8 +1161,84 @@ namespace march
         return desc;
     }
 
-    void RenderGraph::SetPassRenderStates(GfxCommandContext* cmd, const RenderGraphPass& pass)
+    static GfxRenderPassBeginAccess GetRenderPassBeginAccess(RenderTargetInitMode initMode)
+    {
+        switch (initMode)
+        {
+        case RenderTargetInitMode::Discard:
+            return GfxRenderPassBeginAccess::Discard;
+        case RenderTargetInitMode::Clear:
+            return GfxRenderPassBeginAccess::Clear;
+        default:
+            return GfxRenderPassBeginAccess::Preserve;
+        }
+    }
+
+    void RenderGraph::BeginMergedRenderPass(GfxCommandContext* cmd, size_t passIndex)
     {
+        const RenderGraphPass& pass = m_Passes[passIndex];
+
+        // 最后一个合并的 pass 结束后生命周期也结束的 render target，之后不会再被读取
+        size_t lastPassIndex = passIndex;
+
+        for (size_t i = passIndex + 1; i < m_Passes.size(); i++)
+        {
+            if (m_Passes[i].IsCulled)
+            {
+                continue;
+            }
+
+            if (!m_Passes[i].IsMergedWithPrevious)
+            {
+                break;
+            }
+
+            lastPassIndex = i;
+        }
+
+        const RenderGraphPass& lastPass = m_Passes[lastPassIndex];
+
+        auto getEndAccess = [this, &lastPass](size_t resourceIndex)
+        {
+            bool isDead = std::find(lastPass.ResourcesDead.begin(), lastPass.ResourcesDead.end(), resourceIndex) != lastPass.ResourcesDead.end();
+            return isDead && !m_ResourceManager->IsExternalResource(resourceIndex) ? GfxRenderPassEndAccess::Discard : GfxRenderPassEndAccess::Preserve;
+        };
+
+        GfxRenderPassColorTarget colorTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+
+        for (uint32_t i = 0; i < pass.NumColorTargets; i++)
+        {
+            const RenderGraphPassColorTarget& target = pass.ColorTargets[i];
+            GfxRenderPassColorTarget& rpTarget = colorTargets[i];
+
+            rpTarget.Target = ResolveRenderTarget(target);
+            rpTarget.BeginAccess = GetRenderPassBeginAccess(target.InitMode);
+            rpTarget.EndAccess = getEndAccess(target.ResourceIndex);
+            std::copy_n(target.ClearColor, 4, rpTarget.ClearColor);
+        }
+
+        if (pass.DepthStencilTarget.IsSet)
+        {
+            const RenderGraphPassDepthStencilTarget& target = pass.DepthStencilTarget;
+
+            GfxRenderPassDepthStencilTarget depthStencilTarget{};
+            depthStencilTarget.Target = ResolveRenderTarget(target);
+            depthStencilTarget.BeginAccess = GetRenderPassBeginAccess(target.InitMode);
+            depthStencilTarget.EndAccess = getEndAccess(target.ResourceIndex);
+            depthStencilTarget.ClearDepth = target.ClearDepthValue;
+            depthStencilTarget.ClearStencil = target.ClearStencilValue;
+            cmd->BeginRenderPass(pass.NumColorTargets, colorTargets, &depthStencilTarget);
+        }
+        else
+        {
+            cmd->BeginRenderPass(pass.NumColorTargets, colorTargets, nullptr);
+        }
+    }
+
+    void RenderGraph::SetPassRenderStates(GfxCommandContext* cmd, size_t passIndex)
+    {
+        const RenderGraphPass& pass = m_Passes[passIndex];
+
         if (!pass.RenderFunc)
         {
             LOG_WARNING("Render function is not set in pass '{}'", pass.Name);
@@ -672,29 +1258,42 @@ namespace march
             return;
         }
 
-        GfxRenderTargetDesc colorTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+        // 合并的 pass 由第一个 pass 开始 render pass，render target 在整个 render pass 中都不变，clear 变成 render pass 的 BeginAccess
+        bool isMerged = pass.IsMergedWithPrevious || pass.IsMergedWithNext;
 
-        for (uint32_t i = 0; i < pass.NumColorTargets; i++)
+        if (!pass.IsMergedWithPrevious)
         {
-            const RenderGraphPassColorTarget& target = pass.ColorTargets[i];
-
-            if (!target.IsSet)
+            if (isMerged)
             {
-                LOG_WARNING("Color target '{}' is not set in pass '{}'", i, pass.Name);
-                continue;
+                BeginMergedRenderPass(cmd, passIndex);
             }
+            else
+            {
+                GfxRenderTargetDesc colorTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
 
-            colorTargets[i] = ResolveRenderTarget(target);
-        }
+                for (uint32_t i = 0; i < pass.NumColorTargets; i++)
+                {
+                    const RenderGraphPassColorTarget& target = pass.ColorTargets[i];
 
-        if (pass.DepthStencilTarget.IsSet)
-        {
-            GfxRenderTargetDesc depthStencilTarget = ResolveRenderTarget(pass.DepthStencilTarget);
-            cmd->SetRenderTargets(pass.NumColorTargets, colorTargets, depthStencilTarget);
-        }
-        else
-        {
-            cmd->SetRenderTargets(pass.NumColorTargets, colorTargets);
+                    if (!target.IsSet)
+                    {
+                        LOG_WARNING("Color target '{}' is not set in pass '{}'", i, pass.Name);
+                        continue;
+                    }
+
+                    colorTargets[i] = ResolveRenderTarget(target);
+                }
+
+                if (pass.DepthStencilTarget.IsSet)
+                {
+                    GfxRenderTargetDesc depthStencilTarget = ResolveRenderTarget(pass.DepthStencilTarget);
+                    cmd->SetRenderTargets(pass.NumColorTargets, colorTargets, depthStencilTarget);
+                }
+                else
+                {
+                    cmd->SetRenderTargets(pass.NumColorTargets, colorTargets);
+                }
+            }
         }
 
         if (pass.HasCustomViewport)
@@ -715,19 +1314,22 @@ namespace march
             cmd->SetDefaultScissorRect();
         }
 
-        for (uint32_t i = 0; i < pass.NumColorTargets; i++)
+        if (!isMerged)
         {
-            const RenderGraphPassColorTarget& target = pass.ColorTargets[i];
-
-            if (target.IsSet && target.InitMode == RenderTargetInitMode::Clear)
+            for (uint32_t i = 0; i < pass.NumColorTargets; i++)
             {
-                cmd->ClearColorTarget(i, target.ClearColor);
+                const RenderGraphPassColorTarget& target = pass.ColorTargets[i];
+
+                if (target.IsSet && target.InitMode == RenderTargetInitMode::Clear)
+                {
+                    cmd->ClearColorTarget(i, target.ClearColor);
+                }
             }
-        }
 
-        if (pass.DepthStencilTarget.IsSet && pass.DepthStencilTarget.InitMode == RenderTargetInitMode::Clear)
-        {
-            cmd->ClearDepthStencilTarget(pass.DepthStencilTarget.ClearDepthValue, pass.DepthStencilTarget.ClearStencilValue);
+            if (pass.DepthStencilTarget.IsSet && pass.DepthStencilTarget.InitMode == RenderTargetInitMode::Clear)
+            {
+                cmd->ClearDepthStencilTarget(pass.DepthStencilTarget.ClearDepthValue, pass.DepthStencilTarget.ClearStencilValue);
+            }
         }
 
         cmd->SetWireframe(pass.Wireframe);
@@ -747,7 +1349,7 @@ namespace march
         if (pass.IsAsyncCompute)
         {
             // async compute 资源的生命周期会被延长，所以这个 pass 不该释放任何资源
-            assert(pass.ResourcesDead.empty());
+            assert(pass.ResourcesDead.IsEmpty());
         }
         else
         {
@@ -775,12 +1377,152 @@ namespace march
 
         for (const auto& kv : pass.ResourcesIn)
         {
-            fn(kv.first, kv.second);
+            fn(kv.Key, kv.Value);
         }
 
         for (const auto& kv : pass.ResourcesOut)
         {
-            fn(kv.first, kv.second);
+            fn(kv.Key, kv.Value);
+        }
+    }
+
+    void RenderGraph::RecordPass(RenderGraphContext& context, size_t passIndex)
+    {
+        RenderGraphPass& pass = m_Passes[passIndex];
+        GfxCommandContext* cmd = context.GetCommandContext();
+
+        if (m_IsProfiling)
+        {
+            m_Profiler->BeginPass(cmd, passIndex);
+        }
+
+        PrepareAliasedPassResources(cmd, pass);
+        ApplyPlannedBarriers(cmd, pass.BarriersBefore);
+
+        cmd->BeginEvent(pass.Name.data());
+        {
+            SetPassRenderStates(cmd, passIndex);
+            SetPassDefaultVariables(cmd, pass);
+
+            if (pass.RenderFunc)
+            {
+                pass.RenderFunc(context);
+            }
+
+            cmd->UnsetTexturesAndBuffers();
+
+            if (pass.IsMergedWithPrevious && !pass.IsMergedWithNext)
+            {
+                cmd->EndRenderPass();
+            }
+        }
+        cmd->EndEvent();
+
+        // 后面的 pass 不用这些资源，让 GPU 提前开始转换
+        ApplyPlannedBarriers(cmd, pass.BarriersAfter);
+
+        if (m_IsProfiling)
+        {
+            m_Profiler->EndPass(cmd, passIndex);
+        }
+    }
+
+    size_t RenderGraph::CollectParallelPasses(size_t beginPassIndex)
+    {
+        m_ParallelPassIndices.clear();
+
+        if (!m_EnableParallelRecording || JobManager::GetWorkerCount() == 0)
+        {
+            return beginPassIndex;
+        }
+
+        size_t passIndex = beginPassIndex;
+
+        for (; passIndex < m_Passes.size(); passIndex++)
+        {
+            const RenderGraphPass& pass = m_Passes[passIndex];
+
+            if (pass.IsCulled)
+            {
+                continue;
+            }
+
+            // async compute 和需要等待 sync point 的 pass 要新建 context，只能在主线程按顺序处理
+            if (!pass.AllowParallelRecording || pass.IsAsyncCompute || pass.PassIndexToWait)
+            {
+                break;
+            }
+
+            m_ParallelPassIndices.push_back(passIndex);
+        }
+
+        return passIndex;
+    }
+
+    void RenderGraph::ExecutePassesInParallel(RenderGraphContext& context)
+    {
+        const size_t numPasses = m_ParallelPassIndices.size();
+        const size_t numChunks = std::min<size_t>(numPasses, static_cast<size_t>(JobManager::GetWorkerCount()) + 1);
+
+        // 资源在主线程中提前准备好，录制时只读取
+        // 整段的资源都在开始前申请、结束后释放，段内的 pass 之间无法复用 pool 里的资源
+        for (size_t passIndex : m_ParallelPassIndices)
+        {
+            RequestPassResources(m_Passes[passIndex]);
+        }
+
+        context.Ensure(GfxCommandType::Direct);
+        m_ParallelChunks.assign(numChunks, ParallelRecordingChunk{ nullptr, nullptr });
+
+        JobManager::ParallelFor(numChunks, 1, [this, numPasses, numChunks](size_t chunkIndex)
+        {
+            ParallelRecordingChunk& chunk = m_ParallelChunks[chunkIndex];
+
+            try
+            {
+                RenderGraphContext chunkContext{};
+                chunkContext.m_Cmd = chunk.Cmd = GetGfxDevice()->RequestContext(GfxCommandType::Direct);
+                chunk.Cmd->EnableLocalResourceStates();
+
+                // 每个 chunk 是连续的一段 pass，保证提交顺序和 graph 一致
+                size_t begin = numPasses * chunkIndex / numChunks;
+                size_t end = numPasses * (chunkIndex + 1) / numChunks;
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    RecordPass(chunkContext, m_ParallelPassIndices[i]);
+                }
+            }
+            catch (...)
+            {
+                chunk.Error = std::current_exception();
+            }
+        });
+
+        // 按顺序补上 chunk 之间的 barrier，然后提交
+        for (ParallelRecordingChunk& chunk : m_ParallelChunks)
+        {
+            if (chunk.Cmd == nullptr)
+            {
+                continue;
+            }
+
+            chunk.Cmd->ResolveLocalResourceStates(context.m_Cmd);
+            context.m_Cmd->SubmitAndRelease();
+            context.m_Cmd = chunk.Cmd;
+        }
+
+        for (size_t passIndex : m_ParallelPassIndices)
+        {
+            ReleasePassResources(m_Passes[passIndex]);
+        }
+
+        for (ParallelRecordingChunk& chunk : m_ParallelChunks)
+        {
+            if (chunk.Error)
+            {
+                std::rethrow_exception(chunk.Error);
+            }
         }
     }
 
@@ -799,23 +1541,17 @@ namespace march
                     continue;
                 }
 
-                RequestPassResources(pass);
-                GfxCommandContext* cmd = EnsurePassContext(context, passIndex);
-
-                cmd->BeginEvent(pass.Name);
+                // 至少两个 pass 时才值得并行
+                if (size_t endPassIndex = CollectParallelPasses(passIndex); m_ParallelPassIndices.size() > 1)
                 {
-                    SetPassRenderStates(cmd, pass);
-                    SetPassDefaultVariables(cmd, pass);
-
-                    if (pass.RenderFunc)
-                    {
-                        pass.RenderFunc(context);
-                    }
-
-                    cmd->UnsetTexturesAndBuffers();
+                    ExecutePassesInParallel(context);
+                    passIndex = endPassIndex - 1;
+                    continue;
                 }
-                cmd->EndEvent();
 
+                RequestPassResources(pass);
+                EnsurePassContext(context, passIndex);
+                RecordPass(context, passIndex);
                 ReleasePassResources(pass);
 
                 if (pass.IsAsyncCompute && pass.NeedSyncPoint)
@@ -843,6 +1579,26 @@ namespace march
                 cmdQueue->WaitOnGpu(syncPoint);
             }
         }
+
+        if (m_IsProfiling)
+        {
+            // 在所有 pass 后面 resolve，这时 async compute 也已经执行完了
+            m_ProfilerPassNames.clear();
+
+            for (const RenderGraphPass& pass : m_Passes)
+            {
+                m_ProfilerPassNames.push_back(pass.Name);
+            }
+
+            m_Profiler->EndFrame(m_ProfilerPassNames);
+        }
+    }
+
+    RenderGraph::RenderGraph(std::unique_ptr<IRenderGraphBackend> backend)
+        : m_Backend(backend ? std::move(backend) : std::make_unique<RenderGraphD3D12Backend>())
+        , m_ResourceManager(nullptr)
+    {
+        m_ResourceManager = std::make_unique<RenderGraphResourceManager>(m_Backend.get());
     }
 
     RenderGraphBuilder RenderGraph::AddPass()
@@ -850,28 +1606,266 @@ namespace march
         return AddPass("AnonymousPass");
     }
 
-    RenderGraphBuilder RenderGraph::AddPass(const std::string& name)
+    RenderGraphBuilder RenderGraph::AddPass(std::string_view name)
     {
         RenderGraphPass& pass = m_Passes.emplace_back();
-        pass.Name = name;
+        pass.Name = m_Arena.AllocateString(name);
 
         return RenderGraphBuilder(this, m_Passes.size() - 1);
     }
 
     static std::unordered_set<IRenderGraphCompiledEventListener*> g_GraphCompiledEventListeners{};
+    static bool g_IsProfilingEnabled = false;
+
+    void RenderGraph::BuildTopologyKey()
+    {
+        m_TopologyKey.clear();
+        m_TopologyKey.push_back(m_Passes.size());
+        m_TopologyKey.push_back(m_ResourceManager->GetNumResources());
+
+        for (size_t i = 0; i < m_ResourceManager->GetNumResources(); i++)
+        {
+            // 外部资源的状态可能被锁定，会影响 async compute 的编译结果
+            m_TopologyKey.push_back(static_cast<size_t>(m_ResourceManager->GetResourceId(i)));
+            m_TopologyKey.push_back(m_ResourceManager->IsExternalResource(i) ? 1 : 0);
+            m_TopologyKey.push_back(m_ResourceManager->IsGenericallyReadableResource(i) ? 1 : 0);
+
+            // 会影响编译时算出来的 barrier
+            bool isTexture = m_ResourceManager->IsTextureResource(i);
+            m_TopologyKey.push_back(isTexture ? 1 : 0);
+            m_TopologyKey.push_back(isTexture && m_ResourceManager->GetTextureDesc(i).IsDepthStencil() ? 1 : 0);
+        }
+
+        // 遍历顺序和 builder 的调用顺序有关，排序后再放进去
+        auto appendSortedScratch = [this]()
+        {
+            std::sort(m_TopologyKeyScratch.begin(), m_TopologyKeyScratch.end());
+            m_TopologyKey.push_back(m_TopologyKeyScratch.size());
+
+            for (const auto& [first, second] : m_TopologyKeyScratch)
+            {
+                m_TopologyKey.push_back(first);
+                m_TopologyKey.push_back(second);
+            }
+        };
+
+        for (const RenderGraphPass& pass : m_Passes)
+        {
+            size_t flags = 0;
+            flags |= pass.HasSideEffects ? 1 : 0;
+            flags |= pass.AllowPassCulling ? 2 : 0;
+            flags |= pass.EnableAsyncCompute ? 4 : 0;
+            flags |= pass.AllowParallelRecording ? 8 : 0;
+
+            m_TopologyKey.push_back(std::hash<std::string_view>{}(pass.Name));
+            m_TopologyKey.push_back(flags);
+            m_TopologyKey.push_back(static_cast<size_t>(pass.EstimatedCost)); // 会影响调度，只精确到微秒
+
+            // 没有估计耗时时使用 profiler 的耗时，只放档位，档位内的抖动不会让缓存失效
+            std::optional<uint32_t> costBucket = std::nullopt;
+
+            if (pass.EstimatedCost <= 0)
+            {
+                costBucket = m_ProfiledPassCosts.GetBucket(std::hash<std::string_view>{}(pass.Name));
+            }
+
+            m_TopologyKey.push_back(costBucket ? static_cast<size_t>(*costBucket) + 1 : 0);
+
+            // 会影响 render pass 的合并
+            auto appendRenderTarget = [this](const RenderGraphPassRenderTarget& target)
+            {
+                m_TopologyKey.push_back(target.IsSet ? target.ResourceIndex : static_cast<size_t>(-1));
+                m_TopologyKey.push_back(static_cast<size_t>(target.Face));
+                m_TopologyKey.push_back(target.WOrArraySlice);
+                m_TopologyKey.push_back(target.MipSlice);
+                m_TopologyKey.push_back(static_cast<size_t>(target.InitMode));
+            };
+
+            m_TopologyKey.push_back(pass.RenderFunc ? 1 : 0);
+            m_TopologyKey.push_back(pass.NumColorTargets);
+
+            for (uint32_t i = 0; i < pass.NumColorTargets; i++)
+            {
+                appendRenderTarget(pass.ColorTargets[i]);
+            }
+
+            appendRenderTarget(pass.DepthStencilTarget);
+
+            m_TopologyKeyScratch.clear();
+            for (const auto& kv : pass.ResourcesIn)
+            {
+                m_TopologyKeyScratch.emplace_back(kv.Key, static_cast<size_t>(kv.Value));
+            }
+
+            appendSortedScratch();
+
+            m_TopologyKeyScratch.clear();
+            for (const auto& kv : pass.ResourcesOut)
+            {
+                m_TopologyKeyScratch.emplace_back(kv.Key, static_cast<size_t>(kv.Value));
+            }
+
+            appendSortedScratch();
+
+            m_TopologyKeyScratch.clear();
+            for (size_t adjIndex : pass.NextPassIndices)
+            {
+                m_TopologyKeyScratch.emplace_back(adjIndex, 0);
+            }
+
+            appendSortedScratch();
+        }
+    }
+
+    void RenderGraph::SaveCompileCache()
+    {
+        m_CompileCache.IsValid = true;
+        m_CompileCache.TopologyKey.swap(m_TopologyKey);
+        m_CompileCache.PassIndexToWaitFallback = m_PassIndexToWaitFallback;
+        m_CompileCache.IsPassOrderIdentity = m_Scheduler.IsIdentity();
+        m_CompileCache.PassOrder.assign(m_Scheduler.GetOrder().begin(), m_Scheduler.GetOrder().end());
+
+        m_CompileCache.Passes.resize(m_Passes.size());
+
+        for (size_t i = 0; i < m_Passes.size(); i++)
+        {
+            const RenderGraphPass& pass = m_Passes[i];
+            CompiledPassData& data = m_CompileCache.Passes[i];
+
+            data.IsCulled = pass.IsCulled;
+            data.IsAsyncCompute = pass.IsAsyncCompute;
+            data.IsBatchedWithPrevious = pass.IsBatchedWithPrevious;
+            data.NeedSyncPoint = pass.NeedSyncPoint;
+            data.PassIndexToWait = pass.PassIndexToWait;
+            data.IsMergedWithPrevious = pass.IsMergedWithPrevious;
+            data.IsMergedWithNext = pass.IsMergedWithNext;
+            data.ResourcesBorn.assign(pass.ResourcesBorn.begin(), pass.ResourcesBorn.end());
+            data.ResourcesDead.assign(pass.ResourcesDead.begin(), pass.ResourcesDead.end());
+            data.BarriersBefore.assign(pass.BarriersBefore.begin(), pass.BarriersBefore.end());
+            data.BarriersAfter.assign(pass.BarriersAfter.begin(), pass.BarriersAfter.end());
+        }
+
+        m_CompileCache.ResourceLifetimes.resize(m_ResourceManager->GetNumResources());
+
+        for (size_t i = 0; i < m_ResourceManager->GetNumResources(); i++)
+        {
+            m_CompileCache.ResourceLifetimes[i] = m_ResourceManager->GetLifetimePassIndexRange(i);
+        }
+    }
+
+    void RenderGraph::LoadCompileCache()
+    {
+        // 缓存的数据是按调度后的顺序保存的
+        if (!m_CompileCache.IsPassOrderIdentity)
+        {
+            ReorderPasses(m_CompileCache.PassOrder);
+        }
+
+        m_PassIndexToWaitFallback = m_CompileCache.PassIndexToWaitFallback;
+
+        for (size_t i = 0; i < m_Passes.size(); i++)
+        {
+            RenderGraphPass& pass = m_Passes[i];
+            const CompiledPassData& data = m_CompileCache.Passes[i];
+
+            pass.IsVisited = true;
+            pass.IsCulled = data.IsCulled;
+            pass.IsAsyncCompute = data.IsAsyncCompute;
+            pass.IsBatchedWithPrevious = data.IsBatchedWithPrevious;
+            pass.NeedSyncPoint = data.NeedSyncPoint;
+            pass.PassIndexToWait = data.PassIndexToWait;
+            pass.IsMergedWithPrevious = data.IsMergedWithPrevious;
+            pass.IsMergedWithNext = data.IsMergedWithNext;
+            pass.ResourcesBorn.Assign(data.ResourcesBorn.begin(), data.ResourcesBorn.end(), m_Arena);
+            pass.ResourcesDead.Assign(data.ResourcesDead.begin(), data.ResourcesDead.end(), m_Arena);
+            pass.BarriersBefore.Assign(data.BarriersBefore.begin(), data.BarriersBefore.end(), m_Arena);
+            pass.BarriersAfter.Assign(data.BarriersAfter.begin(), data.BarriersAfter.end(), m_Arena);
+        }
+
+        for (size_t i = 0; i < m_ResourceManager->GetNumResources(); i++)
+        {
+            m_ResourceManager->SetLifetimePassIndexRange(i, m_CompileCache.ResourceLifetimes[i]);
+        }
+    }
 
     void RenderGraph::CompileAndExecute()
     {
         DeferredCleanup cleanup{ this };
 
-        CompilePasses();
+        Compile();
+
+        if (m_Backend->CanExecute())
+        {
+            ExecutePasses();
+        }
+    }
+
+    void RenderGraph::Compile()
+    {
+        // profiler 需要 GfxDevice
+        m_IsProfiling = g_IsProfilingEnabled && m_Backend->CanExecute();
+
+        if (m_IsProfiling)
+        {
+            if (!m_Profiler)
+            {
+                m_Profiler = std::make_unique<RenderGraphProfiler>();
+            }
+
+            if (m_Profiler->BeginFrame(m_Passes.size()) > 0)
+            {
+                ApplyProfiledPassCosts(*m_Profiler->GetLatestFrameTiming());
+
+                for (IRenderGraphCompiledEventListener* listener : g_GraphCompiledEventListeners)
+                {
+                    listener->OnGraphProfiled(*m_Profiler->GetLatestFrameTiming());
+                }
+            }
+
+            m_Profiler->BeginCompile();
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        BuildTopologyKey();
+
+        if (m_CompileCache.IsValid && m_CompileCache.TopologyKey == m_TopologyKey)
+        {
+            LoadCompileCache();
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+            m_CompileStats.NumCacheHits++;
+            m_CompileStats.SavedMilliseconds += std::max(m_CompileCache.CompileMilliseconds - elapsed.count(), 0.0);
+        }
+        else
+        {
+            CompilePasses();
+            SaveCompileCache();
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+            m_CompileCache.CompileMilliseconds = elapsed.count();
+            m_CompileStats.NumCacheMisses++;
+            m_CompileStats.LastCompileMilliseconds = elapsed.count();
+        }
+
+        AliasTransientTextures();
+
+        if (m_IsProfiling)
+        {
+            m_Profiler->EndCompile();
+        }
 
         for (IRenderGraphCompiledEventListener* listener : g_GraphCompiledEventListeners)
         {
             listener->OnGraphCompiled(m_Passes, m_ResourceManager.get());
         }
+    }
 
-        ExecutePasses();
+    void RenderGraph::Reset()
+    {
+        m_Passes.clear();
+        m_PassIndexToWaitFallback = std::nullopt;
+        m_ResourceManager->ClearResources();
+        m_Arena.Reset();
     }
 
     void RenderGraph::AddGraphCompiledEventListener(IRenderGraphCompiledEventListener* listener)
@@ -884,6 +1878,44 @@ namespace march
         g_GraphCompiledEventListeners.erase(listener);
     }
 
+    void RenderGraph::SetProfilingEnabled(bool value)
+    {
+        g_IsProfilingEnabled = value;
+    }
+
+    bool RenderGraph::IsProfilingEnabled()
+    {
+        return g_IsProfilingEnabled;
+    }
+
+    const RenderGraphFrameTiming* RenderGraph::GetLatestFrameTiming() const
+    {
+        return m_Profiler ? m_Profiler->GetLatestFrameTiming() : nullptr;
+    }
+
+    void RenderGraph::ApplyProfiledPassCosts(const RenderGraphFrameTiming& timing)
+    {
+        for (const RenderGraphPassTiming& passTiming : timing.Passes)
+        {
+            if (passTiming.HasGpuTiming)
+            {
+                size_t nameHash = std::hash<std::string_view>{}(passTiming.Name);
+                m_ProfiledPassCosts.Update(nameHash, passTiming.GetGpuMilliseconds() * 1000.0);
+            }
+        }
+    }
+
+    bool RenderGraph::SaveChromeTrace(const std::string& path) const
+    {
+        if (!m_Profiler)
+        {
+            LOG_WARNING("Render graph profiling has never been enabled");
+            return false;
+        }
+
+        return RenderGraphProfiler::SaveChromeTrace(path, m_Profiler->GetHistory());
+    }
+
     BufferHandle RenderGraph::ImportBuffer(const std::string& name, GfxBuffer* buffer)
     {
         return ImportBuffer(ShaderUtils::GetIdFromString(name), buffer);
@@ -934,6 +1966,26 @@ namespace march
         return m_ResourceManager->CreateTexture(id, desc);
     }
 
+    BufferHandle RenderGraph::ImportBuffer(const std::string& name, const GfxBufferDesc& desc)
+    {
+        return ImportBuffer(ShaderUtils::GetIdFromString(name), desc);
+    }
+
+    BufferHandle RenderGraph::ImportBuffer(int32 id, const GfxBufferDesc& desc)
+    {
+        return m_ResourceManager->ImportVirtualBuffer(id, desc);
+    }
+
+    TextureHandle RenderGraph::ImportTexture(const std::string& name, const GfxTextureDesc& desc)
+    {
+        return ImportTexture(ShaderUtils::GetIdFromString(name), desc);
+    }
+
+    TextureHandle RenderGraph::ImportTexture(int32 id, const GfxTextureDesc& desc)
+    {
+        return m_ResourceManager->ImportVirtualTexture(id, desc);
+    }
+
     void RenderGraphContext::New(GfxCommandType type, bool waitPreviousOneOnGpu)
     {
         GfxSyncPoint prevSyncPoint{};
@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphPassScheduler.h"
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+namespace march
+{
+    void RenderGraphPassScheduler::Schedule(const std::vector<RenderGraphSchedulePassInfo>& passes, const std::vector<RenderGraphScheduleDependency>& dependencies)
+    {
+        size_t numPasses = passes.size();
+
+        m_Order.clear();
+        m_IsIdentity = true;
+        m_Stats = {};
+
+        // 把后继结点按 From 分组
+        m_AdjOffsets.assign(numPasses + 1, 0);
+        m_Indegrees.assign(numPasses, 0);
+
+        for (const RenderGraphScheduleDependency& dep : dependencies)
+        {
+            assert(dep.From < dep.To && dep.To < numPasses);
+            m_AdjOffsets[dep.From + 1]++;
+            m_Indegrees[dep.To]++;
+        }
+
+        for (size_t i = 0; i < numPasses; i++)
+        {
+            m_AdjOffsets[i + 1] += m_AdjOffsets[i];
+        }
+
+        m_AdjCursors.assign(m_AdjOffsets.begin(), m_AdjOffsets.end() - 1);
+        m_AdjIndices.resize(dependencies.size());
+
+        for (const RenderGraphScheduleDependency& dep : dependencies)
+        {
+            m_AdjIndices[m_AdjCursors[dep.From]++] = dep.To;
+        }
+
+        // 原来的顺序就是拓扑序，从后往前算关键路径，同时找出 async compute pass 和它依赖的 pass
+        m_BottomLevels.assign(numPasses, 0);
+        m_IsHoisted.assign(numPasses, false);
+
+        for (size_t i = numPasses; i > 0; i--)
+        {
+            size_t passIndex = i - 1;
+            double maxNextLevel = 0;
+            bool isHoisted = passes[passIndex].IsAsyncComputeCandidate;
+
+            for (size_t j = m_AdjOffsets[passIndex]; j < m_AdjOffsets[passIndex + 1]; j++)
+            {
+                size_t adjIndex = m_AdjIndices[j];
+                maxNextLevel = std::max(maxNextLevel, m_BottomLevels[adjIndex]);
+                isHoisted |= m_IsHoisted[adjIndex];
+            }
+
+            m_BottomLevels[passIndex] = std::max(passes[passIndex].Cost, 0.0) + maxNextLevel;
+            m_IsHoisted[passIndex] = isHoisted;
+            m_Stats.CriticalPathCost = std::max(m_Stats.CriticalPathCost, m_BottomLevels[passIndex]);
+        }
+
+        // 关键路径长的优先，一样长时按原来的顺序，保证结果稳定
+        auto isLowerPriority = [this](size_t a, size_t b)
+        {
+            if (m_BottomLevels[a] != m_BottomLevels[b])
+            {
+                return m_BottomLevels[a] < m_BottomLevels[b];
+            }
+
+            return a > b;
+        };
+
+        m_ReadyHoistedPasses.clear();
+
+        for (size_t i = 0; i < numPasses; i++)
+        {
+            if (m_IsHoisted[i] && m_Indegrees[i] == 0)
+            {
+                m_ReadyHoistedPasses.push_back(i);
+                std::push_heap(m_ReadyHoistedPasses.begin(), m_ReadyHoistedPasses.end(), isLowerPriority);
+            }
+        }
+
+        size_t nextPassIndex = 0; // 下一个保持原来顺序的 pass
+
+        while (m_Order.size() < numPasses)
+        {
+            size_t passIndex;
+
+            if (!m_ReadyHoistedPasses.empty())
+            {
+                std::pop_heap(m_ReadyHoistedPasses.begin(), m_ReadyHoistedPasses.end(), isLowerPriority);
+                passIndex = m_ReadyHoistedPasses.back();
+                m_ReadyHoistedPasses.pop_back();
+            }
+            else
+            {
+                while (m_IsHoisted[nextPassIndex])
+                {
+                    nextPassIndex++;
+                }
+
+                // 它依赖的 pass 要么在它前面并且保持原来的顺序，要么会被提前，所以一定已经执行了
+                passIndex = nextPassIndex++;
+                assert(m_Indegrees[passIndex] == 0);
+            }
+
+            m_Order.push_back(passIndex);
+
+            for (size_t j = m_AdjOffsets[passIndex]; j < m_AdjOffsets[passIndex + 1]; j++)
+            {
+                size_t adjIndex = m_AdjIndices[j];
+
+                if (--m_Indegrees[adjIndex] == 0 && m_IsHoisted[adjIndex])
+                {
+                    m_ReadyHoistedPasses.push_back(adjIndex);
+                    std::push_heap(m_ReadyHoistedPasses.begin(), m_ReadyHoistedPasses.end(), isLowerPriority);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < numPasses; i++)
+        {
+            if (m_Order[i] != i)
+            {
+                m_IsIdentity = false;
+            }
+
+            if (i < m_Order[i])
+            {
+                m_Stats.NumHoistedPasses++;
+            }
+        }
+    }
+
+    // 连续的档位坐标，整数部分就是档位
+    static double GetBucketPosition(double microseconds)
+    {
+        double position = std::log2(std::max(microseconds, 1.0)) * RenderGraphPassCostBuckets::BucketsPerOctave;
+        return std::min(position, static_cast<double>(RenderGraphPassCostBuckets::MaxBucket));
+    }
+
+    bool RenderGraphPassCostBuckets::Update(size_t passNameHash, double microseconds)
+    {
+        double position = GetBucketPosition(microseconds);
+        auto [it, isNew] = m_Buckets.try_emplace(passNameHash, static_cast<uint32_t>(position));
+
+        if (isNew)
+        {
+            return true;
+        }
+
+        double lower = static_cast<double>(it->second) - HysteresisBuckets;
+        double upper = static_cast<double>(it->second) + 1 + HysteresisBuckets;
+
+        if (position >= lower && position < upper)
+        {
+            return false;
+        }
+
+        it->second = static_cast<uint32_t>(position);
+        return true;
+    }
+
+    std::optional<uint32_t> RenderGraphPassCostBuckets::GetBucket(size_t passNameHash) const
+    {
+        if (auto it = m_Buckets.find(passNameHash); it != m_Buckets.end())
+        {
+            return it->second;
+        }
+
+        return std::nullopt;
+    }
+
+    uint32_t RenderGraphPassCostBuckets::Quantize(double microseconds)
+    {
+        return static_cast<uint32_t>(GetBucketPosition(microseconds));
+    }
+
+    double RenderGraphPassCostBuckets::GetBucketCost(uint32_t bucket)
+    {
+        return std::exp2((static_cast<double>(bucket) + 0.5) / BucketsPerOctave);
+    }
+}
@@ -0,0 +1,395 @@
+#include "pch.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphProfiler.h"
+#include "Engine/Rendering/D3D12Impl/GfxDevice.h"
+#include "Engine/Rendering/D3D12Impl/GfxCommand.h"
+#include "Engine/Rendering/D3D12Impl/GfxResource.h"
+#include "Engine/Rendering/D3D12Impl/GfxException.h"
+#include "Engine/Rendering/D3D12Impl/GfxUtils.h"
+#include "Engine/Debug.h"
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <assert.h>
+
+using namespace Microsoft::WRL;
+
+namespace march
+{
+    static constexpr uint32_t InvalidQueryPassIndex = static_cast<uint32_t>(-1);
+
+    RenderGraphProfiler::RenderGraphProfiler()
+        : m_QueryHeap(MARCH_MAKE_REF(QueryHeap))
+        , m_ReadbackBuffer(nullptr)
+        , m_Slots{}
+        , m_NextSlotIndex(0)
+        , m_CurrentSlotIndex(-1)
+        , m_FrameIndex(0)
+        , m_CompileBeginMicroseconds(0)
+        , m_CompileEndMicroseconds(0)
+        , m_PassRecords{}
+        , m_History{}
+    {
+        GfxDevice* device = GetGfxDevice();
+        const uint32_t numQueries = NumFrameSlots * MaxPassesPerFrame * 2;
+
+        // direct 和 async compute 队列都可以写 timestamp query
+        D3D12_QUERY_HEAP_DESC heapDesc{};
+        heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        heapDesc.Count = static_cast<UINT>(numQueries);
+        heapDesc.NodeMask = 0;
+        CHECK_HR(device->GetD3DDevice4()->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&m_QueryHeap->Heap)));
+        GfxUtils::SetName(m_QueryHeap->Heap.Get(), "RenderGraphProfilerQueryHeap");
+
+        D3D12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(static_cast<UINT64>(numQueries) * sizeof(uint64_t));
+        GfxResourceAllocator* allocator = device->GetCommittedAllocator(D3D12_HEAP_TYPE_READBACK);
+        m_ReadbackBuffer = allocator->Allocate("RenderGraphProfilerReadbackBuffer", &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST);
+        m_ReadbackBuffer->LockState(true); // readback heap 上的资源只能是 COPY_DEST
+    }
+
+    RenderGraphProfiler::~RenderGraphProfiler()
+    {
+        // GPU 可能还在写入
+        GetGfxDevice()->DeferredRelease(m_QueryHeap);
+        GetGfxDevice()->DeferredRelease(m_ReadbackBuffer);
+    }
+
+    double RenderGraphProfiler::GetCpuMicroseconds()
+    {
+        static const double microsecondsPerCount = []()
+        {
+            LARGE_INTEGER freq;
+            QueryPerformanceFrequency(&freq);
+            return 1000000.0 / static_cast<double>(freq.QuadPart);
+        }();
+
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return static_cast<double>(counter.QuadPart) * microsecondsPerCount;
+    }
+
+    uint32_t RenderGraphProfiler::GetQueryIndex(uint32_t slotIndex, size_t passIndex) const
+    {
+        return (slotIndex * MaxPassesPerFrame + static_cast<uint32_t>(passIndex)) * 2;
+    }
+
+    size_t RenderGraphProfiler::BeginFrame(size_t numPasses)
+    {
+        size_t numCompletedSlots = CollectCompletedSlots();
+
+        // 所有 slot 都在等 GPU 时，这一帧只记录 CPU 时间
+        if (m_Slots[m_NextSlotIndex].IsPending)
+        {
+            m_CurrentSlotIndex = -1;
+        }
+        else
+        {
+            m_CurrentSlotIndex = static_cast<int32_t>(m_NextSlotIndex);
+            m_NextSlotIndex = (m_NextSlotIndex + 1) % NumFrameSlots;
+        }
+
+        m_PassRecords.assign(numPasses, PassRecord{});
+        m_CompileBeginMicroseconds = 0;
+        m_CompileEndMicroseconds = 0;
+        return numCompletedSlots;
+    }
+
+    void RenderGraphProfiler::BeginCompile()
+    {
+        m_CompileBeginMicroseconds = GetCpuMicroseconds();
+    }
+
+    void RenderGraphProfiler::EndCompile()
+    {
+        m_CompileEndMicroseconds = GetCpuMicroseconds();
+    }
+
+    void RenderGraphProfiler::BeginPass(GfxCommandContext* cmd, size_t passIndex)
+    {
+        PassRecord& record = m_PassRecords[passIndex];
+        record.HasGpuQuery = m_CurrentSlotIndex >= 0 && passIndex < MaxPassesPerFrame;
+        record.IsAsyncCompute = cmd->GetType() == GfxCommandType::AsyncCompute;
+        record.CpuThreadId = static_cast<uint32_t>(GetCurrentThreadId());
+
+        if (record.HasGpuQuery)
+        {
+            uint32_t queryIndex = GetQueryIndex(static_cast<uint32_t>(m_CurrentSlotIndex), passIndex);
+            cmd->GetList()->EndQuery(m_QueryHeap->Heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, static_cast<UINT>(queryIndex));
+        }
+
+        record.CpuBeginMicroseconds = GetCpuMicroseconds();
+    }
+
+    void RenderGraphProfiler::EndPass(GfxCommandContext* cmd, size_t passIndex)
+    {
+        PassRecord& record = m_PassRecords[passIndex];
+        record.CpuEndMicroseconds = GetCpuMicroseconds();
+        record.IsRecorded = true;
+
+        if (record.HasGpuQuery)
+        {
+            // 录制过程中还没提交的 barrier 也算在这个 pass 里
+            cmd->FlushResourceBarriers();
+
+            uint32_t queryIndex = GetQueryIndex(static_cast<uint32_t>(m_CurrentSlotIndex), passIndex) + 1;
+            cmd->GetList()->EndQuery(m_QueryHeap->Heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, static_cast<UINT>(queryIndex));
+        }
+    }
+
+    void RenderGraphProfiler::EndFrame(const std::vector<std::string_view>& passNames)
+    {
+        assert(passNames.size() == m_PassRecords.size());
+
+        RenderGraphFrameTiming timing{};
+        timing.FrameIndex = m_FrameIndex++;
+        timing.CpuThreadId = static_cast<uint32_t>(GetCurrentThreadId());
+        timing.CompileBeginMicroseconds = m_CompileBeginMicroseconds;
+        timing.CompileEndMicroseconds = m_CompileEndMicroseconds;
+
+        std::vector<uint32_t> queryPassIndices{};
+
+        for (size_t passIndex = 0; passIndex < m_PassRecords.size(); passIndex++)
+        {
+            const PassRecord& record = m_PassRecords[passIndex];
+
+            if (!record.IsRecorded)
+            {
+                continue;
+            }
+
+            RenderGraphPassTiming& pass = timing.Passes.emplace_back();
+            pass.Name = passNames[passIndex];
+            pass.IsAsyncCompute = record.IsAsyncCompute;
+            pass.CpuThreadId = record.CpuThreadId;
+            pass.CpuBeginMicroseconds = record.CpuBeginMicroseconds;
+            pass.CpuEndMicroseconds = record.CpuEndMicroseconds;
+
+            queryPassIndices.push_back(record.HasGpuQuery ? static_cast<uint32_t>(passIndex) : InvalidQueryPassIndex);
+        }
+
+        if (m_CurrentSlotIndex < 0)
+        {
+            AddHistory(std::move(timing));
+            return;
+        }
+
+        const uint32_t slotIndex = static_cast<uint32_t>(m_CurrentSlotIndex);
+        GfxDevice* device = GetGfxDevice();
+        GfxCommandContext* cmd = device->RequestContext(GfxCommandType::Direct);
+
+        // 只 resolve 写入过的 query，连续的合并成一次
+        for (size_t i = 0; i < queryPassIndices.size();)
+        {
+            if (queryPassIndices[i] == InvalidQueryPassIndex)
+            {
+                i++;
+                continue;
+            }
+
+            size_t j = i + 1;
+            while (j < queryPassIndices.size() && queryPassIndices[j] == queryPassIndices[j - 1] + 1)
+            {
+                j++;
+            }
+
+            uint32_t firstQuery = GetQueryIndex(slotIndex, queryPassIndices[i]);
+            uint32_t numQueries = static_cast<uint32_t>(j - i) * 2;
+            UINT64 offset = static_cast<UINT64>(firstQuery) * sizeof(uint64_t);
+            cmd->GetList()->ResolveQueryData(m_QueryHeap->Heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+                static_cast<UINT>(firstQuery), static_cast<UINT>(numQueries), m_ReadbackBuffer->GetD3DResource(), offset);
+            i = j;
+        }
+
+        cmd->SubmitAndRelease();
+
+        FrameSlot& slot = m_Slots[slotIndex];
+        slot.IsPending = true;
+        slot.Fence = device->GetNextFence();
+        slot.Timing = std::move(timing);
+        slot.QueryPassIndices = std::move(queryPassIndices);
+
+        // 两个队列的 timestamp 频率可能不一样，分别换算到 CPU 的时间轴上
+        const GfxCommandType queueTypes[2] = { GfxCommandType::Direct, GfxCommandType::AsyncCompute };
+
+        for (size_t i = 0; i < std::size(queueTypes); i++)
+        {
+            ID3D12CommandQueue* queue = device->GetCommandManager()->GetQueue(queueTypes[i])->GetQueue();
+            QueueClock& clock = slot.Clocks[i];
+            CHECK_HR(queue->GetTimestampFrequency(&clock.Frequency));
+            CHECK_HR(queue->GetClockCalibration(&clock.GpuTimestamp, &clock.CpuTimestamp));
+        }
+    }
+
+    size_t RenderGraphProfiler::CollectCompletedSlots()
+    {
+        size_t count = 0;
+
+        // 按提交的顺序读回来，保证 history 是有序的
+        for (uint32_t i = 0; i < NumFrameSlots; i++)
+        {
+            uint32_t slotIndex = (m_NextSlotIndex + i) % NumFrameSlots;
+            FrameSlot& slot = m_Slots[slotIndex];
+
+            if (!slot.IsPending)
+            {
+                continue;
+            }
+
+            if (!GetGfxDevice()->IsFenceCompleted(slot.Fence))
+            {
+                break;
+            }
+
+            ReadbackSlot(slot, slotIndex);
+            count++;
+        }
+
+        return count;
+    }
+
+    void RenderGraphProfiler::ReadbackSlot(FrameSlot& slot, uint32_t slotIndex)
+    {
+        LARGE_INTEGER cpuFreq;
+        QueryPerformanceFrequency(&cpuFreq);
+
+        const uint32_t firstQuery = GetQueryIndex(slotIndex, 0);
+        const size_t begin = static_cast<size_t>(firstQuery) * sizeof(uint64_t);
+        const size_t end = begin + static_cast<size_t>(MaxPassesPerFrame) * 2 * sizeof(uint64_t);
+
+        D3D12_RANGE readRange{ begin, end };
+        D3D12_RANGE writtenRange{ 0, 0 };
+        void* pData = nullptr;
+        CHECK_HR(m_ReadbackBuffer->GetD3DResource()->Map(0, &readRange, &pData));
+        const uint64_t* timestamps = static_cast<const uint64_t*>(pData) + firstQuery;
+
+        for (size_t i = 0; i < slot.Timing.Passes.size(); i++)
+        {
+            uint32_t passIndex = slot.QueryPassIndices[i];
+
+            if (passIndex == InvalidQueryPassIndex)
+            {
+                continue;
+            }
+
+            RenderGraphPassTiming& pass = slot.Timing.Passes[i];
+            const QueueClock& clock = slot.Clocks[pass.IsAsyncCompute ? 1 : 0];
+
+            auto toCpuMicroseconds = [&clock, &cpuFreq](uint64_t gpuTimestamp)
+            {
+                double gpuDelta = static_cast<double>(static_cast<int64_t>(gpuTimestamp - clock.GpuTimestamp));
+                double cpuBase = static_cast<double>(clock.CpuTimestamp) * 1000000.0 / static_cast<double>(cpuFreq.QuadPart);
+                return cpuBase + gpuDelta * 1000000.0 / static_cast<double>(clock.Frequency);
+            };
+
+            pass.HasGpuTiming = true;
+            pass.GpuBeginMicroseconds = toCpuMicroseconds(timestamps[passIndex * 2]);
+            pass.GpuEndMicroseconds = toCpuMicroseconds(timestamps[passIndex * 2 + 1]);
+        }
+
+        m_ReadbackBuffer->GetD3DResource()->Unmap(0, &writtenRange);
+
+        slot.IsPending = false;
+        slot.QueryPassIndices.clear();
+        AddHistory(std::move(slot.Timing));
+        slot.Timing = {};
+    }
+
+    void RenderGraphProfiler::AddHistory(RenderGraphFrameTiming&& timing)
+    {
+        m_History.push_back(std::move(timing));
+
+        if (m_History.size() > MaxHistoryFrames)
+        {
+            m_History.pop_front();
+        }
+    }
+
+    static void AppendJsonString(std::string& out, std::string_view str)
+    {
+        out.push_back('"');
+
+        for (char c : str)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<unsigned int>(c));
+                }
+                else
+                {
+                    out.push_back(c);
+                }
+                break;
+            }
+        }
+
+        out.push_back('"');
+    }
+
+    static void AppendTraceEvent(std::string& out, std::string_view name, std::string_view category,
+        double beginMicroseconds, double endMicroseconds, uint32_t pid, uint32_t tid, uint64_t frameIndex)
+    {
+        out += ",\n{\"name\":";
+        AppendJsonString(out, name);
+        out += ",\"cat\":";
+        AppendJsonString(out, category);
+        fmt::format_to(std::back_inserter(out), ",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{},\"args\":{{\"frame\":{}}}}}",
+            beginMicroseconds, endMicroseconds - beginMicroseconds, pid, tid, frameIndex);
+    }
+
+    std::string RenderGraphProfiler::ToChromeTraceJson(const std::deque<RenderGraphFrameTiming>& frames)
+    {
+        // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+        // pid 0 是 CPU，pid 1 是 GPU，GPU 的 tid 0 是 direct 队列，tid 1 是 async compute 队列
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}}";
+        out += ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Direct Queue\"}}";
+        out += ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Async Compute Queue\"}}";
+
+        for (const RenderGraphFrameTiming& frame : frames)
+        {
+            if (frame.CompileEndMicroseconds > frame.CompileBeginMicroseconds)
+            {
+                AppendTraceEvent(out, "RenderGraph::Compile", "Compile", frame.CompileBeginMicroseconds,
+                    frame.CompileEndMicroseconds, 0, frame.CpuThreadId, frame.FrameIndex);
+            }
+
+            for (const RenderGraphPassTiming& pass : frame.Passes)
+            {
+                AppendTraceEvent(out, pass.Name, "CPU", pass.CpuBeginMicroseconds, pass.CpuEndMicroseconds,
+                    0, pass.CpuThreadId, frame.FrameIndex);
+
+                if (pass.HasGpuTiming)
+                {
+                    AppendTraceEvent(out, pass.Name, "GPU", pass.GpuBeginMicroseconds, pass.GpuEndMicroseconds,
+                        1, pass.IsAsyncCompute ? 1 : 0, frame.FrameIndex);
+                }
+            }
+        }
+
+        out += "\n]}\n";
+        return out;
+    }
+
+    bool RenderGraphProfiler::SaveChromeTrace(const std::string& path, const std::deque<RenderGraphFrameTiming>& frames)
+    {
+        std::ofstream fs(path, std::ios::out | std::ios::binary);
+
+        if (!fs)
+        {
+            LOG_ERROR("Failed to open file: {}", path);
+            return false;
+        }
+
+        std::string json = ToChromeTraceJson(frames);
+        fs.write(json.data(), static_cast<std::streamsize>(json.size()));
+        return static_cast<bool>(fs);
+    }
+}
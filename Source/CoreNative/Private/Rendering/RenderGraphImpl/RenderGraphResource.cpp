@@ -2,6 +2,7 @@
 #include "Engine/Rendering/RenderGraphImpl/RenderGraphResource.h"
 #include "Engine/Debug.h"
 #include <utility>
+#include <algorithm>
 #include <stdexcept>
 #include <assert.h>
 
@@ -26,6 +27,9 @@ namespace march
             [](const RenderGraphResourceExternalBuffer& b) -> bool { return true; },
             [](const RenderGraphResourcePooledTexture& t) -> bool { return false; },
             [](const RenderGraphResourceExternalTexture& t) -> bool { return true; },
+            [](const RenderGraphResourceTransientTexture& t) -> bool { return false; },
+            [](const RenderGraphResourceVirtualBuffer& b) -> bool { return b.IsExternal; },
+            [](const RenderGraphResourceVirtualTexture& t) -> bool { return true; },
             [](auto&&) -> bool { throw std::runtime_error("Resource is not a buffer or texture"); },
         }, m_Resource);
     }
@@ -56,6 +60,9 @@ namespace march
             [](RenderGraphResourceExternalBuffer& b) -> bool {return AllowGenericRead(b.Buffer); },
             [](RenderGraphResourcePooledTexture& t) -> bool { return true; },
             [](RenderGraphResourceExternalTexture& t) -> bool {return AllowGenericRead(t.Texture); },
+            [](RenderGraphResourceTransientTexture& t) -> bool { return true; },
+            [](RenderGraphResourceVirtualBuffer& b) -> bool { return true; },
+            [](RenderGraphResourceVirtualTexture& t) -> bool { return true; },
             [](auto&&) -> bool { throw std::runtime_error("Resource is not a buffer or texture"); },
         }, m_Resource);
     }
@@ -76,16 +83,43 @@ namespace march
             [](const RenderGraphResourceExternalBuffer& b) -> bool { return !IsSubAllocatedBuffer(b.Buffer); },
             [](const RenderGraphResourcePooledTexture& t) -> bool { return true; },
             [](const RenderGraphResourceExternalTexture& t) -> bool { return !t.Texture->IsReadOnly(); },
+            [](const RenderGraphResourceTransientTexture& t) -> bool { return true; },
+            [](const RenderGraphResourceVirtualBuffer& b) -> bool { return !GfxBufferAllocUtils::IsSubAlloc(b.Desc.GetAllocStrategy()); },
+            [](const RenderGraphResourceVirtualTexture& t) -> bool { return true; },
             [](auto&&) -> bool { throw std::runtime_error("Resource is not a buffer or texture"); },
         }, m_Resource);
     }
 
+    bool RenderGraphResourceData::IsPooledTexture() const
+    {
+        return std::holds_alternative<RenderGraphResourcePooledTexture>(m_Resource);
+    }
+
+    bool RenderGraphResourceData::IsTexture() const
+    {
+        return std::holds_alternative<RenderGraphResourcePooledTexture>(m_Resource)
+            || std::holds_alternative<RenderGraphResourceExternalTexture>(m_Resource)
+            || std::holds_alternative<RenderGraphResourceTransientTexture>(m_Resource)
+            || std::holds_alternative<RenderGraphResourceVirtualTexture>(m_Resource);
+    }
+
+    bool RenderGraphResourceData::NeedAliasingBarrier() const
+    {
+        if (const RenderGraphResourceTransientTexture* t = std::get_if<RenderGraphResourceTransientTexture>(&m_Resource))
+        {
+            return t->IsAliased;
+        }
+
+        return false;
+    }
+
     GfxBuffer* RenderGraphResourceData::GetBuffer()
     {
         return std::visit(overloaded{
             [](RenderGraphResourceTempBuffer& b) -> GfxBuffer* { return &b.Buffer; },
             [](RenderGraphResourcePooledBuffer& b) -> GfxBuffer* { return b.Buffer.get(); },
             [](RenderGraphResourceExternalBuffer& b) -> GfxBuffer* { return b.Buffer; },
+            [](RenderGraphResourceVirtualBuffer& b) -> GfxBuffer* { return nullptr; },
             [](auto&&) -> GfxBuffer* { throw std::runtime_error("Resource is not a buffer"); },
         }, m_Resource);
     }
@@ -96,6 +130,7 @@ namespace march
             [](const RenderGraphResourceTempBuffer& b) -> const GfxBufferDesc& { return b.Buffer.GetDesc(); },
             [](const RenderGraphResourcePooledBuffer& b) -> const GfxBufferDesc& { return b.Desc; },
             [](const RenderGraphResourceExternalBuffer& b) -> const GfxBufferDesc& { return b.Buffer->GetDesc(); },
+            [](const RenderGraphResourceVirtualBuffer& b) -> const GfxBufferDesc& { return b.Desc; },
             [](auto&&) -> const GfxBufferDesc& { throw std::runtime_error("Resource is not a buffer"); },
         }, m_Resource);
     }
@@ -105,6 +140,8 @@ namespace march
         return std::visit(overloaded{
             [](RenderGraphResourcePooledTexture& t) -> GfxTexture* { return t.Texture.get(); },
             [](RenderGraphResourceExternalTexture& t) -> GfxTexture* { return t.Texture; },
+            [](RenderGraphResourceTransientTexture& t) -> GfxTexture* { return t.Texture; },
+            [](RenderGraphResourceVirtualTexture& t) -> GfxTexture* { return nullptr; },
             [](auto&&) -> GfxTexture* { throw std::runtime_error("Resource is not a texture"); },
         }, m_Resource);
     }
@@ -114,6 +151,8 @@ namespace march
         return std::visit(overloaded{
             [](const RenderGraphResourcePooledTexture& t) -> const GfxTextureDesc& { return t.Desc; },
             [](const RenderGraphResourceExternalTexture& t) -> const GfxTextureDesc& { return t.Texture->GetDesc(); },
+            [](const RenderGraphResourceTransientTexture& t) -> const GfxTextureDesc& { return t.Desc; },
+            [](const RenderGraphResourceVirtualTexture& t) -> const GfxTextureDesc& { return t.Desc; },
             [](auto&&) -> const GfxTextureDesc& { throw std::runtime_error("Resource is not a texture"); },
         }, m_Resource);
     }
@@ -126,6 +165,7 @@ namespace march
             [id = m_Id, cmd](RenderGraphResourceExternalBuffer& b) -> void { cmd->SetBuffer(id, b.Buffer); },
             [id = m_Id, cmd](RenderGraphResourcePooledTexture& t) -> void { cmd->SetTexture(id, t.Texture.get()); },
             [id = m_Id, cmd](RenderGraphResourceExternalTexture& t) -> void { cmd->SetTexture(id, t.Texture); },
+            [id = m_Id, cmd](RenderGraphResourceTransientTexture& t) -> void { cmd->SetTexture(id, t.Texture); },
             [](auto&&) -> void { throw std::runtime_error("Resource is not a buffer or texture"); },
         }, m_Resource);
     }
@@ -138,12 +178,14 @@ namespace march
             [](RenderGraphResourceExternalBuffer& b) -> RefCountPtr<GfxResource> { return b.Buffer->GetUnderlyingResource(); },
             [](RenderGraphResourcePooledTexture& t) -> RefCountPtr<GfxResource> { return t.Texture->GetUnderlyingResource(); },
             [](RenderGraphResourceExternalTexture& t) -> RefCountPtr<GfxResource> { return t.Texture->GetUnderlyingResource(); },
+            [](RenderGraphResourceTransientTexture& t) -> RefCountPtr<GfxResource> { return t.Texture->GetUnderlyingResource(); },
             [](auto&&) -> RefCountPtr<GfxResource> { throw std::runtime_error("Resource is not a buffer or texture"); },
         }, m_Resource);
     }
 
     void RenderGraphResourceData::RequestResource()
     {
+        // transient texture 一直存在，不需要请求和释放
         std::visit(overloaded{
             [](RenderGraphResourcePooledBuffer& b) { b.RequestBuffer(); },
             [](RenderGraphResourcePooledTexture& t) { t.RequestTexture(); },
@@ -163,9 +205,9 @@ namespace march
     std::optional<size_t> RenderGraphResourceData::GetLastProducerBeforePassIndex(size_t passIndex) const
     {
         // 如果自己是自己的 producer 就会产生环，所以要从后往前找第一个不等于自己的 producer
-        for (auto it = m_ProducerPassIndices.rbegin(); it != m_ProducerPassIndices.rend(); ++it)
+        for (size_t i = m_ProducerPassIndices.Num(); i > 0; i--)
         {
-            if (size_t v = *it; v != passIndex)
+            if (size_t v = m_ProducerPassIndices[i - 1]; v != passIndex)
             {
                 return v;
             }
@@ -174,9 +216,9 @@ namespace march
         return std::nullopt;
     }
 
-    void RenderGraphResourceData::AddProducerPassIndex(size_t passIndex)
+    void RenderGraphResourceData::AddProducerPassIndex(size_t passIndex, RenderGraphArena& arena)
     {
-        m_ProducerPassIndices.push_back(passIndex);
+        m_ProducerPassIndices.Append(passIndex, arena);
     }
 
     void RenderGraphResourceData::SetAlive(size_t passIndex)
@@ -193,16 +235,38 @@ namespace march
         }
     }
 
-    RenderGraphResourceManager::RenderGraphResourceManager()
-        : m_Resources{}
+    RenderGraphResourceManager::RenderGraphResourceManager(IRenderGraphBackend* backend)
+        : m_Backend(backend)
+        , m_Resources{}
+        , m_TransientTextureSets{}
+        , m_NumTransientTextureSetBuilds(0)
+        , m_TransientRequests{}
+        , m_TransientPlanner{}
+        , m_TransientMemoryStats{}
     {
-        m_BufferPool = std::make_unique<RenderGraphResourcePool<GfxBuffer>>();
-        m_TexturePool = std::make_unique<RenderGraphResourcePool<GfxRenderTexture>>();
+        m_BufferPool = std::make_unique<RenderGraphResourcePool<GfxBuffer>>(backend);
+        m_TexturePool = std::make_unique<RenderGraphResourcePool<GfxRenderTexture>>(backend);
     }
 
     void RenderGraphResourceManager::ClearResources()
     {
         m_Resources.clear();
+
+        // 资源都回到池里了，释放太久没用的
+        m_BufferPool->Trim();
+        m_TexturePool->Trim();
+    }
+
+    void RenderGraphResourceManager::SetPoolMemoryBudget(uint64_t bytes)
+    {
+        m_BufferPool->SetMemoryBudget(bytes);
+        m_TexturePool->SetMemoryBudget(bytes);
+    }
+
+    void RenderGraphResourceManager::SetPoolMaxUnusedFrames(uint32_t frames)
+    {
+        m_BufferPool->SetMaxUnusedFrames(frames);
+        m_TexturePool->SetMaxUnusedFrames(frames);
     }
 
     BufferHandle RenderGraphResourceManager::CreateBuffer(int32 id, const GfxBufferDesc& desc, const void* pInitialData, std::optional<uint32_t> initialCounter)
@@ -211,6 +275,13 @@ namespace march
         GfxBufferAllocStrategy allocStrategy = desc.GetAllocStrategy();
         bool isHeapCpuAccessible = GfxBufferAllocUtils::IsHeapCpuAccessible(allocStrategy);
 
+        if (!m_Backend->CanExecute())
+        {
+            // 和 TempBuffer 的 IsExternal 保持一致，这样编译结果和真正执行时相同
+            resData.InitAsVirtualBuffer(id, desc, isHeapCpuAccessible);
+            return BufferHandle(this, m_Resources.size() - 1);
+        }
+
         if (GfxBufferAllocUtils::IsSubAlloc(allocStrategy))
         {
             // SubAlloc 开销小，没必要再复用了
@@ -252,6 +323,15 @@ namespace march
         return BufferHandle(this, m_Resources.size() - 1);
     }
 
+    BufferHandle RenderGraphResourceManager::ImportVirtualBuffer(int32 id, const GfxBufferDesc& desc)
+    {
+        assert(!m_Backend->CanExecute());
+
+        RenderGraphResourceData& resData = m_Resources.emplace_back();
+        resData.InitAsVirtualBuffer(id, desc, true);
+        return BufferHandle(this, m_Resources.size() - 1);
+    }
+
     TextureHandle RenderGraphResourceManager::CreateTexture(int32 id, const GfxTextureDesc& desc)
     {
         RenderGraphResourceData& resData = m_Resources.emplace_back();
@@ -266,6 +346,15 @@ namespace march
         return TextureHandle(this, m_Resources.size() - 1);
     }
 
+    TextureHandle RenderGraphResourceManager::ImportVirtualTexture(int32 id, const GfxTextureDesc& desc)
+    {
+        assert(!m_Backend->CanExecute());
+
+        RenderGraphResourceData& resData = m_Resources.emplace_back();
+        resData.InitAsVirtualTexture(id, desc);
+        return TextureHandle(this, m_Resources.size() - 1);
+    }
+
     size_t RenderGraphResourceManager::GetResourceIndex(const BufferHandle& handle) const
     {
         assert(handle.m_Manager == this);
@@ -343,9 +432,9 @@ namespace march
         return m_Resources[resourceIndex].GetLastProducerBeforePassIndex(passIndex);
     }
 
-    void RenderGraphResourceManager::AddProducerPassIndex(size_t resourceIndex, size_t passIndex)
+    void RenderGraphResourceManager::AddProducerPassIndex(size_t resourceIndex, size_t passIndex, RenderGraphArena& arena)
     {
-        m_Resources[resourceIndex].AddProducerPassIndex(passIndex);
+        m_Resources[resourceIndex].AddProducerPassIndex(passIndex, arena);
     }
 
     void RenderGraphResourceManager::SetAlive(size_t resourceIndex, size_t passIndex)
@@ -358,6 +447,202 @@ namespace march
         return m_Resources[resourceIndex].GetLifetimePassIndexRange();
     }
 
+    void RenderGraphResourceManager::SetLifetimePassIndexRange(size_t resourceIndex, const std::optional<std::pair<size_t, size_t>>& range)
+    {
+        m_Resources[resourceIndex].SetLifetimePassIndexRange(range);
+    }
+
+    bool RenderGraphResourceManager::IsPooledTexture(size_t resourceIndex) const
+    {
+        return m_Resources[resourceIndex].IsPooledTexture();
+    }
+
+    bool RenderGraphResourceManager::IsTextureResource(size_t resourceIndex) const
+    {
+        return m_Resources[resourceIndex].IsTexture();
+    }
+
+    bool RenderGraphResourceManager::NeedAliasingBarrier(size_t resourceIndex) const
+    {
+        return m_Resources[resourceIndex].NeedAliasingBarrier();
+    }
+
+    void RenderGraphResourceManager::AliasTransientTextures(const std::vector<size_t>& resourceIndices)
+    {
+        TransientTextureSet* set = FindOrBuildTransientTextureSet(resourceIndices);
+        set->LastUsedFrame = m_Backend->GetFrameIndex();
+        m_TransientMemoryStats = set->Stats;
+
+        for (size_t i = 0; i < resourceIndices.size(); i++)
+        {
+            TransientTexture& texture = set->Textures[i];
+            m_Resources[resourceIndices[i]].ConvertToTransientTexture(texture.Texture.get(), texture.IsAliased);
+        }
+
+        TrimTransientTextureSets();
+    }
+
+    bool RenderGraphResourceManager::IsTransientPlanValid(const TransientTextureSet& set, const std::vector<size_t>& resourceIndices) const
+    {
+        if (resourceIndices.size() != set.Textures.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < resourceIndices.size(); i++)
+        {
+            const RenderGraphResourceData& resData = m_Resources[resourceIndices[i]];
+            const TransientTexture& texture = set.Textures[i];
+            std::pair<size_t, size_t> lifetime = resData.GetLifetimePassIndexRange().value();
+
+            if (lifetime.first != texture.FirstPassIndex || lifetime.second != texture.LastPassIndex)
+            {
+                return false;
+            }
+
+            if (!texture.Desc.IsCompatibleWith(resData.GetTextureDesc()))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    RenderGraphResourceManager::TransientTextureSet* RenderGraphResourceManager::FindOrBuildTransientTextureSet(const std::vector<size_t>& resourceIndices)
+    {
+        for (const std::unique_ptr<TransientTextureSet>& set : m_TransientTextureSets)
+        {
+            if (IsTransientPlanValid(*set, resourceIndices))
+            {
+                return set.get();
+            }
+        }
+
+        std::unique_ptr<TransientTextureSet> newSet = nullptr;
+
+        if (m_TransientTextureSets.size() >= MaxTransientTextureSets)
+        {
+            // 复用最久没用的那一套，旧的 texture 和 heap 会在 BuildTransientTextureSet 里延迟释放
+            auto it = std::min_element(m_TransientTextureSets.begin(), m_TransientTextureSets.end(),
+                [](const std::unique_ptr<TransientTextureSet>& a, const std::unique_ptr<TransientTextureSet>& b)
+                {
+                    return a->LastUsedFrame < b->LastUsedFrame;
+                });
+
+            newSet = std::move(*it);
+            m_TransientTextureSets.erase(it);
+        }
+        else
+        {
+            newSet = std::make_unique<TransientTextureSet>();
+        }
+
+        BuildTransientTextureSet(*newSet, resourceIndices);
+        return m_TransientTextureSets.emplace_back(std::move(newSet)).get();
+    }
+
+    void RenderGraphResourceManager::TrimTransientTextureSets()
+    {
+        uint64_t frameIndex = m_Backend->GetFrameIndex();
+
+        for (size_t i = 0; i < m_TransientTextureSets.size();)
+        {
+            // 例如关掉了一个窗口，它的相机不再渲染
+            if (frameIndex - m_TransientTextureSets[i]->LastUsedFrame > MaxTransientTextureSetUnusedFrames)
+            {
+                m_TransientTextureSets[i] = std::move(m_TransientTextureSets.back());
+                m_TransientTextureSets.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    void RenderGraphResourceManager::BuildTransientTextureSet(TransientTextureSet& set, const std::vector<size_t>& resourceIndices)
+    {
+        m_NumTransientTextureSetBuilds++;
+        m_TransientRequests.clear();
+
+        for (size_t resourceIndex : resourceIndices)
+        {
+            const RenderGraphResourceData& resData = m_Resources[resourceIndex];
+            const GfxTextureDesc& desc = resData.GetTextureDesc();
+            std::pair<size_t, size_t> lifetime = resData.GetLifetimePassIndexRange().value();
+            D3D12_RESOURCE_ALLOCATION_INFO info = m_Backend->GetTextureAllocationInfo(desc);
+
+            RenderGraphTransientRequest& request = m_TransientRequests.emplace_back();
+            request.SizeInBytes = static_cast<uint64_t>(info.SizeInBytes);
+            request.Alignment = static_cast<uint64_t>(info.Alignment);
+            request.FirstPassIndex = lifetime.first;
+            request.LastPassIndex = lifetime.second;
+            request.HeapGroup = desc.MSAASamples > 1 ? 1 : 0; // MSAA 的对齐要求更高，单独放
+        }
+
+        m_TransientPlanner.Plan(m_TransientRequests);
+
+        // 旧的 texture 析构时会延迟释放，placed resource 持有 heap 的引用，所以 heap 也会等 GPU 用完再释放
+        set.Textures.clear();
+        set.Heaps.clear();
+
+        // null backend 只计算内存布局，不创建 heap 和 texture
+        bool canExecute = m_Backend->CanExecute();
+        GfxDevice* device = canExecute ? GetGfxDevice() : nullptr;
+
+        for (size_t group = 0; group < m_TransientPlanner.GetHeapSizes().size(); group++)
+        {
+            uint64_t size = m_TransientPlanner.GetHeapSizes()[group];
+            Microsoft::WRL::ComPtr<ID3D12Heap> heap = nullptr;
+
+            if (size > 0 && canExecute)
+            {
+                UINT64 alignment = group == 1 ? D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+                D3D12_HEAP_DESC heapDesc{};
+                heapDesc.SizeInBytes = (static_cast<UINT64>(size) + alignment - 1) & ~(alignment - 1);
+                heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+                heapDesc.Alignment = alignment;
+                heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+
+                CHECK_HR(device->GetD3DDevice4()->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+                GfxUtils::SetName(heap.Get(), "RenderGraphTransientHeap" + std::to_string(group));
+            }
+
+            set.Heaps.push_back(heap);
+        }
+
+        for (size_t i = 0; i < resourceIndices.size(); i++)
+        {
+            const RenderGraphTransientRequest& request = m_TransientRequests[i];
+            const RenderGraphTransientPlacement& placement = m_TransientPlanner.GetPlacements()[i];
+            const GfxTextureDesc& desc = m_Resources[resourceIndices[i]].GetTextureDesc();
+
+            TransientTexture& texture = set.Textures.emplace_back();
+            texture.Desc = desc;
+            texture.FirstPassIndex = request.FirstPassIndex;
+            texture.LastPassIndex = request.LastPassIndex;
+            texture.IsAliased = placement.IsAliased;
+            texture.Texture = nullptr;
+
+            if (canExecute)
+            {
+                ID3D12Heap* heap = set.Heaps[request.HeapGroup].Get();
+                std::string name = "RenderGraphTransientTexture" + std::to_string(i);
+                texture.Texture = std::make_unique<GfxRenderTexture>(device, name, desc, heap, placement.Offset);
+            }
+        }
+
+        set.Stats = m_TransientPlanner.GetStats();
+
+        LOG_TRACE("Build render graph transient textures: {} textures, {} aliased, {:.2f} MB -> {:.2f} MB",
+            set.Stats.NumResources,
+            set.Stats.NumAliasedResources,
+            set.Stats.BytesWithoutAliasing / (1024.0 * 1024.0),
+            set.Stats.BytesWithAliasing / (1024.0 * 1024.0));
+    }
+
     TextureHandle::operator TextureSliceHandle() const
     {
         return TextureSliceHandle{ *this, GfxCubemapFace::PositiveX, 0, 0 };
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphTransientPlanner.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace march
+{
+    static uint64_t AlignOffset(uint64_t offset, uint64_t alignment)
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    static bool IsLifetimeOverlapped(const RenderGraphTransientRequest& a, const RenderGraphTransientRequest& b)
+    {
+        return a.FirstPassIndex <= b.LastPassIndex && b.FirstPassIndex <= a.LastPassIndex;
+    }
+
+    void RenderGraphTransientPlanner::Plan(const std::vector<RenderGraphTransientRequest>& requests)
+    {
+        m_Placements.assign(requests.size(), RenderGraphTransientPlacement{ 0, false });
+        m_HeapSizes.clear();
+        m_Stats = {};
+
+        m_SortedIndices.resize(requests.size());
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            m_SortedIndices[i] = i;
+        }
+
+        // 大的先放，更容易填满空隙；大小相同时按出现顺序，保证结果稳定
+        std::stable_sort(m_SortedIndices.begin(), m_SortedIndices.end(), [&requests](size_t a, size_t b)
+        {
+            return requests[a].SizeInBytes > requests[b].SizeInBytes;
+        });
+
+        for (size_t i = 0; i < m_SortedIndices.size(); i++)
+        {
+            const RenderGraphTransientRequest& req = requests[m_SortedIndices[i]];
+
+            // 收集同一 group 中生命周期重叠、已经放好的资源占用的内存
+            m_Occupied.clear();
+            for (size_t j = 0; j < i; j++)
+            {
+                const RenderGraphTransientRequest& other = requests[m_SortedIndices[j]];
+
+                if (other.HeapGroup == req.HeapGroup && IsLifetimeOverlapped(req, other))
+                {
+                    uint64_t begin = m_Placements[m_SortedIndices[j]].Offset;
+                    m_Occupied.push_back({ begin, begin + other.SizeInBytes });
+                }
+            }
+
+            std::sort(m_Occupied.begin(), m_Occupied.end(), [](const Interval& a, const Interval& b)
+            {
+                return a.Begin < b.Begin;
+            });
+
+            // first-fit
+            uint64_t offset = 0;
+            for (const Interval& interval : m_Occupied)
+            {
+                uint64_t alignedOffset = AlignOffset(offset, req.Alignment);
+
+                if (alignedOffset + req.SizeInBytes <= interval.Begin)
+                {
+                    break;
+                }
+
+                offset = std::max(offset, interval.End);
+            }
+
+            offset = AlignOffset(offset, req.Alignment);
+            m_Placements[m_SortedIndices[i]].Offset = offset;
+
+            if (req.HeapGroup >= m_HeapSizes.size())
+            {
+                m_HeapSizes.resize(static_cast<size_t>(req.HeapGroup) + 1, 0);
+            }
+
+            m_HeapSizes[req.HeapGroup] = std::max(m_HeapSizes[req.HeapGroup], offset + req.SizeInBytes);
+            m_Stats.BytesWithoutAliasing += req.SizeInBytes;
+        }
+
+        // 内存区域有重叠的资源都需要 aliasing barrier，资源数量不多，直接两两比较
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            uint64_t beginA = m_Placements[i].Offset;
+            uint64_t endA = beginA + requests[i].SizeInBytes;
+
+            for (size_t j = i + 1; j < requests.size(); j++)
+            {
+                if (requests[i].HeapGroup != requests[j].HeapGroup)
+                {
+                    continue;
+                }
+
+                uint64_t beginB = m_Placements[j].Offset;
+                uint64_t endB = beginB + requests[j].SizeInBytes;
+
+                if (beginA < endB && beginB < endA)
+                {
+                    assert(!IsLifetimeOverlapped(requests[i], requests[j]));
+                    m_Placements[i].IsAliased = true;
+                    m_Placements[j].IsAliased = true;
+                }
+            }
+        }
+
+        for (uint64_t size : m_HeapSizes)
+        {
+            m_Stats.BytesWithAliasing += size;
+        }
+
+        m_Stats.NumResources = static_cast<uint32_t>(requests.size());
+
+        for (const RenderGraphTransientPlacement& placement : m_Placements)
+        {
+            if (placement.IsAliased)
+            {
+                m_Stats.NumAliasedResources++;
+            }
+        }
+    }
+}
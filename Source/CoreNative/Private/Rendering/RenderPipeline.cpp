@@ -4,6 +4,7 @@
 #include "Engine/Debug.h"
 #include "Engine/Transform.h"
 #include "Engine/Misc/MathUtils.h"
+#include "Engine/JobManager.h"
 #include <vector>
 #include <random>
 #include <DirectXCollision.h>
@@ -18,6 +19,38 @@ using namespace DirectX;
 
 namespace march
 {
+    // 每帧都要用的名字，hash 在编译期算好，查找时也不用构造 std::string
+    // 不能在静态初始化时查 id，那时 ShaderUtils 里的表可能还没构造，所以在函数内的静态变量中第一次用到时查一次，之后不再查表
+    static constexpr ShaderStringKey CameraColorTargetName("_CameraColorTarget");
+    static constexpr ShaderStringKey CameraDepthStencilTargetName("_CameraDepthStencilTarget");
+    static constexpr ShaderStringKey HistoryColorTextureName("_HistoryColorTexture");
+    static constexpr ShaderStringKey CbCameraName("cbCamera");
+    static constexpr ShaderStringKey CbShadowCameraName("cbShadowCamera");
+    static constexpr ShaderStringKey EnvDiffuseSH9CoefsName("_EnvDiffuseSH9Coefs");
+    static constexpr ShaderStringKey EnvSpecularRadianceMapName("_EnvSpecularRadianceMap");
+    static constexpr ShaderStringKey EnvSpecularBRDFLUTName("_EnvSpecularBRDFLUT");
+    static constexpr ShaderStringKey InputName("_Input");
+    static constexpr ShaderStringKey OutputName("_Output");
+    static constexpr ShaderStringKey CurrentColorTextureName("_CurrentColorTexture");
+    static constexpr ShaderStringKey ColorTextureName("_ColorTexture");
+    static constexpr ShaderStringKey InputTextureName("_InputTexture");
+    static constexpr ShaderStringKey OutputTextureName("_OutputTexture");
+    static constexpr ShaderStringKey CbLightName("cbLight");
+    static constexpr ShaderStringKey DirectionalLightsName("_DirectionalLights");
+    static constexpr ShaderStringKey PunctualLightsName("_PunctualLights");
+    static constexpr ShaderStringKey ClusterPunctualLightRangesName("_ClusterPunctualLightRanges");
+    static constexpr ShaderStringKey ClusterPunctualLightIndicesName("_ClusterPunctualLightIndices");
+    static constexpr ShaderStringKey VisibleLightCounterName("_VisibleLightCounter");
+    static constexpr ShaderStringKey MaxClusterZIdsName("_MaxClusterZIds");
+    static constexpr ShaderStringKey CbShadowName("cbShadow");
+    static constexpr ShaderStringKey ShadowMapName("_ShadowMap");
+    static constexpr ShaderStringKey CbSSAOName("cbSSAO");
+    static constexpr ShaderStringKey SSAOMapName("_SSAOMap");
+    static constexpr ShaderStringKey SSAOMapTempName("_SSAOMapTemp");
+    static constexpr ShaderStringKey RandomVecMapName("_RandomVecMap");
+    static constexpr ShaderStringKey MotionVectorTextureName("_MotionVectorTexture");
+    static constexpr ShaderStringKey HiZTextureName("_HiZTexture");
+
     RenderPipeline::RenderPipeline()
     {
         m_RenderGraph = std::make_unique<RenderGraph>();
@@ -43,17 +76,104 @@ namespace march
 
     void RenderPipeline::AddMeshRenderer(MeshRenderer* obj)
     {
+        assert(obj->m_Pipeline == nullptr);
+
+        // 这时 Transform 可能还没更新，Bounds 不准也没关系，渲染前会刷新
+        obj->m_Pipeline = this;
+        obj->m_PipelineIndex = static_cast<uint32_t>(m_MeshRenderers.size());
+        obj->m_BVHLeaf = m_MeshRendererBVH.Insert(obj->GetBounds(), obj);
         m_MeshRenderers.push_back(obj);
+
+        obj->GetTransform()->AddChangeListener(obj);
+        MarkMeshRendererDirty(obj);
     }
 
     void RenderPipeline::RemoveMeshRenderer(MeshRenderer* obj)
     {
-        auto it = std::find(m_MeshRenderers.begin(), m_MeshRenderers.end(), obj);
+        if (obj->m_Pipeline != this)
+        {
+            return;
+        }
+
+        obj->GetTransform()->RemoveChangeListener(obj);
+        m_MeshRendererBVH.Remove(obj->m_BVHLeaf);
 
-        if (it != m_MeshRenderers.end())
+        // 和最后一个交换后删除，顺序无关紧要
+        if (obj->m_DirtyIndex != MeshRenderer::InvalidIndex)
         {
-            m_MeshRenderers.erase(it);
+            MeshRenderer* last = m_DirtyMeshRenderers.back();
+            m_DirtyMeshRenderers[obj->m_DirtyIndex] = last;
+            last->m_DirtyIndex = obj->m_DirtyIndex;
+            m_DirtyMeshRenderers.pop_back();
         }
+
+        MeshRenderer* last = m_MeshRenderers.back();
+        m_MeshRenderers[obj->m_PipelineIndex] = last;
+        last->m_PipelineIndex = obj->m_PipelineIndex;
+        m_MeshRenderers.pop_back();
+
+        obj->m_Pipeline = nullptr;
+        obj->m_PipelineIndex = MeshRenderer::InvalidIndex;
+        obj->m_DirtyIndex = MeshRenderer::InvalidIndex;
+        obj->m_BVHLeaf = MeshRenderer::InvalidIndex;
+    }
+
+    void RenderPipeline::MarkMeshRendererDirty(MeshRenderer* obj)
+    {
+        assert(obj->m_Pipeline == this);
+
+        if (obj->m_DirtyIndex == MeshRenderer::InvalidIndex)
+        {
+            obj->m_DirtyIndex = static_cast<uint32_t>(m_DirtyMeshRenderers.size());
+            m_DirtyMeshRenderers.push_back(obj);
+        }
+    }
+
+    void RenderPipeline::UpdateMeshRendererBVH()
+    {
+        // 不知道哪些 renderer 用了 Bounds 变化的 Mesh，只能全部重新计算，一般只在加载时发生
+        if (m_MeshBoundsVersion != GfxMesh::GetBoundsVersion())
+        {
+            m_MeshBoundsVersion = GfxMesh::GetBoundsVersion();
+
+            for (MeshRenderer* renderer : m_MeshRenderers)
+            {
+                MarkMeshRendererDirty(renderer);
+            }
+        }
+
+        // 只处理 Transform 或 Mesh 变化过的 renderer，先并行算出 Bounds，再串行修改 BVH
+        // 大部分物体都还在扩大后的 Bounds 里面，不会修改树
+        const size_t numDirty = m_DirtyMeshRenderers.size();
+        m_MeshRendererBounds.resize(numDirty);
+
+        auto computeBounds = [this](size_t i)
+        {
+            m_MeshRendererBounds[i] = m_DirtyMeshRenderers[i]->GetBounds();
+        };
+
+        constexpr size_t minParallelCount = 256; // 太少的话不值得并行
+
+        if (numDirty > minParallelCount)
+        {
+            JobManager::ParallelFor(numDirty, 0, computeBounds);
+        }
+        else
+        {
+            for (size_t i = 0; i < numDirty; i++)
+            {
+                computeBounds(i);
+            }
+        }
+
+        for (size_t i = 0; i < numDirty; i++)
+        {
+            MeshRenderer* renderer = m_DirtyMeshRenderers[i];
+            m_MeshRendererBVH.Update(renderer->m_BVHLeaf, m_MeshRendererBounds[i]);
+            renderer->m_DirtyIndex = MeshRenderer::InvalidIndex;
+        }
+
+        m_DirtyMeshRenderers.clear();
     }
 
     void RenderPipeline::AddLight(Light* light)
@@ -91,6 +211,10 @@ namespace march
 
     void RenderPipeline::Render()
     {
+        // 之后会在多线程中读取 Transform，先把缓存都更新好
+        Transform::UpdateAllDirtyTransforms();
+        UpdateMeshRendererBVH();
+
         for (Camera* camera : Camera::GetAllCameras())
         {
             RenderSingleCamera(camera);
@@ -114,16 +238,24 @@ namespace march
                 return;
             }
 
-            m_MeshRendererBatch.Rebuild(camera->GetFrustum(), m_MeshRenderers.size(), m_MeshRenderers.data());
+            m_MeshRendererBatch.Rebuild(camera->GetFrustum(), m_MeshRendererBVH);
+
+            static int32 colorTargetId = ShaderUtils::GetIdFromString(CameraColorTargetName);
+            static int32 depthStencilTargetId = ShaderUtils::GetIdFromString(CameraDepthStencilTargetName);
+            static int32 historyColorTextureId = ShaderUtils::GetIdFromString(HistoryColorTextureName);
+            static int32 cbCameraId = ShaderUtils::GetIdFromString(CbCameraName);
+            static int32 envDiffuseSH9CoefsId = ShaderUtils::GetIdFromString(EnvDiffuseSH9CoefsName);
+            static int32 envSpecularRadianceMapId = ShaderUtils::GetIdFromString(EnvSpecularRadianceMapName);
+            static int32 envSpecularBRDFLUTId = ShaderUtils::GetIdFromString(EnvSpecularBRDFLUTName);
 
             m_Resource.Reset();
-            m_Resource.ColorTarget = m_RenderGraph->ImportTexture("_CameraColorTarget", display->GetColorBuffer());
-            m_Resource.DepthStencilTarget = m_RenderGraph->ImportTexture("_CameraDepthStencilTarget", display->GetDepthStencilBuffer());
-            m_Resource.HistoryColorTexture = m_RenderGraph->ImportTexture("_HistoryColorTexture", display->GetHistoryColorBuffer());
-            m_Resource.CbCamera = CreateCameraConstantBuffer("cbCamera", camera);
-            m_Resource.EnvDiffuseSH9Coefs = m_RenderGraph->ImportBuffer("_EnvDiffuseSH9Coefs", m_EnvDiffuseSH9Coefs.get());
-            m_Resource.EnvSpecularRadianceMap = m_RenderGraph->ImportTexture("_EnvSpecularRadianceMap", m_EnvSpecularRadianceMap.get());
-            m_Resource.EnvSpecularBRDFLUT = m_RenderGraph->ImportTexture("_EnvSpecularBRDFLUT", m_EnvSpecularBRDFLUT.get());
+            m_Resource.ColorTarget = m_RenderGraph->ImportTexture(colorTargetId, display->GetColorBuffer());
+            m_Resource.DepthStencilTarget = m_RenderGraph->ImportTexture(depthStencilTargetId, display->GetDepthStencilBuffer());
+            m_Resource.HistoryColorTexture = m_RenderGraph->ImportTexture(historyColorTextureId, display->GetHistoryColorBuffer());
+            m_Resource.CbCamera = CreateCameraConstantBuffer(cbCameraId, camera);
+            m_Resource.EnvDiffuseSH9Coefs = m_RenderGraph->ImportBuffer(envDiffuseSH9CoefsId, m_EnvDiffuseSH9Coefs.get());
+            m_Resource.EnvSpecularRadianceMap = m_RenderGraph->ImportTexture(envSpecularRadianceMapId, m_EnvSpecularRadianceMap.get());
+            m_Resource.EnvSpecularBRDFLUT = m_RenderGraph->ImportTexture(envSpecularBRDFLUTId, m_EnvSpecularBRDFLUT.get());
             m_Resource.RequestGBuffers(m_RenderGraph.get(), display->GetPixelWidth(), display->GetPixelHeight());
 
             ClearAndDrawGBuffers(camera->GetEnableWireframe());
@@ -151,7 +283,7 @@ namespace march
         }
     }
 
-    BufferHandle RenderPipeline::CreateCameraConstantBuffer(const std::string& name, Camera* camera)
+    BufferHandle RenderPipeline::CreateCameraConstantBuffer(int32 id, Camera* camera)
     {
         CameraData data{};
         camera->FillCameraData(data);
@@ -162,10 +294,10 @@ namespace march
         desc.Usages = GfxBufferUsages::Constant;
         desc.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
 
-        return m_RenderGraph->RequestBufferWithContent(name, desc, &data);
+        return m_RenderGraph->RequestBufferWithContent(id, desc, &data);
     }
 
-    BufferHandle RenderPipeline::CreateCameraConstantBuffer(const std::string& name, const XMFLOAT4X4& viewMatrix, const XMFLOAT4X4& projectionMatrix)
+    BufferHandle RenderPipeline::CreateCameraConstantBuffer(int32 id, const XMFLOAT4X4& viewMatrix, const XMFLOAT4X4& projectionMatrix)
     {
         XMMATRIX view = XMLoadFloat4x4(&viewMatrix);
         XMMATRIX proj = XMLoadFloat4x4(&projectionMatrix);
@@ -187,13 +319,14 @@ namespace march
         desc.Usages = GfxBufferUsages::Constant;
         desc.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
 
-        return m_RenderGraph->RequestBufferWithContent(name, desc, &data);
+        return m_RenderGraph->RequestBufferWithContent(id, desc, &data);
     }
 
     void RenderPipeline::ClearAndDrawGBuffers(bool wireframe)
     {
         auto builder = m_RenderGraph->AddPass("DrawGBuffer");
 
+        builder.AllowParallelRecording(true);
         builder.In(m_Resource.CbCamera);
 
         for (uint32_t i = 0; i < m_Resource.NumGBuffers; i++)
@@ -293,7 +426,7 @@ namespace march
         desc1.Count = 1;
         desc1.Usages = GfxBufferUsages::Constant;
         desc1.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
-        static int32 cbufferId = ShaderUtils::GetIdFromString("cbLight");
+        static int32 cbufferId = ShaderUtils::GetIdFromString(CbLightName);
         m_Resource.CbLight = m_RenderGraph->RequestBufferWithContent(cbufferId, desc1, &consts);
 
         GfxBufferDesc desc2{};
@@ -301,7 +434,7 @@ namespace march
         desc2.Count = static_cast<uint32_t>(directionalLights.size());
         desc2.Usages = GfxBufferUsages::Structured;
         desc2.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
-        static int32 directionalLightsBufferId = ShaderUtils::GetIdFromString("_DirectionalLights");
+        static int32 directionalLightsBufferId = ShaderUtils::GetIdFromString(DirectionalLightsName);
         m_Resource.DirectionalLights = m_RenderGraph->RequestBufferWithContent(directionalLightsBufferId, desc2, directionalLights.data());
 
         GfxBufferDesc desc3{};
@@ -309,23 +442,24 @@ namespace march
         desc3.Count = static_cast<uint32_t>(punctualLights.size());
         desc3.Usages = GfxBufferUsages::Structured;
         desc3.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
-        static int32 punctualLightsBufferId = ShaderUtils::GetIdFromString("_PunctualLights");
+        static int32 punctualLightsBufferId = ShaderUtils::GetIdFromString(PunctualLightsName);
         m_Resource.PunctualLights = m_RenderGraph->RequestBufferWithContent(punctualLightsBufferId, desc3, punctualLights.data());
 
-        static int32 clusterPunctualLightRangesBufferId = ShaderUtils::GetIdFromString("_ClusterPunctualLightRanges");
+        static int32 clusterPunctualLightRangesBufferId = ShaderUtils::GetIdFromString(ClusterPunctualLightRangesName);
         m_Resource.ClusterPunctualLightRanges = m_RenderGraph->ImportBuffer(clusterPunctualLightRangesBufferId, m_ClusterPunctualLightRangesBuffer.get());
 
-        static int32 clusterPunctualLightIndicesBufferId = ShaderUtils::GetIdFromString("_ClusterPunctualLightIndices");
+        static int32 clusterPunctualLightIndicesBufferId = ShaderUtils::GetIdFromString(ClusterPunctualLightIndicesName);
         m_Resource.ClusterPunctualLightIndices = m_RenderGraph->ImportBuffer(clusterPunctualLightIndicesBufferId, m_ClusterPunctualLightIndicesBuffer.get());
 
-        static int32 visibleLightCounterBufferId = ShaderUtils::GetIdFromString("_VisibleLightCounter");
+        static int32 visibleLightCounterBufferId = ShaderUtils::GetIdFromString(VisibleLightCounterName);
         m_Resource.VisibleLightCounter = m_RenderGraph->ImportBuffer(visibleLightCounterBufferId, m_VisibleLightCounterBuffer.get());
 
-        static int32 maxClusterZIdsBufferId = ShaderUtils::GetIdFromString("_MaxClusterZIds");
+        static int32 maxClusterZIdsBufferId = ShaderUtils::GetIdFromString(MaxClusterZIdsName);
         m_Resource.MaxClusterZIds = m_RenderGraph->ImportBuffer(maxClusterZIdsBufferId, m_MaxClusterZIdsBuffer.get());
 
         auto builder = m_RenderGraph->AddPass("CullLights");
 
+        builder.AllowParallelRecording(true);
         builder.EnableAsyncCompute(true);
 
         builder.In(m_Resource.CbCamera);
@@ -371,7 +505,7 @@ namespace march
         consts.ShadowMatrix = shadowMatrix;
         consts.ShadowParams.x = depth2RadialScale;
 
-        static int32_t bufferId = ShaderUtils::GetIdFromString("cbShadow");
+        static int32 bufferId = ShaderUtils::GetIdFromString(CbShadowName);
         m_Resource.CbShadow = m_RenderGraph->RequestBufferWithContent(bufferId, bufDesc, &consts);
 
         auto builder = m_RenderGraph->AddPass("DeferredLighting");
@@ -401,6 +535,9 @@ namespace march
 
     void RenderPipeline::DrawShadowCasters(XMFLOAT4X4& shadowMatrix, float& depth2RadialScale)
     {
+        static int32 cbShadowCameraId = ShaderUtils::GetIdFromString(CbShadowCameraName);
+        static int32 cbCameraId = ShaderUtils::GetIdFromString(CbCameraName);
+
         BufferHandle cbShadowCamera{};
 
         GfxTextureDesc desc = {};
@@ -443,21 +580,8 @@ namespace march
         }
         else
         {
-            BoundingBox aabb{};
-
-            for (size_t i = 0; i < m_MeshRenderers.size(); i++)
-            {
-                if (i == 0)
-                {
-                    aabb = m_MeshRenderers[i]->GetBounds();
-                }
-                else
-                {
-                    BoundingBox temp{};
-                    BoundingBox::CreateMerged(temp, aabb, m_MeshRenderers[i]->GetBounds());
-                    aabb = temp;
-                }
-            }
+            // BVH 根节点包含了所有 renderer，比精确的 Bounds 稍大一点
+            const BoundingBox& aabb = m_MeshRendererBVH.GetRootBounds();
 
             BoundingSphere sphere = {};
             BoundingSphere::CreateFromBoundingBox(sphere, aabb);
@@ -483,15 +607,16 @@ namespace march
             float s = std::tanf(XMConvertToRadians(0.5f * m_Lights[lightIndex]->GetAngularDiameter()));
             depth2RadialScale = s * std::abs(proj._11 / proj._33);
 
-            cbShadowCamera = CreateCameraConstantBuffer("cbShadowCamera", view, proj);
-            m_MeshRendererBatchShadow.Rebuild(sphere, m_MeshRenderers.size(), m_MeshRenderers.data());
+            cbShadowCamera = CreateCameraConstantBuffer(cbShadowCameraId, view, proj);
+            m_MeshRendererBatchShadow.Rebuild(sphere, m_MeshRendererBVH);
         }
 
-        static int32 shadowMapId = ShaderUtils::GetIdFromString("_ShadowMap");
+        static int32 shadowMapId = ShaderUtils::GetIdFromString(ShadowMapName);
         m_Resource.ShadowMap = m_RenderGraph->RequestTexture(shadowMapId, desc);
 
         auto builder = m_RenderGraph->AddPass("DrawShadowCasters");
 
+        builder.AllowParallelRecording(true);
         if (drawShadow)
         {
             builder.In(cbShadowCamera);
@@ -508,7 +633,7 @@ namespace march
         {
             if (drawShadow)
             {
-                context.SetVariable(cbShadowCamera, "cbCamera");
+                context.SetVariable(cbShadowCamera, cbCameraId);
                 context.DrawMeshRenderers(m_MeshRendererBatchShadow, "ShadowCaster");
             }
         });
@@ -589,7 +714,7 @@ namespace march
         ssaoCbDesc.Usages = GfxBufferUsages::Constant;
         ssaoCbDesc.Flags = GfxBufferFlags::Dynamic | GfxBufferFlags::Transient;
 
-        static int32 ssaoCbId = ShaderUtils::GetIdFromString("cbSSAO");
+        static int32 ssaoCbId = ShaderUtils::GetIdFromString(CbSSAOName);
         m_Resource.CbSSAO = m_RenderGraph->RequestBufferWithContent(ssaoCbId, ssaoCbDesc, &ssaoConsts);
 
         GfxTextureDesc ssaoMapDesc{};
@@ -604,17 +729,21 @@ namespace march
         ssaoMapDesc.Wrap = GfxTextureWrapMode::Clamp;
         ssaoMapDesc.MipmapBias = 0;
 
-        static int32 ssaoMapId = ShaderUtils::GetIdFromString("_SSAOMap");
+        static int32 ssaoMapId = ShaderUtils::GetIdFromString(SSAOMapName);
         m_Resource.SSAOMap = m_RenderGraph->RequestTexture(ssaoMapId, ssaoMapDesc);
 
-        static int32 ssaoMapTempId = ShaderUtils::GetIdFromString("_SSAOMapTemp");
+        static int32 ssaoMapTempId = ShaderUtils::GetIdFromString(SSAOMapTempName);
         m_Resource.SSAOMapTemp = m_RenderGraph->RequestTexture(ssaoMapTempId, ssaoMapDesc);
 
-        static int32 randVecMapId = ShaderUtils::GetIdFromString("_RandomVecMap");
+        static int32 randVecMapId = ShaderUtils::GetIdFromString(RandomVecMapName);
         m_Resource.SSAORandomVectorMap = m_RenderGraph->ImportTexture(randVecMapId, m_SSAORandomVectorMap.get());
 
+        static int32 inputId = ShaderUtils::GetIdFromString(InputName);
+        static int32 outputId = ShaderUtils::GetIdFromString(OutputName);
+
         auto builder = m_RenderGraph->AddPass("ScreenSpaceAmbientOcclusion");
 
+        builder.AllowParallelRecording(true);
         builder.EnableAsyncCompute(true);
 
         builder.In(m_Resource.CbCamera);
@@ -629,12 +758,12 @@ namespace march
         {
             context.DispatchComputeByThreadCount(m_SSAOShader.get(), "SSAOMain", w, h, 1);
 
-            context.SetVariable(m_Resource.SSAOMap, "_Input");
-            context.SetVariable(m_Resource.SSAOMapTemp, "_Output");
+            context.SetVariable(m_Resource.SSAOMap, inputId);
+            context.SetVariable(m_Resource.SSAOMapTemp, outputId);
             context.DispatchComputeByThreadCount(m_SSAOShader.get(), "HBlurMain", w, h, 1);
 
-            context.SetVariable(m_Resource.SSAOMapTemp, "_Input");
-            context.SetVariable(m_Resource.SSAOMap, "_Output");
+            context.SetVariable(m_Resource.SSAOMapTemp, inputId);
+            context.SetVariable(m_Resource.SSAOMap, outputId);
             context.DispatchComputeByThreadCount(m_SSAOShader.get(), "VBlurMain", w, h, 1);
         });
     }
@@ -786,7 +915,7 @@ namespace march
         desc.Wrap = GfxTextureWrapMode::Clamp;
         desc.MipmapBias = 0;
 
-        static int32 mvId = ShaderUtils::GetIdFromString("_MotionVectorTexture");
+        static int32 mvId = ShaderUtils::GetIdFromString(MotionVectorTextureName);
         m_Resource.MotionVectorTexture = m_RenderGraph->RequestTexture(mvId, desc);
 
         auto builder = m_RenderGraph->AddPass("MotionVector");
@@ -805,13 +934,16 @@ namespace march
     {
         auto builder = m_RenderGraph->AddPass("TemporalAntialiasing");
 
+        builder.AllowParallelRecording(true);
         builder.In(m_Resource.MotionVectorTexture);
         builder.InOut(m_Resource.HistoryColorTexture);
         builder.InOut(m_Resource.ColorTarget);
 
+        static int32 currentColorTextureId = ShaderUtils::GetIdFromString(CurrentColorTextureName);
+
         builder.SetRenderFunc([this](RenderGraphContext& context)
         {
-            context.SetVariable(m_Resource.ColorTarget, "_CurrentColorTexture");
+            context.SetVariable(m_Resource.ColorTarget, currentColorTextureId);
 
             const GfxTextureDesc& desc = m_Resource.ColorTarget.GetDesc();
             context.DispatchComputeByThreadCount(m_TAAShader.get(), "CSMain", desc.Width, desc.Height, 1);
@@ -824,12 +956,15 @@ namespace march
     {
         auto builder = m_RenderGraph->AddPass("Postprocessing");
 
+        builder.AllowParallelRecording(true);
         builder.InOut(m_Resource.ColorTarget);
         builder.UseDefaultVariables(false);
 
+        static int32 colorTextureId = ShaderUtils::GetIdFromString(ColorTextureName);
+
         builder.SetRenderFunc([this](RenderGraphContext& context)
         {
-            context.SetVariable(m_Resource.ColorTarget, "_ColorTexture");
+            context.SetVariable(m_Resource.ColorTarget, colorTextureId);
 
             const GfxTextureDesc& desc = m_Resource.ColorTarget.GetDesc();
             context.DispatchComputeByThreadCount(m_PostprocessingShader.get(), "CSMain", desc.Width, desc.Height, 1);
@@ -850,25 +985,29 @@ namespace march
         desc.Wrap = GfxTextureWrapMode::Clamp;
         desc.MipmapBias = 0.0f;
 
-        static int32 hizId = ShaderUtils::GetIdFromString("_HiZTexture");
+        static int32 hizId = ShaderUtils::GetIdFromString(HiZTextureName);
         m_Resource.HiZTexture = m_RenderGraph->RequestTexture(hizId, desc);
 
         auto builder = m_RenderGraph->AddPass("HierarchicalZ");
 
+        builder.AllowParallelRecording(true);
         builder.In(m_Resource.DepthStencilTarget);
         builder.Out(m_Resource.HiZTexture);
         builder.UseDefaultVariables(false);
 
+        static int32 inputTextureId = ShaderUtils::GetIdFromString(InputTextureName);
+        static int32 outputTextureId = ShaderUtils::GetIdFromString(OutputTextureName);
+
         builder.SetRenderFunc([this, w = desc.Width, h = desc.Height](RenderGraphContext& context)
         {
-            context.SetVariable(m_Resource.DepthStencilTarget, "_InputTexture", GfxTextureElement::Depth);
-            context.SetVariable(m_Resource.HiZTexture, "_OutputTexture", GfxTextureElement::Default, 0);
+            context.SetVariable(m_Resource.DepthStencilTarget, inputTextureId, GfxTextureElement::Depth);
+            context.SetVariable(m_Resource.HiZTexture, outputTextureId, GfxTextureElement::Default, 0);
             context.DispatchComputeByThreadCount(m_HiZShader.get(), "CopyDepthMain", w, h, 1);
 
             for (uint32_t mipLevel = 1; mipLevel < m_Resource.HiZTexture->GetMipLevels(); mipLevel++)
             {
-                context.SetVariable(m_Resource.HiZTexture, "_InputTexture", GfxTextureElement::Default, mipLevel - 1);
-                context.SetVariable(m_Resource.HiZTexture, "_OutputTexture", GfxTextureElement::Default, mipLevel);
+                context.SetVariable(m_Resource.HiZTexture, inputTextureId, GfxTextureElement::Default, mipLevel - 1);
+                context.SetVariable(m_Resource.HiZTexture, outputTextureId, GfxTextureElement::Default, mipLevel);
 
                 uint32_t width = std::max(w >> mipLevel, 1u);
                 uint32_t height = std::max(h >> mipLevel, 1u);
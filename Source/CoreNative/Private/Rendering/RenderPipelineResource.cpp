@@ -10,12 +10,20 @@ namespace march
 
     void RenderPipelineResource::RequestGBuffers(RenderGraph* graph, uint32_t width, uint32_t height)
     {
+        static constexpr ShaderStringKey keys[NumGBuffers] =
+        {
+            ShaderStringKey("_GBuffer0"),
+            ShaderStringKey("_GBuffer1"),
+            ShaderStringKey("_GBuffer2"),
+            ShaderStringKey("_GBuffer3"),
+        };
+
         static int32 ids[NumGBuffers] =
         {
-            ShaderUtils::GetIdFromString("_GBuffer0"),
-            ShaderUtils::GetIdFromString("_GBuffer1"),
-            ShaderUtils::GetIdFromString("_GBuffer2"),
-            ShaderUtils::GetIdFromString("_GBuffer3"),
+            ShaderUtils::GetIdFromString(keys[0]),
+            ShaderUtils::GetIdFromString(keys[1]),
+            ShaderUtils::GetIdFromString(keys[2]),
+            ShaderUtils::GetIdFromString(keys[3]),
         };
 
         GfxTextureDesc desc{};
@@ -36,8 +36,6 @@ namespace march
         { ManagedMethod::AssetManager_NativeUnloadAsset           , { "March.Core.AssetManager,March.Core"          , "NativeUnloadAsset"      } },
         { ManagedMethod::Mesh_NativeGetGeometry                   , { "March.Core.Rendering.Mesh,March.Core"        , "NativeGetGeometry"      } },
         { ManagedMethod::Texture_NativeGetDefault                 , { "March.Core.Rendering.Texture,March.Core"     , "NativeGetDefault"       } },
-        { ManagedMethod::JobManager_NativeSchedule                , { "March.Core.JobManager,March.Core"            , "NativeSchedule"         } },
-        { ManagedMethod::JobManager_NativeComplete                , { "March.Core.JobManager,March.Core"            , "NativeComplete"         } },
         { ManagedMethod::DragDrop_HandleExternalFiles             , { "March.Editor.DragDrop,March.Editor"          , "HandleExternalFiles"    } },
     };
 
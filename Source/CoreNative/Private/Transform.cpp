@@ -2,43 +2,60 @@
 #include "Engine/Transform.h"
 #include "Engine/Debug.h"
 #include <math.h>
+#include <algorithm>
 
 using namespace DirectX;
 
 namespace march
 {
+    TransformHierarchy Transform::s_Hierarchy{};
+
     Transform::Transform()
-        : m_Parent(nullptr)
-        , m_LocalPosition(0, 0, 0)
-        , m_LocalRotation(0, 0, 0, 1)
-        , m_LocalEulerAngles(0, 0, 0)
-        , m_LocalScale(1, 1, 1)
+        : m_Index(TransformHierarchy::InvalidIndex)
+        , m_Children{}
+        , m_ChangeListeners{}
     {
+        // 分配时会移动其他节点，要访问 m_Children，所以不能放在初始化列表里
+        m_Index = s_Hierarchy.Allocate(this);
+    }
+
+    Transform::~Transform()
+    {
+        TransformInternalUtility::SetParent(this, nullptr);
+
+        // 正常情况下 C# 会先销毁子节点，这里只是防止悬垂指针
+        for (Transform* child : std::vector<Transform*>(m_Children))
+        {
+            TransformInternalUtility::SetParent(child, nullptr);
+        }
+
+        s_Hierarchy.Release(m_Index);
     }
 
     Transform* Transform::GetParent() const
     {
-        return m_Parent;
+        uint32_t parent = s_Hierarchy.m_ParentIndices[m_Index];
+        return parent == TransformHierarchy::InvalidIndex ? nullptr : s_Hierarchy.m_Owners[parent];
     }
 
     XMFLOAT3 Transform::GetLocalPosition() const
     {
-        return m_LocalPosition;
+        return s_Hierarchy.m_LocalPositions[m_Index];
     }
 
     XMFLOAT4 Transform::GetLocalRotation() const
     {
-        return m_LocalRotation;
+        return s_Hierarchy.m_LocalRotations[m_Index];
     }
 
     XMFLOAT3 Transform::GetLocalEulerAngles() const
     {
-        return m_LocalEulerAngles;
+        return s_Hierarchy.m_LocalEulerAngles[m_Index];
     }
 
     XMFLOAT3 Transform::GetLocalScale() const
     {
-        return m_LocalScale;
+        return s_Hierarchy.m_LocalScales[m_Index];
     }
 
     XMFLOAT3 Transform::GetPosition() const
@@ -104,52 +121,33 @@ namespace march
 
     XMVECTOR Transform::LoadLocalPosition() const
     {
-        return XMLoadFloat3(&m_LocalPosition);
+        return XMLoadFloat3(&s_Hierarchy.m_LocalPositions[m_Index]);
     }
 
     XMVECTOR Transform::LoadLocalRotation() const
     {
-        return XMLoadFloat4(&m_LocalRotation);
+        return XMLoadFloat4(&s_Hierarchy.m_LocalRotations[m_Index]);
     }
 
     XMVECTOR Transform::LoadLocalEulerAngles() const
     {
-        return XMLoadFloat3(&m_LocalEulerAngles);
+        return XMLoadFloat3(&s_Hierarchy.m_LocalEulerAngles[m_Index]);
     }
 
     XMVECTOR Transform::LoadLocalScale() const
     {
-        return XMLoadFloat3(&m_LocalScale);
+        return XMLoadFloat3(&s_Hierarchy.m_LocalScales[m_Index]);
     }
 
     XMVECTOR Transform::LoadPosition() const
     {
-        XMVECTOR position = LoadLocalPosition();
-
-        if (m_Parent != nullptr)
-        {
-            position = m_Parent->TransformPoint(position);
-        }
-
-        return position;
+        // 第 4 行就是世界空间的位置
+        return XMVectorSetW(LoadLocalToWorldMatrix().r[3], 1.0f);
     }
 
     XMVECTOR Transform::LoadRotation() const
     {
-        const Transform* trans = this;
-        XMVECTOR result = XMQuaternionIdentity();
-
-        while (trans != nullptr)
-        {
-            // https://learn.microsoft.com/en-us/windows/win32/api/directxmath/nf-directxmath-xmquaternionmultiply
-            // The result represents the rotation Q1 followed by the rotation Q2 to be consistent with XMMatrixMultiply concatenation
-            // since this function is typically used to concatenate quaternions that represent rotations
-            // (i.e. it returns Q2*Q1).
-            result = XMQuaternionMultiply(result, trans->LoadLocalRotation());
-            trans = trans->GetParent();
-        }
-
-        return result;
+        return s_Hierarchy.LoadRotation(m_Index);
     }
 
     XMVECTOR Transform::LoadEulerAngles() const
@@ -167,41 +165,17 @@ namespace march
         // lossyScale is a convenience property that attempts to match the actual world scale as much as it can.
         // If your objects are not skewed the value will be completely correct and most likely the value will not be very different if it contains skew too.
 
-        const Transform* trans = this;
-        XMVECTOR result = XMVectorSplatOne();
-
-        while (trans != nullptr)
-        {
-            result = XMVectorMultiply(result, trans->LoadLocalScale());
-            trans = trans->GetParent();
-        }
-
-        return result;
+        return s_Hierarchy.LoadLossyScale(m_Index);
     }
 
     XMMATRIX Transform::LoadLocalToWorldMatrix() const
     {
-        const Transform* trans = this;
-        const XMVECTOR rotationOrigin = XMVectorZero();
-        XMMATRIX result = XMMatrixIdentity();
-
-        while (trans != nullptr)
-        {
-            XMVECTOR translation = trans->LoadLocalPosition();
-            XMVECTOR rotation = trans->LoadLocalRotation();
-            XMVECTOR scale = trans->LoadLocalScale(); // 不能直接用 lossyScale，因为它不准确
-            XMMATRIX mat = XMMatrixAffineTransformation(scale, rotationOrigin, rotation, translation);
-
-            result = XMMatrixMultiply(result, mat); // DirectX 中使用的是行向量
-            trans = trans->GetParent();
-        }
-
-        return result;
+        return s_Hierarchy.LoadLocalToWorldMatrix(m_Index);
     }
 
     XMMATRIX Transform::LoadWorldToLocalMatrix() const
     {
-        return XMMatrixInverse(nullptr, LoadLocalToWorldMatrix());
+        return s_Hierarchy.LoadWorldToLocalMatrix(m_Index);
     }
 
     XMVECTOR Transform::LoadForward() const
@@ -330,73 +304,136 @@ namespace march
         return euler;
     }
 
+    void Transform::MarkDirty()
+    {
+        // 如果自己已经全脏了，那么子节点也一定是全脏的
+        if (!s_Hierarchy.MarkDirty(m_Index))
+        {
+            return;
+        }
+
+        for (TransformChangeListener* listener : m_ChangeListeners)
+        {
+            listener->OnTransformChanged();
+        }
+
+        for (Transform* child : m_Children)
+        {
+            child->MarkDirty();
+        }
+    }
+
+    void Transform::UpdateAllDirtyTransforms()
+    {
+        s_Hierarchy.UpdateDirtyNodes();
+    }
+
+    void Transform::AddChangeListener(TransformChangeListener* listener)
+    {
+        assert(std::find(m_ChangeListeners.begin(), m_ChangeListeners.end(), listener) == m_ChangeListeners.end());
+        m_ChangeListeners.push_back(listener);
+    }
+
+    void Transform::RemoveChangeListener(TransformChangeListener* listener)
+    {
+        auto it = std::find(m_ChangeListeners.begin(), m_ChangeListeners.end(), listener);
+
+        if (it != m_ChangeListeners.end())
+        {
+            m_ChangeListeners.erase(it);
+        }
+    }
+
     void TransformInternalUtility::SetParent(Transform* transform, Transform* parent)
     {
-        transform->m_Parent = parent;
+        Transform* oldParent = transform->GetParent();
+
+        if (oldParent == parent)
+        {
+            return;
+        }
+
+        if (oldParent != nullptr)
+        {
+            std::vector<Transform*>& children = oldParent->m_Children;
+            children.erase(std::remove(children.begin(), children.end(), transform), children.end());
+        }
+
+        if (parent != nullptr)
+        {
+            parent->m_Children.push_back(transform);
+            Transform::s_Hierarchy.SetParent(transform->m_Index, parent->m_Index);
+        }
+        else
+        {
+            Transform::s_Hierarchy.SetParent(transform->m_Index, TransformHierarchy::InvalidIndex);
+        }
+
+        transform->MarkDirty();
     }
 
     void TransformInternalUtility::SetLocalPosition(Transform* transform, const XMFLOAT3& value)
     {
-        transform->m_LocalPosition = value;
+        Transform::s_Hierarchy.m_LocalPositions[transform->m_Index] = value;
+        transform->MarkDirty();
     }
 
     void TransformInternalUtility::SetLocalRotation(Transform* transform, const XMFLOAT4& value)
     {
-        transform->m_LocalRotation = value;
+        Transform::s_Hierarchy.m_LocalRotations[transform->m_Index] = value;
+        transform->MarkDirty();
         SyncLocalEulerAngles(transform);
     }
 
     void TransformInternalUtility::SetLocalRotationWithoutSyncEulerAngles(Transform* transform, const XMFLOAT4& value)
     {
-        transform->m_LocalRotation = value;
+        Transform::s_Hierarchy.m_LocalRotations[transform->m_Index] = value;
+        transform->MarkDirty();
     }
 
     void TransformInternalUtility::SetLocalEulerAngles(Transform* transform, const XMFLOAT3& value)
     {
-        transform->m_LocalRotation = Transform::EulerAnglesToQuaternion(value);
-        transform->m_LocalEulerAngles = value;
+        Transform::s_Hierarchy.m_LocalRotations[transform->m_Index] = Transform::EulerAnglesToQuaternion(value);
+        Transform::s_Hierarchy.m_LocalEulerAngles[transform->m_Index] = value;
+        transform->MarkDirty();
     }
 
     void TransformInternalUtility::SetLocalEulerAnglesWithoutSyncRotation(Transform* transform, const XMFLOAT3& value)
     {
-        transform->m_LocalEulerAngles = value;
+        Transform::s_Hierarchy.m_LocalEulerAngles[transform->m_Index] = value;
     }
 
     void TransformInternalUtility::SetLocalScale(Transform* transform, const XMFLOAT3& value)
     {
-        transform->m_LocalScale = value;
+        Transform::s_Hierarchy.m_LocalScales[transform->m_Index] = value;
+        transform->MarkDirty();
     }
 
     void TransformInternalUtility::SetPosition(Transform* transform, const XMFLOAT3& value)
     {
         XMVECTOR result = XMLoadFloat3(&value);
 
-        if (transform->m_Parent != nullptr)
+        if (Transform* parent = transform->GetParent(); parent != nullptr)
         {
-            result = transform->m_Parent->InverseTransformPoint(result);
+            result = parent->InverseTransformPoint(result);
         }
 
-        XMStoreFloat3(&transform->m_LocalPosition, result);
+        XMStoreFloat3(&Transform::s_Hierarchy.m_LocalPositions[transform->m_Index], result);
+        transform->MarkDirty();
     }
 
     void TransformInternalUtility::SetRotation(Transform* transform, const XMFLOAT4& value)
     {
-        const Transform* trans = transform->GetParent();
-        XMVECTOR parentRotation = XMQuaternionIdentity();
+        XMVECTOR result = XMLoadFloat4(&value);
 
-        while (trans != nullptr)
+        if (Transform* parent = transform->GetParent(); parent != nullptr)
         {
-            // https://learn.microsoft.com/en-us/windows/win32/api/directxmath/nf-directxmath-xmquaternionmultiply
-            // The result represents the rotation Q1 followed by the rotation Q2 to be consistent with XMMatrixMultiply concatenation
-            // since this function is typically used to concatenate quaternions that represent rotations
-            // (i.e. it returns Q2*Q1).
-            parentRotation = XMQuaternionMultiply(parentRotation, trans->LoadLocalRotation());
-            trans = trans->GetParent();
+            XMVECTOR parentRotation = parent->LoadRotation();
+            result = XMQuaternionMultiply(result, XMQuaternionInverse(parentRotation));
         }
 
-        XMVECTOR result = XMLoadFloat4(&value);
-        result = XMQuaternionMultiply(result, XMQuaternionInverse(parentRotation));
-        XMStoreFloat4(&transform->m_LocalRotation, result);
+        XMStoreFloat4(&Transform::s_Hierarchy.m_LocalRotations[transform->m_Index], result);
+        transform->MarkDirty();
         SyncLocalEulerAngles(transform);
     }
 
@@ -446,7 +483,8 @@ namespace march
 
     void TransformInternalUtility::SyncLocalEulerAngles(Transform* transform)
     {
-        XMFLOAT4 localRotation = transform->m_LocalRotation;
-        transform->m_LocalEulerAngles = Transform::QuaternionToEulerAngles(localRotation);
+        TransformHierarchy& hierarchy = Transform::s_Hierarchy;
+        XMFLOAT4 localRotation = hierarchy.m_LocalRotations[transform->m_Index];
+        hierarchy.m_LocalEulerAngles[transform->m_Index] = Transform::QuaternionToEulerAngles(localRotation);
     }
 }
@@ -0,0 +1,487 @@
+#include "pch.h"
+#include "Engine/TransformHierarchy.h"
+#include "Engine/Transform.h"
+#include "Engine/JobManager.h"
+#include "Engine/Misc/MathUtils.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+namespace march
+{
+    uint32_t TransformHierarchy::Allocate(Transform* owner)
+    {
+        uint32_t index = static_cast<uint32_t>(m_Owners.size());
+
+        m_Owners.push_back(owner);
+        m_ParentIndices.push_back(InvalidIndex);
+        m_LocalPositions.emplace_back(0.0f, 0.0f, 0.0f);
+        m_LocalRotations.emplace_back(0.0f, 0.0f, 0.0f, 1.0f);
+        m_LocalEulerAngles.emplace_back(0.0f, 0.0f, 0.0f);
+        m_LocalScales.emplace_back(1.0f, 1.0f, 1.0f);
+        m_DirtyFlags.push_back(TransformDirtyFlags::None);
+        m_LocalToWorldMatrices.push_back(MathUtils::Identity4x4());
+        m_WorldToLocalMatrices.push_back(MathUtils::Identity4x4());
+        m_Rotations.emplace_back(0.0f, 0.0f, 0.0f, 1.0f);
+        m_LossyScales.emplace_back(1.0f, 1.0f, 1.0f);
+
+        // 先放在最后一层的末尾，再往上移到根节点所在的第 0 层
+        if (m_LevelOffsets.size() < 2)
+        {
+            m_LevelOffsets.assign(2, 0);
+        }
+
+        m_LevelOffsets.back()++;
+        owner->m_Index = index;
+        return MoveToLevel(index, 0);
+    }
+
+    void TransformHierarchy::Release(uint32_t index)
+    {
+        // 此时已经没有父节点和子节点了，移到最后再删掉
+        index = MoveToLevel(index, static_cast<uint32_t>(GetLevelCount() - 1));
+        SwapNodes(index, static_cast<uint32_t>(m_Owners.size() - 1));
+
+        m_Owners.pop_back();
+        m_ParentIndices.pop_back();
+        m_LocalPositions.pop_back();
+        m_LocalRotations.pop_back();
+        m_LocalEulerAngles.pop_back();
+        m_LocalScales.pop_back();
+        m_DirtyFlags.pop_back();
+        m_LocalToWorldMatrices.pop_back();
+        m_WorldToLocalMatrices.pop_back();
+        m_Rotations.pop_back();
+        m_LossyScales.pop_back();
+
+        m_LevelOffsets.back()--;
+        TrimEmptyLevels();
+    }
+
+    void TransformHierarchy::SetParent(uint32_t index, uint32_t parentIndex)
+    {
+        m_ParentIndices[index] = parentIndex;
+
+        uint32_t oldLevel = GetLevel(index);
+        uint32_t newLevel = (parentIndex == InvalidIndex) ? 0 : GetLevel(parentIndex) + 1;
+
+        if (oldLevel == newLevel)
+        {
+            return;
+        }
+
+        // 整棵子树的层级都变化相同的值，先收集起来，因为移动时索引会变
+        m_SubtreeScratch.clear();
+        m_SubtreeScratch.push_back(m_Owners[index]);
+
+        for (size_t i = 0; i < m_SubtreeScratch.size(); i++)
+        {
+            const std::vector<Transform*>& children = m_SubtreeScratch[i]->m_Children;
+            m_SubtreeScratch.insert(m_SubtreeScratch.end(), children.begin(), children.end());
+        }
+
+        for (Transform* node : m_SubtreeScratch)
+        {
+            uint32_t level = GetLevel(node->m_Index);
+            MoveToLevel(node->m_Index, newLevel > oldLevel ? level + (newLevel - oldLevel) : level - (oldLevel - newLevel));
+        }
+
+        TrimEmptyLevels();
+    }
+
+    bool TransformHierarchy::MarkDirty(uint32_t index)
+    {
+        if (m_DirtyFlags[index] == TransformDirtyFlags::All)
+        {
+            return false;
+        }
+
+        m_DirtyFlags[index] = TransformDirtyFlags::All;
+        m_HasDirtyNodes = true;
+        return true;
+    }
+
+    XMMATRIX TransformHierarchy::LoadLocalToWorldMatrix(uint32_t index)
+    {
+        if ((m_DirtyFlags[index] & TransformDirtyFlags::LocalToWorldMatrix) == TransformDirtyFlags::LocalToWorldMatrix)
+        {
+            XMVECTOR translation = XMLoadFloat3(&m_LocalPositions[index]);
+            XMVECTOR rotation = XMLoadFloat4(&m_LocalRotations[index]);
+            XMVECTOR scale = XMLoadFloat3(&m_LocalScales[index]); // 不能直接用 lossyScale，因为它不准确
+            XMMATRIX result = XMMatrixAffineTransformation(scale, XMVectorZero(), rotation, translation);
+
+            if (uint32_t parent = m_ParentIndices[index]; parent != InvalidIndex)
+            {
+                result = XMMatrixMultiply(result, LoadLocalToWorldMatrix(parent)); // DirectX 中使用的是行向量
+            }
+
+            XMStoreFloat4x4(&m_LocalToWorldMatrices[index], result);
+            m_DirtyFlags[index] &= ~TransformDirtyFlags::LocalToWorldMatrix;
+        }
+
+        return XMLoadFloat4x4(&m_LocalToWorldMatrices[index]);
+    }
+
+    XMMATRIX TransformHierarchy::LoadWorldToLocalMatrix(uint32_t index)
+    {
+        if ((m_DirtyFlags[index] & TransformDirtyFlags::WorldToLocalMatrix) == TransformDirtyFlags::WorldToLocalMatrix)
+        {
+            XMStoreFloat4x4(&m_WorldToLocalMatrices[index], XMMatrixInverse(nullptr, LoadLocalToWorldMatrix(index)));
+            m_DirtyFlags[index] &= ~TransformDirtyFlags::WorldToLocalMatrix;
+        }
+
+        return XMLoadFloat4x4(&m_WorldToLocalMatrices[index]);
+    }
+
+    XMVECTOR TransformHierarchy::LoadRotation(uint32_t index)
+    {
+        if ((m_DirtyFlags[index] & TransformDirtyFlags::Rotation) == TransformDirtyFlags::Rotation)
+        {
+            XMVECTOR result = XMLoadFloat4(&m_LocalRotations[index]);
+
+            if (uint32_t parent = m_ParentIndices[index]; parent != InvalidIndex)
+            {
+                // https://learn.microsoft.com/en-us/windows/win32/api/directxmath/nf-directxmath-xmquaternionmultiply
+                // The result represents the rotation Q1 followed by the rotation Q2 to be consistent with XMMatrixMultiply concatenation
+                // since this function is typically used to concatenate quaternions that represent rotations
+                // (i.e. it returns Q2*Q1).
+                result = XMQuaternionMultiply(result, LoadRotation(parent));
+            }
+
+            XMStoreFloat4(&m_Rotations[index], result);
+            m_DirtyFlags[index] &= ~TransformDirtyFlags::Rotation;
+        }
+
+        return XMLoadFloat4(&m_Rotations[index]);
+    }
+
+    XMVECTOR TransformHierarchy::LoadLossyScale(uint32_t index)
+    {
+        if ((m_DirtyFlags[index] & TransformDirtyFlags::LossyScale) == TransformDirtyFlags::LossyScale)
+        {
+            XMVECTOR result = XMLoadFloat3(&m_LocalScales[index]);
+
+            if (uint32_t parent = m_ParentIndices[index]; parent != InvalidIndex)
+            {
+                result = XMVectorMultiply(result, LoadLossyScale(parent));
+            }
+
+            XMStoreFloat3(&m_LossyScales[index], result);
+            m_DirtyFlags[index] &= ~TransformDirtyFlags::LossyScale;
+        }
+
+        return XMLoadFloat3(&m_LossyScales[index]);
+    }
+
+    uint32_t TransformHierarchy::GetLevel(uint32_t index) const
+    {
+        // 层数很少，二分查找足够快
+        auto it = std::upper_bound(m_LevelOffsets.begin(), m_LevelOffsets.end(), static_cast<size_t>(index));
+        return static_cast<uint32_t>(it - m_LevelOffsets.begin() - 1);
+    }
+
+    void TransformHierarchy::SwapNodes(uint32_t a, uint32_t b)
+    {
+        if (a == b)
+        {
+            return;
+        }
+
+        std::swap(m_Owners[a], m_Owners[b]);
+        std::swap(m_ParentIndices[a], m_ParentIndices[b]);
+        std::swap(m_LocalPositions[a], m_LocalPositions[b]);
+        std::swap(m_LocalRotations[a], m_LocalRotations[b]);
+        std::swap(m_LocalEulerAngles[a], m_LocalEulerAngles[b]);
+        std::swap(m_LocalScales[a], m_LocalScales[b]);
+        std::swap(m_DirtyFlags[a], m_DirtyFlags[b]);
+        std::swap(m_LocalToWorldMatrices[a], m_LocalToWorldMatrices[b]);
+        std::swap(m_WorldToLocalMatrices[a], m_WorldToLocalMatrices[b]);
+        std::swap(m_Rotations[a], m_Rotations[b]);
+        std::swap(m_LossyScales[a], m_LossyScales[b]);
+
+        m_Owners[a]->m_Index = a;
+        m_Owners[b]->m_Index = b;
+
+        // 移动子树的过程中，父子节点可能暂时在同一层，所以要先更新两个节点的 m_Index
+        for (uint32_t i : { a, b })
+        {
+            for (Transform* child : m_Owners[i]->m_Children)
+            {
+                m_ParentIndices[child->m_Index] = i;
+            }
+        }
+    }
+
+    uint32_t TransformHierarchy::MoveToLevel(uint32_t index, uint32_t level)
+    {
+        uint32_t current = GetLevel(index);
+
+        while (current > level)
+        {
+            // 换到本层的开头，然后边界后移一位，就成了上一层的最后一个
+            uint32_t first = static_cast<uint32_t>(m_LevelOffsets[current]);
+            SwapNodes(index, first);
+            index = first;
+            m_LevelOffsets[current]++;
+            current--;
+        }
+
+        while (current < level)
+        {
+            if (current + 1 == GetLevelCount())
+            {
+                m_LevelOffsets.push_back(m_LevelOffsets.back());
+            }
+
+            // 换到本层的末尾，然后边界前移一位，就成了下一层的第一个
+            uint32_t last = static_cast<uint32_t>(m_LevelOffsets[current + 1] - 1);
+            SwapNodes(index, last);
+            index = last;
+            m_LevelOffsets[current + 1]--;
+            current++;
+        }
+
+        return index;
+    }
+
+    void TransformHierarchy::TrimEmptyLevels()
+    {
+        while (m_LevelOffsets.size() >= 2 && m_LevelOffsets[m_LevelOffsets.size() - 2] == m_LevelOffsets.back())
+        {
+            m_LevelOffsets.pop_back();
+        }
+    }
+
+    void TransformHierarchy::UpdateRange(size_t begin, size_t end)
+    {
+        // 只收集脏节点，攒够 4 个算一次，脏节点稀疏时也不会浪费 lane
+        uint32_t packet[4];
+        size_t count = 0;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            if (m_DirtyFlags[i] == TransformDirtyFlags::None)
+            {
+                continue;
+            }
+
+            packet[count++] = static_cast<uint32_t>(i);
+
+            if (count == 4)
+            {
+                UpdatePacket(packet, count);
+                count = 0;
+            }
+        }
+
+        if (count > 0)
+        {
+            UpdatePacket(packet, count);
+        }
+    }
+
+    // 4 个节点的同一行（或同一个向量），每个分量放在一个寄存器里
+    struct Vector4SoA
+    {
+        XMVECTOR X;
+        XMVECTOR Y;
+        XMVECTOR Z;
+        XMVECTOR W;
+    };
+
+    static inline Vector4SoA XM_CALLCONV TransposeToSoA(FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, CXMVECTOR v3)
+    {
+        XMMATRIX m = XMMatrixTranspose(XMMATRIX(v0, v1, v2, v3));
+        return Vector4SoA{ m.r[0], m.r[1], m.r[2], m.r[3] };
+    }
+
+    static inline XMMATRIX TransposeToAoS(const Vector4SoA& v)
+    {
+        return XMMatrixTranspose(XMMATRIX(v.X, v.Y, v.Z, v.W));
+    }
+
+    void TransformHierarchy::UpdatePacket(const uint32_t* indices, size_t count)
+    {
+        uint32_t lanes[4];
+        XMMATRIX parentMatrices[4];
+        XMVECTOR parentRotations[4];
+        XMVECTOR parentScales[4];
+        XMVECTOR positions[4];
+        XMVECTOR rotations[4];
+        XMVECTOR scales[4];
+
+        for (size_t i = 0; i < 4; i++)
+        {
+            uint32_t index = lanes[i] = indices[std::min(i, count - 1)];
+            positions[i] = XMLoadFloat3(&m_LocalPositions[index]);
+            rotations[i] = XMLoadFloat4(&m_LocalRotations[index]);
+            scales[i] = XMLoadFloat3(&m_LocalScales[index]);
+
+            // 父节点在上一层，已经更新完了
+            if (uint32_t parent = m_ParentIndices[index]; parent != InvalidIndex)
+            {
+                parentMatrices[i] = XMLoadFloat4x4(&m_LocalToWorldMatrices[parent]);
+                parentRotations[i] = XMLoadFloat4(&m_Rotations[parent]);
+                parentScales[i] = XMLoadFloat3(&m_LossyScales[parent]);
+            }
+            else
+            {
+                parentMatrices[i] = XMMatrixIdentity();
+                parentRotations[i] = XMQuaternionIdentity();
+                parentScales[i] = XMVectorSplatOne();
+            }
+        }
+
+        const Vector4SoA t = TransposeToSoA(positions[0], positions[1], positions[2], positions[3]);
+        const Vector4SoA q = TransposeToSoA(rotations[0], rotations[1], rotations[2], rotations[3]);
+        const Vector4SoA s = TransposeToSoA(scales[0], scales[1], scales[2], scales[3]);
+        const Vector4SoA pq = TransposeToSoA(parentRotations[0], parentRotations[1], parentRotations[2], parentRotations[3]);
+        const Vector4SoA ps = TransposeToSoA(parentScales[0], parentScales[1], parentScales[2], parentScales[3]);
+
+        Vector4SoA p[4]; // 父节点矩阵的 4 行
+
+        for (size_t row = 0; row < 4; row++)
+        {
+            p[row] = TransposeToSoA(parentMatrices[0].r[row], parentMatrices[1].r[row], parentMatrices[2].r[row], parentMatrices[3].r[row]);
+        }
+
+        const XMVECTOR one = XMVectorSplatOne();
+        const XMVECTOR zero = XMVectorZero();
+
+        // 和 XMMatrixAffineTransformation(scale, 0, rotation, translation) 相同：每一行是 scale * 旋转矩阵的一行
+        XMVECTOR x2 = XMVectorAdd(q.X, q.X);
+        XMVECTOR y2 = XMVectorAdd(q.Y, q.Y);
+        XMVECTOR z2 = XMVectorAdd(q.Z, q.Z);
+        XMVECTOR xx = XMVectorMultiply(q.X, x2);
+        XMVECTOR yy = XMVectorMultiply(q.Y, y2);
+        XMVECTOR zz = XMVectorMultiply(q.Z, z2);
+        XMVECTOR xy = XMVectorMultiply(q.X, y2);
+        XMVECTOR xz = XMVectorMultiply(q.X, z2);
+        XMVECTOR yz = XMVectorMultiply(q.Y, z2);
+        XMVECTOR wx = XMVectorMultiply(q.W, x2);
+        XMVECTOR wy = XMVectorMultiply(q.W, y2);
+        XMVECTOR wz = XMVectorMultiply(q.W, z2);
+
+        XMVECTOR local[3][3];
+        local[0][0] = XMVectorMultiply(s.X, XMVectorSubtract(one, XMVectorAdd(yy, zz)));
+        local[0][1] = XMVectorMultiply(s.X, XMVectorAdd(xy, wz));
+        local[0][2] = XMVectorMultiply(s.X, XMVectorSubtract(xz, wy));
+        local[1][0] = XMVectorMultiply(s.Y, XMVectorSubtract(xy, wz));
+        local[1][1] = XMVectorMultiply(s.Y, XMVectorSubtract(one, XMVectorAdd(xx, zz)));
+        local[1][2] = XMVectorMultiply(s.Y, XMVectorAdd(yz, wx));
+        local[2][0] = XMVectorMultiply(s.Z, XMVectorAdd(xz, wy));
+        local[2][1] = XMVectorMultiply(s.Z, XMVectorSubtract(yz, wx));
+        local[2][2] = XMVectorMultiply(s.Z, XMVectorSubtract(one, XMVectorAdd(xx, yy)));
+
+        // localToWorld = local * parent，DirectX 中使用的是行向量，两个都是仿射矩阵，最后一列是 (0, 0, 0, 1)
+        Vector4SoA world[4];
+
+        for (size_t row = 0; row < 3; row++)
+        {
+            world[row].X = XMVectorMultiplyAdd(local[row][2], p[2].X, XMVectorMultiplyAdd(local[row][1], p[1].X, XMVectorMultiply(local[row][0], p[0].X)));
+            world[row].Y = XMVectorMultiplyAdd(local[row][2], p[2].Y, XMVectorMultiplyAdd(local[row][1], p[1].Y, XMVectorMultiply(local[row][0], p[0].Y)));
+            world[row].Z = XMVectorMultiplyAdd(local[row][2], p[2].Z, XMVectorMultiplyAdd(local[row][1], p[1].Z, XMVectorMultiply(local[row][0], p[0].Z)));
+            world[row].W = zero;
+        }
+
+        world[3].X = XMVectorMultiplyAdd(t.Z, p[2].X, XMVectorMultiplyAdd(t.Y, p[1].X, XMVectorMultiplyAdd(t.X, p[0].X, p[3].X)));
+        world[3].Y = XMVectorMultiplyAdd(t.Z, p[2].Y, XMVectorMultiplyAdd(t.Y, p[1].Y, XMVectorMultiplyAdd(t.X, p[0].Y, p[3].Y)));
+        world[3].Z = XMVectorMultiplyAdd(t.Z, p[2].Z, XMVectorMultiplyAdd(t.Y, p[1].Z, XMVectorMultiplyAdd(t.X, p[0].Z, p[3].Z)));
+        world[3].W = one;
+
+        // 仿射矩阵的逆：左上角 3x3 用伴随矩阵求逆，平移是 -t * A^-1
+        // A 的三行是 a、b、c，A^-1 的三列分别是 b×c、c×a、a×b 除以行列式
+        const Vector4SoA& a = world[0];
+        const Vector4SoA& b = world[1];
+        const Vector4SoA& c = world[2];
+
+        auto cross = [](const Vector4SoA& u, const Vector4SoA& v)
+        {
+            return Vector4SoA{
+                XMVectorNegativeMultiplySubtract(u.Z, v.Y, XMVectorMultiply(u.Y, v.Z)),
+                XMVectorNegativeMultiplySubtract(u.X, v.Z, XMVectorMultiply(u.Z, v.X)),
+                XMVectorNegativeMultiplySubtract(u.Y, v.X, XMVectorMultiply(u.X, v.Y)),
+                XMVectorZero() };
+        };
+
+        Vector4SoA bc = cross(b, c);
+        Vector4SoA ca = cross(c, a);
+        Vector4SoA ab = cross(a, b);
+        XMVECTOR det = XMVectorMultiplyAdd(a.Z, bc.Z, XMVectorMultiplyAdd(a.Y, bc.Y, XMVectorMultiply(a.X, bc.X)));
+        XMVECTOR invDet = XMVectorReciprocal(det);
+
+        Vector4SoA inverse[4];
+        inverse[0] = Vector4SoA{ XMVectorMultiply(bc.X, invDet), XMVectorMultiply(ca.X, invDet), XMVectorMultiply(ab.X, invDet), zero };
+        inverse[1] = Vector4SoA{ XMVectorMultiply(bc.Y, invDet), XMVectorMultiply(ca.Y, invDet), XMVectorMultiply(ab.Y, invDet), zero };
+        inverse[2] = Vector4SoA{ XMVectorMultiply(bc.Z, invDet), XMVectorMultiply(ca.Z, invDet), XMVectorMultiply(ab.Z, invDet), zero };
+
+        const Vector4SoA& wt = world[3];
+        inverse[3].X = XMVectorNegate(XMVectorMultiplyAdd(wt.Z, inverse[2].X, XMVectorMultiplyAdd(wt.Y, inverse[1].X, XMVectorMultiply(wt.X, inverse[0].X))));
+        inverse[3].Y = XMVectorNegate(XMVectorMultiplyAdd(wt.Z, inverse[2].Y, XMVectorMultiplyAdd(wt.Y, inverse[1].Y, XMVectorMultiply(wt.X, inverse[0].Y))));
+        inverse[3].Z = XMVectorNegate(XMVectorMultiplyAdd(wt.Z, inverse[2].Z, XMVectorMultiplyAdd(wt.Y, inverse[1].Z, XMVectorMultiply(wt.X, inverse[0].Z))));
+        inverse[3].W = one;
+
+        // 和 XMQuaternionMultiply(rotation, parentRotation) 相同，即 parentRotation * rotation
+        Vector4SoA rotation{};
+        rotation.X = XMVectorSubtract(XMVectorMultiplyAdd(pq.Y, q.Z, XMVectorMultiplyAdd(pq.X, q.W, XMVectorMultiply(pq.W, q.X))), XMVectorMultiply(pq.Z, q.Y));
+        rotation.Y = XMVectorMultiplyAdd(pq.Z, q.X, XMVectorMultiplyAdd(pq.Y, q.W, XMVectorNegativeMultiplySubtract(pq.X, q.Z, XMVectorMultiply(pq.W, q.Y))));
+        rotation.Z = XMVectorMultiplyAdd(pq.Z, q.W, XMVectorNegativeMultiplySubtract(pq.Y, q.X, XMVectorMultiplyAdd(pq.X, q.Y, XMVectorMultiply(pq.W, q.Z))));
+        rotation.W = XMVectorNegativeMultiplySubtract(pq.Z, q.Z, XMVectorNegativeMultiplySubtract(pq.Y, q.Y, XMVectorNegativeMultiplySubtract(pq.X, q.X, XMVectorMultiply(pq.W, q.W))));
+
+        Vector4SoA lossyScale{ XMVectorMultiply(s.X, ps.X), XMVectorMultiply(s.Y, ps.Y), XMVectorMultiply(s.Z, ps.Z), zero };
+
+        // 转置回每个节点一行，只写回有效的 lane
+        XMMATRIX worldRows[4];
+        XMMATRIX inverseRows[4];
+
+        for (size_t row = 0; row < 4; row++)
+        {
+            worldRows[row] = TransposeToAoS(world[row]);
+            inverseRows[row] = TransposeToAoS(inverse[row]);
+        }
+
+        XMMATRIX rotationRows = TransposeToAoS(rotation);
+        XMMATRIX scaleRows = TransposeToAoS(lossyScale);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t index = lanes[i];
+            XMStoreFloat4x4(&m_LocalToWorldMatrices[index], XMMATRIX(worldRows[0].r[i], worldRows[1].r[i], worldRows[2].r[i], worldRows[3].r[i]));
+            XMStoreFloat4x4(&m_WorldToLocalMatrices[index], XMMATRIX(inverseRows[0].r[i], inverseRows[1].r[i], inverseRows[2].r[i], inverseRows[3].r[i]));
+            XMStoreFloat4(&m_Rotations[index], rotationRows.r[i]);
+            XMStoreFloat3(&m_LossyScales[index], scaleRows.r[i]);
+            m_DirtyFlags[index] = TransformDirtyFlags::None;
+        }
+    }
+
+    void TransformHierarchy::UpdateDirtyNodes()
+    {
+        if (!m_HasDirtyNodes)
+        {
+            return;
+        }
+
+        // 太少的话不值得并行
+        constexpr size_t minParallelCount = 1024;
+
+        for (size_t level = 0; level + 1 < m_LevelOffsets.size(); level++)
+        {
+            size_t begin = m_LevelOffsets[level];
+            size_t end = m_LevelOffsets[level + 1];
+
+            if (end - begin < minParallelCount)
+            {
+                UpdateRange(begin, end);
+                continue;
+            }
+
+            // 同一层的节点互不依赖，按连续的区间（也就是若干棵子树在这一层的部分）拆分给 worker
+            JobManager::ScheduleBatch(end - begin, 0, [this, begin](size_t b, size_t e)
+            {
+                UpdateRange(begin + b, begin + e);
+            }).Complete();
+        }
+
+        m_HasDirtyNodes = false;
+    }
+}
@@ -5,7 +5,8 @@
 #include <vector>
 #include <stdint.h>
 #include <mutex>
-#include <deque>
+#include <atomic>
+#include <string_view>
 #include <functional>
 #include <fmt/core.h>
 #include <fmt/xchar.h>
@@ -28,20 +29,35 @@ namespace march
         int32_t Line{};
     };
 
+    // 原生代码的日志位置，每个 LOG_XXX 调用处有一个静态实例，日志里只存它的指针
+    struct LogSourceLocation
+    {
+        const char* Function;
+        const char* Filename;
+        int32_t Line;
+    };
+
     struct LogEntry
     {
         LogLevel Level{};
         time_t Time{};
         std::string Message{};
-        std::vector<LogStackFrame> StackTrace{};
+        const LogSourceLocation* Location = nullptr; // 原生代码的日志
+        std::vector<LogStackFrame> StackTrace{};     // C# 的日志
     };
 
+    struct LogThreadQueue;
+
     class Log
     {
     public:
-        static LogLevel GetMinimumLevel();
-        static void SetMinimumLevel(LogLevel level);
-        static bool IsLevelEnabled(LogLevel level);
+        static LogLevel GetMinimumLevel() { return s_MinimumLevel.load(std::memory_order_relaxed); }
+        static void SetMinimumLevel(LogLevel level) { s_MinimumLevel.store(level, std::memory_order_relaxed); }
+
+        static bool IsLevelEnabled(LogLevel level)
+        {
+            return static_cast<int32_t>(level) >= static_cast<int32_t>(GetMinimumLevel());
+        }
 
         static uint32_t GetCount(LogLevel level);
         static void Clear();
@@ -52,17 +68,44 @@ namespace march
         static void Message(LogLevel level, std::string&& message, std::vector<LogStackFrame>&& stackTrace);
         static void Message(LogLevel level, const std::string& message, std::vector<LogStackFrame>&& stackTrace);
 
+        // 先格式化到栈上的 buffer，再放进当前线程的队列，短消息不会分配堆内存
+        template <typename... Args>
+        static void Message(LogLevel level, const LogSourceLocation* location, fmt::format_string<Args...> format, Args&&... args)
+        {
+            fmt::basic_memory_buffer<char, 256> buffer{};
+            fmt::vformat_to(fmt::appender(buffer), format, fmt::make_format_args(args...));
+            Enqueue(level, location, std::string_view(buffer.data(), buffer.size()));
+        }
+
     private:
-        static LogLevel s_MinimumLevel;
-        static std::deque<LogEntry> s_Entries;
+        static constexpr size_t MaxEntries = 10000;
+
+        static std::atomic<LogLevel> s_MinimumLevel;
+
+        // 以下成员都由 s_Mutex 保护
+        static LogEntry s_Entries[MaxEntries]; // 环形缓冲区，满了以后覆盖最旧的
+        static size_t s_FirstEntry;
+        static size_t s_EntryCount;
         static uint32_t s_Counts[static_cast<int32_t>(LogLevel::Error) + 1];
+        static std::vector<LogThreadQueue*> s_ThreadQueues;
         static std::mutex s_Mutex;
+
+        static void Enqueue(LogLevel level, const LogSourceLocation* location, std::string_view message);
+        static LogThreadQueue* GetThreadQueue(); // 线程退出时返回 nullptr
+        static void DrainThreadQueues();
+        static LogEntry& AppendEntry(LogLevel level, time_t time);
     };
 }
 
 #define LOG_MSG(level, f, ...) \
-    if (::march::Log::IsLevelEnabled(level)) \
-        ::march::Log::Message(level, ::fmt::format(f, __VA_ARGS__), { { __FUNCSIG__, __FILE__, __LINE__ } })
+    do \
+    { \
+        if (::march::Log::IsLevelEnabled(level)) \
+        { \
+            static const ::march::LogSourceLocation _marchLogLocation{ __FUNCSIG__, __FILE__, __LINE__ }; \
+            ::march::Log::Message(level, &_marchLogLocation, f, __VA_ARGS__); \
+        } \
+    } while (false)
 
 #define LOG_TRACE(format, ...)   LOG_MSG(::march::LogLevel::Trace, format, __VA_ARGS__)
 #define LOG_DEBUG(format, ...)   LOG_MSG(::march::LogLevel::Debug, format, __VA_ARGS__)
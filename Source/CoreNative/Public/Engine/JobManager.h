@@ -1,32 +1,71 @@
 #pragma once
 
-#include "Engine/Ints.h"
+#include <stdint.h>
 #include <functional>
+#include <initializer_list>
+#include <memory>
+#include <utility>
 
 namespace march
 {
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-but-set-variable"
-#pragma clang diagnostic ignored "-Wunused-private-field"
+    struct JobGroup;
 
     class JobHandle
     {
+        friend struct JobManager;
+
     public:
+        JobHandle() = default;
+
+        bool IsValid() const { return m_Group != nullptr; }
+        bool IsCompleted() const;
+
+        // 等待期间，当前线程会帮忙执行队列中的 job，而不是阻塞
         void Complete();
 
     private:
-        uint64 m_GroupId;
+        std::shared_ptr<JobGroup> m_Group;
     };
 
-#pragma clang diagnostic pop
-
-    struct JobData final
-    {
-        std::function<void(size_t)> Func;
-    };
+    // 参数是 [begin, end)，每个 batch 只调用一次
+    using JobBatchFunc = std::function<void(size_t, size_t)>;
 
     struct JobManager final
     {
-        static JobHandle Schedule(size_t totalSize, size_t batchSize, const std::function<void(size_t)>& func);
+        // numWorkers 为 0 时，使用 CPU 核心数 - 1
+        static void Initialize(uint32_t numWorkers = 0);
+        static void Shutdown();
+
+        static uint32_t GetWorkerCount();
+
+        // batchSize 为 0 时，根据 totalSize 和线程数自动决定
+        // 所有 dependencies 完成后，job 才会开始执行
+        static JobHandle ScheduleBatch(size_t totalSize, size_t batchSize, JobBatchFunc func, std::initializer_list<JobHandle> dependencies = {});
+
+        template <typename Func>
+        static JobHandle Schedule(size_t totalSize, size_t batchSize, Func&& func, std::initializer_list<JobHandle> dependencies = {})
+        {
+            // 在 batch 内部循环，避免每个 index 都经过一次 std::function
+            return ScheduleBatch(totalSize, batchSize, [f = std::forward<Func>(func)](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    f(i);
+                }
+            }, dependencies);
+        }
+
+        template <typename Func>
+        static JobHandle Run(Func&& func, std::initializer_list<JobHandle> dependencies = {})
+        {
+            return ScheduleBatch(1, 1, [f = std::forward<Func>(func)](size_t, size_t) { f(); }, dependencies);
+        }
+
+        // 当前线程也会参与执行，返回时所有 index 都执行完毕
+        template <typename Func>
+        static void ParallelFor(size_t totalSize, size_t batchSize, Func&& func)
+        {
+            Schedule(totalSize, batchSize, std::forward<Func>(func)).Complete();
+        }
     };
 }
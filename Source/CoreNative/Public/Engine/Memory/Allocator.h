@@ -3,7 +3,6 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
-#include <set>
 #include <optional>
 #include <memory>
 #include <functional>
@@ -32,13 +31,41 @@ namespace march
         uint32_t m_NextAllocOffset;
     };
 
+    // 用来比较不同分配器浪费的内存，单位都是字节
+    struct AllocatorFragmentationStats
+    {
+        uint64_t TotalSize = 0;            // 所有 page 的大小
+        uint64_t AllocatedSize = 0;        // 分配出去的 block 的大小，包括向上取整和对齐的部分
+        uint64_t RequestedSize = 0;        // 调用 Allocate 时请求的大小
+        uint64_t LargestFreeBlockSize = 0;
+        uint32_t NumFreeBlocks = 0;
+        uint32_t NumPages = 0;
+
+        // 内部碎片
+        uint64_t GetWastedSize() const { return AllocatedSize - RequestedSize; }
+
+        double GetInternalFragmentation() const
+        {
+            return AllocatedSize == 0 ? 0.0 : static_cast<double>(GetWastedSize()) / static_cast<double>(AllocatedSize);
+        }
+
+        // 外部碎片，空闲的内存都连在一起时为 0
+        double GetExternalFragmentation() const
+        {
+            uint64_t freeSize = TotalSize - AllocatedSize;
+            return freeSize == 0 ? 0.0 : 1.0 - static_cast<double>(LargestFreeBlockSize) / static_cast<double>(freeSize);
+        }
+    };
+
     struct BuddyAllocation
     {
         class BuddyAllocator* Owner;
         uint32_t Offset;
         uint32_t Order;
+        uint32_t RequestedSize;
     };
 
+    // 每个 order 用 bitmap 记录空闲的 block，分配时总是选 offset 最小的
     class BuddyAllocator final
     {
     public:
@@ -50,19 +77,37 @@ namespace march
 
         uint32_t GetMaxSize() const { return m_MaxBlockSize; }
         uint32_t GetTotalAllocatedSize() const { return m_TotalAllocatedSize; }
+        uint32_t GetTotalRequestedSize() const { return m_TotalRequestedSize; }
+        uint32_t GetLargestFreeBlockSize() const;
+        uint32_t GetNumFreeBlocks() const { return m_NumFreeBlocks; }
 
     private:
         uint32_t m_MinBlockSize;
         uint32_t m_MaxBlockSize;
         uint32_t m_MaxOrder;
-        std::vector<std::set<uint32_t>> m_FreeBlocks;
         uint32_t m_TotalAllocatedSize;
+        uint32_t m_TotalRequestedSize;
+        uint32_t m_NumFreeBlocks;
+
+        // Levels[0] 的第 i 位表示第 i 个 block 是否空闲，Levels[k + 1] 的第 i 位表示 Levels[k][i] 是否不为 0
+        // 最上面一层只有一个 word，找第一个空闲 block 时从上往下每层扫一次，层数最多为 6
+        struct FreeBlockBitmap
+        {
+            std::vector<std::vector<uint64_t>> Levels;
+        };
+
+        std::vector<FreeBlockBitmap> m_FreeBlocks; // 按 order 索引
+        uint64_t m_NonEmptyOrders;                 // 第 i 位表示 order i 是否有空闲的 block
 
         uint32_t SizeToUnitSize(uint32_t size) const;
         uint32_t UnitSizeToOrder(uint32_t size) const;
         uint32_t OrderToUnitSize(uint32_t order) const;
         uint32_t GetBuddyOffset(uint32_t offset, uint32_t size) const;
 
+        void AddFreeBlock(uint32_t offset, uint32_t order);
+        bool RemoveFreeBlock(uint32_t offset, uint32_t order); // 如果 block 不是空闲的，返回 false
+        uint32_t PopFirstFreeBlock(uint32_t order);
+
         std::optional<uint32_t> AllocateBlock(uint32_t order);
         void ReleaseBlock(uint32_t offset, uint32_t order);
     };
@@ -79,6 +124,7 @@ namespace march
         void Release(const BuddyAllocation& allocation);
 
         const std::string& GetName() const { return m_Name; }
+        AllocatorFragmentationStats GetFragmentationStats() const;
 
     private:
         std::string m_Name;
@@ -89,4 +135,165 @@ namespace march
 
         void AppendNewPage(uint32_t maxBlockSize);
     };
+
+    struct TlsfAllocation
+    {
+        class TlsfAllocator* Owner;
+        uint32_t BlockIndex;
+        uint32_t PageIndex; // 只有 MultiTlsfAllocator 使用
+    };
+
+    // 空闲 block 按大小分到两级的 bucket 里，每一级用 bitmask 记录非空的 bucket
+    struct TlsfBucketMasks
+    {
+        static constexpr uint32_t NumSecondLevelBits = 4;
+        static constexpr uint32_t NumSecondLevels = 1u << NumSecondLevelBits;
+        static constexpr uint32_t NumFirstLevels = 32 - NumSecondLevelBits + 1;
+
+        uint32_t FirstLevel;                   // 第 i 位表示 SecondLevels[i] 是否不为 0
+        uint32_t SecondLevels[NumFirstLevels]; // 第 j 位表示 bucket (i, j) 是否有空闲的 block
+    };
+
+    // Two-Level Segregated Fit，分配和释放都是 O(1)
+    // 大小只需要对齐到 minBlockSize，不用像 buddy 一样凑成 2 的幂，释放时和相邻的空闲 block 合并
+    class TlsfAllocator final
+    {
+    public:
+        TlsfAllocator(uint32_t minBlockSize, uint32_t maxSize);
+
+        void Reset();
+        std::optional<uint32_t> Allocate(uint32_t sizeInBytes, uint32_t alignment, TlsfAllocation* pOutAllocation);
+        void Release(const TlsfAllocation& allocation);
+
+        uint32_t GetMaxSize() const { return m_MaxSize; }
+        uint32_t GetTotalAllocatedSize() const { return m_TotalAllocatedSize; }
+        uint32_t GetTotalRequestedSize() const { return m_TotalRequestedSize; }
+        uint32_t GetLargestFreeBlockSize() const;
+        uint32_t GetNumFreeBlocks() const { return m_NumFreeBlocks; }
+        const TlsfBucketMasks& GetBucketMasks() const { return m_Masks; }
+
+        // 遍历所有空闲 block 的大小（字节），碎片整理时用来规划资源搬到哪里
+        template <typename Func>
+        void ForEachFreeBlock(Func&& func) const
+        {
+            for (uint32_t firstLevelMask = m_Masks.FirstLevel; firstLevelMask != 0; firstLevelMask &= firstLevelMask - 1)
+            {
+                unsigned long fl;
+                _BitScanForward(&fl, firstLevelMask);
+
+                for (uint32_t secondLevelMask = m_Masks.SecondLevels[fl]; secondLevelMask != 0; secondLevelMask &= secondLevelMask - 1)
+                {
+                    unsigned long sl;
+                    _BitScanForward(&sl, secondLevelMask);
+
+                    for (uint32_t index = m_FreeHeads[fl][sl]; index != InvalidIndex; index = m_Blocks[index].NextFree)
+                    {
+                        func(static_cast<uint64_t>(m_Blocks[index].Size) * m_MinBlockSize);
+                    }
+                }
+            }
+        }
+
+        // 按 block 的大小（以 minBlockSize 为单位）找到所在的 bucket
+        static void MapInsertBucket(uint32_t units, uint32_t* pOutFirstLevel, uint32_t* pOutSecondLevel);
+
+        // 向上取整到下一个 bucket，这样 bucket 里的任何一个 block 都足够大，返回 false 表示太大
+        static bool MapSearchBucket(uint32_t units, uint32_t* pOutFirstLevel, uint32_t* pOutSecondLevel);
+
+        // 找到不小于 (firstLevel, secondLevel) 的第一个非空的 bucket
+        static bool FindNonEmptyBucket(const TlsfBucketMasks& masks, uint32_t* pInOutFirstLevel, uint32_t* pInOutSecondLevel);
+
+        // 分配 sizeInBytes 时，需要找多大的 block（以 minBlockSize 为单位）才能保证对齐
+        static uint32_t GetSearchUnits(uint32_t minBlockSize, uint32_t sizeInBytes, uint32_t alignment);
+
+        // 空闲 block 不小于这个大小（字节）时，Allocate 一定能找到它，返回 std::nullopt 表示太大
+        static std::optional<uint64_t> GetGuaranteedBlockSize(uint32_t minBlockSize, uint32_t sizeInBytes, uint32_t alignment);
+
+    private:
+        static constexpr uint32_t InvalidIndex = 0xFFFFFFFF;
+
+        struct Block
+        {
+            uint32_t Offset; // 单位是 minBlockSize
+            uint32_t Size;   // 单位是 minBlockSize
+            uint32_t RequestedSize; // 字节
+            uint32_t PrevPhysical;
+            uint32_t NextPhysical;
+            uint32_t PrevFree; // 没有使用的 Block 用 NextFree 串起来
+            uint32_t NextFree;
+            bool IsFree;
+        };
+
+        uint32_t m_MinBlockSize;
+        uint32_t m_MaxSize;
+        uint32_t m_TotalAllocatedSize;
+        uint32_t m_TotalRequestedSize;
+        uint32_t m_NumFreeBlocks;
+
+        TlsfBucketMasks m_Masks;
+        uint32_t m_FreeHeads[TlsfBucketMasks::NumFirstLevels][TlsfBucketMasks::NumSecondLevels];
+
+        std::vector<Block> m_Blocks;
+        uint32_t m_UnusedBlockHead;
+
+        uint32_t NewBlock();
+        void DeleteBlock(uint32_t index);
+        void AddFreeBlock(uint32_t index);
+        void RemoveFreeBlock(uint32_t index);
+        uint32_t SplitBlock(uint32_t index, uint32_t size); // 返回后半部分
+        void MergeWithNextBlock(uint32_t index);
+    };
+
+    // 多个 page 的 TLSF，用 bitmask 记录每个 bucket 在哪些 page 里非空，选 page 时不用一个个尝试
+    class MultiTlsfAllocator final
+    {
+    public:
+        // pageIndex 可能是之前 ReleasePage 空出来的位置
+        using AppendPageFunc = std::function<void(size_t pageIndex, uint32_t sizeInBytes)>;
+
+        MultiTlsfAllocator(const std::string& name, uint32_t minBlockSize, uint32_t defaultPageSize, const AppendPageFunc& appendPageFunc);
+
+        void Reset();
+
+        // allowNewPage 为 false 时，已有的 page 放不下就失败
+        // 需要新 page 时，先复用不可分配但已经清空的 page，避免碎片整理刚清空的 page 马上又要重新创建
+        std::optional<uint32_t> Allocate(uint32_t sizeInBytes, uint32_t alignment, size_t* pOutPageIndex, TlsfAllocation* pOutAllocation, bool allowNewPage = true);
+
+        // 只在指定的 page 里分配，page 必须是可分配的
+        std::optional<uint32_t> AllocateInPage(size_t pageIndex, uint32_t sizeInBytes, uint32_t alignment, TlsfAllocation* pOutAllocation);
+        void Release(const TlsfAllocation& allocation);
+
+        // 不可分配的 page 不参与 Allocate，但已有的分配仍然可以释放，用于碎片整理时清空 page
+        void SetPageAllocatable(size_t pageIndex, bool allocatable);
+        bool IsPageAllocatable(size_t pageIndex) const { return m_IsPageAllocatable[pageIndex]; }
+
+        // 释放一个空的 page，之后调用者自己销毁对应的内存，这个位置之后会被新的 page 复用
+        void ReleasePage(size_t pageIndex);
+
+        // 可能有已经释放的 page，此时 GetPage 返回 nullptr
+        size_t GetNumPages() const { return m_PageAllocators.size(); }
+        const TlsfAllocator* GetPage(size_t pageIndex) const { return m_PageAllocators[pageIndex].get(); }
+
+        const std::string& GetName() const { return m_Name; }
+        AllocatorFragmentationStats GetFragmentationStats() const;
+
+    private:
+        std::string m_Name;
+        uint32_t m_MinBlockSize;
+        uint32_t m_DefaultPageSize;
+        AppendPageFunc m_AppendPageFunc;
+        std::vector<std::unique_ptr<TlsfAllocator>> m_PageAllocators;
+        std::vector<bool> m_IsPageAllocatable;
+        std::vector<size_t> m_FreePageIndices; // ReleasePage 空出来的位置
+
+        TlsfBucketMasks m_Masks; // 所有 page 合在一起
+        uint32_t m_BucketPageCounts[TlsfBucketMasks::NumFirstLevels][TlsfBucketMasks::NumSecondLevels];
+        std::vector<uint64_t> m_BucketPages[TlsfBucketMasks::NumFirstLevels][TlsfBucketMasks::NumSecondLevels]; // 第 i 位表示第 i 个 page 的这个 bucket 非空
+
+        size_t AppendNewPage(uint32_t sizeInBytes);
+        std::optional<size_t> ReclaimEmptyPage(uint64_t minSizeInBytes);
+        std::optional<size_t> FindPage(uint32_t searchUnits) const;
+        TlsfBucketMasks GetIndexedBucketMasks(size_t pageIndex) const; // 不可分配的 page 不进入索引
+        void UpdatePageBuckets(size_t pageIndex, const TlsfBucketMasks& oldMasks, const TlsfBucketMasks& newMasks);
+    };
 }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace march
+{
+    struct DefragPageInfo
+    {
+        uint64_t Size;
+        uint64_t AllocatedSize; // 包括对齐等浪费的部分
+    };
+
+    struct DefragFreeBlock
+    {
+        size_t PageIndex;
+        uint64_t Size;
+    };
+
+    struct DefragAllocationInfo
+    {
+        size_t PageIndex;
+        uint64_t Size;
+        uint64_t RequiredBlockSize; // 空闲 block 至少要这么大才能保证放得下，包括对齐需要的空间
+        bool IsMovable;             // 有不能移动的分配时，整个 page 都不会被清空
+    };
+
+    struct DefragMove
+    {
+        size_t AllocationIndex;     // 在 allocations 中的下标
+        size_t DestinationPageIndex;
+    };
+
+    struct DefragBudget
+    {
+        uint64_t MaxBytesToMove;
+        uint32_t MaxMoves;
+        float MaxPageUsage; // 使用率超过这个值的 page 不值得清空
+    };
+
+    struct DefragStats
+    {
+        uint32_t NumEvacuatedPages = 0;
+        uint32_t NumMoves = 0;
+        uint64_t MovedBytes = 0;
+        uint64_t ReleasedBytes = 0; // 清空的 page 的总大小
+    };
+
+    // 增量碎片整理，每次从最空的 page 开始，选出能在预算内整个搬空的 page
+    // 用其他 page 实际的空闲 block 模拟放置，给每个要移动的分配选好目标 page，至少保留一个 page
+    // 纯 CPU 计算，不依赖 D3D12，方便单独测试
+    class DefragmentationPlanner final
+    {
+    public:
+        void Plan(const std::vector<DefragPageInfo>& pages,
+            const std::vector<DefragFreeBlock>& freeBlocks,
+            const std::vector<DefragAllocationInfo>& allocations,
+            const DefragBudget& budget);
+
+        // 要清空的 page，按选中的顺序
+        const std::vector<size_t>& GetEvacuatedPages() const { return m_EvacuatedPages; }
+
+        // 按 page 分组，同一个 page 里大的在前，按这个顺序执行时和规划的放置一致
+        const std::vector<DefragMove>& GetMoves() const { return m_Moves; }
+
+        const DefragStats& GetStats() const { return m_Stats; }
+
+    private:
+        std::vector<size_t> m_EvacuatedPages{};
+        std::vector<DefragMove> m_Moves{};
+        DefragStats m_Stats{};
+
+        // 复用内存
+        std::vector<uint64_t> m_PageMovableBytes{};
+        std::vector<uint32_t> m_PageNumAllocations{};
+        std::vector<size_t> m_PageFirstAllocation{}; // m_SortedAllocations 中每个 page 的起始位置
+        std::vector<bool> m_PageHasImmovable{};
+        std::vector<bool> m_IsPageEvacuated{};
+        std::vector<bool> m_IsPageDestination{};
+        std::vector<size_t> m_SortedAllocations{};
+        std::vector<size_t> m_CandidatePages{};
+        std::vector<DefragFreeBlock> m_FreeBlocks{};  // 按大小从小到大
+        std::vector<DefragFreeBlock> m_TrialBlocks{}; // 尝试清空一个 page 时的副本，失败了就丢掉
+        std::vector<DefragMove> m_TrialMoves{};
+
+        bool TryEvacuatePage(size_t pageIndex, const std::vector<DefragAllocationInfo>& allocations);
+    };
+}
@@ -26,6 +26,6 @@ namespace march
 
         static void* CreateContextHandle(ID3D12CommandList* cmdList);
         static void ReleaseContextHandle(void* contextHandle);
-        static void SetEventMarker(void* contextHandle, const std::string& label);
+        static void SetEventMarker(void* contextHandle, const char* label);
     };
 }
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include <stdint.h>
+#include <vector>
+#include <assert.h>
+
+namespace march
+{
+    // 动态 AABB 树，支持增量插入、删除和更新
+    // 叶子节点保存扩大后的 Bounds，物体在里面小幅移动时不需要修改树
+    // 每次修改后会通过旋转保持树的平衡
+    class BoundingVolumeHierarchy final
+    {
+    public:
+        static constexpr uint32_t NullIndex = UINT32_MAX;
+
+        struct Node
+        {
+            DirectX::BoundingBox Bounds;       // 叶子节点的是扩大后的 Bounds
+            DirectX::BoundingBox ObjectBounds; // 只有叶子节点有，物体实际的 Bounds
+            void* UserData;                    // 只有叶子节点有
+            uint32_t Parent;                   // 空闲节点用它表示下一个空闲节点
+            uint32_t Children[2];
+            int32_t Height;                    // 叶子节点为 0，空闲节点为 -1
+
+            bool IsLeaf() const { return Children[0] == NullIndex; }
+        };
+
+        BoundingVolumeHierarchy() = default;
+
+        BoundingVolumeHierarchy(const BoundingVolumeHierarchy&) = delete;
+        BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&) = delete;
+
+        // 返回叶子节点的索引，之后用它来更新和删除
+        uint32_t Insert(const DirectX::BoundingBox& bounds, void* userData);
+        void Remove(uint32_t leaf);
+
+        // 总是会记录新的 ObjectBounds，如果树被修改了，返回 true
+        bool Update(uint32_t leaf, const DirectX::BoundingBox& bounds);
+
+        void* GetUserData(uint32_t leaf) const { return m_Nodes[leaf].UserData; }
+        const Node& GetNode(uint32_t index) const { return m_Nodes[index]; }
+        uint32_t GetRoot() const { return m_Root; }
+        uint32_t GetLeafCount() const { return m_LeafCount; }
+        bool IsEmpty() const { return m_Root == NullIndex; }
+
+        // 包含所有物体的 Bounds，树为空时无意义
+        const DirectX::BoundingBox& GetRootBounds() const { return m_Nodes[m_Root].Bounds; }
+
+        // 从根节点开始按广度优先拆分，直到有至少 minCount 棵子树或者全部拆成叶子
+        // 拆出来的子树互不重叠，可以分给多个线程分别 Query
+        void CollectSubtrees(size_t minCount, std::vector<uint32_t>& outRoots) const;
+
+        // 对可能与 volume 相交的叶子调用 func(const Node& leaf, bool isContained)，Volume 可以是 DirectXCollision 里任意有 Contains(BoundingBox) 的类型
+        // 只测试中间节点，isContained 为 true 时叶子一定在 volume 里面，否则需要调用者用 ObjectBounds 自己测试（方便批量用 SIMD 测试）
+        template <typename Volume, typename Func>
+        void Query(const Volume& volume, Func&& func) const
+        {
+            Query(volume, m_Root, func);
+        }
+
+        template <typename Volume, typename Func>
+        void Query(const Volume& volume, uint32_t root, Func&& func) const
+        {
+            if (root == NullIndex)
+            {
+                return;
+            }
+
+            uint32_t stack[MaxStackSize];
+            size_t stackSize = 0;
+            stack[stackSize++] = root;
+
+            while (stackSize > 0)
+            {
+                uint32_t index = stack[--stackSize];
+                const Node& node = m_Nodes[index];
+                DirectX::ContainmentType containment = volume.Contains(node.Bounds);
+
+                if (containment == DirectX::ContainmentType::DISJOINT)
+                {
+                    continue;
+                }
+
+                if (containment == DirectX::ContainmentType::CONTAINS)
+                {
+                    // 整棵子树都在 volume 里面，不用再测试了
+                    VisitLeaves(index, [&func](const Node& leaf) { func(leaf, true); });
+                    continue;
+                }
+
+                if (node.IsLeaf())
+                {
+                    // 只有 root 本身是叶子时才会走到这里
+                    func(node, false);
+                    continue;
+                }
+
+                for (uint32_t child : node.Children)
+                {
+                    if (m_Nodes[child].IsLeaf())
+                    {
+                        func(m_Nodes[child], false);
+                    }
+                    else
+                    {
+                        assert(stackSize < MaxStackSize);
+                        stack[stackSize++] = child;
+                    }
+                }
+            }
+        }
+
+        template <typename Func>
+        void VisitLeaves(uint32_t root, Func&& func) const
+        {
+            if (root == NullIndex)
+            {
+                return;
+            }
+
+            uint32_t stack[MaxStackSize];
+            size_t stackSize = 0;
+            stack[stackSize++] = root;
+
+            while (stackSize > 0)
+            {
+                const Node& node = m_Nodes[stack[--stackSize]];
+
+                if (node.IsLeaf())
+                {
+                    func(node);
+                    continue;
+                }
+
+                assert(stackSize + 2 <= MaxStackSize);
+                stack[stackSize++] = node.Children[0];
+                stack[stackSize++] = node.Children[1];
+            }
+        }
+
+    private:
+        // 树是平衡的，栈的深度不会超过树高 + 1
+        static constexpr size_t MaxStackSize = 128;
+
+        // 叶子节点的 Bounds 向外扩大的距离
+        static constexpr float BoundsMargin = 0.1f;
+
+        std::vector<Node> m_Nodes{};
+        uint32_t m_Root = NullIndex;
+        uint32_t m_FreeList = NullIndex;
+        uint32_t m_LeafCount = 0;
+
+        uint32_t AllocateNode();
+        void FreeNode(uint32_t index);
+        void InsertLeaf(uint32_t leaf);
+        void RemoveLeaf(uint32_t leaf);
+        void RefitAncestors(uint32_t index);
+        uint32_t Balance(uint32_t index);
+    };
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include <stdint.h>
+#include <vector>
+
+namespace march
+{
+    // SoA 存储的 AABB，方便用 SIMD 一次测试多个
+    class BoundingBoxSoA
+    {
+    public:
+        void Clear();
+        void Add(const DirectX::BoundingBox& bounds);
+
+        size_t GetCount() const { return m_CenterX.size(); }
+
+        const float* GetCenterX() const { return m_CenterX.data(); }
+        const float* GetCenterY() const { return m_CenterY.data(); }
+        const float* GetCenterZ() const { return m_CenterZ.data(); }
+        const float* GetExtentX() const { return m_ExtentX.data(); }
+        const float* GetExtentY() const { return m_ExtentY.data(); }
+        const float* GetExtentZ() const { return m_ExtentZ.data(); }
+
+    private:
+        std::vector<float> m_CenterX{};
+        std::vector<float> m_CenterY{};
+        std::vector<float> m_CenterZ{};
+        std::vector<float> m_ExtentX{};
+        std::vector<float> m_ExtentY{};
+        std::vector<float> m_ExtentZ{};
+    };
+
+    // 用来剔除 AABB 的体积，内部是 6 个朝外的平面或者一个球
+    // 平面测试是保守的：和 DirectX::BoundingFrustum::Contains 相比，不会漏掉可见的物体，但角落附近可能多保留一些
+    class CullingVolume
+    {
+    public:
+        explicit CullingVolume(const DirectX::BoundingFrustum& frustum);
+        explicit CullingVolume(const DirectX::BoundingBox& box);
+        explicit CullingVolume(const DirectX::BoundingOrientedBox& box);
+        explicit CullingVolume(const DirectX::BoundingSphere& sphere);
+
+        // 把 boxes 中 [begin, end) 范围内可见的索引按顺序写到 pOutIndices，返回可见的数量
+        // pOutIndices 至少要能放下 end - begin 个元素
+        size_t Cull(const BoundingBoxSoA& boxes, size_t begin, size_t end, uint32_t* pOutIndices) const;
+
+    private:
+        static constexpr size_t NumPlanes = 6;
+
+        bool m_IsSphere;
+
+        // 平面 n * p + d > 0 的一侧是外面，为了方便 SIMD 广播，按分量分开存
+        float m_PlaneNormalX[NumPlanes];
+        float m_PlaneNormalY[NumPlanes];
+        float m_PlaneNormalZ[NumPlanes];
+        float m_PlaneDistance[NumPlanes];
+
+        DirectX::BoundingSphere m_Sphere;
+
+        void SetPlane(size_t index, DirectX::FXMVECTOR plane);
+        size_t CullPlanes(const BoundingBoxSoA& boxes, size_t begin, size_t end, uint32_t* pOutIndices) const;
+        size_t CullSphere(const BoundingBoxSoA& boxes, size_t begin, size_t end, uint32_t* pOutIndices) const;
+    };
+}
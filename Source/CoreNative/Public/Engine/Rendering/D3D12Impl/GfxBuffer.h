@@ -10,6 +10,8 @@
 #include <vector>
 #include <queue>
 #include <memory>
+#include <mutex>
+#include <atomic>
 
 namespace march
 {
@@ -20,6 +22,7 @@ namespace march
     union GfxBufferSubAllocation
     {
         BuddyAllocation Buddy;
+        TlsfAllocation Tlsf;
     };
 
     enum class GfxBufferUsages
@@ -170,12 +173,14 @@ namespace march
 
         GfxBufferSubAllocator* m_Allocator; // 可以没有
         GfxBufferSubAllocation m_Allocation;
+        uint32_t m_DescriptorResourceVersion; // 创建 view 时 m_Resource 的版本
 
         // Lazy creation
         GfxOfflineDescriptor m_UavDescriptors[4];
+        std::mutex m_DescriptorMutex; // 不同线程录制的 command list 可能同时创建 view，不随 move 转移
 
         void AllocateResourceIfNot();
-        D3D12_RANGE ReallocateResource();
+        void ReallocateResource();
     };
 
     class GfxBufferSubAllocator
@@ -221,27 +226,30 @@ namespace march
 
         void CleanUpAllocations() override;
 
+        AllocatorFragmentationStats GetFragmentationStats();
+
     private:
         GfxDevice* m_Device;
         std::unique_ptr<MultiBuddyAllocator> m_Allocator;
         std::vector<RefCountPtr<GfxResource>> m_Pages;
         std::queue<std::pair<uint64_t, GfxBufferSubAllocation>> m_ReleaseQueue;
+        std::mutex m_Mutex;
     };
 
-    struct GfxBufferLinearSubAllocatorDesc
+    struct GfxBufferMultiTlsfSubAllocatorDesc
     {
-        uint32_t PageSize;
+        uint32_t MinBlockSize;
+        uint32_t DefaultPageSize; // 放不下的请求单独创建一个刚好够大的 page
     };
 
-    // 分配结果只有一帧有效
-    class GfxBufferLinearSubAllocator : public GfxBufferSubAllocator
+    // 和 GfxBufferMultiBuddySubAllocator 一样，但大小不用凑成 2 的幂，浪费的内存更少
+    class GfxBufferMultiTlsfSubAllocator : public GfxBufferSubAllocator
     {
     public:
-        GfxBufferLinearSubAllocator(
+        GfxBufferMultiTlsfSubAllocator(
             const std::string& name,
-            const GfxBufferLinearSubAllocatorDesc& desc,
-            GfxResourceAllocator* pageAllocator,
-            GfxResourceAllocator* largePageAllocator);
+            const GfxBufferMultiTlsfSubAllocatorDesc& desc,
+            GfxResourceAllocator* pageAllocator);
 
         RefCountPtr<GfxResource> Allocate(
             uint32_t sizeInBytes,
@@ -253,11 +261,74 @@ namespace march
 
         void CleanUpAllocations() override;
 
+        AllocatorFragmentationStats GetFragmentationStats();
+
     private:
         GfxDevice* m_Device;
-        std::unique_ptr<LinearAllocator> m_Allocator;
+        std::unique_ptr<MultiTlsfAllocator> m_Allocator;
         std::vector<RefCountPtr<GfxResource>> m_Pages;
-        std::vector<RefCountPtr<GfxResource>> m_LargePages;
-        std::queue<std::pair<uint64_t, RefCountPtr<GfxResource>>> m_ReleaseQueue;
+        std::queue<std::pair<uint64_t, GfxBufferSubAllocation>> m_ReleaseQueue;
+        std::mutex m_Mutex;
+    };
+
+    struct GfxBufferRingSubAllocatorDesc
+    {
+        uint32_t Capacity; // 要能放下同时在 GPU 上执行的几帧的数据，放不下时单独创建 buffer
+    };
+
+    struct GfxBufferRingStats
+    {
+        uint64_t AllocatedBytes = 0; // 从环形 buffer 分配出去的大小，不包括浪费的部分
+        uint64_t WastedBytes = 0;    // 对齐、绕回和放不下时在环形 buffer 上跳过的部分
+        uint64_t FallbackBytes = 0;  // 环形 buffer 放不下，单独创建的 buffer 的大小
+        uint32_t NumAllocations = 0;
+        uint32_t NumFallbacks = 0;
+    };
+
+    // 分配结果只有一帧有效
+    // 一个一直 map 着的环形 buffer，每帧从上一帧结束的位置继续分配，GPU 执行完某一帧后回收这一帧的空间
+    // 分配只用一次原子加法，可以在多个线程中同时调用
+    class GfxBufferRingSubAllocator : public GfxBufferSubAllocator
+    {
+    public:
+        GfxBufferRingSubAllocator(
+            const std::string& name,
+            const GfxBufferRingSubAllocatorDesc& desc,
+            GfxResourceAllocator* ringAllocator,
+            GfxResourceAllocator* fallbackAllocator);
+
+        RefCountPtr<GfxResource> Allocate(
+            uint32_t sizeInBytes,
+            uint32_t dataPlacementAlignment,
+            uint32_t* pOutOffsetInBytes,
+            GfxBufferSubAllocation* pOutAllocation) override;
+
+        void DeferredRelease(const GfxBufferSubAllocation& allocation) override;
+
+        // 每帧结束时调用一次
+        void CleanUpAllocations() override;
+
+        const GfxBufferRingStats& GetLastFrameStats() const { return m_LastFrameStats; }
+
+    private:
+        GfxDevice* m_Device;
+        std::string m_Name;
+        GfxResourceAllocator* m_FallbackAllocator;
+        RefCountPtr<GfxResource> m_Ring;
+        uint64_t m_Capacity;
+
+        // 位置只增不减，对 m_Capacity 取模得到 buffer 中的偏移
+        std::atomic<uint64_t> m_Head;
+        std::atomic<uint64_t> m_Tail; // GPU 可能还在使用的最早的位置
+        std::queue<std::pair<uint64_t, uint64_t>> m_FrameEnds; // 每帧的 fence 和结束的位置
+
+        std::atomic<uint64_t> m_FrameAllocatedBytes;
+        std::atomic<uint64_t> m_FrameWastedBytes;
+        std::atomic<uint64_t> m_FrameFallbackBytes;
+        std::atomic<uint32_t> m_FrameNumAllocations;
+        std::atomic<uint32_t> m_FrameNumFallbacks;
+        GfxBufferRingStats m_LastFrameStats;
+
+        RefCountPtr<GfxResource> AllocateFallback(uint32_t sizeInBytes);
     };
 }
@@ -20,6 +20,7 @@
 #include <memory>
 #include <unordered_map>
 #include <optional>
+#include <mutex>
 
 namespace march
 {
@@ -106,6 +107,7 @@ namespace march
         std::unique_ptr<GfxFence> m_Fence;
 
         std::queue<std::pair<uint64_t, Microsoft::WRL::ComPtr<ID3D12CommandAllocator>>> m_CommandAllocators;
+        std::mutex m_CommandAllocatorMutex; // 多个线程可能同时 Open context
     };
 
     // https://learn.microsoft.com/en-us/windows/win32/direct3d12/user-mode-heap-synchronization
@@ -152,6 +154,7 @@ namespace march
 
         GfxDevice* m_Device;
         std::vector<std::unique_ptr<GfxCommandContext>> m_ContextStore; // 保存所有分配的 command context，用于释放资源
+        std::mutex m_ContextMutex; // 保护 FreeContexts 和 m_ContextStore，可以在多个线程中请求 context
         uint64_t m_CompletedFrameFence; // cache
     };
 
@@ -184,6 +187,36 @@ namespace march
         static GfxRenderTargetDesc CubeArray(GfxTexture* texture, GfxCubemapFace face, uint32_t arraySlice = 0, uint32_t mipSlice = 0);
     };
 
+    enum class GfxRenderPassBeginAccess
+    {
+        Preserve, // 需要之前的内容
+        Discard,  // 不需要之前的内容
+        Clear,
+    };
+
+    enum class GfxRenderPassEndAccess
+    {
+        Preserve, // 之后还要使用
+        Discard,  // 之后不再使用
+    };
+
+    struct GfxRenderPassColorTarget
+    {
+        GfxRenderTargetDesc Target;
+        GfxRenderPassBeginAccess BeginAccess;
+        GfxRenderPassEndAccess EndAccess;
+        float ClearColor[4];
+    };
+
+    struct GfxRenderPassDepthStencilTarget
+    {
+        GfxRenderTargetDesc Target;
+        GfxRenderPassBeginAccess BeginAccess;
+        GfxRenderPassEndAccess EndAccess;
+        float ClearDepth;
+        uint8_t ClearStencil;
+    };
+
     // 不要跨帧使用
     class GfxCommandContext final
     {
@@ -194,7 +227,7 @@ namespace march
         void Open();
         GfxSyncPoint SubmitAndRelease();
 
-        void BeginEvent(const std::string& name);
+        void BeginEvent(const char* name);
         void EndEvent();
 
         void TransitionResource(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter);
@@ -203,6 +236,24 @@ namespace march
         void TransitionSubresource(ID3D12Resource* resource, uint32_t subresource, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter);
         void FlushResourceBarriers();
 
+        // split barrier，Begin 和 End 之间不能使用这个资源，GPU 可以在这段时间里完成转换
+        // 只对所有 subresource state 一致、没有锁定 state 的资源生效，否则什么都不做，由 End 做普通的转换
+        // 同一个资源的 Begin 和 End 要在同一个 context 中，没结束的 split barrier 会在提交前结束
+        void BeginSplitTransition(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter);
+        void EndSplitTransition(RefCountPtr<GfxResource> resource, D3D12_RESOURCE_STATES stateAfter);
+
+        // 开始使用和其他资源共用内存的 placed resource，之后需要 DiscardResource 或者完整写入一次才能读取
+        void AliasingBarrier(RefCountPtr<GfxResource> resourceAfter);
+        void DiscardResource(RefCountPtr<GfxResource> resource);
+
+        // 开启后，resource state 只记录在当前 context 中，不修改 GfxResource，可以在多个线程中同时录制
+        // 第一次使用资源时不产生 barrier，之后必须在主线程按提交顺序调用 ResolveLocalResourceStates
+        void EnableLocalResourceStates();
+
+        // 把第一次使用资源时需要的 barrier 补到 previous 的末尾，然后把最终的 state 写回 GfxResource
+        // previous 必须在当前 context 之前提交
+        void ResolveLocalResourceStates(GfxCommandContext* previous);
+
         void WaitOnGpu(const GfxSyncPoint& syncPoint);
 
         void SetTexture(const std::string& name, GfxTexture* value, GfxTextureElement element = GfxTextureElement::Default, std::optional<uint32_t> mipSlice = std::nullopt);
@@ -231,6 +282,12 @@ namespace march
         void SetDefaultDepthBias();
         void SetWireframe(bool value);
 
+        // 在 BeginRenderPass 和 EndRenderPass 之间的 draw 使用 D3D12 的 render pass，不需要再调用 SetRenderTargets 和 Clear
+        // 遇到 barrier、clear、dispatch、copy 等 render pass 中不允许的操作时，会先结束当前的 render pass，之后的 draw 再用 Preserve 继续
+        // 所以 EndAccess 为 Discard 时不能写在 D3D12 的 render pass 里，而是在 EndRenderPass 时调用 DiscardResource
+        void BeginRenderPass(uint32_t numColorTargets, const GfxRenderPassColorTarget* colorTargets, const GfxRenderPassDepthStencilTarget* depthStencilTarget);
+        void EndRenderPass();
+
         // Use this method to denote that subsequent rendering and resource manipulation commands are not actually performed
         // if the resulting predicate data of the predicate is equal to the operation specified.
         void SetPredication(GfxBuffer* buffer, uint32_t alignedOffset = 0, D3D12_PREDICATION_OP operation = D3D12_PREDICATION_OP_EQUAL_ZERO);
@@ -268,10 +325,32 @@ namespace march
 
         Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_CommandAllocator;
         Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_CommandList;
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList4> m_CommandList4; // 用于 render pass
 
         std::vector<D3D12_RESOURCE_BARRIER> m_ResourceBarriers;
         std::vector<GfxSyncPoint> m_SyncPointsToWait;
 
+        struct PendingSplitTransition
+        {
+            RefCountPtr<GfxResource> Resource;
+            D3D12_RESOURCE_STATES StateBefore;
+            D3D12_RESOURCE_STATES StateAfter;
+            size_t BarrierIndex; // begin barrier 还没提交时在 m_ResourceBarriers 中的下标，否则为 -1
+        };
+
+        std::vector<PendingSplitTransition> m_PendingSplitTransitions; // 数量很少，直接线性查找
+
+        struct LocalResourceState
+        {
+            RefCountPtr<GfxResource> Resource;
+            std::vector<D3D12_RESOURCE_STATES> FirstStates;   // 第一次使用时需要的 state
+            std::vector<D3D12_RESOURCE_STATES> CurrentStates;
+            std::vector<bool> HasBarriers;                    // 第一次使用之后是否产生过 barrier
+        };
+
+        bool m_UseLocalResourceStates;
+        std::unordered_map<GfxResource*, LocalResourceState> m_LocalResourceStates;
+
         GfxPipelineParameterCache<GfxPipelineType::Graphics> m_GraphicsViewCache;
         GfxPipelineParameterCache<GfxPipelineType::Compute> m_ComputeViewCache;
 
@@ -294,6 +373,21 @@ namespace march
 
         GfxOutputDesc m_OutputDesc;
 
+        struct RenderPassData
+        {
+            bool IsActive;       // 在 BeginRenderPass 和 EndRenderPass 之间
+            bool IsRecording;    // 已经调用了 ID3D12GraphicsCommandList4::BeginRenderPass
+            bool IsFirstSegment; // 还没有开始过，需要使用 BeginAccess
+            bool NeedClear;      // 第一次开始时会 clear
+
+            uint32_t NumColorTargets;
+            GfxRenderPassColorTarget ColorTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+            bool HasDepthStencilTarget;
+            GfxRenderPassDepthStencilTarget DepthStencilTarget;
+        };
+
+        RenderPassData m_RenderPass;
+
         GfxBuffer* m_CurrentPredicationBuffer;
         uint32_t m_CurrentPredicationOffset;
         D3D12_PREDICATION_OP m_CurrentPredicationOperation;
@@ -322,10 +416,22 @@ namespace march
         std::unordered_map<int32_t, GlobalBufferData> m_GlobalBuffers;
 
         GfxBuffer m_InstanceBuffer;
+        GfxBuffer* m_CurrentInstanceBuffer; // DrawMesh 用 m_InstanceBuffer，DrawMeshRenderers 用 batch 的 buffer
 
         void* m_NsightAftermathHandle;
 
-        void SetRenderTargets(uint32_t numColorTargets, const GfxRenderTargetDesc* colorTargets, const GfxRenderTargetDesc* depthStencilTarget);
+        LocalResourceState& GetLocalResourceState(const RefCountPtr<GfxResource>& resource);
+        void EndPendingSplitTransition(GfxResource* resource);
+        void EndAllPendingSplitTransitions();
+        void TransitionLocalSubresource(LocalResourceState& local, uint32_t subresource, D3D12_RESOURCE_STATES stateAfter);
+
+        void SetRenderTargets(uint32_t numColorTargets, const GfxRenderTargetDesc* colorTargets, const GfxRenderTargetDesc* depthStencilTarget, bool bindOutputMerger = true);
+        void ResetRenderTargetBindings();
+        bool IsRenderPassTargets(uint32_t numColorTargets, const GfxRenderTargetDesc* colorTargets, const GfxRenderTargetDesc* depthStencilTarget) const;
+        void ResumeRenderPass();
+        void InterruptRenderPass();
+        void AbortRenderPass();
+
         static D3D12_CPU_DESCRIPTOR_HANDLE GetRtvDsvFromRenderTargetDesc(const GfxRenderTargetDesc& desc);
 
         GfxTexture* GetFirstRenderTarget() const;
@@ -337,7 +443,7 @@ namespace march
         void SetInstanceBufferData(uint32_t numInstances, const MeshRendererBatch::InstanceData* instances);
 
         void SetGraphicsPipelineParameters(Material* material, size_t passIndex);
-        void UpdateGraphicsPipelineInstanceDataParameter(uint32_t numInstances, const MeshRendererBatch::InstanceData* instances);
+        void UpdateGraphicsPipelineInstanceDataParameter(uint32_t firstInstance);
         void ApplyGraphicsPipelineParameters(ID3D12PipelineState* pso);
         void SetAndApplyComputePipelineParameters(ID3D12PipelineState* pso, ComputeShader* shader, size_t kernelIndex);
 
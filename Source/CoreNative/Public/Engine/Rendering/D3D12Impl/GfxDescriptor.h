@@ -10,6 +10,7 @@
 #include <list>
 #include <unordered_map>
 #include <functional>
+#include <mutex>
 
 namespace march
 {
@@ -71,6 +72,7 @@ namespace march
         uint32_t m_NextDescriptorIndex;
         std::vector<std::unique_ptr<GfxDescriptorHeap>> m_Pages;
         std::queue<std::pair<uint64_t, D3D12_CPU_DESCRIPTOR_HANDLE>> m_ReleaseQueue;
+        std::mutex m_Mutex; // 录制 command list 时可能在多个线程中创建 view
 
         void DeferredRelease(D3D12_CPU_DESCRIPTOR_HANDLE handle);
     };
@@ -206,5 +208,6 @@ namespace march
         Factory m_Factory;
         std::unique_ptr<GfxOnlineDescriptorAllocator> m_CurrentAllocator;
         std::queue<std::pair<uint64_t, std::unique_ptr<GfxOnlineDescriptorAllocator>>> m_ReleaseQueue;
+        std::mutex m_Mutex; // 多个 command context 可能在不同线程中同时分配
     };
 }
@@ -6,6 +6,7 @@
 #include <wrl.h>
 #include <memory>
 #include <queue>
+#include <mutex>
 #include <stdint.h>
 
 namespace march
@@ -18,7 +19,10 @@ namespace march
     class GfxOnlineDescriptorMultiAllocator;
 
     class GfxResourceAllocator;
+    class GfxPlacedResourceAllocator;
     class GfxBufferSubAllocator;
+    class GfxBufferRingSubAllocator;
+    struct GfxBufferRingStats;
 
     struct GfxDeviceDesc
     {
@@ -39,6 +43,9 @@ namespace march
 
         void CleanupResources();
 
+        // 帧末在 CleanupResources 之后调用，在预算内整理 default heap 中的碎片
+        void DefragmentHeaps();
+
         GfxCommandManager* GetCommandManager() const { return m_CommandManager.get(); }
         GfxCommandContext* RequestContext(GfxCommandType type);
 
@@ -54,6 +61,7 @@ namespace march
         GfxResourceAllocator* GetPlacedBufferAllocator(D3D12_HEAP_TYPE heapType) const;
         GfxResourceAllocator* GetDefaultHeapPlacedTextureAllocator(bool render, bool msaa) const;
         GfxBufferSubAllocator* GetUploadHeapBufferSubAllocator(bool fastOneFrame) const;
+        const GfxBufferRingStats& GetUploadHeapBufferRingStats() const; // 上一帧从环形 buffer 上传的数据量
 
         void DeferredRelease(RefCountPtr<RefCountedObject> obj);
 
@@ -74,15 +82,17 @@ namespace march
 
         std::unique_ptr<GfxResourceAllocator> m_DefaultHeapCommittedAllocator;
         std::unique_ptr<GfxResourceAllocator> m_UploadHeapCommittedAllocator;
-        std::unique_ptr<GfxResourceAllocator> m_DefaultHeapPlacedAllocatorBuffer;
-        std::unique_ptr<GfxResourceAllocator> m_DefaultHeapPlacedAllocatorTexture;
-        std::unique_ptr<GfxResourceAllocator> m_DefaultHeapPlacedAllocatorRenderTexture;
-        std::unique_ptr<GfxResourceAllocator> m_DefaultHeapPlacedAllocatorRenderTextureMS;
+        std::unique_ptr<GfxResourceAllocator> m_ReadbackHeapCommittedAllocator;
+        std::unique_ptr<GfxPlacedResourceAllocator> m_DefaultHeapPlacedAllocatorBuffer;
+        std::unique_ptr<GfxPlacedResourceAllocator> m_DefaultHeapPlacedAllocatorTexture;
+        std::unique_ptr<GfxPlacedResourceAllocator> m_DefaultHeapPlacedAllocatorRenderTexture;
+        std::unique_ptr<GfxPlacedResourceAllocator> m_DefaultHeapPlacedAllocatorRenderTextureMS;
         std::unique_ptr<GfxResourceAllocator> m_UploadHeapPlacedAllocatorBuffer;
         std::unique_ptr<GfxBufferSubAllocator> m_UploadHeapBufferSubAllocator;
-        std::unique_ptr<GfxBufferSubAllocator> m_UploadHeapBufferSubAllocatorFastOneFrame;
+        std::unique_ptr<GfxBufferRingSubAllocator> m_UploadHeapBufferSubAllocatorFastOneFrame;
 
         std::queue<std::pair<uint64_t, RefCountPtr<RefCountedObject>>> m_ReleaseQueue;
+        std::mutex m_ReleaseQueueMutex; // 录制 command list 时可能在多个线程中释放资源
 
         void LogAdapterOutputs(IDXGIAdapter* adapter, DXGI_FORMAT format);
         void LogOutputDisplayModes(IDXGIOutput* output, DXGI_FORMAT format);
@@ -8,6 +8,7 @@
 #include <DirectXMath.h>
 #include <DirectXCollision.h>
 #include <vector>
+#include <mutex>
 
 namespace march
 {
@@ -37,6 +38,7 @@ namespace march
             , m_Vertices{}
             , m_Indices{}
             , m_IsDirty(false)
+            , m_BufferMutex{}
             , m_BufferFlags(bufferFlags)
             , m_VertexBuffer(GetGfxDevice(), "MeshVertexBuffer")
             , m_IndexBuffer(GetGfxDevice(), "MeshIndexBuffer")
@@ -115,6 +117,7 @@ namespace march
         std::vector<TVertex> m_Vertices;
         std::vector<uint16_t> m_Indices;
         bool m_IsDirty;
+        std::mutex m_BufferMutex; // 多个线程录制时可能同时 Draw 同一个 mesh
 
         GfxBufferFlags m_BufferFlags;
         GfxBuffer m_VertexBuffer;
@@ -122,6 +125,8 @@ namespace march
 
         void RecreateBuffersIfDirty()
         {
+            std::lock_guard<std::mutex> lock(m_BufferMutex);
+
             if (!m_IsDirty)
             {
                 return;
@@ -177,7 +182,12 @@ namespace march
 
         static GfxMesh* GetGeometry(GfxMeshGeometry geometry);
 
+        // 任意一个 mesh 的 Bounds 变化后加 1
+        static uint32_t GetBoundsVersion() { return s_BoundsVersion; }
+
     private:
         DirectX::BoundingBox m_Bounds; // Object space bounds
+
+        static uint32_t s_BoundsVersion;
     };
 }
@@ -311,9 +311,9 @@ namespace march
             }
         }
 
-        void SetSrvCbvBuffer(size_t type, uint32_t index, GfxBuffer* buffer, GfxBufferElement element, bool isConstantBuffer)
+        void SetSrvCbvBuffer(size_t type, uint32_t index, GfxBuffer* buffer, GfxBufferElement element, bool isConstantBuffer, uint32_t offsetInBytes = 0)
         {
-            D3D12_GPU_VIRTUAL_ADDRESS address = buffer->GetGpuVirtualAddress(element);
+            D3D12_GPU_VIRTUAL_ADDRESS address = buffer->GetGpuVirtualAddress(element) + offsetInBytes;
             m_SrvCbvBufferCache[type].Set(static_cast<size_t>(index), address, isConstantBuffer);
 
             D3D12_RESOURCE_STATES state;
@@ -492,7 +492,8 @@ namespace march
             }
         }
 
-        void UpdateSrvCbvBuffer(int32_t id, GfxBuffer* buffer, GfxBufferElement element)
+        // offsetInBytes 直接加到 root srv/cbv 的地址上，可以用来指定 buffer 中的起始位置
+        void UpdateSrvCbvBuffer(int32_t id, GfxBuffer* buffer, GfxBufferElement element, uint32_t offsetInBytes = 0)
         {
             for (size_t i = 0; i < NumProgramTypes; i++)
             {
@@ -503,7 +504,7 @@ namespace march
                         continue;
                     }
 
-                    SetSrvCbvBuffer(i, buf.RootParameterIndex, buffer, element, buf.IsConstantBuffer);
+                    SetSrvCbvBuffer(i, buf.RootParameterIndex, buffer, element, buf.IsConstantBuffer, offsetInBytes);
                 }
             }
         }
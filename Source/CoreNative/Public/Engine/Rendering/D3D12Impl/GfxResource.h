@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Engine/Memory/Allocator.h"
+#include "Engine/Memory/DefragmentationPlanner.h"
 #include "Engine/Memory/RefCounting.h"
 #include <d3dx12.h>
 #include <wrl.h>
@@ -8,6 +9,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace march
 {
@@ -18,6 +21,7 @@ namespace march
     union GfxResourceAllocation
     {
         BuddyAllocation Buddy;
+        TlsfAllocation Tlsf;
     };
 
     class GfxResource final : public RefCountedObject
@@ -35,6 +39,8 @@ namespace march
         std::unique_ptr<D3D12_RESOURCE_STATES[]> m_SubresourceStates;
 
         void* m_NsightAftermathHandle;
+        uint32_t m_Version; // 底层的 resource 被换掉后加 1，用来让缓存的 descriptor 失效
+        uint8_t* m_MappedData; // upload heap 的 buffer 创建后一直 map 着，直到析构
 
     public:
         GfxResource(GfxDevice* device, Microsoft::WRL::ComPtr<ID3D12Resource> resource, D3D12_RESOURCE_STATES state);
@@ -51,6 +57,10 @@ namespace march
         void SetState(D3D12_RESOURCE_STATES state);
         void SetState(D3D12_RESOURCE_STATES state, uint32_t subresource);
 
+        // 碎片整理时数据已经复制到 other 里，交换两者的底层 resource 和分配的内存，之后 other 持有旧的 resource，由它负责释放
+        // state 跟着底层的 resource 一起交换，是否锁定不变
+        void SwapStorage(GfxResource* other);
+
         GfxDevice* GetDevice() const { return m_Device; }
         GfxResourceAllocator* GetAllocator() const { return m_Allocator; }
         ID3D12Resource* GetD3DResource() const { return m_Resource.Get(); }
@@ -58,6 +68,11 @@ namespace march
         uint32_t GetSubresourceCount() const { return m_SubresourceCount; }
         bool IsStateLocked() const { return m_IsStateLocked; }
         bool AreAllSubresourceStatesSame() const { return m_AllStatesSame; }
+        uint32_t GetVersion() const { return m_Version; }
+
+        // 只有 upload heap 的 buffer 有，CPU 只能写入，多个线程写不同的区域是安全的
+        uint8_t* GetMappedData() const { return m_MappedData; }
+        const GfxResourceAllocation& GetAllocation() const { return m_Allocation; }
     };
 
     class GfxResourceAllocator
@@ -114,7 +129,7 @@ namespace march
 
     struct GfxPlacedResourceAllocatorDesc
     {
-        uint32_t DefaultMaxBlockSize;
+        uint32_t DefaultPageSize; // 每个 heap 的大小，放不下的资源单独创建一个刚好够大的 heap
         D3D12_HEAP_TYPE HeapType;
         D3D12_HEAP_FLAGS HeapFlags;
         bool MSAA;
@@ -133,9 +148,63 @@ namespace march
 
         void Release(const GfxResourceAllocation& allocation) override;
 
+        const std::string& GetName() const { return m_Allocator->GetName(); }
+        AllocatorFragmentationStats GetFragmentationStats();
+
+        // 增量碎片整理，只支持 default heap，每帧在主线程调用一次，此时不能有正在录制的 command list
+        // 把最空的 page 里的资源复制到规划好的其他 page，然后换掉 GfxResource 的底层 resource，旧的延迟释放
+        // 一般的资源在 copy queue 上复制，锁定为只读 state 的 texture 在 direct queue 上复制
+        // 清空的 page 不再参与分配，空了一段时间以后才销毁 heap，这期间需要新 page 时会先复用它
+        DefragStats Defragment(const DefragBudget& budget, double maxCpuMicroseconds);
+
     private:
+        // 清空的 page 要连续空这么多次 Defragment 才销毁，避免刚销毁又要创建
+        static constexpr uint32_t MinEmptyFramesBeforeRelease = 120;
+
+        struct LiveResource
+        {
+            GfxResource* Resource;
+            uint32_t SizeInBytes;
+            uint32_t Alignment;
+        };
+
+        struct EvacuatingPage
+        {
+            size_t PageIndex;
+            uint32_t NumEmptyFrames;
+        };
+
         bool m_MSAA;
         std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> m_HeapPages;
-        std::unique_ptr<MultiBuddyAllocator> m_Allocator;
+        std::unique_ptr<MultiTlsfAllocator> m_Allocator;
+        std::unordered_map<uint64_t, LiveResource> m_LiveResources; // key 由 page 和 block 组成，碎片整理时用来找到资源
+        std::vector<EvacuatingPage> m_EvacuatingPages; // 不再参与分配，等待清空
+        std::mutex m_Mutex; // 录制 command list 时可能在多个线程中分配
+
+        // 碎片整理复用内存
+        DefragmentationPlanner m_DefragPlanner;
+        std::vector<DefragPageInfo> m_DefragPages;
+        std::vector<DefragFreeBlock> m_DefragFreeBlocks;
+        std::vector<size_t> m_DefragPageIndices; // m_DefragPages 对应的 page 下标
+        std::vector<size_t> m_DefragPageRemap;   // page 下标到 m_DefragPages 下标
+        std::vector<DefragAllocationInfo> m_DefragAllocations;
+        std::vector<GfxResource*> m_DefragResources;
+
+        // destinationPageIndex 有值时只在这个 page 里分配
+        Microsoft::WRL::ComPtr<ID3D12Resource> AllocatePlacedResource(
+            const D3D12_RESOURCE_DESC* pDesc,
+            D3D12_RESOURCE_STATES initialState,
+            const D3D12_CLEAR_VALUE* pOptimizedClearValue,
+            bool allowNewPage,
+            std::optional<size_t> destinationPageIndex,
+            GfxResourceAllocation* pOutAllocation,
+            uint32_t* pOutSizeInBytes,
+            uint32_t* pOutAlignment);
+
+        void StopEvacuatingPage(size_t pageIndex);
+
+        static uint64_t GetLiveResourceKey(const TlsfAllocation& allocation);
+        static bool IsMovable(GfxResource* resource);
+        static bool IsCopiedOnDirectQueue(GfxResource* resource);
     };
 }
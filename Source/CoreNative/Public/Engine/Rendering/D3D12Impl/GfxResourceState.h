@@ -0,0 +1,28 @@
+#pragma once
+
+#include <d3dx12.h>
+
+namespace march
+{
+    struct GfxLocalStateResolveResult
+    {
+        bool NeedBarrier;                  // 需要在前一个 context 末尾补 stateBefore -> firstState 的 barrier
+        D3D12_RESOURCE_STATES FinalState;  // 写回 GfxResource 的 state
+    };
+
+    // resource state 转换的规则，纯 CPU 计算，不需要 GfxDevice
+    struct GfxResourceStateUtils final
+    {
+        // 还没有在 context 中使用过
+        static constexpr D3D12_RESOURCE_STATES LocalStateUnknown = static_cast<D3D12_RESOURCE_STATES>(-1);
+
+        // stateBefore 已经包含 stateAfter 时不需要 barrier
+        static bool NeedTransition(D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter);
+
+        // 开启 local resource state 的 context 提交前，把一个 subresource 的本地 state 和之前的 state 合并
+        // stateBefore 是之前的 context 结束时的 state，firstState 和 currentState 是在当前 context 中第一次和最后一次的 state
+        // hasLocalBarriers 表示当前 context 中有以 firstState 为起点的 barrier，这时实际的 state 必须正好是 firstState
+        static GfxLocalStateResolveResult ResolveLocalState(D3D12_RESOURCE_STATES stateBefore,
+            D3D12_RESOURCE_STATES firstState, D3D12_RESOURCE_STATES currentState, bool hasLocalBarriers);
+    };
+}
@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <unordered_map>
 #include <optional>
+#include <mutex>
 
 namespace march
 {
@@ -260,6 +261,7 @@ namespace march
         GfxTextureDesc m_Desc;
         uint32_t m_MipLevels;
         uint32_t m_SampleQuality;
+        uint32_t m_DescriptorResourceVersion; // 创建 view 时 m_Resource 的版本
 
         struct RtvDsvQuery
         {
@@ -286,8 +288,10 @@ namespace march
         std::unordered_map<uint32_t, GfxOfflineDescriptor> m_UavDescriptors[2];
         std::unordered_map<RtvDsvQuery, GfxOfflineDescriptor, RtvDsvQueryHash> m_RtvDsvDescriptors;
         std::optional<D3D12_CPU_DESCRIPTOR_HANDLE> m_SamplerDescriptor;
+        std::mutex m_DescriptorMutex; // 不同线程录制的 command list 可能同时创建 view，不随 move 转移
 
         void ReleaseResource();
+        void ReleaseDescriptorsIfResourceChanged(); // 需要持有 m_DescriptorMutex
         void CreateRtvDsv(const RtvDsvQuery& query, GfxOfflineDescriptor& rtvDsv);
     };
 
@@ -332,6 +336,11 @@ namespace march
     public:
         GfxRenderTexture(GfxDevice* device, const std::string& name, const GfxTextureDesc& desc, GfxTextureAllocStrategy allocationStrategy);
 
+        // 放在 heap 的指定位置，可以和其他资源重叠，使用前需要 aliasing barrier
+        GfxRenderTexture(GfxDevice* device, const std::string& name, const GfxTextureDesc& desc, ID3D12Heap* heap, uint64_t heapOffset);
+
         bool IsReadOnly() const override { return false; }
+
+        static D3D12_RESOURCE_ALLOCATION_INFO GetAllocationInfo(GfxDevice* device, const GfxTextureDesc& desc);
     };
 }
@@ -11,12 +11,19 @@
 #include <string>
 #include <optional>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
 
 namespace march
 {
     class GfxBuffer;
     class GfxTexture;
 
+    // 按 Id 排序，二分查找
+    template <typename T>
+    using MaterialPropertyList = std::vector<std::pair<int32_t, T>>;
+
     class Material final : public MarchObject
     {
         friend struct MaterialInternalUtility;
@@ -34,21 +41,31 @@ namespace march
         DynamicShaderKeywordSet m_Keywords{};
         bool m_IsKeywordDirty = true;
 
-        std::unordered_map<int32_t, int32_t> m_Ints{};
-        std::unordered_map<int32_t, float> m_Floats{};
-        std::unordered_map<int32_t, DirectX::XMFLOAT4> m_Vectors{};
-        std::unordered_map<int32_t, DirectX::XMFLOAT4> m_Colors{};
-        std::unordered_map<int32_t, GfxTexture*> m_Textures{};
+        MaterialPropertyList<int32_t> m_Ints{};
+        MaterialPropertyList<float> m_Floats{};
+        MaterialPropertyList<DirectX::XMFLOAT4> m_Vectors{};
+        MaterialPropertyList<DirectX::XMFLOAT4> m_Colors{};
+        MaterialPropertyList<GfxTexture*> m_Textures{};
 
+        // cbuffer 在 CPU 上的副本，布局和 shader 的 ShaderPropertyLocation 一致，setter 直接写入
+        std::vector<uint8_t> m_ConstantBufferData{};
+        bool m_IsConstantBufferLayoutDirty = true; // shader 变了，需要重新填充 m_ConstantBufferData
         std::unique_ptr<GfxBuffer> m_ConstantBuffer = nullptr;
-        bool m_IsConstantBufferDirty = true;
+        bool m_IsConstantBufferDirty = true; // m_ConstantBufferData 需要上传
 
         // 每个 pass 都有一个 ResolvedRenderState
         std::vector<ResolvedRenderState> m_ResolvedRenderStates{};
         uint32_t m_ResolvedRenderStateVersion = 0;
 
+        // 同一个 material 可能在多个线程中同时录制，保护上面的 lazy 数据，Get 方法之间会互相调用
+        std::recursive_mutex m_CacheMutex{};
+
         void CheckShaderVersion();
         void UpdateKeywords();
+        void RebuildConstantBufferData();
+
+        template <typename T>
+        void WriteConstantBufferData(int32_t id, ShaderPropertyType type, const T& value);
 
     public:
         Material() = default;
@@ -98,11 +115,11 @@ namespace march
 
     struct MaterialInternalUtility
     {
-        static const std::unordered_map<int32_t, int32_t>& GetRawInts(Material* m);
-        static const std::unordered_map<int32_t, float>& GetRawFloats(Material* m);
-        static const std::unordered_map<int32_t, DirectX::XMFLOAT4>& GetRawVectors(Material* m);
-        static const std::unordered_map<int32_t, DirectX::XMFLOAT4>& GetRawColors(Material* m);
-        static const std::unordered_map<int32_t, GfxTexture*>& GetRawTextures(Material* m);
+        static const MaterialPropertyList<int32_t>& GetRawInts(Material* m);
+        static const MaterialPropertyList<float>& GetRawFloats(Material* m);
+        static const MaterialPropertyList<DirectX::XMFLOAT4>& GetRawVectors(Material* m);
+        static const MaterialPropertyList<DirectX::XMFLOAT4>& GetRawColors(Material* m);
+        static const MaterialPropertyList<GfxTexture*>& GetRawTextures(Material* m);
         static std::vector<std::string> GetRawEnabledKeywords(Material* m);
     };
 }
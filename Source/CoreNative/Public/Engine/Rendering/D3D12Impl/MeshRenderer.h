@@ -1,20 +1,28 @@
 #pragma once
 
 #include "Engine/Component.h"
+#include "Engine/Transform.h"
 #include "Engine/Rendering/D3D12Impl/GfxMesh.h"
+#include "Engine/Rendering/D3D12Impl/GfxBuffer.h"
+#include "Engine/Rendering/CullingVolume.h"
+#include "Engine/Rendering/DrawCallSorter.h"
 #include <stdint.h>
 #include <vector>
-#include <map>
 #include <variant>
+#include <memory>
 #include <DirectXCollision.h>
 #include <DirectXMath.h>
 
 namespace march
 {
     class Material;
+    class BoundingVolumeHierarchy;
+    class RenderPipeline;
 
-    class MeshRenderer : public Component
+    class MeshRenderer : public Component, public TransformChangeListener
     {
+        friend class RenderPipeline;
+
     public:
         GfxMesh* Mesh;
         std::vector<Material*> Materials;
@@ -29,8 +37,21 @@ namespace march
 
         void PrepareFrameData();
 
+        // 修改 Mesh 以后调用，让 RenderPipeline 重新计算 Bounds
+        void MarkBoundsDirty();
+
+    protected:
+        void OnTransformChanged() override;
+
     private:
         DirectX::XMFLOAT4X4 m_PrevLocalToWorldMatrix;
+
+        // 以下由 RenderPipeline 维护，没有加入 RenderPipeline 时 m_Pipeline 是 nullptr
+        static constexpr uint32_t InvalidIndex = UINT32_MAX;
+        RenderPipeline* m_Pipeline;
+        uint32_t m_PipelineIndex; // 在 RenderPipeline 的 renderer 列表中的索引
+        uint32_t m_DirtyIndex; // 在 RenderPipeline 的脏 renderer 列表中的索引，Bounds 不脏时是 InvalidIndex
+        uint32_t m_BVHLeaf; // 在 BVH 中的叶子节点
     };
 
     class MeshRendererBatch
@@ -39,22 +60,26 @@ namespace march
         // 相同的可以合批，使用 GPU instancing 绘制
         struct DrawCall
         {
+            uint64_t Key; // 第一个 instance 的 DrawCallSortItem::Key，只在这一帧内有意义
             Material* Mat;
             GfxMesh* Mesh;
             uint32_t SubMeshIndex;
             bool HasOddNegativeScaling;
 
-            bool operator<(const DrawCall& other) const;
+            // 在 GetInstances() 中的范围
+            uint32_t FirstInstance;
+            uint32_t InstanceCount;
         };
 
+        // 和 Common.hlsl 中的 InstanceData 保持一致
+        // 只存仿射矩阵的前三行（列向量约定），最后一行是 (0, 0, 0, 1)
+        // 法线用的逆转置矩阵和 OddNegativeScale 都在 shader 里算，CPU 不用每帧求逆
         struct InstanceData
         {
-            DirectX::XMFLOAT4X4 Matrix;
-            DirectX::XMFLOAT4X4 MatrixIT; // 逆转置，用于法线变换
-            DirectX::XMFLOAT4X4 MatrixPrev; // 上一帧的矩阵
-            DirectX::XMFLOAT4 Params; // x: OddNegativeScale
+            DirectX::XMFLOAT3X4 Matrix;
+            DirectX::XMFLOAT3X4 MatrixPrev; // 上一帧的矩阵
 
-            bool HasOddNegativeScaling() const { return Params.x < 0.0f; }
+            bool HasOddNegativeScaling() const;
 
             static InstanceData Create(const MeshRenderer* renderer);
             static InstanceData Create(const DirectX::XMFLOAT4X4& currMatrix, const DirectX::XMFLOAT4X4& prevMatrix);
@@ -62,13 +87,41 @@ namespace march
 
         using FrustumType = std::variant<DirectX::BoundingFrustum, DirectX::BoundingBox, DirectX::BoundingOrientedBox, DirectX::BoundingSphere>;
 
-        void Rebuild(const FrustumType& frustum, size_t numRenderers, MeshRenderer* const* renderers);
+        // bvh 的叶子节点的 UserData 是 MeshRenderer*
+        void Rebuild(const FrustumType& frustum, const BoundingVolumeHierarchy& bvh);
+
+        // 按 Shader / Material / Mesh / HasOddNegativeScaling / SubMeshIndex 排序
+        const std::vector<DrawCall>& GetDrawCalls() const { return m_DrawCalls; }
+        const std::vector<InstanceData>& GetInstances() const { return m_Instances; }
 
-        const auto& GetDrawCalls() const { return m_DrawCalls; }
+        // Rebuild 时把所有 instance 上传到这一个 buffer 中，只在这一帧有效，draw call 用 FirstInstance 作为偏移
+        GfxBuffer* GetInstanceBuffer() const { return m_InstanceBuffer.get(); }
 
         const auto& GetMeshInputDesc() const { return std::remove_pointer_t<decltype(MeshRenderer::Mesh)>::GetInputDesc(); }
 
     private:
-        std::map<DrawCall, std::vector<InstanceData>> m_DrawCalls{};
+        // 每棵子树一个，线程之间互不干扰
+        struct CullContext
+        {
+            std::vector<MeshRenderer*> Results;
+            std::vector<MeshRenderer*> Candidates; // 和 BVH 中间节点相交，还需要用 SIMD 再测试一次
+            BoundingBoxSoA CandidateBounds;
+            std::vector<uint32_t> VisibleIndices;
+        };
+
+        std::vector<MeshRenderer*> m_VisibleRenderers{};
+        std::vector<uint32_t> m_CullSubtrees{};
+        std::vector<CullContext> m_CullContexts{};
+        std::vector<InstanceData> m_RendererInstances{}; // 每个可见 renderer 一个
+        DrawCallSorter m_Sorter{}; // RendererIndex 是在 m_VisibleRenderers 中的索引
+
+        std::vector<DrawCall> m_DrawCalls{};
+        std::vector<InstanceData> m_Instances{};
+        std::unique_ptr<GfxBuffer> m_InstanceBuffer = nullptr;
+
+        void CullMeshRenderers(const FrustumType& frustum, const BoundingVolumeHierarchy& bvh);
+
+        template <typename Volume>
+        static void CullSubtree(CullContext& context, const Volume& volume, const CullingVolume& cullingVolume, const BoundingVolumeHierarchy& bvh, uint32_t root);
     };
 }
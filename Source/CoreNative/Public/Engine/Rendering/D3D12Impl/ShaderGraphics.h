@@ -126,6 +126,15 @@ namespace march
         uint32_t Size;
     };
 
+    // 在 cbuffer 中有位置的 shader property
+    struct ShaderConstantBufferProperty
+    {
+        int32_t Id;
+        ShaderPropertyType Type;
+        uint32_t Offset;
+        uint32_t Size;
+    };
+
     template <typename T>
     struct ShaderPassVar
     {
@@ -225,9 +234,11 @@ namespace march
         std::unordered_map<int32_t, ShaderProperty> m_Properties{};
         std::unordered_map<int32_t, ShaderPropertyLocation> m_PropertyLocations{}; // shader property 在 cbuffer 中的位置
         uint32_t m_MaterialConstantBufferSize = 0;
+        std::vector<ShaderConstantBufferProperty> m_ConstantBufferProperties{}; // 按 Id 排序，二分查找
 
         std::vector<std::unique_ptr<ShaderPass>> m_Passes{};
 
+        void RebuildConstantBufferProperties();
         bool CompilePass(size_t passIndex, const std::string& filename, const std::string& source, const std::vector<std::string>& pragmas, std::vector<std::string>& warnings, std::string& error);
 
     public:
@@ -239,6 +250,8 @@ namespace march
         const std::unordered_map<int32_t, ShaderProperty>& GetProperties() const { return m_Properties; }
         const std::unordered_map<int32_t, ShaderPropertyLocation>& GetPropertyLocations() const { return m_PropertyLocations; }
         uint32_t GetMaterialConstantBufferSize() const { return m_MaterialConstantBufferSize; }
+        const std::vector<ShaderConstantBufferProperty>& GetConstantBufferProperties() const { return m_ConstantBufferProperties; }
+        const ShaderConstantBufferProperty* FindConstantBufferProperty(int32_t id) const;
 
         ShaderPass* GetPass(size_t index) const { return m_Passes[index].get(); }
         size_t GetPassCount() const { return m_Passes.size(); }
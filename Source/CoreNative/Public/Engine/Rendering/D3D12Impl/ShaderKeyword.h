@@ -40,8 +40,12 @@ namespace march
     {
         friend ::std::hash<ShaderKeywordSet>;
 
+    public:
+        using BitsType = std::bitset<ShaderKeywordSpace::NumMaxKeywords>;
+
+    private:
         const ShaderKeywordSpace* m_Space = nullptr;
-        std::bitset<ShaderKeywordSpace::NumMaxKeywords> m_Keywords{};
+        BitsType m_Keywords{};
 
     public:
         std::vector<std::string> GetEnabledKeywordStringsInSpace() const;
@@ -66,6 +70,10 @@ namespace march
             m_Keywords.reset();
         }
 
+        // 第 i 位表示 KeywordSpace 中索引为 i 的 Keyword 是否启用
+        const BitsType& GetBits() const { return m_Keywords; }
+        void SetBits(const BitsType& bits) { m_Keywords = bits; }
+
         size_t GetNumEnabledKeywords() const
         {
             return m_Keywords.count();
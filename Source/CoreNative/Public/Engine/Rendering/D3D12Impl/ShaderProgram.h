@@ -7,6 +7,7 @@
 #include "Engine/Rendering/D3D12Impl/GfxException.h"
 #include "Engine/Rendering/D3D12Impl/ShaderUtils.h"
 #include "Engine/Rendering/D3D12Impl/ShaderKeyword.h"
+#include "Engine/Rendering/D3D12Impl/ShaderVariantLookup.h"
 #include "Engine/Misc/PlatformUtils.h"
 #include <d3dx12.h>
 #include <d3d12shader.h> // Shader reflection
@@ -18,6 +19,8 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <limits>
 #include <functional>
 #include <algorithm>
@@ -195,35 +198,32 @@ namespace march
         std::unordered_map<ShaderKeywordSet, ProgramMatch> m_ProgramMatches{};
         std::unordered_map<size_t, std::unique_ptr<RootSignatureType>> m_RootSignatures{};
         std::unordered_map<size_t, Microsoft::WRL::ComPtr<ID3D12PipelineState>> m_PipelineStates{};
+        std::shared_mutex m_RootSignatureMutex{};
+        std::shared_mutex m_PipelineStateMutex{}; // 先锁 PSO 再锁 root signature
 
+        // 可以在多个线程中调用，返回的引用一直有效
         const ProgramMatch& GetProgramMatch(const ShaderKeywordSet& keywords)
         {
+            {
+                std::shared_lock<std::shared_mutex> lock(m_ProgramMatchMutex);
+
+                if (auto it = m_ProgramMatches.find(keywords); it != m_ProgramMatches.end())
+                {
+                    return it->second;
+                }
+            }
+
+            std::unique_lock<std::shared_mutex> lock(m_ProgramMatchMutex);
             auto [it, isNew] = m_ProgramMatches.try_emplace(keywords);
 
             if (isNew)
             {
                 DefaultHash hash{};
                 ProgramMatch& m = it->second;
-                size_t targetKeywordCount = keywords.GetNumEnabledKeywords();
 
                 for (size_t i = 0; i < NumProgramTypes; i++)
                 {
-                    size_t minDiff = std::numeric_limits<size_t>::max();
-                    m.Indices[i] = std::nullopt;
-
-                    for (size_t j = 0; j < m_Programs[i].size(); j++)
-                    {
-                        const ShaderKeywordSet& ks = m_Programs[i][j]->GetKeywords();
-                        size_t matchingCount = ks.GetNumMatchingKeywords(keywords);
-                        size_t currentKeywordCount = ks.GetNumEnabledKeywords();
-
-                        // diff = 没 match 的数量 + 多余的数量
-                        if (size_t diff = targetKeywordCount + currentKeywordCount - 2 * matchingCount; diff < minDiff)
-                        {
-                            minDiff = diff;
-                            m.Indices[i] = j;
-                        }
-                    }
+                    m.Indices[i] = FindProgram(i, keywords);
 
                     if (m.Indices[i])
                     {
@@ -237,6 +237,29 @@ namespace march
             return it->second;
         }
 
+    private:
+        std::shared_mutex m_ProgramMatchMutex{}; // 保护 m_ProgramMatches 和 m_ProgramLookups
+        ShaderVariantLookup m_ProgramLookups[NumProgramTypes]{};
+
+        // 找到 keyword 差异最小的 program，差异相同时使用索引最小的
+        std::optional<size_t> FindProgram(size_t programType, const ShaderKeywordSet& keywords)
+        {
+            const std::vector<std::unique_ptr<ShaderProgram>>& programs = m_Programs[programType];
+            ShaderVariantLookup& lookup = m_ProgramLookups[programType];
+
+            if (lookup.GetNumVariants() != programs.size())
+            {
+                lookup.Reset();
+
+                for (const std::unique_ptr<ShaderProgram>& program : programs)
+                {
+                    lookup.Add(program->GetKeywords());
+                }
+            }
+
+            return lookup.Find(keywords);
+        }
+
     public:
         const std::string& GetName() const { return m_Name; }
 
@@ -374,6 +397,18 @@ namespace march
     {
         const ProgramMatch& m = GetProgramMatch(keywords);
 
+        {
+            std::shared_lock<std::shared_mutex> lock(m_RootSignatureMutex);
+
+            if (auto it = m_RootSignatures.find(m.Hash); it != m_RootSignatures.end())
+            {
+                return it->second.get();
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(m_RootSignatureMutex);
+
+        // 等锁的时候可能已经被其他线程创建了
         if (auto it = m_RootSignatures.find(m.Hash); it != m_RootSignatures.end())
         {
             return it->second.get();
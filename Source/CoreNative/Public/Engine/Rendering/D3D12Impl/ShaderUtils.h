@@ -3,13 +3,40 @@
 #include "Engine/Ints.h"
 #include <dxcapi.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace march
 {
+    // 预先算好 hash 的字符串，用字面量构造时可以在编译期算出 hash
+    // 例如 static constexpr ShaderStringKey key("_MainTex");
+    struct ShaderStringKey
+    {
+        std::string_view Str;
+        uint64 Hash;
+
+        // FNV-1a
+        static constexpr uint64 ComputeHash(std::string_view str)
+        {
+            uint64 hash = 14695981039346656037ull;
+
+            for (char c : str)
+            {
+                hash ^= static_cast<uint8>(c);
+                hash *= 1099511628211ull;
+            }
+
+            return hash;
+        }
+
+        constexpr explicit ShaderStringKey(std::string_view str) : Str(str), Hash(ComputeHash(str)) {}
+    };
+
     struct ShaderUtils
     {
-        static int32 GetIdFromString(const std::string& str);
+        // 这几个函数都是线程安全的，返回的 id 从 0 开始连续分配，string 引用一直有效
+        static int32 GetIdFromString(std::string_view str);
+        static int32 GetIdFromString(const ShaderStringKey& key);
         static const std::string& GetStringFromId(int32 id);
 
         static IDxcUtils* GetDxcUtils();
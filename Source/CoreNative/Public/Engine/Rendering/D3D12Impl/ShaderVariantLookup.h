@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Engine/Rendering/D3D12Impl/ShaderKeyword.h"
+#include <unordered_map>
+#include <optional>
+#include <vector>
+
+namespace march
+{
+    // 找到 keyword 差异最小的 variant，差异 = 没 match 的数量 + 多余的数量
+    // 差异相同时返回索引最小的 variant，和线性查找的结果完全一样
+    class ShaderVariantLookup
+    {
+    public:
+        void Reset();
+        void Add(const ShaderKeywordSet& keywords); // 索引按添加的顺序
+
+        size_t GetNumVariants() const { return m_Variants.size(); }
+
+        // 第一次查找时构建索引
+        std::optional<size_t> Find(const ShaderKeywordSet& keywords);
+
+    private:
+        // 差异相同的组合数超过这个值时，列举组合不比线性查找快
+        static constexpr size_t MaxTiedCombinations = 64;
+
+        std::vector<ShaderKeywordSet> m_Variants{};
+        bool m_IsBuilt = false;
+
+        std::unordered_map<ShaderKeywordSet, size_t> m_ExactMatches{};
+
+        // 如果所有 variant 正好是各个 multi_compile 维度的笛卡尔积，每个维度可以单独选出最接近的 keyword
+        bool m_IsCartesianProduct = false;
+        const ShaderKeywordSpace* m_KeywordSpace = nullptr;
+        std::vector<std::vector<size_t>> m_Dimensions{}; // 每个维度中 keyword 的索引
+        std::vector<bool> m_DimensionHasEmptyOption{};   // 维度中是否有 _ 选项
+
+        void Build();
+        std::optional<size_t> FindInCartesianProduct(const ShaderKeywordSet& keywords) const;
+        std::optional<size_t> FindLinear(const ShaderKeywordSet& keywords) const;
+    };
+}
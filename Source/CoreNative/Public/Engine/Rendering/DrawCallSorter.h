@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace march
+{
+    struct DrawCallSortItem
+    {
+        uint64_t Key;           // 没有溢出时是打包的排序键，溢出时是 Add 的顺序
+        uint32_t RendererIndex;
+        uint32_t SubMeshIndex;
+    };
+
+    // 按 Shader / Material / Mesh / HasOddNegativeScaling / SubMeshIndex 排序，相同的可以合成一个 draw call
+    // 指针映射为连续的 id 后打包成 64 位的键做基数排序，id 超出位宽时退回到逐个字段比较
+    // 只处理指针和下标，不依赖 GfxDevice，方便单独测试
+    class DrawCallSorter final
+    {
+    public:
+        // 排序键从高到低：Shader (12) | Material (20) | Mesh (20) | HasOddNegativeScaling (1) | SubMeshIndex (11)
+        static constexpr uint32_t SubMeshIndexBits = 11;
+        static constexpr uint32_t OddNegativeScalingBits = 1;
+        static constexpr uint32_t MeshIdBits = 20;
+        static constexpr uint32_t MaterialIdBits = 20;
+        static constexpr uint32_t ShaderIdBits = 12;
+
+        // 清空但保留内存
+        void Clear();
+
+        // 同一个 renderer 的 sub mesh 要连续添加，renderer 按 rendererIndex 从小到大添加
+        void Add(const void* shader, const void* material, const void* mesh, bool hasOddNegativeScaling, uint32_t subMeshIndex, uint32_t rendererIndex);
+
+        // 相同的键之间保持添加的顺序
+        void Sort();
+
+        const std::vector<DrawCallSortItem>& GetItems() const { return m_Items; }
+
+        // 排序后的两个 item 能否合成一个 draw call
+        bool IsSameDrawCall(const DrawCallSortItem& a, const DrawCallSortItem& b) const;
+
+        // 这一次是否因为 id 超出位宽而退回到逐个字段比较
+        bool IsUsingWideKeys() const { return m_IsKeyOverflowed; }
+
+    private:
+        // 把指针映射为连续的 id，开放寻址，每帧清空但保留内存
+        class PointerIdMap
+        {
+        public:
+            uint32_t GetOrAdd(const void* ptr);
+            void Clear();
+
+        private:
+            std::vector<std::pair<const void*, uint32_t>> m_Slots{};
+            uint32_t m_Count = 0;
+
+            void Grow();
+        };
+
+        // 和打包的键顺序相同，但每个字段都有 32 位
+        struct WideKey
+        {
+            uint64_t High; // Shader (32) | Material (32)
+            uint64_t Low;  // Mesh (32) | HasOddNegativeScaling (1) | SubMeshIndex (31)
+
+            bool operator==(const WideKey& other) const { return High == other.High && Low == other.Low; }
+            bool operator<(const WideKey& other) const { return High < other.High || (High == other.High && Low < other.Low); }
+        };
+
+        PointerIdMap m_ShaderIds{};
+        PointerIdMap m_MaterialIds{};
+        PointerIdMap m_MeshIds{};
+
+        std::vector<DrawCallSortItem> m_Items{};
+        std::vector<WideKey> m_WideKeys{}; // 按 Add 的顺序，只在溢出时使用
+        bool m_IsKeyOverflowed = false;
+
+        std::vector<DrawCallSortItem> m_Scratch{};
+        std::vector<uint32_t> m_Histograms{};
+
+        void RadixSort();
+        void WideSort();
+    };
+}
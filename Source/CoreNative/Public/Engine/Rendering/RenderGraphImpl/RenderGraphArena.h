@@ -0,0 +1,322 @@
+#pragma once
+
+#include "Engine/Memory/Allocator.h"
+#include <cstddef>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <assert.h>
+
+namespace march
+{
+    // 每帧重置一次的线性分配器，内存页在帧之间复用，稳定以后不会再从堆上分配内存
+    // 内存不会单独释放，里面的对象要么能 trivially destruct，要么由使用者自己调用析构函数
+    class RenderGraphArena final
+    {
+    public:
+        RenderGraphArena(uint32_t pageSize = 64 * 1024);
+
+        RenderGraphArena(const RenderGraphArena&) = delete;
+        RenderGraphArena& operator=(const RenderGraphArena&) = delete;
+
+        // 之前分配的内存全部失效
+        void Reset();
+
+        void* Allocate(size_t sizeInBytes, size_t alignment);
+
+        template <typename T>
+        T* AllocateArray(size_t count)
+        {
+            return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+        }
+
+        // 复制到 arena 里，末尾会加上 '\0'
+        std::string_view AllocateString(std::string_view str);
+
+    private:
+        struct LargePage
+        {
+            std::unique_ptr<uint8_t[]> Data;
+            uint32_t SizeInBytes;
+            bool IsUsed;
+        };
+
+        LinearAllocator m_Allocator;
+        std::vector<std::unique_ptr<uint8_t[]>> m_Pages;
+        size_t m_NumUsedPages;
+        std::vector<LargePage> m_LargePages;
+
+        size_t RequestPage(uint32_t sizeInBytes, bool large, bool* pOutIsNew);
+    };
+
+    // 元素少的时候放在对象内部，超出以后放到 arena 里，只能存放 trivially copyable 的类型
+    // 不能在 arena 重置以后继续使用
+    template <typename T, size_t _InlineCapacity>
+    class RenderGraphSmallVector
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "RenderGraphSmallVector only supports trivially copyable types");
+
+    public:
+        using ElementType = T;
+
+        RenderGraphSmallVector() = default;
+
+        RenderGraphSmallVector(const RenderGraphSmallVector&) = delete;
+        RenderGraphSmallVector& operator=(const RenderGraphSmallVector&) = delete;
+
+        RenderGraphSmallVector(RenderGraphSmallVector&&) = default;
+        RenderGraphSmallVector& operator=(RenderGraphSmallVector&&) = default;
+
+        size_t Num() const { return m_Num; }
+        bool IsEmpty() const { return m_Num == 0; }
+
+        // 不会释放内存
+        void Clear() { m_Num = 0; }
+
+        void Append(const ElementType& value, RenderGraphArena& arena)
+        {
+            if (m_Num == m_Capacity)
+            {
+                Grow(arena);
+            }
+
+            GetData()[m_Num++] = value;
+        }
+
+        template <typename _Iterator>
+        void Assign(_Iterator first, _Iterator last, RenderGraphArena& arena)
+        {
+            Clear();
+
+            for (; first != last; ++first)
+            {
+                Append(*first, arena);
+            }
+        }
+
+        ElementType& operator[](size_t index)
+        {
+            assert(index < m_Num);
+            return GetData()[index];
+        }
+
+        const ElementType& operator[](size_t index) const
+        {
+            assert(index < m_Num);
+            return GetData()[index];
+        }
+
+        ElementType* begin() { return GetData(); }
+        ElementType* end() { return GetData() + m_Num; }
+        const ElementType* begin() const { return GetData(); }
+        const ElementType* end() const { return GetData() + m_Num; }
+
+    private:
+        ElementType m_InlineData[_InlineCapacity]{};
+        ElementType* m_ArenaData = nullptr; // 为空时使用 m_InlineData，这样移动对象时不用修正指针
+        uint32_t m_Num = 0;
+        uint32_t m_Capacity = static_cast<uint32_t>(_InlineCapacity);
+
+        ElementType* GetData() { return m_ArenaData ? m_ArenaData : m_InlineData; }
+        const ElementType* GetData() const { return m_ArenaData ? m_ArenaData : m_InlineData; }
+
+        void Grow(RenderGraphArena& arena)
+        {
+            // 旧的内存等 arena 重置时一起回收
+            uint32_t capacity = m_Capacity * 2;
+            ElementType* data = arena.AllocateArray<ElementType>(capacity);
+            memcpy(data, GetData(), sizeof(ElementType) * m_Num);
+
+            m_ArenaData = data;
+            m_Capacity = capacity;
+        }
+    };
+
+    // 用数组实现的 map，元素很少时比 unordered_map 快，并且按插入顺序遍历
+    template <typename _Key, typename _Value, size_t _InlineCapacity>
+    class RenderGraphSmallMap
+    {
+    public:
+        struct Entry
+        {
+            _Key Key;
+            _Value Value;
+        };
+
+        size_t Num() const { return m_Entries.Num(); }
+        bool IsEmpty() const { return m_Entries.IsEmpty(); }
+        void Clear() { m_Entries.Clear(); }
+
+        bool Contains(const _Key& key) const { return Find(key) != nullptr; }
+
+        const _Value* Find(const _Key& key) const
+        {
+            for (const Entry& e : m_Entries)
+            {
+                if (e.Key == key)
+                {
+                    return &e.Value;
+                }
+            }
+
+            return nullptr;
+        }
+
+        // 不存在时插入一个值初始化的 value
+        _Value& GetOrAdd(const _Key& key, RenderGraphArena& arena)
+        {
+            for (Entry& e : m_Entries)
+            {
+                if (e.Key == key)
+                {
+                    return e.Value;
+                }
+            }
+
+            m_Entries.Append(Entry{ key, _Value{} }, arena);
+            return m_Entries[m_Entries.Num() - 1].Value;
+        }
+
+        Entry* begin() { return m_Entries.begin(); }
+        Entry* end() { return m_Entries.end(); }
+        const Entry* begin() const { return m_Entries.begin(); }
+        const Entry* end() const { return m_Entries.end(); }
+
+    private:
+        RenderGraphSmallVector<Entry, _InlineCapacity> m_Entries{};
+    };
+
+    template <typename _Signature, size_t _InlineSize = 64>
+    class RenderGraphFunction;
+
+    // 和 std::function 类似，但一般的 lambda 直接放在对象内部，太大的放到 arena 里，不会从堆上分配内存
+    template <typename _Ret, typename... _Args, size_t _InlineSize>
+    class RenderGraphFunction<_Ret(_Args...), _InlineSize>
+    {
+    public:
+        RenderGraphFunction() = default;
+        ~RenderGraphFunction() { Reset(); }
+
+        RenderGraphFunction(const RenderGraphFunction&) = delete;
+        RenderGraphFunction& operator=(const RenderGraphFunction&) = delete;
+
+        RenderGraphFunction(RenderGraphFunction&& other) noexcept
+        {
+            MoveFrom(other);
+        }
+
+        RenderGraphFunction& operator=(RenderGraphFunction&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                MoveFrom(other);
+            }
+
+            return *this;
+        }
+
+        template <typename _Func>
+        void Set(_Func&& func, RenderGraphArena& arena)
+        {
+            using FuncType = std::decay_t<_Func>;
+
+            Reset();
+
+            if constexpr (sizeof(FuncType) <= _InlineSize && alignof(FuncType) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<FuncType>)
+            {
+                m_Func = new (m_InlineStorage) FuncType(std::forward<_Func>(func));
+                m_Ops = &s_InlineOps<FuncType>;
+            }
+            else
+            {
+                void* memory = arena.Allocate(sizeof(FuncType), alignof(FuncType));
+                m_Func = new (memory) FuncType(std::forward<_Func>(func));
+                m_Ops = &s_ArenaOps<FuncType>;
+            }
+        }
+
+        void Reset()
+        {
+            if (m_Ops != nullptr)
+            {
+                m_Ops->Destroy(m_Func);
+                m_Ops = nullptr;
+                m_Func = nullptr;
+            }
+        }
+
+        explicit operator bool() const { return m_Ops != nullptr; }
+
+        _Ret operator()(_Args... args) const
+        {
+            assert(m_Ops != nullptr);
+            return m_Ops->Invoke(m_Func, std::forward<_Args>(args)...);
+        }
+
+    private:
+        struct Ops
+        {
+            _Ret(*Invoke)(void* func, _Args&&... args);
+            void(*Move)(void* src, void* dst); // 放在 arena 里的不需要移动，直接复制指针
+            void(*Destroy)(void* func);
+        };
+
+        template <typename _Func>
+        static _Ret InvokeImpl(void* func, _Args&&... args)
+        {
+            return (*static_cast<_Func*>(func))(std::forward<_Args>(args)...);
+        }
+
+        template <typename _Func>
+        static void MoveImpl(void* src, void* dst)
+        {
+            new (dst) _Func(std::move(*static_cast<_Func*>(src)));
+            static_cast<_Func*>(src)->~_Func();
+        }
+
+        template <typename _Func>
+        static void DestroyImpl(void* func)
+        {
+            static_cast<_Func*>(func)->~_Func();
+        }
+
+        template <typename _Func>
+        static constexpr Ops s_InlineOps = { &InvokeImpl<_Func>, &MoveImpl<_Func>, &DestroyImpl<_Func> };
+
+        template <typename _Func>
+        static constexpr Ops s_ArenaOps = { &InvokeImpl<_Func>, nullptr, &DestroyImpl<_Func> };
+
+        alignas(std::max_align_t) uint8_t m_InlineStorage[_InlineSize];
+        void* m_Func = nullptr;
+        const Ops* m_Ops = nullptr;
+
+        void MoveFrom(RenderGraphFunction& other)
+        {
+            if (other.m_Ops == nullptr)
+            {
+                return;
+            }
+
+            m_Ops = other.m_Ops;
+
+            if (m_Ops->Move != nullptr)
+            {
+                m_Ops->Move(other.m_Func, m_InlineStorage);
+                m_Func = m_InlineStorage;
+            }
+            else
+            {
+                m_Func = other.m_Func;
+            }
+
+            other.m_Ops = nullptr;
+            other.m_Func = nullptr;
+        }
+    };
+}
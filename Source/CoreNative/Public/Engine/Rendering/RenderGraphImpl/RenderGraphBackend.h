@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Engine/Rendering/D3D12.h"
+#include <stdint.h>
+
+namespace march
+{
+    // RenderGraph 编译时只需要这些信息，实际创建资源和录制命令由 CanExecute() 决定是否进行
+    class IRenderGraphBackend
+    {
+    public:
+        virtual ~IRenderGraphBackend() = default;
+
+        // 返回 false 时只编译，不创建资源，也不录制和提交命令
+        virtual bool CanExecute() const = 0;
+
+        // pool 用来判断资源多久没被使用，每帧至少加 1
+        virtual uint64_t GetFrameIndex() const = 0;
+
+        // transient texture 在 heap 中占用的大小和对齐
+        virtual D3D12_RESOURCE_ALLOCATION_INFO GetTextureAllocationInfo(const GfxTextureDesc& desc) const = 0;
+    };
+
+    // 默认的 backend，使用 GetGfxDevice()
+    class RenderGraphD3D12Backend final : public IRenderGraphBackend
+    {
+    public:
+        bool CanExecute() const override { return true; }
+        uint64_t GetFrameIndex() const override;
+        D3D12_RESOURCE_ALLOCATION_INFO GetTextureAllocationInfo(const GfxTextureDesc& desc) const override;
+    };
+
+    // 不需要 GfxDevice，用于在没有 GPU 的机器上测试编译结果（剔除、async compute、生命周期等）和编译的性能
+    // 导入外部资源时只能用 desc，见 RenderGraph::ImportBuffer 和 RenderGraph::ImportTexture
+    class RenderGraphNullBackend final : public IRenderGraphBackend
+    {
+        uint64_t m_FrameIndex = 0;
+
+    public:
+        bool CanExecute() const override { return false; }
+        uint64_t GetFrameIndex() const override { return m_FrameIndex; }
+        D3D12_RESOURCE_ALLOCATION_INFO GetTextureAllocationInfo(const GfxTextureDesc& desc) const override;
+
+        void AdvanceFrame() { m_FrameIndex++; }
+    };
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace march
+{
+    // 和 D3D12_RESOURCE_STATES 无关的资源状态，由 RenderGraph 转换成实际的 state
+    enum class RenderGraphBarrierState : uint32_t
+    {
+        Unknown = 0, // 录制时才知道需要的 state，planner 不处理
+
+        ShaderResource = 1 << 0,  // 只读
+        DepthRead = 1 << 1,       // 只读
+        UnorderedAccess = 1 << 2,
+        RenderTarget = 1 << 3,
+        DepthWrite = 1 << 4,
+    };
+
+    struct RenderGraphBarrierPassInfo
+    {
+        bool IsCulled;
+        bool IsAsyncCompute;    // async compute pass 的 barrier 由 RenderGraph 单独处理
+        bool StartsCommandList; // 会在新的 command list 中录制，split barrier 不能跨过它
+    };
+
+    struct RenderGraphBarrierUse
+    {
+        size_t ResourceIndex;
+        size_t PassIndex;
+        RenderGraphBarrierState State;
+    };
+
+    enum class RenderGraphBarrierType
+    {
+        Full,       // pass 开始前
+        BeginSplit, // pass 结束后
+        EndSplit,   // pass 开始前
+    };
+
+    struct RenderGraphPlannedBarrier
+    {
+        size_t ResourceIndex;
+        size_t PassIndex;
+        RenderGraphBarrierState StateAfter; // 多个只读 state 可能合在一起
+        RenderGraphBarrierType Type;
+    };
+
+    struct RenderGraphBarrierStats
+    {
+        uint32_t NumFullBarriers = 0;
+        uint32_t NumSplitBarriers = 0;
+        uint32_t NumFoldedTransitions = 0; // 状态没变（例如连续读取）而省掉的 barrier
+    };
+
+    // 根据每个 pass 对资源的读写，在编译时算出每个 pass 前后需要的 barrier
+    // 纯 CPU 计算，不依赖 D3D12，方便单独测试
+    class RenderGraphBarrierPlanner final
+    {
+    public:
+        // 连续的只读使用会合并成一次 barrier；前一次使用和这次之间有空闲的 pass 时，使用 split barrier
+        void Plan(const std::vector<RenderGraphBarrierPassInfo>& passes, const std::vector<RenderGraphBarrierUse>& uses);
+
+        const std::vector<RenderGraphPlannedBarrier>& GetBarriers() const { return m_Barriers; }
+        const RenderGraphBarrierStats& GetStats() const { return m_Stats; }
+
+        static bool IsReadOnlyState(RenderGraphBarrierState state);
+
+    private:
+        std::vector<RenderGraphPlannedBarrier> m_Barriers{};
+        RenderGraphBarrierStats m_Stats{};
+
+        std::vector<size_t> m_SortedUses{}; // 复用内存
+
+        bool CanSplit(const std::vector<RenderGraphBarrierPassInfo>& passes, size_t fromPassIndex, size_t toPassIndex) const;
+    };
+}
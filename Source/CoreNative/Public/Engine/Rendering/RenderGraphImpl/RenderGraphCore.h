@@ -4,14 +4,21 @@
 #include "Engine/InlineArray.h"
 #include "Engine/Rendering/D3D12.h"
 #include "Engine/Rendering/RenderGraphImpl/RenderGraphResource.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphArena.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBarrierPlanner.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphPassScheduler.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphProfiler.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
 #include <d3dx12.h>
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <functional>
+#include <exception>
 #include <DirectXColors.h>
 
 namespace march
@@ -64,15 +71,18 @@ namespace march
         // Config Data
         // -----------------------
 
-        std::string Name{};
+        std::string_view Name{}; // 保存在 arena 里，以 '\0' 结尾
 
         bool HasSideEffects = false; // 如果写入了 external resource，就有副作用
         bool AllowPassCulling = true;
         bool EnableAsyncCompute = false; // 只是一个建议，会根据实际情况决定是否启用 async-compute
         bool UseDefaultVariables = true;
+        bool AllowParallelRecording = false; // RenderFunc 可能在 worker 线程中执行，不能调用 C# 代码
+        double EstimatedCost = 0; // 用户估计的 GPU 耗时（微秒），为 0 时使用 profiler 记录的时间
 
-        std::unordered_map<size_t, RenderGraphPassResourceUsages> ResourcesIn{};  // 所有输入的资源，包括 render target
-        std::unordered_map<size_t, RenderGraphPassResourceUsages> ResourcesOut{}; // 所有输出的资源，包括 render target
+        // pass 和资源的数据每帧都会重新构建，所以容器都用 arena 分配内存，key 是 resource index
+        RenderGraphSmallMap<size_t, RenderGraphPassResourceUsages, 8> ResourcesIn{};  // 所有输入的资源，包括 render target
+        RenderGraphSmallMap<size_t, RenderGraphPassResourceUsages, 8> ResourcesOut{}; // 所有输出的资源，包括 render target
 
         uint32_t NumColorTargets = 0;
         RenderGraphPassColorTarget ColorTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
@@ -91,7 +101,7 @@ namespace march
 
         bool Wireframe = false;
 
-        std::function<void(RenderGraphContext&)> RenderFunc{};
+        RenderGraphFunction<void(RenderGraphContext&)> RenderFunc{};
 
         // -----------------------
         // Runtime Data
@@ -100,15 +110,22 @@ namespace march
         bool IsVisited = false;
         bool IsCulled = false;
 
-        std::unordered_set<size_t> NextPassIndices{}; // 后继结点
-        std::vector<size_t> ResourcesBorn{};          // 生命周期从本结点开始的资源
-        std::vector<size_t> ResourcesDead{};          // 生命周期到本结点结束的资源
+        RenderGraphSmallVector<size_t, 4> NextPassIndices{}; // 后继结点，不重复
+        RenderGraphSmallVector<size_t, 4> ResourcesBorn{};   // 生命周期从本结点开始的资源
+        RenderGraphSmallVector<size_t, 4> ResourcesDead{};   // 生命周期到本结点结束的资源
+
+        RenderGraphSmallVector<RenderGraphPlannedBarrier, 4> BarriersBefore{}; // 编译时算好的 barrier，在 pass 开始前提交
+        RenderGraphSmallVector<RenderGraphPlannedBarrier, 4> BarriersAfter{};  // pass 结束后开始的 split barrier
 
         bool IsAsyncCompute = false;
         bool IsBatchedWithPrevious = false; // 两个连续的 async-compute pass 可以合并，后一个 pass 的 Resource Barrier 也会提前
         bool NeedSyncPoint = false;         // 如果当前 pass 是 async-compute，并且该值为 true，则会产生一个 sync point
         GfxSyncPoint SyncPoint{};
         std::optional<size_t> PassIndexToWait = std::nullopt; // 在执行当前 pass 前需要等待的 pass，利用 sync point 实现
+
+        // 连续的 pass 使用相同的 render target 时，合并到同一个 render pass 中，中间被剔除的 pass 不影响
+        bool IsMergedWithPrevious = false;
+        bool IsMergedWithNext = false;
     };
 
     class RenderGraphBuilder final
@@ -127,6 +144,10 @@ namespace march
         void AllowPassCulling(bool value);
         void EnableAsyncCompute(bool value);
         void UseDefaultVariables(bool value);
+        void AllowParallelRecording(bool value);
+
+        // 调度 async compute 时使用，单位是微秒，不设置时使用 profiler 最近一次记录的 GPU 时间
+        void SetEstimatedCost(double microseconds);
 
         // 表示需要读取前面 pass 写入 buffer 的数据
         void In(const BufferHandle& buffer);
@@ -158,7 +179,9 @@ namespace march
 
         void SetWireframe(bool value);
 
-        void SetRenderFunc(const std::function<void(RenderGraphContext&)>& func);
+        // 一般的 lambda 不会分配堆内存
+        template <typename _Func>
+        void SetRenderFunc(_Func&& func);
 
         template <size_t _Capacity>
         void In(const InlineArray<BufferHandle, _Capacity>& buffers)
@@ -219,29 +242,138 @@ namespace march
     {
     public:
         virtual void OnGraphCompiled(const std::vector<RenderGraphPass>& passes, const RenderGraphResourceManager* resourceManager) = 0;
+
+        // 开启 profiling 后，GPU 时间读回来时调用，比 OnGraphCompiled 晚几帧
+        virtual void OnGraphProfiled(const RenderGraphFrameTiming& timing) {}
+    };
+
+    struct RenderGraphCompileStats
+    {
+        uint64_t NumCacheHits = 0;
+        uint64_t NumCacheMisses = 0;
+        double LastCompileMilliseconds = 0; // 最近一次完整编译的耗时
+        double SavedMilliseconds = 0;       // 命中缓存后累计节省的编译时间
+        uint32_t NumMergedPasses = 0;       // 最近一次完整编译中，和前一个 pass 合并了 render pass 的数量
+        uint32_t NumHoistedPasses = 0;      // 最近一次完整编译中，为了和 async compute 重叠而提前执行的 pass 的数量
+        double CriticalPathCost = 0;        // 最近一次完整编译中，估计的最长依赖链的 GPU 耗时（微秒）
+
+        double GetHitRate() const
+        {
+            uint64_t total = NumCacheHits + NumCacheMisses;
+            return total == 0 ? 0.0 : static_cast<double>(NumCacheHits) / static_cast<double>(total);
+        }
     };
 
     class RenderGraph final
     {
         friend RenderGraphBuilder;
 
-        std::vector<RenderGraphPass> m_Passes{};
+        RenderGraphArena m_Arena{}; // 每帧重置，必须在 m_Passes 和 m_ResourceManager 的数据销毁以后再重置
+        std::vector<RenderGraphPass> m_Passes{}; // clear 以后保留容量，稳定以后不会再分配内存
         std::optional<size_t> m_PassIndexToWaitFallback = std::nullopt; // 用于等待不被任何 pass 依赖的 async compute 结束
-        std::unique_ptr<RenderGraphResourceManager> m_ResourceManager = std::make_unique<RenderGraphResourceManager>();
+        std::unique_ptr<IRenderGraphBackend> m_Backend; // 必须在 m_ResourceManager 之后析构
+        std::unique_ptr<RenderGraphResourceManager> m_ResourceManager;
+
+        // 编译结果只和图的拓扑有关，每帧的拓扑一般都一样，所以缓存上一次的编译结果
+        struct CompiledPassData
+        {
+            bool IsCulled;
+            bool IsAsyncCompute;
+            bool IsBatchedWithPrevious;
+            bool NeedSyncPoint;
+            std::optional<size_t> PassIndexToWait;
+            bool IsMergedWithPrevious;
+            bool IsMergedWithNext;
+            std::vector<size_t> ResourcesBorn;
+            std::vector<size_t> ResourcesDead;
+            std::vector<RenderGraphPlannedBarrier> BarriersBefore;
+            std::vector<RenderGraphPlannedBarrier> BarriersAfter;
+        };
+
+        struct CompileCache
+        {
+            bool IsValid = false;
+            std::vector<size_t> TopologyKey{}; // 所有影响编译结果的数据，完全相同时才复用
+            std::vector<CompiledPassData> Passes{};
+            std::vector<std::optional<std::pair<size_t, size_t>>> ResourceLifetimes{};
+            std::optional<size_t> PassIndexToWaitFallback = std::nullopt;
+            bool IsPassOrderIdentity = true;
+            std::vector<size_t> PassOrder{}; // 调度后的顺序，见 RenderGraphPassScheduler::GetOrder()
+            double CompileMilliseconds = 0;
+        };
+
+        CompileCache m_CompileCache{};
+        RenderGraphCompileStats m_CompileStats{};
+        std::vector<size_t> m_TopologyKey{};
+        std::vector<std::pair<size_t, size_t>> m_TopologyKeyScratch{};
+        std::vector<size_t> m_TransientTextureIndices{};
+
+        RenderGraphBarrierPlanner m_BarrierPlanner{};
+        std::vector<RenderGraphBarrierPassInfo> m_BarrierPassInfos{};
+        std::vector<RenderGraphBarrierUse> m_BarrierUses{};
+
+        // 没有 profiler 的数据，也没有用户估计时使用的耗时（微秒）
+        static constexpr double DefaultPassCostMicroseconds = 100.0;
+
+        // 和 graphics 重叠的耗时少于这个值（微秒）时，不值得为 async compute 付出两次跨 queue 同步的开销
+        static constexpr double MinAsyncComputeOverlapMicroseconds = 20.0;
+
+        RenderGraphPassScheduler m_Scheduler{};
+        std::vector<RenderGraphSchedulePassInfo> m_SchedulePassInfos{};
+        std::vector<RenderGraphScheduleDependency> m_ScheduleDependencies{};
+        std::vector<std::optional<size_t>> m_ScheduleLastWriters{}; // 下标是 resource index
+        std::vector<std::vector<size_t>> m_ScheduleReaders{};       // 上一次写入以后读取资源的 pass
+        RenderGraphPassCostBuckets m_ProfiledPassCosts{}; // 没有估计耗时的 pass 使用，档位会放进编译缓存的 key
+        std::vector<RenderGraphPass> m_PassScratch{};
+        std::vector<size_t> m_PassIndexRemap{};
+
+        // 连续的可以并行录制的 pass 分成几个 chunk，每个 chunk 在一个线程中录制到自己的 command list
+        struct ParallelRecordingChunk
+        {
+            GfxCommandContext* Cmd;
+            std::exception_ptr Error;
+        };
+
+        bool m_EnableParallelRecording = true;
+        std::vector<size_t> m_ParallelPassIndices{};
+        std::vector<ParallelRecordingChunk> m_ParallelChunks{};
+
+        std::unique_ptr<RenderGraphProfiler> m_Profiler = nullptr; // 第一次开启 profiling 时创建
+        bool m_IsProfiling = false; // 这一帧是否开启了 profiling，关闭时不会调用 m_Profiler
+        std::vector<std::string_view> m_ProfilerPassNames{};
+
+        void BuildTopologyKey();
+        void SaveCompileCache();
+        void LoadCompileCache();
 
         void CompilePasses();
+        double GetEstimatedPassCost(const RenderGraphPass& pass) const;
+        void SchedulePasses();
+        void ReorderPasses(const std::vector<size_t>& order);
         void CullPass(size_t passIndex, size_t& asyncComputeDeadlineIndexExclusive);
         void CompileAsyncCompute(size_t passIndex, size_t& deadlineIndexExclusive);
-        size_t AvoidAsyncComputeResourceHazard(size_t passIndex, size_t& deadlineIndexExclusive);
+        size_t AvoidAsyncComputeResourceHazard(size_t passIndex, size_t& deadlineIndexExclusive, double& overlappedCost);
         void BatchAsyncComputePasses();
+        void AliasTransientTextures();
+        RenderGraphBarrierState GetPlannedBarrierState(const RenderGraphPass& pass, size_t resourceIndex);
+        void PlanBarriers();
+        bool IsRenderTargetOnly(const RenderGraphPass& pass, const RenderGraphPassRenderTarget& target) const;
+        bool CanMergeRenderPasses(const RenderGraphPass& previous, const RenderGraphPass& next) const;
+        void MergeRenderPasses();
 
         void RequestPassResources(const RenderGraphPass& pass);
+        void PrepareAliasedPassResources(GfxCommandContext* cmd, const RenderGraphPass& pass);
+        void ApplyPlannedBarriers(GfxCommandContext* cmd, const RenderGraphSmallVector<RenderGraphPlannedBarrier, 4>& barriers);
         void EnsureAsyncComputePassResourceStates(RenderGraphContext& context, size_t passIndex);
         GfxCommandContext* EnsurePassContext(RenderGraphContext& context, size_t passIndex);
         GfxRenderTargetDesc ResolveRenderTarget(const RenderGraphPassRenderTarget& target);
-        void SetPassRenderStates(GfxCommandContext* cmd, const RenderGraphPass& pass);
+        void BeginMergedRenderPass(GfxCommandContext* cmd, size_t passIndex);
+        void SetPassRenderStates(GfxCommandContext* cmd, size_t passIndex);
         void ReleasePassResources(const RenderGraphPass& pass);
         void SetPassDefaultVariables(GfxCommandContext* cmd, const RenderGraphPass& pass);
+        void RecordPass(RenderGraphContext& context, size_t passIndex);
+        size_t CollectParallelPasses(size_t beginPassIndex);
+        void ExecutePassesInParallel(RenderGraphContext& context);
         void ExecutePasses();
 
         class DeferredCleanup
@@ -253,17 +385,31 @@ namespace march
 
             ~DeferredCleanup()
             {
-                m_Graph->m_Passes.clear();
-                m_Graph->m_PassIndexToWaitFallback = std::nullopt;
-                m_Graph->m_ResourceManager->ClearResources();
+                m_Graph->Reset();
             }
         };
 
     public:
+        // backend 为 nullptr 时使用 RenderGraphD3D12Backend
+        RenderGraph(std::unique_ptr<IRenderGraphBackend> backend = nullptr);
+
+        RenderGraph(const RenderGraph&) = delete;
+        RenderGraph& operator=(const RenderGraph&) = delete;
+
         RenderGraphBuilder AddPass();
-        RenderGraphBuilder AddPass(const std::string& name);
+        RenderGraphBuilder AddPass(std::string_view name);
         void CompileAndExecute();
 
+        // 只编译不执行，之后可以用 GetPasses() 检查编译结果，必须调用 Reset() 才能构建下一帧
+        void Compile();
+
+        // 清除所有 pass 和资源
+        void Reset();
+
+        const std::vector<RenderGraphPass>& GetPasses() const { return m_Passes; }
+        const RenderGraphResourceManager* GetResourceManager() const { return m_ResourceManager.get(); }
+        IRenderGraphBackend* GetBackend() const { return m_Backend.get(); }
+
         BufferHandle ImportBuffer(const std::string& name, GfxBuffer* buffer);
         BufferHandle ImportBuffer(int32 id, GfxBuffer* buffer);
 
@@ -279,6 +425,32 @@ namespace march
         TextureHandle RequestTexture(const std::string& name, const GfxTextureDesc& desc);
         TextureHandle RequestTexture(int32 id, const GfxTextureDesc& desc);
 
+        // 只能在 backend 不能执行时使用，用 desc 代替实际的外部资源
+        BufferHandle ImportBuffer(const std::string& name, const GfxBufferDesc& desc);
+        BufferHandle ImportBuffer(int32 id, const GfxBufferDesc& desc);
+        TextureHandle ImportTexture(const std::string& name, const GfxTextureDesc& desc);
+        TextureHandle ImportTexture(int32 id, const GfxTextureDesc& desc);
+
+        // 关闭后所有 pass 都在主线程中录制，方便调试
+        void SetParallelRecordingEnabled(bool value) { m_EnableParallelRecording = value; }
+        bool IsParallelRecordingEnabled() const { return m_EnableParallelRecording; }
+
+        const RenderGraphCompileStats& GetCompileStats() const { return m_CompileStats; }
+        const RenderGraphBarrierStats& GetBarrierStats() const { return m_BarrierPlanner.GetStats(); }
+
+        // 记录每个 pass 的 CPU 和 GPU 时间，对所有 graph 生效
+        static void SetProfilingEnabled(bool value);
+        static bool IsProfilingEnabled();
+
+        // GPU 时间要过几帧才能读回来，所以不是当前帧的结果
+        const RenderGraphFrameTiming* GetLatestFrameTiming() const;
+
+        // 用测到的 GPU 时间调度没有估计耗时的 pass，开启 profiling 时每读回一帧就自动调用
+        // 耗时跨过档位的 pass 会让编译缓存失效，下次编译时重新调度
+        void ApplyProfiledPassCosts(const RenderGraphFrameTiming& timing);
+        bool SaveChromeTrace(const std::string& path) const;
+        const RenderGraphTransientMemoryStats& GetTransientMemoryStats() const { return m_ResourceManager->GetTransientMemoryStats(); }
+
         static void AddGraphCompiledEventListener(IRenderGraphCompiledEventListener* listener);
         static void RemoveGraphCompiledEventListener(IRenderGraphCompiledEventListener* listener);
     };
@@ -404,4 +576,10 @@ namespace march
         GfxDevice* GetDevice() const { return m_Cmd->GetDevice(); }
         GfxCommandContext* GetCommandContext() const { return m_Cmd; }
     };
+
+    template <typename _Func>
+    void RenderGraphBuilder::SetRenderFunc(_Func&& func)
+    {
+        GetPass().RenderFunc.Set(std::forward<_Func>(func), m_Graph->m_Arena);
+    }
 }
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace march
+{
+    struct RenderGraphSchedulePassInfo
+    {
+        double Cost;                  // 估计的 GPU 耗时，单位是微秒
+        bool IsAsyncComputeCandidate; // 可能在 async compute queue 上执行
+    };
+
+    // From 必须在 To 之前执行，要求 From < To，也就是原来的顺序一定满足依赖
+    struct RenderGraphScheduleDependency
+    {
+        size_t From;
+        size_t To;
+    };
+
+    struct RenderGraphScheduleStats
+    {
+        uint32_t NumHoistedPasses = 0; // 比原来的位置提前了的 pass 的数量
+        double CriticalPathCost = 0;   // 最长依赖链的总耗时
+    };
+
+    // 在满足依赖的前提下调整 pass 的执行顺序，让 async compute pass 尽早开始，和更多的 graphics pass 重叠
+    // async compute pass 和它依赖的 pass 在输入准备好以后立刻执行，同时准备好的先执行关键路径更长的
+    // 其他 pass 保持原来的相对顺序
+    // 纯 CPU 计算，不依赖 D3D12，方便单独测试
+    class RenderGraphPassScheduler final
+    {
+    public:
+        void Schedule(const std::vector<RenderGraphSchedulePassInfo>& passes, const std::vector<RenderGraphScheduleDependency>& dependencies);
+
+        // 第 i 个执行的是原来的第 GetOrder()[i] 个 pass
+        const std::vector<size_t>& GetOrder() const { return m_Order; }
+
+        // 顺序没有变化
+        bool IsIdentity() const { return m_IsIdentity; }
+
+        const RenderGraphScheduleStats& GetStats() const { return m_Stats; }
+
+    private:
+        std::vector<size_t> m_Order{};
+        bool m_IsIdentity = true;
+        RenderGraphScheduleStats m_Stats{};
+
+        // 复用内存
+        std::vector<size_t> m_AdjOffsets{}; // 后继结点按 From 分组连续存放
+        std::vector<size_t> m_AdjCursors{};
+        std::vector<size_t> m_AdjIndices{};
+        std::vector<size_t> m_Indegrees{};
+        std::vector<double> m_BottomLevels{}; // 从这个 pass 开始到结束的最长路径的耗时
+        std::vector<bool> m_IsHoisted{};
+        std::vector<size_t> m_ReadyHoistedPasses{}; // 按 m_BottomLevels 排序的堆
+    };
+
+    // profiler 测到的耗时每帧都在抖动，量化成档位以后再用于调度，并放进编译缓存的 key
+    // 这样调度结果只取决于 key，耗时跨过档位时重新编译，在档位内抖动时继续使用缓存
+    class RenderGraphPassCostBuckets final
+    {
+    public:
+        static constexpr uint32_t BucketsPerOctave = 2;  // 相邻档位的耗时相差 sqrt(2) 倍
+        static constexpr uint32_t MaxBucket = 63;
+        static constexpr double HysteresisBuckets = 0.25; // 超出当前档位不到这么多时保持不变
+
+        // 记录 pass 最新测到的耗时，返回档位是否变化
+        bool Update(size_t passNameHash, double microseconds);
+        std::optional<uint32_t> GetBucket(size_t passNameHash) const;
+        void Clear() { m_Buckets.clear(); }
+
+        static uint32_t Quantize(double microseconds);
+        static double GetBucketCost(uint32_t bucket); // 档位内耗时的几何中点
+
+    private:
+        std::unordered_map<size_t, uint32_t> m_Buckets{}; // key 是 pass 名字的 hash
+    };
+}
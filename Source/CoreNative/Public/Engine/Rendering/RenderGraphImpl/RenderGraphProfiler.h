@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Engine/Memory/RefCounting.h"
+#include <d3dx12.h>
+#include <wrl.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+
+namespace march
+{
+    class GfxCommandContext;
+    class GfxResource;
+
+    // 时间的单位都是微秒，使用 QueryPerformanceCounter 的时间轴，GPU 的时间通过 clock calibration 换算到同一个时间轴上
+    struct RenderGraphPassTiming
+    {
+        std::string Name{};
+        bool IsAsyncCompute = false;
+        uint32_t CpuThreadId = 0; // 并行录制时是 worker 线程
+
+        double CpuBeginMicroseconds = 0;
+        double CpuEndMicroseconds = 0;
+
+        bool HasGpuTiming = false; // 超出 query 数量上限，或者 readback buffer 都在使用时没有 GPU 时间
+        double GpuBeginMicroseconds = 0;
+        double GpuEndMicroseconds = 0;
+
+        double GetCpuMilliseconds() const { return (CpuEndMicroseconds - CpuBeginMicroseconds) / 1000.0; }
+        double GetGpuMilliseconds() const { return HasGpuTiming ? (GpuEndMicroseconds - GpuBeginMicroseconds) / 1000.0 : 0.0; }
+    };
+
+    struct RenderGraphFrameTiming
+    {
+        uint64_t FrameIndex = 0; // 第几次执行 graph
+        uint32_t CpuThreadId = 0;
+
+        double CompileBeginMicroseconds = 0; // 包括查找编译缓存
+        double CompileEndMicroseconds = 0;
+
+        std::vector<RenderGraphPassTiming> Passes{}; // 只有执行了的 pass，按执行顺序排列
+
+        double GetCompileMilliseconds() const { return (CompileEndMicroseconds - CompileBeginMicroseconds) / 1000.0; }
+    };
+
+    // 记录每个 pass 录制的 CPU 时间和 GPU 执行的时间
+    // GPU 时间用 timestamp query 记录，resolve 到 readback buffer 里，几帧以后 GPU 执行完了再读回来
+    class RenderGraphProfiler final
+    {
+    public:
+        static constexpr uint32_t MaxPassesPerFrame = 256;
+        static constexpr uint32_t NumFrameSlots = 8; // 同时在 GPU 上执行的帧数不能超过这个值，否则后面的帧没有 GPU 时间
+        static constexpr size_t MaxHistoryFrames = 120;
+
+        RenderGraphProfiler();
+        ~RenderGraphProfiler();
+
+        RenderGraphProfiler(const RenderGraphProfiler&) = delete;
+        RenderGraphProfiler& operator=(const RenderGraphProfiler&) = delete;
+
+        // 返回新读回来的帧的数量
+        size_t BeginFrame(size_t numPasses);
+        void BeginCompile();
+        void EndCompile();
+        void EndFrame(const std::vector<std::string_view>& passNames);
+
+        // 可以在多个线程中同时调用，每个 pass 的数据是分开存放的
+        void BeginPass(GfxCommandContext* cmd, size_t passIndex);
+        void EndPass(GfxCommandContext* cmd, size_t passIndex);
+
+        // 最早的在前面
+        const std::deque<RenderGraphFrameTiming>& GetHistory() const { return m_History; }
+        const RenderGraphFrameTiming* GetLatestFrameTiming() const { return m_History.empty() ? nullptr : &m_History.back(); }
+
+        // 可以用 chrome://tracing 或者 Perfetto 打开
+        static std::string ToChromeTraceJson(const std::deque<RenderGraphFrameTiming>& frames);
+        static bool SaveChromeTrace(const std::string& path, const std::deque<RenderGraphFrameTiming>& frames);
+
+        static double GetCpuMicroseconds();
+
+    private:
+        struct PassRecord
+        {
+            bool IsRecorded;
+            bool HasGpuQuery;
+            bool IsAsyncCompute;
+            uint32_t CpuThreadId;
+            double CpuBeginMicroseconds;
+            double CpuEndMicroseconds;
+        };
+
+        struct QueueClock
+        {
+            uint64_t Frequency;
+            uint64_t GpuTimestamp;
+            uint64_t CpuTimestamp;
+        };
+
+        struct FrameSlot
+        {
+            bool IsPending;
+            uint64_t Fence;
+            QueueClock Clocks[2]; // direct 和 async compute
+            RenderGraphFrameTiming Timing;
+            std::vector<uint32_t> QueryPassIndices; // 和 Timing.Passes 一一对应，没有 GPU 时间时为 -1
+        };
+
+        // query heap 要等 GPU 用完才能释放
+        class QueryHeap : public RefCountedObject
+        {
+        public:
+            Microsoft::WRL::ComPtr<ID3D12QueryHeap> Heap = nullptr;
+        };
+
+        RefCountPtr<QueryHeap> m_QueryHeap;
+        RefCountPtr<GfxResource> m_ReadbackBuffer;
+        FrameSlot m_Slots[NumFrameSlots];
+        uint32_t m_NextSlotIndex;
+        int32_t m_CurrentSlotIndex; // 为 -1 时这一帧不记录 GPU 时间
+
+        uint64_t m_FrameIndex;
+        double m_CompileBeginMicroseconds;
+        double m_CompileEndMicroseconds;
+        std::vector<PassRecord> m_PassRecords;
+        std::deque<RenderGraphFrameTiming> m_History;
+
+        size_t CollectCompletedSlots();
+        void ReadbackSlot(FrameSlot& slot, uint32_t slotIndex);
+        void AddHistory(RenderGraphFrameTiming&& timing);
+        uint32_t GetQueryIndex(uint32_t slotIndex, size_t passIndex) const;
+    };
+}
@@ -2,9 +2,14 @@
 
 #include "Engine/Ints.h"
 #include "Engine/Rendering/D3D12.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphTransientPlanner.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphArena.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+#include "Engine/Misc/HashUtils.h"
 #include <memory>
-#include <list>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
 #include <string>
 #include <variant>
 #include <optional>
@@ -24,6 +29,23 @@ namespace march
             return buffer->GetDesc().IsCompatibleWith(desc);
         }
 
+        // 兼容的 desc 必须有相同的 hash
+        static size_t GetDescHash(const DescType& desc)
+        {
+            DefaultHash hash{};
+            hash.Append(desc.Stride);
+            hash.Append(desc.Count);
+            hash.Append(desc.Usages);
+            hash.Append(desc.Flags);
+            return *hash;
+        }
+
+        static uint64_t GetSizeInBytes(GfxBuffer* buffer)
+        {
+            D3D12_RESOURCE_DESC resDesc = buffer->GetUnderlyingResource()->GetD3DResourceDesc();
+            return GetGfxDevice()->GetD3DDevice4()->GetResourceAllocationInfo(0, 1, &resDesc).SizeInBytes;
+        }
+
         static std::unique_ptr<GfxBuffer> Allocate(const DescType& desc, uint32_t allocCounter)
         {
             GfxDevice* device = GetGfxDevice();
@@ -42,6 +64,29 @@ namespace march
             return texture->GetDesc().IsCompatibleWith(desc);
         }
 
+        // 兼容的 desc 必须有相同的 hash
+        static size_t GetDescHash(const DescType& desc)
+        {
+            DefaultHash hash{};
+            hash.Append(desc.Format);
+            hash.Append(desc.Flags);
+            hash.Append(desc.Dimension);
+            hash.Append(desc.Width);
+            hash.Append(desc.Height);
+            hash.Append(desc.DepthOrArraySize);
+            hash.Append(desc.MSAASamples);
+            hash.Append(desc.Filter);
+            hash.Append(desc.Wrap);
+            hash.Append(desc.MipmapBias);
+            return *hash;
+        }
+
+        static uint64_t GetSizeInBytes(GfxRenderTexture* texture)
+        {
+            D3D12_RESOURCE_DESC resDesc = texture->GetUnderlyingResource()->GetD3DResourceDesc();
+            return GetGfxDevice()->GetD3DDevice4()->GetResourceAllocationInfo(0, 1, &resDesc).SizeInBytes;
+        }
+
         static std::unique_ptr<GfxRenderTexture> Allocate(const DescType& desc, uint32_t allocCounter)
         {
             GfxDevice* device = GetGfxDevice();
@@ -50,6 +95,18 @@ namespace march
         }
     };
 
+    struct RenderGraphResourcePoolStats
+    {
+        // 上一帧的数据
+        uint32_t NumHits = 0;
+        uint32_t NumMisses = 0;      // 等于新分配的数量
+        uint32_t NumEvictions = 0;
+
+        // 当前的数据
+        uint32_t NumFreeResources = 0;
+        uint64_t BytesHeld = 0;      // 空闲资源占用的内存
+    };
+
     template <typename _ResourceType>
     class RenderGraphResourcePool
     {
@@ -58,43 +115,148 @@ namespace march
         struct PoolItem
         {
             std::unique_ptr<_ResourceType> Res;
-            uint32_t FailCount;
+            uint64_t LastUsedFrame;
+            uint64_t SizeInBytes;
         };
 
-        std::list<PoolItem> m_FreeItems{}; // 新的都 push 到最后，这样前面都是旧的
+        IRenderGraphBackend* m_Backend;
+        std::unordered_multimap<size_t, PoolItem> m_FreeItems{}; // key 是 desc 的 hash
+        std::vector<typename std::unordered_multimap<size_t, PoolItem>::node_type> m_SpareNodes{}; // 复用结点，避免每次 Release 都分配内存
         uint32_t m_AllocCounter = 0; // 记录分配数量
 
+        uint32_t m_MaxUnusedFrames = 30;
+        uint64_t m_MemoryBudget = 256ull * 1024 * 1024; // 空闲资源最多占用的内存
+
+        uint64_t m_CurrentFrame = 0;
+        RenderGraphResourcePoolStats m_FrameStats{};
+        RenderGraphResourcePoolStats m_LastFrameStats{};
+        std::vector<typename std::unordered_multimap<size_t, PoolItem>::iterator> m_EvictionScratch{};
+
+        void UpdateFrame()
+        {
+            uint64_t frame = m_Backend->GetFrameIndex();
+
+            if (frame != m_CurrentFrame)
+            {
+                m_CurrentFrame = frame;
+                m_LastFrameStats = m_FrameStats;
+
+                // 空闲资源的数量和占用的内存是一直累积的，只清零每帧的计数
+                m_FrameStats.NumHits = 0;
+                m_FrameStats.NumMisses = 0;
+                m_FrameStats.NumEvictions = 0;
+            }
+        }
+
+        void Evict(typename std::unordered_multimap<size_t, PoolItem>::iterator it)
+        {
+            m_FrameStats.NumEvictions++;
+            m_FrameStats.NumFreeResources--;
+            m_FrameStats.BytesHeld -= it->second.SizeInBytes;
+            m_FreeItems.erase(it);
+        }
+
     public:
+        RenderGraphResourcePool(IRenderGraphBackend* backend) : m_Backend(backend) {}
+
         std::unique_ptr<_ResourceType> Request(const typename ResourceTraits::DescType& desc)
         {
-            auto it = m_FreeItems.begin();
+            UpdateFrame();
+
+            auto [begin, end] = m_FreeItems.equal_range(ResourceTraits::GetDescHash(desc));
 
-            while (it != m_FreeItems.end())
+            for (auto it = begin; it != end; ++it)
             {
-                if (ResourceTraits::IsCompatibleWith(it->Res.get(), desc))
+                // hash 可能冲突，还要再检查一次
+                if (ResourceTraits::IsCompatibleWith(it->second.Res.get(), desc))
                 {
-                    std::unique_ptr<_ResourceType> result = std::move(it->Res);
-                    m_FreeItems.erase(it);
+                    auto node = m_FreeItems.extract(it);
+                    std::unique_ptr<_ResourceType> result = std::move(node.mapped().Res);
+                    m_FrameStats.NumHits++;
+                    m_FrameStats.NumFreeResources--;
+                    m_FrameStats.BytesHeld -= node.mapped().SizeInBytes;
+                    m_SpareNodes.push_back(std::move(node));
                     return result;
                 }
+            }
 
-                if (it->FailCount++; it->FailCount >= 20)
-                {
-                    // 失败次数太多
-                    it = m_FreeItems.erase(it);
-                }
-                else
+            m_FrameStats.NumMisses++;
+            return ResourceTraits::Allocate(desc, ++m_AllocCounter);
+        }
+
+        void Release(std::unique_ptr<_ResourceType>&& value)
+        {
+            UpdateFrame();
+
+            size_t hash = ResourceTraits::GetDescHash(value->GetDesc());
+            uint64_t size = ResourceTraits::GetSizeInBytes(value.get());
+
+            m_FrameStats.NumFreeResources++;
+            m_FrameStats.BytesHeld += size;
+
+            if (m_SpareNodes.empty())
+            {
+                m_FreeItems.emplace(hash, PoolItem{ std::move(value), m_CurrentFrame, size });
+            }
+            else
+            {
+                auto node = std::move(m_SpareNodes.back());
+                m_SpareNodes.pop_back();
+                node.key() = hash;
+                node.mapped() = PoolItem{ std::move(value), m_CurrentFrame, size };
+                m_FreeItems.insert(std::move(node));
+            }
+        }
+
+        // 删除很久没用的资源，如果还是超出预算，就从最久没用的开始删除
+        void Trim()
+        {
+            UpdateFrame();
+
+            for (auto it = m_FreeItems.begin(); it != m_FreeItems.end();)
+            {
+                auto next = std::next(it);
+
+                if (m_CurrentFrame - it->second.LastUsedFrame > m_MaxUnusedFrames)
                 {
-                    ++it;
+                    Evict(it);
                 }
+
+                it = next;
             }
 
-            return ResourceTraits::Allocate(desc, ++m_AllocCounter);
+            if (m_FrameStats.BytesHeld <= m_MemoryBudget)
+            {
+                return;
+            }
+
+            m_EvictionScratch.clear();
+
+            for (auto it = m_FreeItems.begin(); it != m_FreeItems.end(); ++it)
+            {
+                m_EvictionScratch.push_back(it);
+            }
+
+            std::sort(m_EvictionScratch.begin(), m_EvictionScratch.end(), [](const auto& a, const auto& b)
+            {
+                return a->second.LastUsedFrame < b->second.LastUsedFrame;
+            });
+
+            for (size_t i = 0; i < m_EvictionScratch.size() && m_FrameStats.BytesHeld > m_MemoryBudget; i++)
+            {
+                Evict(m_EvictionScratch[i]);
+            }
         }
 
-        void Release(std::unique_ptr<_ResourceType>&& value)
+        void SetMaxUnusedFrames(uint32_t value) { m_MaxUnusedFrames = value; }
+        void SetMemoryBudget(uint64_t bytes) { m_MemoryBudget = bytes; }
+
+        RenderGraphResourcePoolStats GetStats() const
         {
-            m_FreeItems.push_back({ std::move(value), 0 });
+            RenderGraphResourcePoolStats stats = m_LastFrameStats;
+            stats.NumFreeResources = m_FrameStats.NumFreeResources;
+            stats.BytesHeld = m_FrameStats.BytesHeld;
+            return stats;
         }
     };
 
@@ -226,6 +388,55 @@ namespace march
         RenderGraphResourceExternalTexture& operator=(RenderGraphResourceExternalTexture&&) = default;
     };
 
+    // null backend 使用的资源，只有 desc，不会创建实际的资源
+    struct RenderGraphResourceVirtualBuffer
+    {
+        GfxBufferDesc Desc;
+        bool IsExternal;
+
+        RenderGraphResourceVirtualBuffer(const GfxBufferDesc& desc, bool isExternal) : Desc(desc), IsExternal(isExternal) {}
+
+        RenderGraphResourceVirtualBuffer(const RenderGraphResourceVirtualBuffer&) = delete;
+        RenderGraphResourceVirtualBuffer& operator=(const RenderGraphResourceVirtualBuffer&) = delete;
+
+        RenderGraphResourceVirtualBuffer(RenderGraphResourceVirtualBuffer&&) = default;
+        RenderGraphResourceVirtualBuffer& operator=(RenderGraphResourceVirtualBuffer&&) = default;
+    };
+
+    // null backend 导入的外部 texture，只有 desc
+    struct RenderGraphResourceVirtualTexture
+    {
+        GfxTextureDesc Desc;
+
+        RenderGraphResourceVirtualTexture(const GfxTextureDesc& desc) : Desc(desc) {}
+
+        RenderGraphResourceVirtualTexture(const RenderGraphResourceVirtualTexture&) = delete;
+        RenderGraphResourceVirtualTexture& operator=(const RenderGraphResourceVirtualTexture&) = delete;
+
+        RenderGraphResourceVirtualTexture(RenderGraphResourceVirtualTexture&&) = default;
+        RenderGraphResourceVirtualTexture& operator=(RenderGraphResourceVirtualTexture&&) = default;
+    };
+
+    struct RenderGraphResourceTransientTexture
+    {
+        GfxTextureDesc Desc;
+        GfxRenderTexture* Texture; // 由 RenderGraphResourceManager 持有，和其他 transient texture 共用 heap，null backend 时为 nullptr
+        bool IsAliased;            // 和其他资源共用了内存，第一次使用前需要 aliasing barrier
+
+        RenderGraphResourceTransientTexture(const GfxTextureDesc& desc, GfxRenderTexture* texture, bool isAliased)
+            : Desc(desc)
+            , Texture(texture)
+            , IsAliased(isAliased)
+        {
+        }
+
+        RenderGraphResourceTransientTexture(const RenderGraphResourceTransientTexture&) = delete;
+        RenderGraphResourceTransientTexture& operator=(const RenderGraphResourceTransientTexture&) = delete;
+
+        RenderGraphResourceTransientTexture(RenderGraphResourceTransientTexture&&) = default;
+        RenderGraphResourceTransientTexture& operator=(RenderGraphResourceTransientTexture&&) = default;
+    };
+
     class RenderGraphResourceData final
     {
         int32 m_Id{};
@@ -236,16 +447,22 @@ namespace march
             RenderGraphResourcePooledBuffer,
             RenderGraphResourceExternalBuffer,
             RenderGraphResourcePooledTexture,
-            RenderGraphResourceExternalTexture
+            RenderGraphResourceExternalTexture,
+            RenderGraphResourceTransientTexture,
+            RenderGraphResourceVirtualBuffer,
+            RenderGraphResourceVirtualTexture
         > m_Resource{};
 
-        std::vector<size_t> m_ProducerPassIndices{};
+        RenderGraphSmallVector<size_t, 4> m_ProducerPassIndices{}; // 内存在 arena 里
         std::optional<std::pair<size_t, size_t>> m_LifetimePassIndexRange = std::nullopt;
 
     public:
         bool IsExternal() const;
         bool IsGenericallyReadable();
         bool AllowGpuWriting() const;
+        bool IsPooledTexture() const;
+        bool IsTexture() const;
+        bool NeedAliasingBarrier() const;
 
         GfxBuffer* GetBuffer();
         const GfxBufferDesc& GetBufferDesc() const;
@@ -261,13 +478,14 @@ namespace march
         void ReleaseResource();
 
         std::optional<size_t> GetLastProducerBeforePassIndex(size_t passIndex) const;
-        void AddProducerPassIndex(size_t passIndex);
+        void AddProducerPassIndex(size_t passIndex, RenderGraphArena& arena);
 
         void SetAlive(size_t passIndex);
 
         int32 GetId() const { return m_Id; }
 
         std::optional<std::pair<size_t, size_t>> GetLifetimePassIndexRange() const { return m_LifetimePassIndexRange; }
+        void SetLifetimePassIndexRange(const std::optional<std::pair<size_t, size_t>>& range) { m_LifetimePassIndexRange = range; }
 
         void InitAsTempBuffer(int32 id, const GfxBufferDesc& desc)
         {
@@ -299,6 +517,25 @@ namespace march
             m_Resource.emplace<RenderGraphResourceExternalTexture>(texture);
         }
 
+        void InitAsVirtualBuffer(int32 id, const GfxBufferDesc& desc, bool isExternal)
+        {
+            m_Id = id;
+            m_Resource.emplace<RenderGraphResourceVirtualBuffer>(desc, isExternal);
+        }
+
+        void InitAsVirtualTexture(int32 id, const GfxTextureDesc& desc)
+        {
+            m_Id = id;
+            m_Resource.emplace<RenderGraphResourceVirtualTexture>(desc);
+        }
+
+        // 编译后把 pooled texture 换成 transient texture，此时还没有从 pool 中请求资源
+        void ConvertToTransientTexture(GfxRenderTexture* texture, bool isAliased)
+        {
+            GfxTextureDesc desc = GetTextureDesc();
+            m_Resource.emplace<RenderGraphResourceTransientTexture>(desc, texture, isAliased);
+        }
+
         RenderGraphResourceData() = default;
         ~RenderGraphResourceData() = default;
 
@@ -314,12 +551,46 @@ namespace march
 
     class RenderGraphResourceManager
     {
+        IRenderGraphBackend* m_Backend;
         std::unique_ptr<RenderGraphResourcePool<GfxBuffer>> m_BufferPool;
         std::unique_ptr<RenderGraphResourcePool<GfxRenderTexture>> m_TexturePool;
         std::vector<RenderGraphResourceData> m_Resources;
 
+        struct TransientTexture
+        {
+            GfxTextureDesc Desc;
+            size_t FirstPassIndex;
+            size_t LastPassIndex;
+            bool IsAliased;
+            std::unique_ptr<GfxRenderTexture> Texture;
+        };
+
+        // 一次规划的结果，只要 desc 和生命周期不变，就一直复用其中的 heap 和 texture
+        struct TransientTextureSet
+        {
+            std::vector<TransientTexture> Textures;
+            std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> Heaps; // 下标是 HeapGroup
+            RenderGraphTransientMemoryStats Stats;
+            uint64_t LastUsedFrame;
+        };
+
+        // 每帧有多个相机时（例如分辨率不同的 Scene View 和 Game View），每个相机的 graph 各用一套，不会每帧互相覆盖
+        static constexpr size_t MaxTransientTextureSets = 4;
+        static constexpr uint64_t MaxTransientTextureSetUnusedFrames = 60;
+
+        std::vector<std::unique_ptr<TransientTextureSet>> m_TransientTextureSets;
+        uint64_t m_NumTransientTextureSetBuilds;
+        std::vector<RenderGraphTransientRequest> m_TransientRequests;
+        RenderGraphTransientPlanner m_TransientPlanner;
+        RenderGraphTransientMemoryStats m_TransientMemoryStats;
+
+        bool IsTransientPlanValid(const TransientTextureSet& set, const std::vector<size_t>& resourceIndices) const;
+        TransientTextureSet* FindOrBuildTransientTextureSet(const std::vector<size_t>& resourceIndices);
+        void BuildTransientTextureSet(TransientTextureSet& set, const std::vector<size_t>& resourceIndices);
+        void TrimTransientTextureSets();
+
     public:
-        RenderGraphResourceManager();
+        RenderGraphResourceManager(IRenderGraphBackend* backend);
 
         size_t GetNumResources() const { return m_Resources.size(); }
 
@@ -331,6 +602,10 @@ namespace march
         TextureHandle CreateTexture(int32 id, const GfxTextureDesc& desc);
         TextureHandle ImportTexture(int32 id, GfxTexture* texture);
 
+        // 只用于 null backend，没有实际的资源
+        BufferHandle ImportVirtualBuffer(int32 id, const GfxBufferDesc& desc);
+        TextureHandle ImportVirtualTexture(int32 id, const GfxTextureDesc& desc);
+
         size_t GetResourceIndex(const BufferHandle& handle) const;
         size_t GetResourceIndex(const TextureHandle& handle) const;
 
@@ -354,11 +629,31 @@ namespace march
         void ReleaseResource(size_t resourceIndex);
 
         std::optional<size_t> GetLastProducerBeforePassIndex(size_t resourceIndex, size_t passIndex) const;
-        void AddProducerPassIndex(size_t resourceIndex, size_t passIndex);
+        void AddProducerPassIndex(size_t resourceIndex, size_t passIndex, RenderGraphArena& arena);
 
         void SetAlive(size_t resourceIndex, size_t passIndex);
 
         std::optional<std::pair<size_t, size_t>> GetLifetimePassIndexRange(size_t resourceIndex) const;
+        void SetLifetimePassIndexRange(size_t resourceIndex, const std::optional<std::pair<size_t, size_t>>& range);
+
+        bool IsPooledTexture(size_t resourceIndex) const;
+        bool IsTextureResource(size_t resourceIndex) const;
+        bool NeedAliasingBarrier(size_t resourceIndex) const;
+
+        // 让生命周期不重叠的 pooled texture 共用内存，resourceIndices 中的资源必须都有生命周期
+        void AliasTransientTextures(const std::vector<size_t>& resourceIndices);
+
+        // 最近一次 AliasTransientTextures 用到的那一套的统计
+        const RenderGraphTransientMemoryStats& GetTransientMemoryStats() const { return m_TransientMemoryStats; }
+        size_t GetNumTransientTextureSets() const { return m_TransientTextureSets.size(); }
+        uint64_t GetNumTransientTextureSetBuilds() const { return m_NumTransientTextureSetBuilds; }
+
+        RenderGraphResourcePoolStats GetBufferPoolStats() const { return m_BufferPool->GetStats(); }
+        RenderGraphResourcePoolStats GetTexturePoolStats() const { return m_TexturePool->GetStats(); }
+
+        // 池中空闲资源最多占用的内存，超出后从最久没用的开始释放
+        void SetPoolMemoryBudget(uint64_t bytes);
+        void SetPoolMaxUnusedFrames(uint32_t frames);
     };
 
     class BufferHandle
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace march
+{
+    struct RenderGraphTransientRequest
+    {
+        uint64_t SizeInBytes;
+        uint64_t Alignment;      // 必须是 2 的幂
+        size_t FirstPassIndex;   // 生命周期，闭区间
+        size_t LastPassIndex;
+        uint32_t HeapGroup;      // 不同 group 的资源放在不同的 heap 里，不会互相重叠
+    };
+
+    struct RenderGraphTransientPlacement
+    {
+        uint64_t Offset;         // 在所属 group 的 heap 中的偏移
+        bool IsAliased;          // 是否和其他资源共用了一部分内存，使用前需要 aliasing barrier
+    };
+
+    struct RenderGraphTransientMemoryStats
+    {
+        uint64_t BytesWithoutAliasing = 0; // 每个资源单独分配需要的内存
+        uint64_t BytesWithAliasing = 0;    // 所有 heap 加起来的大小
+        uint32_t NumResources = 0;
+        uint32_t NumAliasedResources = 0;
+    };
+
+    // 根据生命周期给 transient 资源分配 heap 中的偏移，生命周期不重叠的资源可以共用内存
+    // 纯 CPU 计算，不依赖 D3D12，方便单独测试
+    class RenderGraphTransientPlanner final
+    {
+    public:
+        // 先放大的资源，每个资源放到第一个放得下的位置（first-fit）
+        void Plan(const std::vector<RenderGraphTransientRequest>& requests);
+
+        // 和 Plan 传入的 requests 一一对应
+        const std::vector<RenderGraphTransientPlacement>& GetPlacements() const { return m_Placements; }
+
+        // 下标是 HeapGroup，没有资源的 group 大小为 0
+        const std::vector<uint64_t>& GetHeapSizes() const { return m_HeapSizes; }
+
+        const RenderGraphTransientMemoryStats& GetStats() const { return m_Stats; }
+
+    private:
+        struct Interval
+        {
+            uint64_t Begin;
+            uint64_t End;
+        };
+
+        std::vector<RenderGraphTransientPlacement> m_Placements{};
+        std::vector<uint64_t> m_HeapSizes{};
+        RenderGraphTransientMemoryStats m_Stats{};
+
+        std::vector<size_t> m_SortedIndices{}; // 复用内存
+        std::vector<Interval> m_Occupied{};
+    };
+}
@@ -2,6 +2,7 @@
 
 #include "Engine/Rendering/Light.h"
 #include "Engine/Rendering/RenderGraph.h"
+#include "Engine/Rendering/BoundingVolumeHierarchy.h"
 #include "Engine/Rendering/D3D12.h"
 #include "Engine/AssetManger.h"
 #include "Engine/InlineArray.h"
@@ -110,6 +111,7 @@ namespace march
 
         void AddMeshRenderer(MeshRenderer* obj);
         void RemoveMeshRenderer(MeshRenderer* obj);
+        void MarkMeshRendererDirty(MeshRenderer* obj); // 下次渲染前重新计算它的 Bounds
         void AddLight(Light* light);
         void RemoveLight(Light* light);
 
@@ -121,9 +123,10 @@ namespace march
         void RenderSingleCamera(Camera* camera);
 
     private:
-        BufferHandle CreateCameraConstantBuffer(const std::string& name, Camera* camera);
-        BufferHandle CreateCameraConstantBuffer(const std::string& name, const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix);
+        BufferHandle CreateCameraConstantBuffer(int32 id, Camera* camera);
+        BufferHandle CreateCameraConstantBuffer(int32 id, const DirectX::XMFLOAT4X4& viewMatrix, const DirectX::XMFLOAT4X4& projectionMatrix);
 
+        void UpdateMeshRendererBVH();
         void CreateLightResources();
         void CullLights();
         void DeferredLighting(const DirectX::XMFLOAT4X4& shadowMatrix, float depth2RadialScale);
@@ -140,6 +143,10 @@ namespace march
         void HiZ();
 
         std::vector<MeshRenderer*> m_MeshRenderers{};
+        std::vector<MeshRenderer*> m_DirtyMeshRenderers{}; // Transform 或 Mesh 变化了，Bounds 需要重新计算
+        std::vector<DirectX::BoundingBox> m_MeshRendererBounds{}; // 和 m_DirtyMeshRenderers 一一对应
+        uint32_t m_MeshBoundsVersion = 0; // 和 GfxMesh::GetBoundsVersion() 不同时所有 renderer 都要重新计算
+        BoundingVolumeHierarchy m_MeshRendererBVH{};
         std::vector<Light*> m_Lights{};
         RenderPipelineResource m_Resource{};
 
@@ -16,8 +16,6 @@ namespace march
         AssetManager_NativeUnloadAsset,
         Mesh_NativeGetGeometry,
         Texture_NativeGetDefault,
-        JobManager_NativeSchedule,
-        JobManager_NativeComplete,
         DragDrop_HandleExternalFiles,
 
         // 该成员仅用于记录方法的数量
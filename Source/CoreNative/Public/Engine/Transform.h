@@ -1,16 +1,32 @@
 #pragma once
 
 #include "Engine/Component.h"
+#include "Engine/TransformHierarchy.h"
 #include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
 
 namespace march
 {
+    // 接收 Transform 世界空间数据变化的通知
+    class TransformChangeListener
+    {
+    public:
+        // 自己或者某个祖先节点被修改时调用。节点已经全脏时不会再通知，直到它的数据被读取过
+        virtual void OnTransformChanged() = 0;
+
+    protected:
+        ~TransformChangeListener() = default;
+    };
+
     class Transform : public Component
     {
         friend class TransformInternalUtility;
+        friend class TransformHierarchy;
 
     public:
         Transform();
+        ~Transform() override;
 
         Transform* GetParent() const;
 
@@ -63,12 +79,22 @@ namespace march
         static DirectX::XMFLOAT4 EulerAnglesToQuaternion(DirectX::XMFLOAT3 eulerAngles);
         static DirectX::XMFLOAT3 QuaternionToEulerAngles(DirectX::XMFLOAT4 quaternion);
 
+        // 按照先父后子的顺序更新所有脏的 Transform，之后在多线程中读取世界空间数据就是安全的
+        static void UpdateAllDirtyTransforms();
+
+        void AddChangeListener(TransformChangeListener* listener);
+        void RemoveChangeListener(TransformChangeListener* listener);
+
     private:
-        Transform* m_Parent;
-        DirectX::XMFLOAT3 m_LocalPosition;
-        DirectX::XMFLOAT4 m_LocalRotation; // quaternion
-        DirectX::XMFLOAT3 m_LocalEulerAngles; // in degrees
-        DirectX::XMFLOAT3 m_LocalScale;
+        uint32_t m_Index; // 在 s_Hierarchy 中的索引，节点的层级变化时会改变
+        std::vector<Transform*> m_Children;
+        std::vector<TransformChangeListener*> m_ChangeListeners; // 一般只有一两个
+
+        // 数据都存在这里，世界空间的数据读取时按需更新
+        static TransformHierarchy s_Hierarchy;
+
+        // 标记自己和所有子节点为脏
+        void MarkDirty();
     };
 
     // C++ 侧提供给 C# 侧的接口，不要用它
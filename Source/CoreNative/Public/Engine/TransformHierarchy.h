@@ -0,0 +1,95 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+namespace march
+{
+    class Transform;
+
+    enum class TransformDirtyFlags : uint8_t
+    {
+        None = 0,
+        LocalToWorldMatrix = 1 << 0,
+        WorldToLocalMatrix = 1 << 1,
+        Rotation = 1 << 2,
+        LossyScale = 1 << 3,
+        All = LocalToWorldMatrix | WorldToLocalMatrix | Rotation | LossyScale,
+    };
+
+    DEFINE_ENUM_FLAG_OPERATORS(TransformDirtyFlags);
+
+    // 所有 Transform 的数据按 SoA 连续存储，始终按层级排序：父节点一定在子节点前面，同一层的节点是连续的
+    // 节点的层级变化时只和层边界上的节点交换，不需要整体重排
+    class TransformHierarchy final
+    {
+        friend class Transform;
+        friend class TransformInternalUtility;
+
+    public:
+        static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+        TransformHierarchy() = default;
+
+        TransformHierarchy(const TransformHierarchy&) = delete;
+        TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+        // 返回新节点的索引，同时会写到 owner->m_Index；其他节点的索引可能会变
+        uint32_t Allocate(Transform* owner);
+        void Release(uint32_t index);
+
+        // 子树中所有节点的层级都会跟着变，调用前 owner 的 m_Children 要已经更新
+        void SetParent(uint32_t index, uint32_t parentIndex);
+
+        // 如果节点之前已经全脏了，返回 false，此时子节点也一定是全脏的
+        bool MarkDirty(uint32_t index);
+
+        // 按需更新单个节点，会递归更新父节点
+        DirectX::XMMATRIX LoadLocalToWorldMatrix(uint32_t index);
+        DirectX::XMMATRIX LoadWorldToLocalMatrix(uint32_t index);
+        DirectX::XMVECTOR LoadRotation(uint32_t index);
+        DirectX::XMVECTOR LoadLossyScale(uint32_t index);
+
+        // 逐层更新所有脏节点，节点多的层会拆分到多个线程
+        void UpdateDirtyNodes();
+
+        size_t GetNodeCount() const { return m_Owners.size(); }
+        size_t GetLevelCount() const { return m_LevelOffsets.empty() ? 0 : m_LevelOffsets.size() - 1; }
+
+    private:
+        std::vector<Transform*> m_Owners;
+        std::vector<uint32_t> m_ParentIndices;
+
+        std::vector<DirectX::XMFLOAT3> m_LocalPositions;
+        std::vector<DirectX::XMFLOAT4> m_LocalRotations; // quaternion
+        std::vector<DirectX::XMFLOAT3> m_LocalEulerAngles; // in degrees
+        std::vector<DirectX::XMFLOAT3> m_LocalScales;
+
+        std::vector<TransformDirtyFlags> m_DirtyFlags;
+        std::vector<DirectX::XMFLOAT4X4> m_LocalToWorldMatrices;
+        std::vector<DirectX::XMFLOAT4X4> m_WorldToLocalMatrices;
+        std::vector<DirectX::XMFLOAT4> m_Rotations; // quaternion
+        std::vector<DirectX::XMFLOAT3> m_LossyScales;
+
+        // 第 i 层的节点范围是 [m_LevelOffsets[i], m_LevelOffsets[i + 1])，最后一层不会是空的
+        std::vector<size_t> m_LevelOffsets;
+
+        std::vector<Transform*> m_SubtreeScratch; // SetParent 时收集子树
+        bool m_HasDirtyNodes = false;
+
+        uint32_t GetLevel(uint32_t index) const;
+
+        // 交换两个节点的数据，同时修正 owner 的 m_Index 和子节点的 m_ParentIndices
+        void SwapNodes(uint32_t a, uint32_t b);
+
+        // 每次和层边界上的节点交换，跨过一层，返回节点新的索引
+        uint32_t MoveToLevel(uint32_t index, uint32_t level);
+        void TrimEmptyLevels();
+
+        void UpdateRange(size_t begin, size_t end);
+
+        // 用 SoA 一次算 4 个节点，count 不足 4 时其余的 lane 重复最后一个节点，但不写回
+        void UpdatePacket(const uint32_t* indices, size_t count);
+    };
+}
@@ -0,0 +1,391 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/Memory/Allocator.h"
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <iterator>
+#include <set>
+#include <stdio.h>
+
+namespace march::bench
+{
+    // 改成 bitmap 之前的 BuddyAllocator，每个 order 一个 std::set，作为对照
+    class SetBuddyAllocator
+    {
+    public:
+        SetBuddyAllocator(uint32_t maxOrder) : m_MaxOrder(maxOrder), m_FreeBlocks(static_cast<size_t>(maxOrder) + 1)
+        {
+            m_FreeBlocks[maxOrder].insert(0);
+        }
+
+        std::optional<uint32_t> AllocateBlock(uint32_t order)
+        {
+            if (order > m_MaxOrder)
+            {
+                return std::nullopt;
+            }
+
+            if (auto it = m_FreeBlocks[order].begin(); it != m_FreeBlocks[order].end())
+            {
+                uint32_t offset = *it;
+                m_FreeBlocks[order].erase(it);
+                return offset;
+            }
+
+            std::optional<uint32_t> left = AllocateBlock(order + 1);
+
+            if (left)
+            {
+                m_FreeBlocks[order].insert(*left + (1u << order));
+            }
+
+            return left;
+        }
+
+        void ReleaseBlock(uint32_t offset, uint32_t order)
+        {
+            uint32_t buddy = offset ^ (1u << order);
+
+            if (auto it = m_FreeBlocks[order].find(buddy); it != m_FreeBlocks[order].end())
+            {
+                m_FreeBlocks[order].erase(it);
+                ReleaseBlock(std::min(offset, buddy), order + 1);
+            }
+            else
+            {
+                m_FreeBlocks[order].insert(offset);
+            }
+        }
+
+    private:
+        uint32_t m_MaxOrder;
+        std::vector<std::set<uint32_t>> m_FreeBlocks;
+    };
+
+    struct BuddyOp
+    {
+        bool IsAllocate;
+        uint32_t Order; // 分配时使用
+        size_t Slot;    // 分配结果存放的位置，释放时用它找到之前的分配
+    };
+
+    // 随机分配和释放，存活的分配数量在一个范围内波动，和 descriptor heap、buffer 子分配的用法类似
+    static std::vector<BuddyOp> MakeBuddyOps(uint32_t maxOrder, size_t numOps, size_t* pOutNumSlots)
+    {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<uint32_t> order(0, std::min(maxOrder, 6u));
+        std::vector<BuddyOp> ops{};
+        std::vector<size_t> liveSlots{};
+        size_t numSlots = 0;
+
+        for (size_t i = 0; i < numOps; i++)
+        {
+            bool allocate = liveSlots.size() < 256 || (liveSlots.size() < 4096 && (rng() & 1) != 0);
+
+            if (allocate)
+            {
+                ops.push_back({ true, order(rng), numSlots });
+                liveSlots.push_back(numSlots++);
+            }
+            else
+            {
+                size_t index = std::uniform_int_distribution<size_t>(0, liveSlots.size() - 1)(rng);
+                ops.push_back({ false, 0, liveSlots[index] });
+                liveSlots[index] = liveSlots.back();
+                liveSlots.pop_back();
+            }
+        }
+
+        // 最后全部释放，下一次迭代从空的状态开始
+        for (size_t slot : liveSlots)
+        {
+            ops.push_back({ false, 0, slot });
+        }
+
+        *pOutNumSlots = numSlots;
+        return ops;
+    }
+
+    BENCHMARK(BuddyAllocator, RandomAllocRelease)
+    {
+        constexpr uint32_t minBlockSize = 256;
+        constexpr uint32_t maxOrder = 18; // 64 MB 的 page，存活的分配不会放不下
+        constexpr size_t numOps = 100000;
+
+        size_t numSlots = 0;
+        std::vector<BuddyOp> ops = MakeBuddyOps(maxOrder, numOps, &numSlots);
+        state.SetItemsPerIteration(ops.size());
+
+        std::vector<BuddyAllocation> allocations(numSlots);
+        std::vector<std::optional<uint32_t>> offsets(numSlots);
+        std::vector<uint32_t> orders(numSlots);
+
+        // 每次迭代最后都全部释放，所以可以在迭代之间复用，构造时的分配不算在里面
+        SetBuddyAllocator setAllocator(maxOrder);
+        BuddyAllocator allocator(minBlockSize, minBlockSize << maxOrder);
+
+        state.Measure("StdSet", [&]
+        {
+            uint64_t sum = 0;
+
+            for (const BuddyOp& op : ops)
+            {
+                if (op.IsAllocate)
+                {
+                    offsets[op.Slot] = setAllocator.AllocateBlock(op.Order);
+                    orders[op.Slot] = op.Order;
+                    sum += offsets[op.Slot].value_or(0);
+                }
+                else if (offsets[op.Slot])
+                {
+                    setAllocator.ReleaseBlock(*offsets[op.Slot], orders[op.Slot]);
+                }
+            }
+
+            KeepAlive(sum);
+        });
+
+        state.Measure("Bitmap", [&]
+        {
+            uint64_t sum = 0;
+
+            for (const BuddyOp& op : ops)
+            {
+                if (op.IsAllocate)
+                {
+                    offsets[op.Slot] = allocator.Allocate(minBlockSize << op.Order, minBlockSize, &allocations[op.Slot]);
+                    sum += offsets[op.Slot].value_or(0);
+                }
+                else if (offsets[op.Slot])
+                {
+                    allocator.Release(allocations[op.Slot]);
+                }
+            }
+
+            KeepAlive(sum);
+        });
+    }
+
+    struct TraceOp
+    {
+        bool IsAllocate;
+        uint32_t Size;      // 分配时使用
+        uint32_t Alignment; // 分配时使用
+        size_t Slot;
+    };
+
+    struct AllocationTrace
+    {
+        std::vector<TraceOp> Ops;
+        size_t NumSlots;
+        size_t PeakOpIndex; // 存活的请求大小最大时的位置，在这里统计浪费的内存
+    };
+
+    // 模拟切换几个场景：每个场景先加载一批资源，运行时不断替换一部分，最后卸载大部分
+    template <typename SizeFunc>
+    static AllocationTrace MakeAllocationTrace(uint32_t seed, uint32_t alignment, SizeFunc&& sizeFunc)
+    {
+        constexpr uint32_t numScenes = 4;
+        constexpr size_t numLoads = 600;
+        constexpr size_t numChurns = 3000;
+
+        std::mt19937 rng(seed);
+        AllocationTrace trace{};
+        trace.NumSlots = 0;
+        trace.PeakOpIndex = 0;
+
+        std::vector<size_t> liveSlots{};
+        std::vector<uint32_t> slotSizes{};
+        uint64_t liveSize = 0;
+        uint64_t peakSize = 0;
+
+        auto allocate = [&]
+        {
+            uint32_t size = sizeFunc(rng);
+            trace.Ops.push_back({ true, size, alignment, trace.NumSlots });
+            liveSlots.push_back(trace.NumSlots++);
+            slotSizes.push_back(size);
+            liveSize += size;
+
+            if (liveSize > peakSize)
+            {
+                peakSize = liveSize;
+                trace.PeakOpIndex = trace.Ops.size();
+            }
+        };
+
+        auto release = [&]
+        {
+            size_t index = std::uniform_int_distribution<size_t>(0, liveSlots.size() - 1)(rng);
+            trace.Ops.push_back({ false, 0, 0, liveSlots[index] });
+            liveSize -= slotSizes[liveSlots[index]];
+            liveSlots[index] = liveSlots.back();
+            liveSlots.pop_back();
+        };
+
+        for (uint32_t scene = 0; scene < numScenes; scene++)
+        {
+            for (size_t i = 0; i < numLoads; i++)
+            {
+                allocate();
+            }
+
+            for (size_t i = 0; i < numChurns; i++)
+            {
+                ((rng() & 1) != 0 || liveSlots.empty()) ? allocate() : release();
+            }
+
+            // 留下一部分给下一个场景，制造碎片
+            while (liveSlots.size() > numLoads / 4)
+            {
+                release();
+            }
+        }
+
+        while (!liveSlots.empty())
+        {
+            release();
+        }
+
+        return trace;
+    }
+
+    // 贴图：大部分是 2 的幂的带 mipmap 的贴图，也有屏幕大小的 render texture
+    static uint32_t SampleTextureSize(std::mt19937& rng)
+    {
+        static constexpr uint32_t screenSizes[][2] = { { 1920, 1080 }, { 1280, 720 }, { 960, 540 }, { 2560, 1440 } };
+
+        uint32_t bytesPerPixel = (rng() % 3) == 0 ? 1 : 4; // BC7 或者 RGBA8
+
+        if ((rng() % 8) == 0)
+        {
+            const uint32_t* screen = screenSizes[rng() % std::size(screenSizes)];
+            return screen[0] * screen[1] * bytesPerPixel;
+        }
+
+        uint32_t width = 64u << (rng() % 6);  // 64 ~ 2048
+        uint32_t height = 64u << (rng() % 6);
+        uint64_t size = static_cast<uint64_t>(width) * height * bytesPerPixel;
+        return static_cast<uint32_t>(size + size / 3); // 加上 mipmap
+    }
+
+    // upload heap 的小 buffer：大部分是 constant buffer，也有动态的顶点和索引
+    static uint32_t SampleUploadBufferSize(std::mt19937& rng)
+    {
+        if ((rng() % 4) != 0)
+        {
+            return std::uniform_int_distribution<uint32_t>(64, 4096)(rng);
+        }
+
+        return std::uniform_int_distribution<uint32_t>(1024, 512 * 1024)(rng);
+    }
+
+    static void ReportFragmentation(const char* name, const char* variant, const AllocatorFragmentationStats& stats)
+    {
+        constexpr uint64_t KB = 1024;
+
+        printf("%-56s %-24s pages %u  total %8llu KB  requested %8llu KB  wasted %8llu KB  unused %8llu KB\n",
+            name, variant, stats.NumPages,
+            static_cast<unsigned long long>(stats.TotalSize / KB),
+            static_cast<unsigned long long>(stats.RequestedSize / KB),
+            static_cast<unsigned long long>(stats.GetWastedSize() / KB),
+            static_cast<unsigned long long>((stats.TotalSize - stats.AllocatedSize) / KB));
+        fflush(stdout);
+    }
+
+    // 回放同一个 trace，比较改成 TLSF 之前的 MultiBuddyAllocator 和现在的 MultiTlsfAllocator
+    // 浪费的内存在存活的请求最多的时候统计，用新的分配器从空的状态开始回放，不计时
+    static void RunTraceReplayBenchmark(BenchmarkState& state, const char* name, const AllocationTrace& trace, uint32_t minBlockSize, uint32_t pageSize)
+    {
+        state.SetItemsPerIteration(trace.Ops.size());
+
+        std::vector<BuddyAllocation> buddyAllocations(trace.NumSlots);
+        std::vector<TlsfAllocation> tlsfAllocations(trace.NumSlots);
+        std::vector<bool> isAllocated(trace.NumSlots);
+
+        auto replayBuddy = [&](MultiBuddyAllocator& allocator, size_t numOps)
+        {
+            uint64_t sum = 0;
+
+            for (size_t i = 0; i < numOps; i++)
+            {
+                const TraceOp& op = trace.Ops[i];
+                size_t pageIndex = 0;
+
+                if (op.IsAllocate)
+                {
+                    std::optional<uint32_t> offset = allocator.Allocate(op.Size, op.Alignment, &pageIndex, &buddyAllocations[op.Slot]);
+                    isAllocated[op.Slot] = offset.has_value();
+                    sum += offset.value_or(0) + pageIndex;
+                }
+                else if (isAllocated[op.Slot])
+                {
+                    allocator.Release(buddyAllocations[op.Slot]);
+                }
+            }
+
+            return sum;
+        };
+
+        auto replayTlsf = [&](MultiTlsfAllocator& allocator, size_t numOps)
+        {
+            uint64_t sum = 0;
+
+            for (size_t i = 0; i < numOps; i++)
+            {
+                const TraceOp& op = trace.Ops[i];
+                size_t pageIndex = 0;
+
+                if (op.IsAllocate)
+                {
+                    std::optional<uint32_t> offset = allocator.Allocate(op.Size, op.Alignment, &pageIndex, &tlsfAllocations[op.Slot]);
+                    isAllocated[op.Slot] = offset.has_value();
+                    sum += offset.value_or(0) + pageIndex;
+                }
+                else if (isAllocated[op.Slot])
+                {
+                    allocator.Release(tlsfAllocations[op.Slot]);
+                }
+            }
+
+            return sum;
+        };
+
+        auto appendBuddyPage = [](uint32_t) {};
+        auto appendTlsfPage = [](size_t, uint32_t) {};
+
+        {
+            MultiBuddyAllocator peakBuddy("PeakBuddy", minBlockSize, pageSize, appendBuddyPage);
+            KeepAlive(replayBuddy(peakBuddy, trace.PeakOpIndex));
+            ReportFragmentation(name, "MultiBuddy", peakBuddy.GetFragmentationStats());
+
+            MultiTlsfAllocator peakTlsf("PeakTlsf", minBlockSize, pageSize, appendTlsfPage);
+            KeepAlive(replayTlsf(peakTlsf, trace.PeakOpIndex));
+            ReportFragmentation(name, "MultiTlsf", peakTlsf.GetFragmentationStats());
+        }
+
+        // trace 最后会全部释放，page 可以在迭代之间复用
+        MultiBuddyAllocator buddy("Buddy", minBlockSize, pageSize, appendBuddyPage);
+        MultiTlsfAllocator tlsf("Tlsf", minBlockSize, pageSize, appendTlsfPage);
+
+        state.Measure("MultiBuddy", [&] { KeepAlive(replayBuddy(buddy, trace.Ops.size())); });
+        state.Measure("MultiTlsf", [&] { KeepAlive(replayTlsf(tlsf, trace.Ops.size())); });
+    }
+
+    BENCHMARK(GpuHeapAllocator, ReplayTextureTrace)
+    {
+        // 和 GfxPlacedResourceAllocator 一样，64KB 的 placement alignment，16MB 的 page
+        constexpr uint32_t placementAlignment = 64 * 1024;
+        AllocationTrace trace = MakeAllocationTrace(7, placementAlignment, SampleTextureSize);
+        RunTraceReplayBenchmark(state, "GpuHeapAllocator.ReplayTextureTrace", trace, placementAlignment, 16 * 1024 * 1024);
+    }
+
+    BENCHMARK(GpuHeapAllocator, ReplayUploadBufferTrace)
+    {
+        // 和 upload heap 的 sub buffer 分配器一样，按 constant buffer 的 256 字节对齐，16MB 的 page
+        constexpr uint32_t cbufferAlignment = 256;
+        AllocationTrace trace = MakeAllocationTrace(8, cbufferAlignment, SampleUploadBufferSize);
+        RunTraceReplayBenchmark(state, "GpuHeapAllocator.ReplayUploadBufferTrace", trace, cbufferAlignment, 16 * 1024 * 1024);
+    }
+}
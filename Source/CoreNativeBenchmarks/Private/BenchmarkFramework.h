@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace march::bench
+{
+    class BenchmarkState;
+
+    using BenchmarkFunc = void(*)(BenchmarkState&);
+
+    // 用静态变量注册，main 里按注册顺序执行
+    struct BenchmarkRegistrar
+    {
+        BenchmarkRegistrar(const char* suite, const char* name, BenchmarkFunc func);
+    };
+
+    // 一个 benchmark 里可以测量多个变体（例如新旧实现），每个变体输出一行结果
+    class BenchmarkState
+    {
+    public:
+        BenchmarkState(std::string fullName, double minSeconds) : m_FullName(std::move(fullName)), m_MinSeconds(minSeconds) {}
+
+        // 每次迭代处理的元素数量，用于输出每个元素的平均耗时
+        void SetItemsPerIteration(uint64_t value) { m_ItemsPerIteration = value; }
+
+        // 先预热，然后至少运行 m_MinSeconds 秒，输出每次迭代耗时的中位数和最小值
+        template <typename _Func>
+        double Measure(const char* variant, _Func&& func)
+        {
+            using Clock = std::chrono::steady_clock;
+
+            for (uint32_t i = 0; i < WarmupIterations; i++)
+            {
+                func();
+            }
+
+            m_Samples.clear();
+            Clock::time_point start = Clock::now();
+
+            while (m_Samples.size() < MinIterations || (std::chrono::duration<double>(Clock::now() - start).count() < m_MinSeconds && m_Samples.size() < MaxIterations))
+            {
+                Clock::time_point t0 = Clock::now();
+                func();
+                Clock::time_point t1 = Clock::now();
+                m_Samples.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+            }
+
+            std::sort(m_Samples.begin(), m_Samples.end());
+            double median = m_Samples[m_Samples.size() / 2];
+            Report(variant, median, m_Samples.front(), m_Samples.size());
+            return median;
+        }
+
+    private:
+        static constexpr uint32_t WarmupIterations = 3;
+        static constexpr size_t MinIterations = 5;
+        static constexpr size_t MaxIterations = 100000;
+
+        std::string m_FullName;
+        double m_MinSeconds;
+        uint64_t m_ItemsPerIteration = 0;
+        std::vector<double> m_Samples{};
+
+        void Report(const char* variant, double medianMicroseconds, double minMicroseconds, size_t iterations) const;
+    };
+
+    // 防止编译器把结果没被使用的计算优化掉
+    void KeepAlive(uint64_t value);
+}
+
+#define MARCH_BENCH_CONCAT_IMPL(a, b) a##b
+#define MARCH_BENCH_CONCAT(a, b) MARCH_BENCH_CONCAT_IMPL(a, b)
+
+#define BENCHMARK(suite, name) \
+    static void MARCH_BENCH_CONCAT(Bench_##suite##_, name)(::march::bench::BenchmarkState& state); \
+    static ::march::bench::BenchmarkRegistrar MARCH_BENCH_CONCAT(g_BenchRegistrar_##suite##_, name)(#suite, #name, &MARCH_BENCH_CONCAT(Bench_##suite##_, name)); \
+    static void MARCH_BENCH_CONCAT(Bench_##suite##_, name)(::march::bench::BenchmarkState& state)
@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/JobManager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+namespace march::bench
+{
+    struct BenchmarkInfo
+    {
+        const char* Suite;
+        const char* Name;
+        BenchmarkFunc Func;
+    };
+
+    // 函数内的静态变量，保证注册时已经初始化
+    static std::vector<BenchmarkInfo>& GetBenchmarks()
+    {
+        static std::vector<BenchmarkInfo> benchmarks{};
+        return benchmarks;
+    }
+
+    BenchmarkRegistrar::BenchmarkRegistrar(const char* suite, const char* name, BenchmarkFunc func)
+    {
+        GetBenchmarks().push_back({ suite, name, func });
+    }
+
+    static std::atomic_uint64_t g_KeepAliveSink = 0;
+
+    void KeepAlive(uint64_t value)
+    {
+        g_KeepAliveSink.fetch_xor(value, std::memory_order_relaxed);
+    }
+
+    void BenchmarkState::Report(const char* variant, double medianMicroseconds, double minMicroseconds, size_t iterations) const
+    {
+        printf("%-56s %-24s median %12.2f us  min %12.2f us  (%zu iterations)", m_FullName.c_str(), variant, medianMicroseconds, minMicroseconds, iterations);
+
+        if (m_ItemsPerIteration > 0)
+        {
+            printf("  %.2f ns/item", medianMicroseconds * 1000.0 / static_cast<double>(m_ItemsPerIteration));
+        }
+
+        printf("\n");
+        fflush(stdout);
+    }
+
+    static int RunBenchmarks(const char* filter, double minSeconds)
+    {
+        for (const BenchmarkInfo& info : GetBenchmarks())
+        {
+            std::string fullName = std::string(info.Suite) + "." + info.Name;
+
+            if (filter != nullptr && strstr(fullName.c_str(), filter) == nullptr)
+            {
+                continue;
+            }
+
+            BenchmarkState state(fullName, minSeconds);
+            info.Func(state);
+        }
+
+        return 0;
+    }
+}
+
+// 用法：CoreNativeBenchmarks [filter] [minSecondsPerVariant]，只运行名字（Suite.Name）包含 filter 的 benchmark
+// 必须用 Release 配置运行，Debug 的结果没有参考价值
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+    double minSeconds = argc > 2 ? atof(argv[2]) : 0.5;
+
+    march::JobManager::Initialize();
+    int result = march::bench::RunBenchmarks(filter, minSeconds);
+    march::JobManager::Shutdown();
+    return result;
+}
@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/Debug.h"
+#include <thread>
+
+namespace march::bench
+{
+    // 多个线程同时写日志，对比每个线程的队列和每条日志都加锁两种写法
+    static void RunLogThroughputBenchmark(BenchmarkState& state, size_t numThreads)
+    {
+        constexpr size_t messagesPerThread = 1000;
+        state.SetItemsPerIteration(numThreads * messagesPerThread);
+
+        LogLevel oldLevel = Log::GetMinimumLevel();
+        Log::SetMinimumLevel(LogLevel::Trace);
+
+        auto runThreads = [numThreads](auto&& func)
+        {
+            std::vector<std::thread> threads{};
+            threads.reserve(numThreads);
+
+            for (size_t t = 0; t < numThreads; t++)
+            {
+                threads.emplace_back([&func, t] { func(t); });
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        };
+
+        // 线程的创建和退出也算在里面，两个变体的开销一样
+        state.Measure("LockPerMessage", [&]
+        {
+            runThreads([](size_t t)
+            {
+                for (size_t i = 0; i < messagesPerThread; i++)
+                {
+                    Log::Message(LogLevel::Trace, fmt::format("Thread {} message {}", t, i), {});
+                }
+            });
+
+            KeepAlive(Log::GetCount(LogLevel::Trace));
+        });
+
+        state.Measure("ThreadQueue", [&]
+        {
+            runThreads([](size_t t)
+            {
+                for (size_t i = 0; i < messagesPerThread; i++)
+                {
+                    LOG_TRACE("Thread {} message {}", t, i);
+                }
+            });
+
+            KeepAlive(Log::GetCount(LogLevel::Trace));
+        });
+
+        Log::Clear();
+        Log::SetMinimumLevel(oldLevel);
+    }
+
+    BENCHMARK(Log, Throughput1Thread)
+    {
+        RunLogThroughputBenchmark(state, 1);
+    }
+
+    BENCHMARK(Log, Throughput8Threads)
+    {
+        RunLogThroughputBenchmark(state, 8);
+    }
+}
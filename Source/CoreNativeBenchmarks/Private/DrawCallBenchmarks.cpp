@@ -0,0 +1,148 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/Rendering/DrawCallSorter.h"
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace march::bench
+{
+    // 50k 个 renderer，500 个 material 分属 50 个 shader，1000 个 mesh，每个 mesh 有 1 ~ 3 个 sub mesh
+    // 只用到指针的值，用数组里元素的地址代替 Shader / Material / Mesh
+    class DrawCallScene
+    {
+    public:
+        static constexpr uint32_t NumRenderers = 50000;
+        static constexpr uint32_t NumShaders = 50;
+        static constexpr uint32_t NumMaterials = 500;
+        static constexpr uint32_t NumMeshes = 1000;
+
+        struct Renderer
+        {
+            uint32_t Mesh;
+            uint32_t Materials[3];
+            bool HasOddNegativeScaling;
+        };
+
+        DrawCallScene() : m_Objects(NumShaders + NumMaterials + NumMeshes)
+        {
+            std::mt19937 rng(11);
+            std::uniform_int_distribution<uint32_t> shader(0, NumShaders - 1);
+            std::uniform_int_distribution<uint32_t> material(0, NumMaterials - 1);
+            std::uniform_int_distribution<uint32_t> mesh(0, NumMeshes - 1);
+            std::uniform_int_distribution<uint32_t> subMeshCount(1, 3);
+
+            for (uint32_t i = 0; i < NumMaterials; i++)
+            {
+                m_MaterialShaders.push_back(shader(rng));
+            }
+
+            for (uint32_t i = 0; i < NumMeshes; i++)
+            {
+                m_MeshSubMeshCounts.push_back(subMeshCount(rng));
+            }
+
+            for (uint32_t i = 0; i < NumRenderers; i++)
+            {
+                Renderer& renderer = m_Renderers.emplace_back();
+                renderer.Mesh = mesh(rng);
+                renderer.HasOddNegativeScaling = (rng() % 16) == 0;
+
+                for (uint32_t& m : renderer.Materials)
+                {
+                    m = material(rng);
+                }
+            }
+        }
+
+        const std::vector<Renderer>& GetRenderers() const { return m_Renderers; }
+        uint32_t GetSubMeshCount(uint32_t mesh) const { return m_MeshSubMeshCounts[mesh]; }
+
+        const void* GetShader(uint32_t material) const { return &m_Objects[m_MaterialShaders[material]]; }
+        const void* GetMaterial(uint32_t material) const { return &m_Objects[NumShaders + material]; }
+        const void* GetMesh(uint32_t mesh) const { return &m_Objects[NumShaders + NumMaterials + mesh]; }
+
+        size_t GetItemCount() const
+        {
+            size_t count = 0;
+
+            for (const Renderer& renderer : m_Renderers)
+            {
+                count += GetSubMeshCount(renderer.Mesh);
+            }
+
+            return count;
+        }
+
+    private:
+        std::vector<uint8_t> m_Objects;
+        std::vector<uint32_t> m_MaterialShaders{};
+        std::vector<uint32_t> m_MeshSubMeshCounts{};
+        std::vector<Renderer> m_Renderers{};
+    };
+
+    BENCHMARK(DrawCallBatching, Sort50kRenderers)
+    {
+        DrawCallScene scene{};
+        const std::vector<DrawCallScene::Renderer>& renderers = scene.GetRenderers();
+        state.SetItemsPerIteration(scene.GetItemCount());
+
+        // 改成排序键之前的做法：每帧用 std::map 按 draw call 收集 instance
+        using MapKey = std::tuple<const void*, const void*, const void*, bool, uint32_t>;
+        std::map<MapKey, std::vector<uint32_t>> drawCallMap{};
+
+        state.Measure("StdMap", [&]
+        {
+            drawCallMap.clear();
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(renderers.size()); i++)
+            {
+                const DrawCallScene::Renderer& renderer = renderers[i];
+
+                for (uint32_t subMesh = 0; subMesh < scene.GetSubMeshCount(renderer.Mesh); subMesh++)
+                {
+                    uint32_t material = renderer.Materials[subMesh];
+                    MapKey key{ scene.GetShader(material), scene.GetMaterial(material), scene.GetMesh(renderer.Mesh), renderer.HasOddNegativeScaling, subMesh };
+                    drawCallMap[key].push_back(i);
+                }
+            }
+
+            KeepAlive(drawCallMap.size());
+        });
+
+        DrawCallSorter sorter{};
+
+        state.Measure("PackedRadix", [&]
+        {
+            sorter.Clear();
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(renderers.size()); i++)
+            {
+                const DrawCallScene::Renderer& renderer = renderers[i];
+
+                for (uint32_t subMesh = 0; subMesh < scene.GetSubMeshCount(renderer.Mesh); subMesh++)
+                {
+                    uint32_t material = renderer.Materials[subMesh];
+                    sorter.Add(scene.GetShader(material), scene.GetMaterial(material), scene.GetMesh(renderer.Mesh), renderer.HasOddNegativeScaling, subMesh, i);
+                }
+            }
+
+            sorter.Sort();
+
+            // 和 MeshRendererBatch 一样数出 draw call 的数量
+            const std::vector<DrawCallSortItem>& items = sorter.GetItems();
+            uint64_t numDrawCalls = 0;
+
+            for (size_t i = 0; i < items.size(); i++)
+            {
+                if (i == 0 || !sorter.IsSameDrawCall(items[i - 1], items[i]))
+                {
+                    numDrawCalls++;
+                }
+            }
+
+            KeepAlive(numDrawCalls);
+        });
+    }
+}
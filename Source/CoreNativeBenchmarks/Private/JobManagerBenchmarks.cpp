@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/JobManager.h"
+#include <DirectXCollision.h>
+#include <random>
+#include <atomic>
+
+using namespace DirectX;
+
+// 旧的实现每个 index 都要经过一次 C# 到 C++ 的 interop，没有 .NET runtime 时无法复现
+// 这里用 batchSize = 1 近似每个 index 单独派发的开销，实际的旧实现只会更慢
+
+namespace march::bench
+{
+    // 和 CullMeshRenderers 差不多的工作量：变换 bounds，再和视锥体求交
+    struct CullingWorkload
+    {
+        std::vector<BoundingBox> LocalBounds;
+        std::vector<XMFLOAT4X4> Matrices;
+        std::vector<uint8_t> Visibility;
+        BoundingFrustum Frustum;
+
+        explicit CullingWorkload(size_t count)
+        {
+            std::mt19937 rng(42);
+            std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+            std::uniform_real_distribution<float> extent(0.5f, 5.0f);
+
+            LocalBounds.resize(count);
+            Matrices.resize(count);
+            Visibility.resize(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                LocalBounds[i] = BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(extent(rng), extent(rng), extent(rng)));
+                XMStoreFloat4x4(&Matrices[i], XMMatrixTranslation(position(rng), position(rng), position(rng)));
+            }
+
+            BoundingFrustum::CreateFromMatrix(Frustum, XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f));
+        }
+
+        void Cull(size_t i)
+        {
+            BoundingBox bounds{};
+            LocalBounds[i].Transform(bounds, XMLoadFloat4x4(&Matrices[i]));
+            Visibility[i] = Frustum.Intersects(bounds) ? 1 : 0;
+        }
+
+        uint64_t CountVisible() const
+        {
+            uint64_t count = 0;
+
+            for (uint8_t v : Visibility)
+            {
+                count += v;
+            }
+
+            return count;
+        }
+    };
+
+    static void RunCullingBenchmark(BenchmarkState& state, size_t count)
+    {
+        CullingWorkload workload(count);
+        state.SetItemsPerIteration(count);
+
+        state.Measure("Serial", [&]
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                workload.Cull(i);
+            }
+
+            KeepAlive(workload.CountVisible());
+        });
+
+        state.Measure("BatchSize1", [&]
+        {
+            JobManager::ParallelFor(count, 1, [&](size_t i) { workload.Cull(i); });
+            KeepAlive(workload.CountVisible());
+        });
+
+        state.Measure("ParallelFor", [&]
+        {
+            JobManager::ParallelFor(count, 0, [&](size_t i) { workload.Cull(i); });
+            KeepAlive(workload.CountVisible());
+        });
+    }
+
+    BENCHMARK(JobManager, Culling1K)
+    {
+        RunCullingBenchmark(state, 1000);
+    }
+
+    BENCHMARK(JobManager, Culling10K)
+    {
+        RunCullingBenchmark(state, 10000);
+    }
+
+    BENCHMARK(JobManager, Culling100K)
+    {
+        RunCullingBenchmark(state, 100000);
+    }
+
+    // 调度本身的开销：一组有依赖关系的小 job，类似每帧的 culling -> instance data -> sort
+    BENCHMARK(JobManager, DependencyChain)
+    {
+        constexpr size_t numChains = 16;
+        constexpr size_t chainLength = 4;
+        state.SetItemsPerIteration(numChains * chainLength);
+
+        state.Measure("Continuations", [&]
+        {
+            std::atomic_uint64_t counter = 0;
+            JobHandle tails[numChains];
+
+            for (size_t c = 0; c < numChains; c++)
+            {
+                JobHandle handle{};
+
+                for (size_t i = 0; i < chainLength; i++)
+                {
+                    handle = JobManager::Run([&counter] { counter.fetch_add(1, std::memory_order_relaxed); }, { handle });
+                }
+
+                tails[c] = handle;
+            }
+
+            for (JobHandle& handle : tails)
+            {
+                handle.Complete();
+            }
+
+            KeepAlive(counter.load());
+        });
+    }
+}
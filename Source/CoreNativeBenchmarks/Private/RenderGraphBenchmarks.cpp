@@ -0,0 +1,306 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/Rendering/RenderGraph.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+#include "Engine/Rendering/D3D12Impl/ShaderUtils.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+// 用 null backend 只编译不执行，不需要 GfxDevice
+// 每次迭代都要重新构建 graph，所以单独测一次构建的耗时作为对照，编译的耗时是两者的差
+
+namespace march::bench
+{
+    struct RandomGraphWrite
+    {
+        size_t Texture;
+        bool IsRead;                     // 不用 render target 时先 In 再 Out
+        RenderTargetInitMode InitMode;   // 用 render target 时使用
+    };
+
+    // 预先生成好每个 pass 的读写，每次迭代按相同的顺序调用 RenderGraphBuilder，不包含生成随机数的开销
+    struct RandomGraphPass
+    {
+        std::string Name;
+        std::vector<size_t> Reads; // RandomGraph::TextureIds 的索引
+        std::vector<RandomGraphWrite> Writes;
+        bool UseColorTargets;
+        bool EnableAsyncCompute;
+        bool AllowPassCulling;
+        double Cost;
+    };
+
+    struct RandomGraph
+    {
+        std::vector<int32> TextureIds;
+        std::vector<GfxTextureDesc> TextureDescs;
+        size_t NumExternalTextures;
+        std::vector<RandomGraphPass> Passes;
+    };
+
+    static GfxTextureDesc MakeTextureDesc(GfxTextureFormat format, uint32_t width, uint32_t height)
+    {
+        GfxTextureDesc desc{};
+        desc.Format = format;
+        desc.Flags = GfxTextureFlags::None;
+        desc.Dimension = GfxTextureDimension::Tex2D;
+        desc.Width = width;
+        desc.Height = height;
+        desc.DepthOrArraySize = 1;
+        desc.MSAASamples = 1;
+        desc.Filter = GfxTextureFilterMode::Bilinear;
+        desc.Wrap = GfxTextureWrapMode::Clamp;
+        desc.MipmapBias = 0;
+        return desc;
+    }
+
+    // 和 CoreNativeTests 中 RandomGraphsMatchReference 的 graph 分布一样：
+    // 1/4 的 pass 可以用 async compute，一半的 graphics pass 用 render target，读写的资源偏向最近写过的
+    static RandomGraph MakeRandomGraph(uint32_t seed, size_t numPasses)
+    {
+        static constexpr size_t NumExternalTextures = 8;
+        static constexpr GfxTextureFormat Formats[] = { GfxTextureFormat::R8G8B8A8_UNorm, GfxTextureFormat::R16G16B16A16_Float, GfxTextureFormat::R8_UNorm };
+        static constexpr uint32_t Sizes[] = { 256, 512, 1024 };
+
+        std::mt19937 rng(seed);
+        std::bernoulli_distribution enableAsyncCompute(0.25);
+        std::bernoulli_distribution disallowCulling(0.03);
+        std::bernoulli_distribution useColorTargets(0.5);
+        std::bernoulli_distribution writeExternal(0.08);
+        std::bernoulli_distribution writeNew(0.7);
+        std::bernoulli_distribution readWrite(0.3);
+        std::uniform_int_distribution<size_t> numReads(0, 3);
+        std::uniform_int_distribution<size_t> numWrites(1, 3);
+        std::uniform_int_distribution<size_t> external(0, NumExternalTextures - 1);
+        std::uniform_int_distribution<size_t> format(0, 2);
+        std::uniform_int_distribution<size_t> size(0, 2);
+        std::uniform_int_distribution<int> initMode(0, 2);
+        std::uniform_real_distribution<double> cost(5, 200);
+        std::geometric_distribution<size_t> recency(0.03);
+
+        RandomGraph graph{};
+        graph.NumExternalTextures = NumExternalTextures;
+
+        std::vector<size_t> readable{}; // 有生产者的资源和外部资源
+
+        auto addTexture = [&graph](const std::string& name, const GfxTextureDesc& desc)
+        {
+            graph.TextureIds.push_back(ShaderUtils::GetIdFromString(name));
+            graph.TextureDescs.push_back(desc);
+            return graph.TextureIds.size() - 1;
+        };
+
+        for (size_t i = 0; i < NumExternalTextures; i++)
+        {
+            readable.push_back(addTexture("_BenchExternal" + std::to_string(i), MakeTextureDesc(GfxTextureFormat::R8G8B8A8_UNorm, 256, 256)));
+        }
+
+        auto pickReadable = [&]()
+        {
+            size_t offset = std::min(recency(rng), readable.size() - 1);
+            return readable[readable.size() - 1 - offset];
+        };
+
+        for (size_t passIndex = 0; passIndex < numPasses; passIndex++)
+        {
+            RandomGraphPass& pass = graph.Passes.emplace_back();
+            pass.Name = "BenchPass" + std::to_string(passIndex);
+            pass.EnableAsyncCompute = enableAsyncCompute(rng);
+            pass.AllowPassCulling = !disallowCulling(rng);
+            pass.UseColorTargets = !pass.EnableAsyncCompute && useColorTargets(rng);
+            pass.Cost = cost(rng);
+
+            // 同一个 pass 里的资源不重复
+            std::vector<size_t> used{};
+            std::vector<size_t> created{};
+
+            auto tryUse = [&used](size_t t)
+            {
+                if (std::find(used.begin(), used.end(), t) != used.end())
+                {
+                    return false;
+                }
+
+                used.push_back(t);
+                return true;
+            };
+
+            for (size_t i = numReads(rng); i > 0; i--)
+            {
+                if (size_t t = pickReadable(); tryUse(t))
+                {
+                    pass.Reads.push_back(t);
+                }
+            }
+
+            for (size_t i = numWrites(rng); i > 0; i--)
+            {
+                if (writeExternal(rng))
+                {
+                    if (size_t t = external(rng); tryUse(t))
+                    {
+                        pass.Writes.push_back({ t, false, RenderTargetInitMode::Load });
+                    }
+                }
+                else if (writeNew(rng))
+                {
+                    // 新建的资源没有内容可以读
+                    uint32_t width = Sizes[size(rng)];
+                    uint32_t height = Sizes[size(rng)];
+                    GfxTextureDesc desc = MakeTextureDesc(Formats[format(rng)], width, height);
+                    size_t t = addTexture("_BenchTexture" + std::to_string(graph.TextureIds.size()), desc);
+                    tryUse(t);
+                    created.push_back(t);
+                    pass.Writes.push_back({ t, false, RenderTargetInitMode::Clear });
+                }
+                else if (size_t t = pickReadable(); tryUse(t))
+                {
+                    pass.Writes.push_back({ t, readWrite(rng), static_cast<RenderTargetInitMode>(initMode(rng)) });
+                }
+            }
+
+            readable.insert(readable.end(), created.begin(), created.end());
+        }
+
+        return graph;
+    }
+
+    static void BuildGraph(RenderGraph& graph, const RandomGraph& desc, std::vector<TextureHandle>& textures)
+    {
+        textures.clear();
+
+        for (size_t i = 0; i < desc.TextureIds.size(); i++)
+        {
+            if (i < desc.NumExternalTextures)
+            {
+                textures.push_back(graph.ImportTexture(desc.TextureIds[i], desc.TextureDescs[i]));
+            }
+            else
+            {
+                textures.push_back(graph.RequestTexture(desc.TextureIds[i], desc.TextureDescs[i]));
+            }
+        }
+
+        for (const RandomGraphPass& pass : desc.Passes)
+        {
+            RenderGraphBuilder builder = graph.AddPass(pass.Name);
+            builder.EnableAsyncCompute(pass.EnableAsyncCompute);
+            builder.AllowPassCulling(pass.AllowPassCulling);
+            builder.SetEstimatedCost(pass.Cost);
+
+            for (size_t t : pass.Reads)
+            {
+                builder.In(textures[t]);
+            }
+
+            for (size_t i = 0; i < pass.Writes.size(); i++)
+            {
+                const RandomGraphWrite& write = pass.Writes[i];
+
+                if (pass.UseColorTargets)
+                {
+                    builder.SetColorTarget(textures[write.Texture], static_cast<uint32_t>(i), write.InitMode);
+                }
+                else
+                {
+                    if (write.IsRead)
+                    {
+                        builder.In(textures[write.Texture]);
+                    }
+
+                    builder.Out(textures[write.Texture]);
+                }
+            }
+        }
+    }
+
+    static void ReportGraph(const char* name, const RenderGraph& graph, size_t numResources)
+    {
+        size_t numCulled = 0;
+        size_t numAsyncCompute = 0;
+
+        for (const RenderGraphPass& pass : graph.GetPasses())
+        {
+            numCulled += pass.IsCulled ? 1 : 0;
+            numAsyncCompute += pass.IsAsyncCompute ? 1 : 0;
+        }
+
+        const RenderGraphCompileStats& stats = graph.GetCompileStats();
+        printf("%-56s %-24s passes %zu  resources %zu  culled %zu  async compute %zu  hoisted %u  merged %u\n",
+            name, "Graph", graph.GetPasses().size(), numResources, numCulled, numAsyncCompute, stats.NumHoistedPasses, stats.NumMergedPasses);
+        fflush(stdout);
+    }
+
+    static void RunCompileBenchmark(BenchmarkState& state, const char* name, size_t numPasses)
+    {
+        // 两个 topology 不同的 graph 交替编译，每次都不能命中缓存
+        RandomGraph graphA = MakeRandomGraph(1, numPasses);
+        RandomGraph graphB = MakeRandomGraph(2, numPasses);
+
+        auto backend = std::make_unique<RenderGraphNullBackend>();
+        RenderGraphNullBackend* nullBackend = backend.get();
+        RenderGraph graph(std::move(backend));
+        std::vector<TextureHandle> textures{};
+
+        BuildGraph(graph, graphA, textures);
+        graph.Compile();
+        ReportGraph(name, graph, graphA.TextureIds.size());
+        graph.Reset();
+        nullBackend->AdvanceFrame();
+
+        state.SetItemsPerIteration(numPasses);
+
+        state.Measure("BuildOnly", [&]
+        {
+            BuildGraph(graph, graphA, textures);
+            KeepAlive(graph.GetPasses().size());
+            graph.Reset();
+            nullBackend->AdvanceFrame();
+        });
+
+        bool useGraphB = false;
+
+        state.Measure("CacheMiss", [&]
+        {
+            BuildGraph(graph, useGraphB ? graphB : graphA, textures);
+            graph.Compile();
+            KeepAlive(graph.GetCompileStats().NumCacheMisses);
+            graph.Reset();
+            nullBackend->AdvanceFrame();
+            useGraphB = !useGraphB;
+        });
+
+        state.Measure("CacheHit", [&]
+        {
+            BuildGraph(graph, graphA, textures);
+            graph.Compile();
+            KeepAlive(graph.GetCompileStats().NumCacheHits);
+            graph.Reset();
+            nullBackend->AdvanceFrame();
+        });
+
+        const RenderGraphCompileStats& stats = graph.GetCompileStats();
+        printf("%-56s %-24s hits %llu  misses %llu\n", name, "CompileCache",
+            static_cast<unsigned long long>(stats.NumCacheHits), static_cast<unsigned long long>(stats.NumCacheMisses));
+        fflush(stdout);
+    }
+
+    BENCHMARK(RenderGraph, Compile64Passes)
+    {
+        RunCompileBenchmark(state, "RenderGraph.Compile64Passes", 64);
+    }
+
+    BENCHMARK(RenderGraph, Compile256Passes)
+    {
+        RunCompileBenchmark(state, "RenderGraph.Compile256Passes", 256);
+    }
+
+    BENCHMARK(RenderGraph, Compile1024Passes)
+    {
+        RunCompileBenchmark(state, "RenderGraph.Compile1024Passes", 1024);
+    }
+}
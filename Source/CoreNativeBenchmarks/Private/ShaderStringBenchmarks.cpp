@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/Rendering/D3D12Impl/ShaderUtils.h"
+#include "Engine/JobManager.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 对比：所有线程共用一个 std::mutex 保护的 unordered_map，这是给旧实现加锁最直接的做法
+
+namespace march::bench
+{
+    static constexpr size_t NumShaderStrings = 1024;
+    static constexpr size_t NumShaderStringLookups = 1 << 18;
+
+    static std::vector<std::string> CreateShaderStrings()
+    {
+        std::vector<std::string> strings{};
+
+        for (size_t i = 0; i < NumShaderStrings; i++)
+        {
+            strings.push_back("_BenchShaderProperty" + std::to_string(i));
+        }
+
+        return strings;
+    }
+
+    BENCHMARK(ShaderStrings, LookupContention)
+    {
+        const std::vector<std::string> strings = CreateShaderStrings();
+        std::vector<ShaderStringKey> keys{};
+        std::vector<int32> ids{};
+
+        for (const std::string& s : strings)
+        {
+            keys.emplace_back(s);
+            ids.push_back(ShaderUtils::GetIdFromString(keys.back())); // 预热，测的都是已经存在的 string
+        }
+
+        std::mutex globalMutex{};
+        std::unordered_map<std::string, int32> globalMap{};
+
+        for (size_t i = 0; i < strings.size(); i++)
+        {
+            globalMap.emplace(strings[i], static_cast<int32>(i));
+        }
+
+        std::vector<int32> results(NumShaderStringLookups);
+        state.SetItemsPerIteration(NumShaderStringLookups);
+
+        auto checksum = [&results]
+        {
+            uint64_t sum = 0;
+
+            for (int32 id : results)
+            {
+                sum += static_cast<uint64_t>(id);
+            }
+
+            return sum;
+        };
+
+        state.Measure("GlobalMutexMap", [&]
+        {
+            JobManager::ParallelFor(NumShaderStringLookups, 256, [&](size_t i)
+            {
+                std::lock_guard<std::mutex> lock(globalMutex);
+                results[i] = globalMap.find(strings[i % NumShaderStrings])->second;
+            });
+
+            KeepAlive(checksum());
+        });
+
+        state.Measure("ShardedStringView", [&]
+        {
+            JobManager::ParallelFor(NumShaderStringLookups, 256, [&](size_t i)
+            {
+                results[i] = ShaderUtils::GetIdFromString(std::string_view(strings[i % NumShaderStrings]));
+            });
+
+            KeepAlive(checksum());
+        });
+
+        // 字面量用 static constexpr ShaderStringKey 时 hash 在编译期算好，这里提前算好来模拟
+        state.Measure("ShardedPrecomputedKey", [&]
+        {
+            JobManager::ParallelFor(NumShaderStringLookups, 256, [&](size_t i)
+            {
+                results[i] = ShaderUtils::GetIdFromString(keys[i % NumShaderStrings]);
+            });
+
+            KeepAlive(checksum());
+        });
+
+        state.Measure("IdToString", [&]
+        {
+            JobManager::ParallelFor(NumShaderStringLookups, 256, [&](size_t i)
+            {
+                results[i] = static_cast<int32>(ShaderUtils::GetStringFromId(ids[i % NumShaderStrings]).size());
+            });
+
+            KeepAlive(checksum());
+        });
+    }
+}
@@ -0,0 +1,192 @@
+#include "pch.h"
+#include "BenchmarkFramework.h"
+#include "Engine/Transform.h"
+#include <random>
+
+using namespace DirectX;
+
+namespace march::bench
+{
+    // 100k 个节点，8 层，每层 12500 个，父节点在上一层中随机选
+    class TransformScene
+    {
+    public:
+        static constexpr size_t NumLevels = 8;
+        static constexpr size_t NodesPerLevel = 12500;
+
+        TransformScene()
+        {
+            std::mt19937 rng(7);
+            std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+            std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+            std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+            m_Transforms.reserve(NumLevels * NodesPerLevel);
+
+            for (size_t level = 0; level < NumLevels; level++)
+            {
+                size_t parentBegin = level > 0 ? (level - 1) * NodesPerLevel : 0;
+                std::uniform_int_distribution<size_t> parent(parentBegin, parentBegin + NodesPerLevel - 1);
+
+                for (size_t i = 0; i < NodesPerLevel; i++)
+                {
+                    Transform* transform = m_Transforms.emplace_back(std::make_unique<Transform>()).get();
+
+                    if (level > 0)
+                    {
+                        TransformInternalUtility::SetParent(transform, m_Transforms[parent(rng)].get());
+                    }
+
+                    TransformInternalUtility::SetLocalPosition(transform, XMFLOAT3(position(rng), position(rng), position(rng)));
+                    TransformInternalUtility::SetLocalEulerAngles(transform, XMFLOAT3(angle(rng), angle(rng), angle(rng)));
+                    TransformInternalUtility::SetLocalScale(transform, XMFLOAT3(scale(rng), scale(rng), scale(rng)));
+                }
+            }
+
+            Transform::UpdateAllDirtyTransforms();
+        }
+
+        ~TransformScene()
+        {
+            // 先销毁子节点，避免析构时逐个解除父子关系
+            while (!m_Transforms.empty())
+            {
+                m_Transforms.pop_back();
+            }
+        }
+
+        size_t GetCount() const { return m_Transforms.size(); }
+        Transform* Get(size_t index) const { return m_Transforms[index].get(); }
+
+    private:
+        std::vector<std::unique_ptr<Transform>> m_Transforms{};
+    };
+
+    // 没有缓存时的做法：每次查询都沿着父节点链重新计算
+    static XMMATRIX WalkParentChain(const Transform* transform)
+    {
+        XMMATRIX result = XMMatrixIdentity();
+
+        for (; transform != nullptr; transform = transform->GetParent())
+        {
+            XMMATRIX local = XMMatrixAffineTransformation(transform->LoadLocalScale(), XMVectorZero(), transform->LoadLocalRotation(), transform->LoadLocalPosition());
+            result = XMMatrixMultiply(result, local);
+        }
+
+        return result;
+    }
+
+    static uint64_t HashMatrix(FXMMATRIX m)
+    {
+        XMFLOAT4X4 value{};
+        XMStoreFloat4x4(&value, m);
+        return static_cast<uint64_t>(value._41 * 1000.0f);
+    }
+
+    BENCHMARK(Transform, Hierarchy100KDepth8)
+    {
+        TransformScene scene{};
+        const size_t count = scene.GetCount();
+        state.SetItemsPerIteration(count);
+
+        state.Measure("ParentChainWalk", [&]
+        {
+            uint64_t hash = 0;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                hash += HashMatrix(WalkParentChain(scene.Get(i)));
+            }
+
+            KeepAlive(hash);
+        });
+
+        state.Measure("CachedQuery", [&]
+        {
+            uint64_t hash = 0;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                hash += HashMatrix(scene.Get(i)->LoadLocalToWorldMatrix());
+            }
+
+            KeepAlive(hash);
+        });
+
+        // 所有根节点都动了，整棵树都要更新
+        state.Measure("UpdateAllDirty", [&]
+        {
+            for (size_t i = 0; i < TransformScene::NodesPerLevel; i++)
+            {
+                Transform* root = scene.Get(i);
+                TransformInternalUtility::SetLocalPosition(root, root->GetLocalPosition());
+            }
+
+            Transform::UpdateAllDirtyTransforms();
+        });
+
+        // 典型的一帧：少量物体在动
+        std::mt19937 rng(13);
+        std::uniform_int_distribution<size_t> node(0, count - 1);
+        std::vector<size_t> moving(count / 100);
+
+        for (size_t& index : moving)
+        {
+            index = node(rng);
+        }
+
+        state.Measure("UpdateOnePercentDirty", [&]
+        {
+            for (size_t index : moving)
+            {
+                Transform* transform = scene.Get(index);
+                TransformInternalUtility::SetLocalPosition(transform, transform->GetLocalPosition());
+            }
+
+            Transform::UpdateAllDirtyTransforms();
+        });
+    }
+
+    // 层级是增量维护的，改父节点和增删节点只移动受影响的节点，不再整体重排
+    BENCHMARK(Transform, EditHierarchy100KDepth8)
+    {
+        TransformScene scene{};
+        const size_t count = scene.GetCount();
+        const size_t leafBegin = (TransformScene::NumLevels - 1) * TransformScene::NodesPerLevel;
+        const size_t numEdits = count / 100;
+        state.SetItemsPerIteration(numEdits);
+
+        std::mt19937 rng(17);
+        std::uniform_int_distribution<size_t> leaf(leafBegin, count - 1);
+        std::uniform_int_distribution<size_t> parent(0, leafBegin - 1);
+
+        // 叶子节点挂到前 7 层的随机节点下面，层级会变，但树的深度不会超过 8
+        state.Measure("ReparentOnePercent", [&]
+        {
+            for (size_t i = 0; i < numEdits; i++)
+            {
+                TransformInternalUtility::SetParent(scene.Get(leaf(rng)), scene.Get(parent(rng)));
+            }
+
+            Transform::UpdateAllDirtyTransforms();
+        });
+
+        std::vector<std::unique_ptr<Transform>> created(numEdits);
+
+        state.Measure("CreateDestroyOnePercent", [&]
+        {
+            for (std::unique_ptr<Transform>& transform : created)
+            {
+                transform = std::make_unique<Transform>();
+                TransformInternalUtility::SetParent(transform.get(), scene.Get(parent(rng)));
+            }
+
+            Transform::UpdateAllDirtyTransforms();
+
+            for (std::unique_ptr<Transform>& transform : created)
+            {
+                transform.reset();
+            }
+        });
+    }
+}
@@ -0,0 +1,11 @@
+local m = marchmodule {
+    name = "CoreNativeBenchmarks",
+    type = "Native",
+    kind = "ConsoleApp",
+}
+
+debugdir(m.binaryDir)
+
+uses {
+    "CoreNative",
+}
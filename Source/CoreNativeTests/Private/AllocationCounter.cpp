@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+#include <stdlib.h>
+#include <new>
+
+namespace march::test
+{
+    // 没有动态初始化，线程刚启动时在 operator new 里访问也是安全的
+    static thread_local uint64_t t_NumHeapAllocations = 0;
+
+    uint64_t GetNumThreadHeapAllocations()
+    {
+        return t_NumHeapAllocations;
+    }
+
+    static void* AllocateCounted(std::size_t size)
+    {
+        t_NumHeapAllocations++;
+
+        void* p = malloc(size == 0 ? 1 : size);
+
+        if (p == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+
+        return p;
+    }
+}
+
+// 替换全局的 operator new 和 operator delete
+// nothrow 版本也要替换，有的运行时（例如 ASan）不会让它调用这里的 operator new，释放时就和 free 对不上
+// 没有替换 align_val_t 的版本，它们自己配对使用，不会和这里的 free 混在一起
+
+void* operator new(std::size_t size)
+{
+    return march::test::AllocateCounted(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return march::test::AllocateCounted(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return march::test::AllocateCounted(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return march::test::AllocateCounted(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace march::test
+{
+    // 当前线程调用全局 operator new 的次数，AllocationCounter.cpp 替换了全局的 operator new
+    uint64_t GetNumThreadHeapAllocations();
+
+    // 统计从构造到现在，当前线程在堆上分配了多少次，用来检查热路径没有堆分配
+    class AllocationCounter final
+    {
+        uint64_t m_StartCount;
+
+    public:
+        AllocationCounter() : m_StartCount(GetNumThreadHeapAllocations()) {}
+
+        uint64_t GetCount() const { return GetNumThreadHeapAllocations() - m_StartCount; }
+    };
+}
@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Memory/Allocator.h"
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+// 和改成 bitmap 之前的实现比较，两者选 block 的规则相同，offset 应该完全一致
+
+namespace march::test
+{
+    // 每个 order 一个 std::set，递归拆分和合并
+    class ReferenceBuddyAllocator
+    {
+    public:
+        ReferenceBuddyAllocator(uint32_t numUnits) : m_MaxOrder(0)
+        {
+            while ((1u << m_MaxOrder) < numUnits)
+            {
+                m_MaxOrder++;
+            }
+
+            m_FreeBlocks.resize(static_cast<size_t>(m_MaxOrder) + 1);
+            m_FreeBlocks[m_MaxOrder].insert(0);
+        }
+
+        std::optional<uint32_t> AllocateBlock(uint32_t order)
+        {
+            if (order > m_MaxOrder)
+            {
+                return std::nullopt;
+            }
+
+            if (auto it = m_FreeBlocks[order].begin(); it != m_FreeBlocks[order].end())
+            {
+                uint32_t offset = *it;
+                m_FreeBlocks[order].erase(it);
+                return offset;
+            }
+
+            std::optional<uint32_t> left = AllocateBlock(order + 1);
+
+            if (left)
+            {
+                m_FreeBlocks[order].insert(*left + (1u << order));
+            }
+
+            return left;
+        }
+
+        void ReleaseBlock(uint32_t offset, uint32_t order)
+        {
+            uint32_t buddy = offset ^ (1u << order);
+
+            if (auto it = m_FreeBlocks[order].find(buddy); order < m_MaxOrder && it != m_FreeBlocks[order].end())
+            {
+                m_FreeBlocks[order].erase(it);
+                ReleaseBlock(std::min(offset, buddy), order + 1);
+            }
+            else
+            {
+                m_FreeBlocks[order].insert(offset);
+            }
+        }
+
+        uint32_t GetNumFreeBlocks() const
+        {
+            size_t count = 0;
+
+            for (const std::set<uint32_t>& blocks : m_FreeBlocks)
+            {
+                count += blocks.size();
+            }
+
+            return static_cast<uint32_t>(count);
+        }
+
+        uint32_t GetLargestFreeOrder() const
+        {
+            for (uint32_t order = m_MaxOrder + 1; order-- > 0;)
+            {
+                if (!m_FreeBlocks[order].empty())
+                {
+                    return order;
+                }
+            }
+
+            return 0;
+        }
+
+    private:
+        uint32_t m_MaxOrder;
+        std::vector<std::set<uint32_t>> m_FreeBlocks;
+    };
+
+    static void RunBuddyFuzz(uint32_t minBlockSize, uint32_t maxBlockSize, uint32_t seed, uint32_t numSteps)
+    {
+        BuddyAllocator allocator(minBlockSize, maxBlockSize);
+        ReferenceBuddyAllocator reference(maxBlockSize / minBlockSize);
+
+        struct Live
+        {
+            BuddyAllocation Allocation;
+            uint32_t UnitOffset;
+        };
+
+        std::vector<Live> live{};
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<uint32_t> op(0, 99);
+        std::uniform_int_distribution<uint32_t> sizeShift(0, 12);
+
+        for (uint32_t step = 0; step < numSteps; step++)
+        {
+            if (live.empty() || op(rng) < 55)
+            {
+                // 大小跨越多个 order，偏向小的
+                uint32_t shift = sizeShift(rng);
+                uint32_t size = std::uniform_int_distribution<uint32_t>(1, minBlockSize << shift)(rng);
+                size = std::min(size, maxBlockSize);
+
+                BuddyAllocation allocation{};
+                std::optional<uint32_t> offset = allocator.Allocate(size, minBlockSize, &allocation);
+
+                uint32_t units = (size + minBlockSize - 1) / minBlockSize;
+                uint32_t order = 0;
+
+                while ((1u << order) < units)
+                {
+                    order++;
+                }
+
+                std::optional<uint32_t> expected = reference.AllocateBlock(order);
+                TEST_REQUIRE_EQ(offset.has_value(), expected.has_value());
+
+                if (offset)
+                {
+                    TEST_REQUIRE_EQ(allocation.Order, order);
+                    TEST_REQUIRE_EQ(allocation.Offset, *expected);
+                    TEST_REQUIRE_EQ(*offset, *expected * minBlockSize);
+                    live.push_back({ allocation, *expected });
+                }
+            }
+            else
+            {
+                size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+                allocator.Release(live[index].Allocation);
+                reference.ReleaseBlock(live[index].UnitOffset, live[index].Allocation.Order);
+
+                live[index] = live.back();
+                live.pop_back();
+            }
+
+            TEST_REQUIRE_EQ(allocator.GetNumFreeBlocks(), reference.GetNumFreeBlocks());
+        }
+
+        for (const Live& l : live)
+        {
+            allocator.Release(l.Allocation);
+        }
+
+        // 全部释放以后会合并回一个最大的 block
+        TEST_CHECK_EQ(allocator.GetNumFreeBlocks(), 1u);
+        TEST_CHECK_EQ(allocator.GetLargestFreeBlockSize(), maxBlockSize);
+        TEST_CHECK_EQ(allocator.GetTotalAllocatedSize(), 0u);
+    }
+
+    TEST_CASE(BuddyAllocator, MatchesReferenceOnSmallPage)
+    {
+        RunBuddyFuzz(256, 256 * 1024, 1, 20000);
+    }
+
+    TEST_CASE(BuddyAllocator, MatchesReferenceOnLargePage)
+    {
+        // order 0 有 2^20 个 block，bitmap 有 4 层
+        RunBuddyFuzz(64, 64 * 1024 * 1024, 2, 20000);
+    }
+
+    TEST_CASE(BuddyAllocator, MatchesReferenceWithSingleBlock)
+    {
+        RunBuddyFuzz(4096, 4096, 3, 100);
+    }
+
+    TEST_CASE(BuddyAllocator, AlignsInsideBlock)
+    {
+        BuddyAllocator allocator(256, 64 * 1024);
+        BuddyAllocation first{};
+        BuddyAllocation second{};
+
+        TEST_REQUIRE(allocator.Allocate(256, 256, &first).has_value());
+
+        // 对齐大于 block 时多分配 alignment 字节，再把 offset 对齐
+        std::optional<uint32_t> offset = allocator.Allocate(1000, 4096, &second);
+        TEST_REQUIRE(offset.has_value());
+        TEST_CHECK_EQ(*offset % 4096, 0u);
+        TEST_CHECK(*offset + 1000 <= second.Offset * 256 + (256u << second.Order));
+    }
+}
@@ -0,0 +1,215 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Memory/Allocator.h"
+#include "Engine/Memory/DefragmentationPlanner.h"
+#include <limits>
+
+// 碎片整理的规划是纯 CPU 计算，不需要 GfxDevice
+
+namespace march::test
+{
+    static constexpr uint64_t PageSize = 1024;
+
+    static DefragBudget MakeBudget(uint64_t maxBytes = std::numeric_limits<uint64_t>::max(), uint32_t maxMoves = 1000)
+    {
+        return DefragBudget{ maxBytes, maxMoves, 0.5f };
+    }
+
+    static DefragAllocationInfo MakeAllocation(size_t pageIndex, uint64_t size, bool isMovable = true)
+    {
+        return DefragAllocationInfo{ pageIndex, size, size, isMovable };
+    }
+
+    TEST_CASE(DefragmentationPlanner, EvacuatesEmptiestPageIntoBestFitBlocks)
+    {
+        std::vector<DefragPageInfo> pages{ { PageSize, 512 }, { PageSize, 128 }, { PageSize, 384 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, 512 }, { 1, 896 }, { 2, 64 }, { 2, 576 } };
+        std::vector<DefragAllocationInfo> allocations{};
+        allocations.push_back(MakeAllocation(0, 512));
+        allocations.push_back(MakeAllocation(1, 64));
+        allocations.push_back(MakeAllocation(1, 64));
+        allocations.push_back(MakeAllocation(2, 384));
+
+        DefragmentationPlanner planner{};
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+
+        // page 1 最空，每个分配都放进最小的够用的 block
+        TEST_REQUIRE_EQ(planner.GetEvacuatedPages().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetEvacuatedPages()[0], size_t(1));
+
+        const std::vector<DefragMove>& moves = planner.GetMoves();
+        TEST_REQUIRE_EQ(moves.size(), size_t(2));
+        TEST_CHECK_EQ(moves[0].AllocationIndex, size_t(1));
+        TEST_CHECK_EQ(moves[0].DestinationPageIndex, size_t(2));
+        TEST_CHECK_EQ(moves[1].AllocationIndex, size_t(2));
+        TEST_CHECK_EQ(moves[1].DestinationPageIndex, size_t(0));
+
+        // page 0 和 page 2 都接收了数据，这次不再清空
+        TEST_CHECK_EQ(planner.GetStats().NumMoves, 2u);
+        TEST_CHECK_EQ(planner.GetStats().MovedBytes, uint64_t(128));
+        TEST_CHECK_EQ(planner.GetStats().ReleasedBytes, PageSize);
+    }
+
+    TEST_CASE(DefragmentationPlanner, RequiresSingleBlockLargeEnough)
+    {
+        // 其他 page 的空闲空间加起来够，但没有一个 block 放得下
+        std::vector<DefragPageInfo> pages{ { PageSize, 256 }, { PageSize, 768 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, 768 }, { 1, 128 }, { 1, 128 } };
+        std::vector<DefragAllocationInfo> allocations{ MakeAllocation(0, 256), MakeAllocation(1, 768) };
+
+        DefragmentationPlanner planner{};
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+
+        TEST_CHECK(planner.GetEvacuatedPages().empty());
+        TEST_CHECK(planner.GetMoves().empty());
+    }
+
+    TEST_CASE(DefragmentationPlanner, UsesRequiredBlockSizeForFit)
+    {
+        std::vector<DefragPageInfo> pages{ { PageSize, 100 }, { PageSize, 512 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, 924 }, { 1, 128 }, { 1, 256 } };
+
+        // 对齐以后需要 192 字节的 block，128 字节的放不下
+        std::vector<DefragAllocationInfo> allocations{ DefragAllocationInfo{ 0, 100, 192, true } };
+
+        DefragmentationPlanner planner{};
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+
+        TEST_REQUIRE_EQ(planner.GetMoves().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetMoves()[0].DestinationPageIndex, size_t(1));
+        TEST_CHECK_EQ(planner.GetStats().MovedBytes, uint64_t(100));
+    }
+
+    TEST_CASE(DefragmentationPlanner, ConsumesFreeBlocksAcrossAllocations)
+    {
+        std::vector<DefragPageInfo> pages{ { PageSize, 384 }, { PageSize, 768 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, 640 }, { 1, 256 } };
+
+        // 第一个分配用掉 page 1 唯一的 block 以后，第二个分配就没有地方放了
+        std::vector<DefragAllocationInfo> allocations{ MakeAllocation(0, 256), MakeAllocation(0, 128), MakeAllocation(1, 768) };
+
+        DefragmentationPlanner planner{};
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+
+        TEST_CHECK(planner.GetEvacuatedPages().empty());
+        TEST_CHECK(planner.GetMoves().empty());
+    }
+
+    TEST_CASE(DefragmentationPlanner, SkipsPagesWithImmovableAllocations)
+    {
+        std::vector<DefragPageInfo> pages{ { PageSize, 128 }, { PageSize, 256 }, { PageSize, 512 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, 896 }, { 1, 768 }, { 2, 512 } };
+        std::vector<DefragAllocationInfo> allocations{};
+        allocations.push_back(MakeAllocation(0, 64));
+        allocations.push_back(MakeAllocation(0, 64, /* isMovable */ false));
+        allocations.push_back(MakeAllocation(1, 256));
+        allocations.push_back(MakeAllocation(2, 512));
+
+        DefragmentationPlanner planner{};
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+
+        // page 0 最空，但有不能移动的分配
+        TEST_REQUIRE_EQ(planner.GetEvacuatedPages().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetEvacuatedPages()[0], size_t(1));
+        TEST_REQUIRE_EQ(planner.GetMoves().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetMoves()[0].AllocationIndex, size_t(2));
+        TEST_CHECK_EQ(planner.GetMoves()[0].DestinationPageIndex, size_t(2));
+    }
+
+    TEST_CASE(DefragmentationPlanner, RespectsBudget)
+    {
+        std::vector<DefragPageInfo> pages{ { PageSize, 128 }, { PageSize, 256 }, { PageSize, 0 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, 896 }, { 1, 768 }, { 2, PageSize } };
+        std::vector<DefragAllocationInfo> allocations{};
+        allocations.push_back(MakeAllocation(0, 64));
+        allocations.push_back(MakeAllocation(0, 64));
+        allocations.push_back(MakeAllocation(1, 256));
+
+        DefragmentationPlanner planner{};
+
+        // 字节数的预算只够 page 2（空的，不需要移动）
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget(100));
+        TEST_REQUIRE_EQ(planner.GetEvacuatedPages().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetEvacuatedPages()[0], size_t(2));
+        TEST_CHECK(planner.GetMoves().empty());
+
+        // 移动次数的预算不够搬空 page 0，跳过它去搬 page 1
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget(std::numeric_limits<uint64_t>::max(), 1));
+        TEST_REQUIRE_EQ(planner.GetEvacuatedPages().size(), size_t(2));
+        TEST_CHECK_EQ(planner.GetEvacuatedPages()[0], size_t(2));
+        TEST_CHECK_EQ(planner.GetEvacuatedPages()[1], size_t(1));
+        TEST_REQUIRE_EQ(planner.GetMoves().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetMoves()[0].AllocationIndex, size_t(2));
+        TEST_CHECK_EQ(planner.GetMoves()[0].DestinationPageIndex, size_t(0));
+    }
+
+    TEST_CASE(DefragmentationPlanner, KeepsAtLeastOnePage)
+    {
+        std::vector<DefragPageInfo> pages{ { PageSize, 0 }, { PageSize, 0 } };
+        std::vector<DefragFreeBlock> freeBlocks{ { 0, PageSize }, { 1, PageSize } };
+        std::vector<DefragAllocationInfo> allocations{};
+
+        DefragmentationPlanner planner{};
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+
+        TEST_REQUIRE_EQ(planner.GetEvacuatedPages().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetEvacuatedPages()[0], size_t(0));
+
+        pages.resize(1);
+        freeBlocks.resize(1);
+        planner.Plan(pages, freeBlocks, allocations, MakeBudget());
+        TEST_CHECK(planner.GetEvacuatedPages().empty());
+    }
+
+    TEST_CASE(DefragmentationPlanner, GuaranteedBlockSizeAlwaysFits)
+    {
+        constexpr uint32_t minBlockSize = 256;
+        const uint32_t sizes[] = { 1, 256, 300, 4096, 65536, 100000, 1 << 20 };
+        const uint32_t alignments[] = { 256, 4096, 65536 };
+
+        for (uint32_t size : sizes)
+        {
+            for (uint32_t alignment : alignments)
+            {
+                std::optional<uint64_t> blockSize = TlsfAllocator::GetGuaranteedBlockSize(minBlockSize, size, alignment);
+                TEST_REQUIRE(blockSize.has_value());
+                TEST_CHECK(*blockSize >= size);
+
+                // 只有这么大的 page 也要分配成功，因为 block 的起始位置不一定对齐，所以在 page 前面先占一个最小的 block
+                TlsfAllocator allocator(minBlockSize, static_cast<uint32_t>(*blockSize) + minBlockSize);
+                TlsfAllocation padding{};
+                TEST_REQUIRE(allocator.Allocate(minBlockSize, minBlockSize, &padding).has_value());
+
+                TlsfAllocation allocation{};
+                TEST_CHECK(allocator.Allocate(size, alignment, &allocation).has_value());
+            }
+        }
+    }
+
+    TEST_CASE(DefragmentationPlanner, AllocatorReclaimsEmptyPageBeforeAppending)
+    {
+        constexpr uint32_t minBlockSize = 256;
+        uint32_t numAppendedPages = 0;
+        MultiTlsfAllocator allocator("Test", minBlockSize, 64 * 1024, [&numAppendedPages](size_t, uint32_t) { numAppendedPages++; });
+
+        size_t pageIndex = 0;
+        TlsfAllocation allocation{};
+        TEST_REQUIRE(allocator.Allocate(1024, minBlockSize, &pageIndex, &allocation).has_value());
+        TEST_CHECK_EQ(numAppendedPages, 1u);
+
+        // 模拟碎片整理：page 不再参与分配，上面的资源都释放了，但还没销毁
+        allocator.SetPageAllocatable(pageIndex, false);
+        allocator.Release(allocation);
+
+        size_t newPageIndex = 0;
+        TEST_REQUIRE(allocator.Allocate(1024, minBlockSize, &newPageIndex, &allocation).has_value());
+        TEST_CHECK_EQ(newPageIndex, pageIndex);
+        TEST_CHECK_EQ(numAppendedPages, 1u);
+        TEST_CHECK(allocator.IsPageAllocatable(pageIndex));
+
+        // 指定 page 分配
+        TlsfAllocation other{};
+        TEST_CHECK(allocator.AllocateInPage(pageIndex, 2048, minBlockSize, &other).has_value());
+        TEST_CHECK_EQ(other.PageIndex, static_cast<uint32_t>(pageIndex));
+    }
+}
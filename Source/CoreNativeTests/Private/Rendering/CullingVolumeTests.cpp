@@ -0,0 +1,202 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/CullingVolume.h"
+#include <DirectXCollision.h>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// SIMD 剔除的结果和 DirectXCollision 的相交测试比较
+// 范围的起点和长度故意不是 4 / 8 的倍数，packet 和剩下的标量部分都会走到
+
+namespace march::test
+{
+    struct CullRange
+    {
+        size_t Begin;
+        size_t Count;
+    };
+
+    static constexpr CullRange CullRanges[] =
+    {
+        { 0, 1 }, { 0, 3 }, { 1, 5 }, { 3, 7 }, { 2, 13 }, { 0, 1000 }, { 1, 1003 }, { 3, 2045 },
+    };
+
+    static constexpr size_t NumCullBoxes = 2048;
+
+    class CullingScene
+    {
+    public:
+        explicit CullingScene(uint32_t seed) : m_Rng(seed)
+        {
+            std::uniform_real_distribution<float> position(-120.0f, 120.0f);
+            std::uniform_real_distribution<float> extent(0.05f, 10.0f);
+
+            for (size_t i = 0; i < NumCullBoxes; i++)
+            {
+                BoundingBox& box = m_Boxes.emplace_back(XMFLOAT3(position(m_Rng), position(m_Rng), position(m_Rng)), XMFLOAT3(extent(m_Rng), extent(m_Rng), extent(m_Rng)));
+                m_BoxesSoA.Add(box);
+            }
+        }
+
+        BoundingFrustum CreateFrustum()
+        {
+            std::uniform_real_distribution<float> position(-30.0f, 30.0f);
+            std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+
+            BoundingFrustum frustum{};
+            BoundingFrustum::CreateFromMatrix(frustum, XMMatrixPerspectiveFovLH(XMConvertToRadians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f));
+
+            XMVECTOR rotation = XMQuaternionRotationRollPitchYaw(angle(m_Rng), angle(m_Rng), angle(m_Rng));
+            XMVECTOR translation = XMVectorSet(position(m_Rng), position(m_Rng), position(m_Rng), 0.0f);
+            frustum.Transform(frustum, 1.0f, rotation, translation);
+            return frustum;
+        }
+
+        BoundingOrientedBox CreateOrientedBox()
+        {
+            std::uniform_real_distribution<float> position(-30.0f, 30.0f);
+            std::uniform_real_distribution<float> extent(5.0f, 60.0f);
+            std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+
+            XMFLOAT4 orientation{};
+            XMStoreFloat4(&orientation, XMQuaternionRotationRollPitchYaw(angle(m_Rng), angle(m_Rng), angle(m_Rng)));
+            return BoundingOrientedBox(XMFLOAT3(position(m_Rng), position(m_Rng), position(m_Rng)), XMFLOAT3(extent(m_Rng), extent(m_Rng), extent(m_Rng)), orientation);
+        }
+
+        BoundingBox CreateBox()
+        {
+            std::uniform_real_distribution<float> position(-30.0f, 30.0f);
+            std::uniform_real_distribution<float> extent(5.0f, 60.0f);
+            return BoundingBox(XMFLOAT3(position(m_Rng), position(m_Rng), position(m_Rng)), XMFLOAT3(extent(m_Rng), extent(m_Rng), extent(m_Rng)));
+        }
+
+        BoundingSphere CreateSphere()
+        {
+            std::uniform_real_distribution<float> position(-30.0f, 30.0f);
+            std::uniform_real_distribution<float> radius(5.0f, 60.0f);
+            return BoundingSphere(XMFLOAT3(position(m_Rng), position(m_Rng), position(m_Rng)), radius(m_Rng));
+        }
+
+        const std::vector<BoundingBox>& GetBoxes() const { return m_Boxes; }
+        const BoundingBoxSoA& GetBoxesSoA() const { return m_BoxesSoA; }
+
+    private:
+        std::mt19937 m_Rng;
+        std::vector<BoundingBox> m_Boxes{};
+        BoundingBoxSoA m_BoxesSoA{};
+    };
+
+    static std::vector<uint32_t> Cull(const CullingVolume& volume, const BoundingBoxSoA& boxes, size_t begin, size_t end)
+    {
+        std::vector<uint32_t> indices(end - begin);
+        indices.resize(volume.Cull(boxes, begin, end, indices.data()));
+        return indices;
+    }
+
+    // 可见性按索引展开，方便和参考结果逐个比较
+    static std::vector<bool> ToVisibility(const std::vector<uint32_t>& indices, size_t begin, size_t end)
+    {
+        std::vector<bool> visible(end - begin, false);
+
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            TEST_REQUIRE(indices[i] >= begin && indices[i] < end);
+            TEST_REQUIRE(i == 0 || indices[i - 1] < indices[i]); // 按顺序，不重复
+            visible[indices[i] - begin] = true;
+        }
+
+        return visible;
+    }
+
+    // exact 为 false 时只要求保守：参考结果可见的一定要保留，反过来不要求
+    // 另外 SIMD 的结果必须和逐个走标量路径的结果一致
+    template <typename Volume>
+    static void CheckAgainstReference(const CullingScene& scene, const Volume& volume, bool exact)
+    {
+        CullingVolume cullingVolume(volume);
+        const std::vector<BoundingBox>& boxes = scene.GetBoxes();
+
+        for (const CullRange& range : CullRanges)
+        {
+            size_t begin = range.Begin;
+            size_t end = range.Begin + range.Count;
+            std::vector<bool> visible = ToVisibility(Cull(cullingVolume, scene.GetBoxesSoA(), begin, end), begin, end);
+
+            for (size_t i = begin; i < end; i++)
+            {
+                bool expected = volume.Intersects(boxes[i]);
+                bool actual = visible[i - begin];
+
+                if (exact)
+                {
+                    TEST_CHECK_EQ(actual, expected);
+                }
+                else
+                {
+                    TEST_CHECK(actual || !expected);
+                }
+
+                bool scalar = Cull(cullingVolume, scene.GetBoxesSoA(), i, i + 1).size() == 1;
+                TEST_CHECK_EQ(actual, scalar);
+            }
+        }
+    }
+
+    TEST_CASE(CullingVolume, FrustumIsConservative)
+    {
+        CullingScene scene(1);
+        size_t numVisible = 0;
+        size_t numExtra = 0;
+
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            BoundingFrustum frustum = scene.CreateFrustum();
+            CheckAgainstReference(scene, frustum, false);
+
+            // 多保留的只是角落附近的少数
+            CullingVolume cullingVolume(frustum);
+            std::vector<uint32_t> indices = Cull(cullingVolume, scene.GetBoxesSoA(), 0, NumCullBoxes);
+
+            for (uint32_t index : indices)
+            {
+                ContainmentType type = frustum.Contains(scene.GetBoxes()[index]);
+                (type == DISJOINT ? numExtra : numVisible)++;
+            }
+        }
+
+        TEST_CHECK(numVisible > 0);
+        TEST_CHECK(numExtra * 4 < numVisible);
+    }
+
+    TEST_CASE(CullingVolume, OrientedBoxIsConservative)
+    {
+        CullingScene scene(2);
+
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            CheckAgainstReference(scene, scene.CreateOrientedBox(), false);
+        }
+    }
+
+    TEST_CASE(CullingVolume, BoxMatchesIntersects)
+    {
+        CullingScene scene(3);
+
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            CheckAgainstReference(scene, scene.CreateBox(), true);
+        }
+    }
+
+    TEST_CASE(CullingVolume, SphereMatchesIntersects)
+    {
+        CullingScene scene(4);
+
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            CheckAgainstReference(scene, scene.CreateSphere(), true);
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "AllocationCounter.h"
+#include "Engine/Rendering/DrawCallSorter.h"
+#include <algorithm>
+#include <random>
+#include <tuple>
+#include <vector>
+
+// 排序只用到指针的值，用数组里元素的地址代替 Shader / Material / Mesh
+
+namespace march::test
+{
+    struct DrawCallInput
+    {
+        uint32_t Shader;
+        uint32_t Material;
+        uint32_t Mesh;
+        bool HasOddNegativeScaling;
+        uint32_t SubMeshIndex;
+        uint32_t RendererIndex;
+    };
+
+    // 和 DrawCallSorter 一样，指针按第一次出现的顺序映射为 id
+    static std::vector<uint32_t> MakeFirstSeenIds(const std::vector<DrawCallInput>& inputs, uint32_t DrawCallInput::* field)
+    {
+        std::vector<uint32_t> ids{};
+
+        for (const DrawCallInput& input : inputs)
+        {
+            uint32_t value = input.*field;
+
+            if (value >= ids.size())
+            {
+                ids.resize(static_cast<size_t>(value) + 1, UINT32_MAX);
+            }
+        }
+
+        uint32_t next = 0;
+
+        for (const DrawCallInput& input : inputs)
+        {
+            uint32_t& id = ids[input.*field];
+
+            if (id == UINT32_MAX)
+            {
+                id = next++;
+            }
+        }
+
+        return ids;
+    }
+
+    // 把输入加到 sorter 里排序，结果和 std::stable_sort 对字段元组排序的结果比较
+    static void CheckAgainstReference(DrawCallSorter& sorter, const std::vector<DrawCallInput>& inputs, bool expectWideKeys)
+    {
+        uint32_t maxValue = 0;
+
+        for (const DrawCallInput& input : inputs)
+        {
+            maxValue = std::max({ maxValue, input.Shader, input.Material, input.Mesh });
+        }
+
+        std::vector<uint8_t> objects(static_cast<size_t>(maxValue) + 1);
+        std::vector<uint8_t> otherObjects(objects.size() * 2); // shader、material、mesh 分别用不同的地址
+
+        sorter.Clear();
+
+        for (const DrawCallInput& input : inputs)
+        {
+            sorter.Add(&objects[input.Shader], &otherObjects[input.Material * 2], &otherObjects[input.Mesh * 2 + 1],
+                input.HasOddNegativeScaling, input.SubMeshIndex, input.RendererIndex);
+        }
+
+        sorter.Sort();
+        TEST_CHECK_EQ(sorter.IsUsingWideKeys(), expectWideKeys);
+
+        std::vector<uint32_t> shaderIds = MakeFirstSeenIds(inputs, &DrawCallInput::Shader);
+        std::vector<uint32_t> materialIds = MakeFirstSeenIds(inputs, &DrawCallInput::Material);
+        std::vector<uint32_t> meshIds = MakeFirstSeenIds(inputs, &DrawCallInput::Mesh);
+
+        auto toTuple = [&](const DrawCallInput& input)
+        {
+            return std::make_tuple(shaderIds[input.Shader], materialIds[input.Material], meshIds[input.Mesh], input.HasOddNegativeScaling, input.SubMeshIndex);
+        };
+
+        std::vector<DrawCallInput> expected = inputs;
+        std::stable_sort(expected.begin(), expected.end(), [&](const DrawCallInput& a, const DrawCallInput& b)
+        {
+            return toTuple(a) < toTuple(b);
+        });
+
+        const std::vector<DrawCallSortItem>& items = sorter.GetItems();
+        TEST_REQUIRE_EQ(items.size(), expected.size());
+
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            TEST_REQUIRE_EQ(items[i].RendererIndex, expected[i].RendererIndex);
+            TEST_REQUIRE_EQ(items[i].SubMeshIndex, expected[i].SubMeshIndex);
+
+            if (i > 0)
+            {
+                bool isSame = toTuple(expected[i - 1]) == toTuple(expected[i]);
+                TEST_REQUIRE_EQ(sorter.IsSameDrawCall(items[i - 1], items[i]), isSame);
+            }
+        }
+    }
+
+    // 每个 renderer 有 1 ~ 3 个 sub mesh，按 renderer 的顺序添加
+    static std::vector<DrawCallInput> MakeRandomInputs(uint32_t seed, uint32_t numRenderers, uint32_t numShaders, uint32_t numMaterials, uint32_t numMeshes)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<uint32_t> shader(0, numShaders - 1);
+        std::uniform_int_distribution<uint32_t> material(0, numMaterials - 1);
+        std::uniform_int_distribution<uint32_t> mesh(0, numMeshes - 1);
+        std::uniform_int_distribution<uint32_t> subMeshCount(1, 3);
+        std::vector<DrawCallInput> inputs{};
+
+        for (uint32_t renderer = 0; renderer < numRenderers; renderer++)
+        {
+            uint32_t meshIndex = mesh(rng);
+            bool odd = (rng() % 8) == 0;
+
+            for (uint32_t subMesh = 0, count = subMeshCount(rng); subMesh < count; subMesh++)
+            {
+                inputs.push_back({ shader(rng), material(rng), meshIndex, odd, subMesh, renderer });
+            }
+        }
+
+        return inputs;
+    }
+
+    TEST_CASE(DrawCallSorter, SortsSmallBatchByFields)
+    {
+        DrawCallSorter sorter{};
+        std::vector<DrawCallInput> inputs{};
+        inputs.push_back({ 1, 0, 0, false, 0, 0 });
+        inputs.push_back({ 0, 1, 0, false, 0, 1 });
+        inputs.push_back({ 0, 0, 1, true, 1, 2 });
+        inputs.push_back({ 0, 0, 1, false, 1, 3 });
+        inputs.push_back({ 1, 0, 0, false, 0, 4 });
+        inputs.push_back({ 0, 1, 0, false, 0, 5 });
+
+        CheckAgainstReference(sorter, inputs, false);
+    }
+
+    TEST_CASE(DrawCallSorter, RadixSortMatchesReference)
+    {
+        DrawCallSorter sorter{};
+
+        // 超过 256 个 item 走基数排序
+        CheckAgainstReference(sorter, MakeRandomInputs(1, 300, 4, 20, 10), false);
+        CheckAgainstReference(sorter, MakeRandomInputs(2, 20000, 50, 500, 1000), false);
+    }
+
+    TEST_CASE(DrawCallSorter, FallsBackWhenShaderIdsOverflow)
+    {
+        DrawCallSorter sorter{};
+        constexpr uint32_t numShaders = (1u << DrawCallSorter::ShaderIdBits) + 100;
+
+        // 前面的 item 已经用打包的键添加了，溢出后要拆回各个字段
+        CheckAgainstReference(sorter, MakeRandomInputs(3, 20000, numShaders, 500, 100), true);
+
+        // 不溢出时 Clear 以后回到打包的键
+        CheckAgainstReference(sorter, MakeRandomInputs(4, 1000, 10, 10, 10), false);
+    }
+
+    TEST_CASE(DrawCallSorter, FallsBackWhenSubMeshIndexOverflows)
+    {
+        DrawCallSorter sorter{};
+        std::vector<DrawCallInput> inputs = MakeRandomInputs(5, 500, 3, 5, 5);
+
+        // 一个 mesh 有超过 2^11 个 sub mesh，溢出的 sub mesh 不能和低位相同的合批
+        constexpr uint32_t subMeshLimit = 1u << DrawCallSorter::SubMeshIndexBits;
+        inputs.push_back({ 0, 0, 0, false, 1, 500 });
+        inputs.push_back({ 0, 0, 0, false, subMeshLimit + 1, 500 });
+        inputs.push_back({ 0, 0, 0, false, 1, 501 });
+        inputs.push_back({ 0, 0, 0, false, subMeshLimit + 1, 501 });
+
+        CheckAgainstReference(sorter, inputs, true);
+    }
+
+    TEST_CASE(DrawCallSorter, SteadyStateDoesNotAllocate)
+    {
+        DrawCallSorter sorter{};
+        std::vector<DrawCallInput> inputs = MakeRandomInputs(6, 5000, 50, 500, 1000);
+        std::vector<uint8_t> objects(3000);
+
+        auto sortFrame = [&]()
+        {
+            sorter.Clear();
+
+            for (const DrawCallInput& input : inputs)
+            {
+                sorter.Add(&objects[input.Shader], &objects[1000 + input.Material], &objects[2000 + input.Mesh],
+                    input.HasOddNegativeScaling, input.SubMeshIndex, input.RendererIndex);
+            }
+
+            sorter.Sort();
+        };
+
+        sortFrame();
+
+        AllocationCounter counter{};
+
+        for (uint32_t frame = 0; frame < 8; frame++)
+        {
+            sortFrame();
+        }
+
+        TEST_CHECK_EQ(counter.GetCount(), uint64_t(0));
+    }
+}
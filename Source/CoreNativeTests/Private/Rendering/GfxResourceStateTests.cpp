@@ -0,0 +1,79 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/D3D12Impl/GfxResourceState.h"
+
+// local resource state 的合并规则要和普通的 TransitionResource 一致，不产生多余的 barrier
+
+namespace march::test
+{
+    using Utils = GfxResourceStateUtils;
+
+    static constexpr D3D12_RESOURCE_STATES Unknown = GfxResourceStateUtils::LocalStateUnknown;
+
+    TEST_CASE(GfxResourceState, NeedTransition)
+    {
+        TEST_CHECK(!Utils::NeedTransition(D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON));
+        TEST_CHECK(Utils::NeedTransition(D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COMMON));
+        TEST_CHECK(Utils::NeedTransition(D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+        TEST_CHECK(Utils::NeedTransition(D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+        // 已经包含需要的 state
+        TEST_CHECK(!Utils::NeedTransition(D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+        TEST_CHECK(!Utils::NeedTransition(D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+        TEST_CHECK(Utils::NeedTransition(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE));
+    }
+
+    TEST_CASE(GfxResourceState, FirstUseSkipsBarrierWhenStateIsIncluded)
+    {
+        // 只读了一次，之前的 state 已经可以读，和普通的 TransitionResource 一样保持原来的 state
+        GfxLocalStateResolveResult result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_GENERIC_READ,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, false);
+        TEST_CHECK(!result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+        result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_RENDER_TARGET,
+            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_RENDER_TARGET, false);
+        TEST_CHECK(!result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    }
+
+    TEST_CASE(GfxResourceState, FirstUseTransitionsWhenStateIsMissing)
+    {
+        GfxLocalStateResolveResult result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_RENDER_TARGET,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, false);
+        TEST_CHECK(result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+        // COMMON 为 0，不能用按位包含来判断
+        result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_COPY_DEST,
+            D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COMMON, false);
+        TEST_CHECK(result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_COMMON);
+    }
+
+    TEST_CASE(GfxResourceState, LocalBarriersRequireExactFirstState)
+    {
+        // context 中之后的 barrier 是 PIXEL_SHADER_RESOURCE -> RENDER_TARGET，实际的 state 必须先转换过去
+        GfxLocalStateResolveResult result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_GENERIC_READ,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
+        TEST_CHECK(result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+        result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
+        TEST_CHECK(!result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    }
+
+    TEST_CASE(GfxResourceState, UnusedSubresourceKeepsState)
+    {
+        GfxLocalStateResolveResult result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_COPY_DEST, Unknown, Unknown, false);
+        TEST_CHECK(!result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_COPY_DEST);
+
+        // aliasing 之后直接从创建时的 state 开始，不需要补 barrier
+        result = Utils::ResolveLocalState(D3D12_RESOURCE_STATE_COPY_DEST, Unknown, D3D12_RESOURCE_STATE_RENDER_TARGET, true);
+        TEST_CHECK(!result.NeedBarrier);
+        TEST_CHECK_EQ(result.FinalState, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    }
+}
@@ -0,0 +1,210 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "AllocationCounter.h"
+#include "Engine/Rendering/RenderGraph.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphArena.h"
+#include "Engine/Rendering/D3D12Impl/ShaderUtils.h"
+
+// 稳定以后每帧都不应该在堆上分配内存，先跑几帧预热，再统计之后的帧
+
+namespace march::test
+{
+    static constexpr uint32_t NumWarmUpFrames = 4;
+    static constexpr uint32_t NumMeasuredFrames = 16;
+
+    TEST_CASE(RenderGraphArena, ReusesPagesAfterReset)
+    {
+        RenderGraphArena arena(4096);
+
+        auto buildFrame = [&arena]()
+        {
+            // 有小的分配，也有超过一页的大分配
+            for (uint32_t i = 0; i < 100; i++)
+            {
+                arena.Allocate(48, 8);
+            }
+
+            arena.Allocate(3 * 4096, 16);
+            arena.AllocateString("ShadowCaster");
+            arena.Allocate(10000, 8);
+        };
+
+        for (uint32_t frame = 0; frame < NumWarmUpFrames; frame++)
+        {
+            buildFrame();
+            arena.Reset();
+        }
+
+        AllocationCounter counter{};
+
+        for (uint32_t frame = 0; frame < NumMeasuredFrames; frame++)
+        {
+            buildFrame();
+            arena.Reset();
+        }
+
+        TEST_CHECK_EQ(counter.GetCount(), uint64_t(0));
+    }
+
+    TEST_CASE(RenderGraphArena, SmallVectorAndFunctionStayOffHeap)
+    {
+        RenderGraphArena arena{};
+        uint64_t sum = 0;
+
+        auto buildFrame = [&arena, &sum]()
+        {
+            // 超出内部容量以后放到 arena 里
+            RenderGraphSmallVector<size_t, 4> values{};
+
+            for (size_t i = 0; i < 32; i++)
+            {
+                values.Append(i, arena);
+            }
+
+            // 和 pass 的 render func 一样，捕获几个指针和值
+            const RenderGraphSmallVector<size_t, 4>* pValues = &values;
+            uint64_t* pSum = &sum;
+            double scale = 2.0;
+
+            RenderGraphFunction<void(uint32_t)> func{};
+            func.Set([pValues, pSum, scale](uint32_t offset)
+            {
+                *pSum += static_cast<uint64_t>((*pValues)[offset] * scale);
+            }, arena);
+
+            // 移动以后仍然可以调用，和 pass 放在 vector 里扩容时一样
+            RenderGraphFunction<void(uint32_t)> moved = std::move(func);
+            moved(31);
+
+            arena.Reset();
+        };
+
+        for (uint32_t frame = 0; frame < NumWarmUpFrames; frame++)
+        {
+            buildFrame();
+        }
+
+        AllocationCounter counter{};
+
+        for (uint32_t frame = 0; frame < NumMeasuredFrames; frame++)
+        {
+            buildFrame();
+        }
+
+        TEST_CHECK_EQ(counter.GetCount(), uint64_t(0));
+        TEST_CHECK_EQ(sum, uint64_t(62 * (NumWarmUpFrames + NumMeasuredFrames)));
+    }
+
+    static GfxTextureDesc MakeFrameTextureDesc(GfxTextureFormat format)
+    {
+        GfxTextureDesc desc{};
+        desc.Format = format;
+        desc.Flags = GfxTextureFlags::None;
+        desc.Dimension = GfxTextureDimension::Tex2D;
+        desc.Width = 1920;
+        desc.Height = 1080;
+        desc.DepthOrArraySize = 1;
+        desc.MSAASamples = 1;
+        desc.Filter = GfxTextureFilterMode::Bilinear;
+        desc.Wrap = GfxTextureWrapMode::Clamp;
+        desc.MipmapBias = 0;
+        return desc;
+    }
+
+    // 热路径上的 id 都是提前算好的，字符串转 id 不算在帧里
+    struct FrameTextureIds
+    {
+        int32 BackBuffer = ShaderUtils::GetIdFromString("_BackBuffer");
+        int32 GBuffer = ShaderUtils::GetIdFromString("_GBuffer");
+        int32 Depth = ShaderUtils::GetIdFromString("_Depth");
+        int32 Color = ShaderUtils::GetIdFromString("_Color");
+        int32 AO = ShaderUtils::GetIdFromString("_AO");
+        int32 Bloom = ShaderUtils::GetIdFromString("_Bloom");
+    };
+
+    static void BuildFrame(RenderGraph& graph, const FrameTextureIds& ids, uint64_t* pNumCalls)
+    {
+        GfxTextureDesc colorDesc = MakeFrameTextureDesc(GfxTextureFormat::R8G8B8A8_UNorm);
+        TextureHandle backBuffer = graph.ImportTexture(ids.BackBuffer, colorDesc);
+        TextureHandle gbuffer = graph.RequestTexture(ids.GBuffer, colorDesc);
+        TextureHandle depth = graph.RequestTexture(ids.Depth, MakeFrameTextureDesc(GfxTextureFormat::D32_Float));
+        TextureHandle color = graph.RequestTexture(ids.Color, colorDesc);
+        TextureHandle ao = graph.RequestTexture(ids.AO, MakeFrameTextureDesc(GfxTextureFormat::R8_UNorm));
+        TextureHandle bloom = graph.RequestTexture(ids.Bloom, colorDesc);
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("GBuffer");
+            builder.Out(gbuffer);
+            builder.Out(depth);
+            builder.SetRenderFunc([pNumCalls](RenderGraphContext&) { (*pNumCalls)++; });
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("AO");
+            builder.In(gbuffer);
+            builder.In(depth);
+            builder.Out(ao);
+            builder.EnableAsyncCompute(true);
+            builder.SetEstimatedCost(50);
+            builder.SetRenderFunc([pNumCalls, ao](RenderGraphContext&) { (*pNumCalls)++; });
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Lighting");
+            builder.In(gbuffer);
+            builder.In(depth);
+            builder.In(ao);
+            builder.Out(color);
+            builder.SetRenderFunc([pNumCalls, gbuffer, depth, ao](RenderGraphContext&) { (*pNumCalls)++; });
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Bloom");
+            builder.In(color);
+            builder.Out(bloom);
+            builder.SetRenderFunc([pNumCalls](RenderGraphContext&) { (*pNumCalls)++; });
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Composite");
+            builder.In(color);
+            builder.In(bloom);
+            builder.Out(backBuffer);
+            builder.SetRenderFunc([pNumCalls](RenderGraphContext&) { (*pNumCalls)++; });
+        }
+
+        graph.Compile();
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphArena, SteadyStateFrameDoesNotAllocate)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+        RenderGraphNullBackend* backend = static_cast<RenderGraphNullBackend*>(graph.GetBackend());
+        FrameTextureIds ids{};
+        uint64_t numCalls = 0;
+
+        for (uint32_t frame = 0; frame < NumWarmUpFrames; frame++)
+        {
+            BuildFrame(graph, ids, &numCalls);
+            backend->AdvanceFrame();
+        }
+
+        uint64_t numCacheHits = graph.GetCompileStats().NumCacheHits;
+        AllocationCounter counter{};
+
+        for (uint32_t frame = 0; frame < NumMeasuredFrames; frame++)
+        {
+            BuildFrame(graph, ids, &numCalls);
+            backend->AdvanceFrame();
+        }
+
+        uint64_t numAllocations = counter.GetCount();
+
+        // 稳定以后每帧都命中编译缓存，pass、资源和 render func 都放在复用的内存里
+        TEST_CHECK_EQ(numAllocations, uint64_t(0));
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheHits - numCacheHits, uint64_t(NumMeasuredFrames));
+        TEST_CHECK_EQ(numCalls, uint64_t(0)); // null backend 不执行
+    }
+}
@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBarrierPlanner.h"
+
+// barrier 的规划是纯 CPU 计算，不需要 GfxDevice
+
+namespace march::test
+{
+    using State = RenderGraphBarrierState;
+    using Type = RenderGraphBarrierType;
+
+    static RenderGraphBarrierPassInfo GraphicsPass()
+    {
+        return RenderGraphBarrierPassInfo{ false, false, false };
+    }
+
+    static RenderGraphBarrierPassInfo AsyncComputePass()
+    {
+        return RenderGraphBarrierPassInfo{ false, true, false };
+    }
+
+    static State Combine(State a, State b)
+    {
+        return static_cast<State>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+    }
+
+    static void CheckBarrier(const RenderGraphPlannedBarrier& barrier, size_t resourceIndex, size_t passIndex, State state, Type type)
+    {
+        TEST_CHECK_EQ(barrier.ResourceIndex, resourceIndex);
+        TEST_CHECK_EQ(barrier.PassIndex, passIndex);
+        TEST_CHECK_EQ(barrier.StateAfter, state);
+        TEST_CHECK_EQ(barrier.Type, type);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, FoldsConsecutiveReadsIntoOneBarrier)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(5, GraphicsPass());
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 0, 0, State::DepthWrite });
+        uses.push_back({ 0, 1, State::DepthRead });
+        uses.push_back({ 0, 2, State::ShaderResource });
+        uses.push_back({ 0, 3, State::DepthRead });
+        uses.push_back({ 0, 4, State::DepthWrite });
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        // 三次连续的读取只需要一个 barrier，转换到所有只读 state 的并集
+        const std::vector<RenderGraphPlannedBarrier>& barriers = planner.GetBarriers();
+        TEST_REQUIRE_EQ(barriers.size(), size_t(3));
+        CheckBarrier(barriers[0], 0, 0, State::DepthWrite, Type::Full);
+        CheckBarrier(barriers[1], 0, 1, Combine(State::DepthRead, State::ShaderResource), Type::Full);
+        CheckBarrier(barriers[2], 0, 4, State::DepthWrite, Type::Full);
+
+        TEST_CHECK_EQ(planner.GetStats().NumFullBarriers, 3u);
+        TEST_CHECK_EQ(planner.GetStats().NumSplitBarriers, 0u);
+        TEST_CHECK_EQ(planner.GetStats().NumFoldedTransitions, 2u);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, FoldsRepeatedWriteState)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(2, GraphicsPass());
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 0, 0, State::RenderTarget });
+        uses.push_back({ 0, 1, State::RenderTarget });
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        TEST_REQUIRE_EQ(planner.GetBarriers().size(), size_t(1));
+        CheckBarrier(planner.GetBarriers()[0], 0, 0, State::RenderTarget, Type::Full);
+        TEST_CHECK_EQ(planner.GetStats().NumFoldedTransitions, 1u);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, SplitsBarrierAcrossIdlePasses)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(4, GraphicsPass());
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 0, 0, State::RenderTarget });
+        uses.push_back({ 0, 3, State::ShaderResource });
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        // pass 1 和 pass 2 没有用到这个资源，barrier 在 pass 0 之后开始，pass 3 之前结束
+        const std::vector<RenderGraphPlannedBarrier>& barriers = planner.GetBarriers();
+        TEST_REQUIRE_EQ(barriers.size(), size_t(3));
+        CheckBarrier(barriers[0], 0, 0, State::RenderTarget, Type::Full);
+        CheckBarrier(barriers[1], 0, 0, State::ShaderResource, Type::BeginSplit);
+        CheckBarrier(barriers[2], 0, 3, State::ShaderResource, Type::EndSplit);
+        TEST_CHECK_EQ(planner.GetStats().NumSplitBarriers, 1u);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, DoesNotSplitWithoutIdlePass)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(3, GraphicsPass());
+        passes[1].IsCulled = true; // 被剔除的 pass 不算
+
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 0, 0, State::RenderTarget });
+        uses.push_back({ 0, 2, State::ShaderResource });
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        TEST_REQUIRE_EQ(planner.GetBarriers().size(), size_t(2));
+        CheckBarrier(planner.GetBarriers()[1], 0, 2, State::ShaderResource, Type::Full);
+        TEST_CHECK_EQ(planner.GetStats().NumSplitBarriers, 0u);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, DoesNotSplitAcrossCommandLists)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(4, GraphicsPass());
+        passes[2].StartsCommandList = true;
+
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 0, 0, State::RenderTarget });
+        uses.push_back({ 0, 3, State::ShaderResource });
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        TEST_REQUIRE_EQ(planner.GetBarriers().size(), size_t(2));
+        CheckBarrier(planner.GetBarriers()[1], 0, 3, State::ShaderResource, Type::Full);
+        TEST_CHECK_EQ(planner.GetStats().NumSplitBarriers, 0u);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, LeavesAsyncComputeUsesToRecording)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(5, GraphicsPass());
+        passes[2] = AsyncComputePass();
+
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 0, 0, State::ShaderResource });
+        uses.push_back({ 0, 2, State::ShaderResource });
+        uses.push_back({ 0, 4, State::ShaderResource });
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        // async compute pass 上不规划 barrier；之后的 state 不确定，不能和前面的读取合并，也不能跨过它 split
+        const std::vector<RenderGraphPlannedBarrier>& barriers = planner.GetBarriers();
+        TEST_REQUIRE_EQ(barriers.size(), size_t(2));
+        CheckBarrier(barriers[0], 0, 0, State::ShaderResource, Type::Full);
+        CheckBarrier(barriers[1], 0, 4, State::ShaderResource, Type::Full);
+        TEST_CHECK_EQ(planner.GetStats().NumFoldedTransitions, 0u);
+        TEST_CHECK_EQ(planner.GetStats().NumSplitBarriers, 0u);
+    }
+
+    TEST_CASE(RenderGraphBarrierPlanner, PlansResourcesIndependently)
+    {
+        std::vector<RenderGraphBarrierPassInfo> passes(3, GraphicsPass());
+        std::vector<RenderGraphBarrierUse> uses{};
+        uses.push_back({ 1, 0, State::UnorderedAccess });
+        uses.push_back({ 0, 0, State::RenderTarget });
+        uses.push_back({ 1, 1, State::ShaderResource });
+        uses.push_back({ 0, 2, State::Unknown }); // 录制时才知道
+
+        RenderGraphBarrierPlanner planner{};
+        planner.Plan(passes, uses);
+
+        const std::vector<RenderGraphPlannedBarrier>& barriers = planner.GetBarriers();
+        TEST_REQUIRE_EQ(barriers.size(), size_t(3));
+        CheckBarrier(barriers[0], 0, 0, State::RenderTarget, Type::Full);
+        CheckBarrier(barriers[1], 1, 0, State::UnorderedAccess, Type::Full);
+        CheckBarrier(barriers[2], 1, 1, State::ShaderResource, Type::Full);
+    }
+}
@@ -0,0 +1,935 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/RenderGraph.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 用 null backend 只编译不执行，检查剔除、调度、async compute、render pass 合并和编译缓存的结果
+
+namespace march::test
+{
+    static GfxTextureDesc MakeTextureDesc(GfxTextureFormat format, uint32_t width = 1920, uint32_t height = 1080)
+    {
+        GfxTextureDesc desc{};
+        desc.Format = format;
+        desc.Flags = GfxTextureFlags::None;
+        desc.Dimension = GfxTextureDimension::Tex2D;
+        desc.Width = width;
+        desc.Height = height;
+        desc.DepthOrArraySize = 1;
+        desc.MSAASamples = 1;
+        desc.Filter = GfxTextureFilterMode::Bilinear;
+        desc.Wrap = GfxTextureWrapMode::Clamp;
+        desc.MipmapBias = 0;
+        return desc;
+    }
+
+    static size_t FindPassIndex(const RenderGraph& graph, std::string_view name)
+    {
+        const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            if (passes[i].Name == name)
+            {
+                return i;
+            }
+        }
+
+        TEST_REQUIRE(false && "pass not found");
+        return 0;
+    }
+
+    static const RenderGraphPass& FindPass(const RenderGraph& graph, std::string_view name)
+    {
+        return graph.GetPasses()[FindPassIndex(graph, name)];
+    }
+
+    static bool Contains(const RenderGraphSmallVector<size_t, 4>& values, size_t value)
+    {
+        return std::find(values.begin(), values.end(), value) != values.end();
+    }
+
+    static size_t GetResourceIndex(const RenderGraph& graph, const TextureHandle& texture)
+    {
+        return graph.GetResourceManager()->GetResourceIndex(texture);
+    }
+
+    // 典型的一帧：AO 声明得晚，但只依赖 GBuffer，可以提前到 Shadow 之前，和 Shadow、Opaque 重叠
+    static void BuildAsyncComputeFrame(RenderGraph& graph, double graphicsPassCost)
+    {
+        GfxTextureDesc colorDesc = MakeTextureDesc(GfxTextureFormat::R8G8B8A8_UNorm);
+        TextureHandle backBuffer = graph.ImportTexture("_BackBuffer", colorDesc);
+        TextureHandle gbuffer = graph.RequestTexture("_GBuffer", colorDesc);
+        TextureHandle shadow = graph.RequestTexture("_ShadowMap", MakeTextureDesc(GfxTextureFormat::D32_Float, 2048, 2048));
+        TextureHandle color = graph.RequestTexture("_Color", colorDesc);
+        TextureHandle ao = graph.RequestTexture("_AO", MakeTextureDesc(GfxTextureFormat::R8_UNorm));
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("GBuffer");
+            builder.Out(gbuffer);
+            builder.SetEstimatedCost(graphicsPassCost);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Shadow");
+            builder.Out(shadow);
+            builder.SetEstimatedCost(graphicsPassCost);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Opaque");
+            builder.In(shadow);
+            builder.Out(color);
+            builder.SetEstimatedCost(graphicsPassCost);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("AO");
+            builder.In(gbuffer);
+            builder.Out(ao);
+            builder.EnableAsyncCompute(true);
+            builder.SetEstimatedCost(50);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Composite");
+            builder.In(color);
+            builder.In(ao);
+            builder.Out(backBuffer);
+            builder.SetEstimatedCost(graphicsPassCost);
+        }
+    }
+
+    TEST_CASE(RenderGraphCompile, CullsPassesWithoutConsumers)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+
+        GfxTextureDesc desc = MakeTextureDesc(GfxTextureFormat::R8G8B8A8_UNorm);
+        TextureHandle backBuffer = graph.ImportTexture("_BackBuffer", desc);
+        TextureHandle unused = graph.RequestTexture("_Unused", desc);
+        TextureHandle intermediate = graph.RequestTexture("_Intermediate", desc);
+        TextureHandle chainA = graph.RequestTexture("_ChainA", desc);
+        TextureHandle chainB = graph.RequestTexture("_ChainB", desc);
+        TextureHandle debug = graph.RequestTexture("_Debug", desc);
+
+        graph.AddPass("Unused").Out(unused);
+        graph.AddPass("Producer").Out(intermediate);
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Present");
+            builder.In(intermediate);
+            builder.Out(backBuffer);
+        }
+
+        // 整条链都没有被使用
+        graph.AddPass("ChainA").Out(chainA);
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("ChainB");
+            builder.In(chainA);
+            builder.Out(chainB);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Debug");
+            builder.Out(debug);
+            builder.AllowPassCulling(false);
+        }
+
+        graph.Compile();
+
+        TEST_REQUIRE_EQ(graph.GetPasses().size(), size_t(6));
+        TEST_CHECK(FindPass(graph, "Unused").IsCulled);
+        TEST_CHECK(!FindPass(graph, "Producer").IsCulled);
+        TEST_CHECK(!FindPass(graph, "Present").IsCulled);
+        TEST_CHECK(FindPass(graph, "ChainA").IsCulled);
+        TEST_CHECK(FindPass(graph, "ChainB").IsCulled);
+        TEST_CHECK(!FindPass(graph, "Debug").IsCulled);
+
+        // 被剔除的 pass 不会让资源活下来
+        const RenderGraphResourceManager* resourceManager = graph.GetResourceManager();
+        TEST_CHECK(!resourceManager->GetLifetimePassIndexRange(GetResourceIndex(graph, unused)).has_value());
+        TEST_CHECK(!resourceManager->GetLifetimePassIndexRange(GetResourceIndex(graph, chainA)).has_value());
+        TEST_CHECK(resourceManager->GetLifetimePassIndexRange(GetResourceIndex(graph, intermediate)).has_value());
+
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphCompile, TracksResourceLifetimes)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+
+        GfxTextureDesc desc = MakeTextureDesc(GfxTextureFormat::R16G16B16A16_Float);
+        TextureHandle backBuffer = graph.ImportTexture("_BackBuffer", desc);
+        TextureHandle a = graph.RequestTexture("_A", desc);
+        TextureHandle b = graph.RequestTexture("_B", desc);
+
+        graph.AddPass("WriteA").Out(a);
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("ReadAWriteB");
+            builder.In(a);
+            builder.Out(b);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("ReadB");
+            builder.In(b);
+            builder.Out(backBuffer);
+        }
+
+        graph.Compile();
+
+        const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+        TEST_REQUIRE_EQ(passes.size(), size_t(3));
+
+        size_t indexA = GetResourceIndex(graph, a);
+        size_t indexB = GetResourceIndex(graph, b);
+
+        TEST_CHECK(Contains(passes[0].ResourcesBorn, indexA));
+        TEST_CHECK(Contains(passes[1].ResourcesDead, indexA));
+        TEST_CHECK(Contains(passes[1].ResourcesBorn, indexB));
+        TEST_CHECK(Contains(passes[2].ResourcesDead, indexB));
+
+        // 两个资源在 ReadAWriteB 中同时存活，不能共用内存
+        const RenderGraphTransientMemoryStats& stats = graph.GetTransientMemoryStats();
+        TEST_CHECK_EQ(stats.NumResources, 2u);
+        TEST_CHECK_EQ(stats.NumAliasedResources, 0u);
+
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphCompile, HoistsAsyncComputeAndWaitsBeforeConsumer)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+        BuildAsyncComputeFrame(graph, 100);
+        graph.Compile();
+
+        const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+        TEST_REQUIRE_EQ(passes.size(), size_t(5));
+
+        // AO 依赖的 GBuffer 不动，AO 提前到 Shadow 之前，其他 pass 保持原来的相对顺序
+        TEST_CHECK_EQ(passes[0].Name, std::string_view("GBuffer"));
+        TEST_CHECK_EQ(passes[1].Name, std::string_view("AO"));
+        TEST_CHECK_EQ(passes[2].Name, std::string_view("Shadow"));
+        TEST_CHECK_EQ(passes[3].Name, std::string_view("Opaque"));
+        TEST_CHECK_EQ(passes[4].Name, std::string_view("Composite"));
+        TEST_CHECK_EQ(graph.GetCompileStats().NumHoistedPasses, 1u);
+
+        TEST_CHECK(passes[1].IsAsyncCompute);
+        TEST_CHECK(passes[1].NeedSyncPoint);
+        TEST_CHECK(!passes[2].IsAsyncCompute);
+        TEST_CHECK(!passes[3].IsAsyncCompute);
+
+        // 第一个读取 AO 结果的 pass 等待 AO
+        TEST_REQUIRE(passes[4].PassIndexToWait.has_value());
+        TEST_CHECK_EQ(*passes[4].PassIndexToWait, size_t(1));
+        TEST_CHECK(!passes[2].PassIndexToWait.has_value());
+        TEST_CHECK(!passes[3].PassIndexToWait.has_value());
+
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphCompile, KeepsAsyncComputeOnGraphicsQueueWhenOverlapIsTooSmall)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+        BuildAsyncComputeFrame(graph, 5); // 和 AO 重叠的只有 Shadow 和 Opaque，一共 10 微秒
+        graph.Compile();
+
+        const RenderGraphPass& ao = FindPass(graph, "AO");
+        TEST_CHECK(!ao.IsCulled);
+        TEST_CHECK(!ao.IsAsyncCompute);
+        TEST_CHECK(!FindPass(graph, "Composite").PassIndexToWait.has_value());
+
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphCompile, MergesRenderPassesWithSameTargets)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+
+        GfxTextureDesc colorDesc = MakeTextureDesc(GfxTextureFormat::R16G16B16A16_Float);
+        TextureHandle backBuffer = graph.ImportTexture("_BackBuffer", MakeTextureDesc(GfxTextureFormat::R8G8B8A8_UNorm));
+        TextureHandle color = graph.RequestTexture("_Color", colorDesc);
+        TextureHandle depth = graph.RequestTexture("_Depth", MakeTextureDesc(GfxTextureFormat::D32_Float));
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Opaque");
+            builder.SetColorTarget(color, RenderTargetInitMode::Clear);
+            builder.SetDepthStencilTarget(depth, RenderTargetInitMode::Clear);
+            builder.SetRenderFunc([](RenderGraphContext& context) {});
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Skybox");
+            builder.SetColorTarget(color);
+            builder.SetDepthStencilTarget(depth);
+            builder.SetRenderFunc([](RenderGraphContext& context) {});
+        }
+
+        {
+            // 中间 clear 了，不能合并
+            RenderGraphBuilder builder = graph.AddPass("Transparent");
+            builder.SetColorTarget(color);
+            builder.SetDepthStencilTarget(depth, RenderTargetInitMode::Clear);
+            builder.SetRenderFunc([](RenderGraphContext& context) {});
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Tonemapping");
+            builder.In(color);
+            builder.SetColorTarget(backBuffer, RenderTargetInitMode::Discard);
+            builder.SetRenderFunc([](RenderGraphContext& context) {});
+        }
+
+        graph.Compile();
+
+        const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+        TEST_REQUIRE_EQ(passes.size(), size_t(4));
+
+        TEST_CHECK(!passes[0].IsMergedWithPrevious);
+        TEST_CHECK(passes[0].IsMergedWithNext);
+        TEST_CHECK(passes[1].IsMergedWithPrevious);
+        TEST_CHECK(!passes[1].IsMergedWithNext);
+        TEST_CHECK(!passes[2].IsMergedWithPrevious);
+        TEST_CHECK(!passes[2].IsMergedWithNext);
+        TEST_CHECK(!passes[3].IsMergedWithPrevious);
+        TEST_CHECK_EQ(graph.GetCompileStats().NumMergedPasses, 1u);
+
+        // _Color 从 render target 变成 shader resource，barrier 在 Tonemapping 之前
+        TEST_CHECK(passes[1].BarriersAfter.IsEmpty());
+        TEST_CHECK(!passes[3].BarriersBefore.IsEmpty());
+
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphCompile, ReusesCompileCacheForSameTopology)
+    {
+        auto backend = std::make_unique<RenderGraphNullBackend>();
+        RenderGraphNullBackend* nullBackend = backend.get();
+        RenderGraph graph(std::move(backend));
+
+        BuildAsyncComputeFrame(graph, 100);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(1));
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheHits, uint64_t(0));
+
+        // 名字在 arena 里，Reset 以后失效，要复制一份
+        std::vector<std::string> firstNames{};
+        std::vector<bool> firstAsyncCompute{};
+
+        for (const RenderGraphPass& pass : graph.GetPasses())
+        {
+            firstNames.emplace_back(pass.Name);
+            firstAsyncCompute.push_back(pass.IsAsyncCompute);
+        }
+
+        graph.Reset();
+        nullBackend->AdvanceFrame();
+
+        BuildAsyncComputeFrame(graph, 100);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(1));
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheHits, uint64_t(1));
+
+        const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+        TEST_REQUIRE_EQ(passes.size(), firstNames.size());
+
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            TEST_CHECK_EQ(passes[i].Name, std::string_view(firstNames[i]));
+            TEST_CHECK_EQ(passes[i].IsAsyncCompute, static_cast<bool>(firstAsyncCompute[i]));
+        }
+
+        graph.Reset();
+        nullBackend->AdvanceFrame();
+
+        // 估计的耗时变了，async compute 的决定也可能变，必须重新编译
+        BuildAsyncComputeFrame(graph, 5);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(2));
+        TEST_CHECK(!FindPass(graph, "AO").IsAsyncCompute);
+
+        graph.Reset();
+    }
+
+    // 只有 GPU 时间，其他字段调度用不到
+    static RenderGraphFrameTiming MakeFrameTiming(const std::vector<std::pair<std::string, double>>& passCosts)
+    {
+        RenderGraphFrameTiming timing{};
+
+        for (const auto& [name, microseconds] : passCosts)
+        {
+            RenderGraphPassTiming& passTiming = timing.Passes.emplace_back();
+            passTiming.Name = name;
+            passTiming.HasGpuTiming = true;
+            passTiming.GpuBeginMicroseconds = 1000;
+            passTiming.GpuEndMicroseconds = 1000 + microseconds;
+        }
+
+        return timing;
+    }
+
+    TEST_CASE(RenderGraphCompile, RecompilesWhenProfiledCostChangesBucket)
+    {
+        auto backend = std::make_unique<RenderGraphNullBackend>();
+        RenderGraphNullBackend* nullBackend = backend.get();
+        RenderGraph graph(std::move(backend));
+
+        // 估计耗时为 0 时，graphics pass 使用 profiler 的耗时
+        BuildAsyncComputeFrame(graph, 0);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(1));
+        TEST_CHECK(FindPass(graph, "AO").IsAsyncCompute);
+
+        graph.Reset();
+        nullBackend->AdvanceFrame();
+
+        graph.ApplyProfiledPassCosts(MakeFrameTiming({ { "GBuffer", 100 }, { "Shadow", 100 }, { "Opaque", 100 }, { "Composite", 100 } }));
+        BuildAsyncComputeFrame(graph, 0);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(2));
+        TEST_CHECK(FindPass(graph, "AO").IsAsyncCompute);
+
+        graph.Reset();
+        nullBackend->AdvanceFrame();
+
+        // 在档位内抖动，继续使用缓存
+        graph.ApplyProfiledPassCosts(MakeFrameTiming({ { "GBuffer", 104 }, { "Shadow", 97 }, { "Opaque", 103 }, { "Composite", 99 } }));
+        BuildAsyncComputeFrame(graph, 0);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(2));
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheHits, uint64_t(1));
+
+        graph.Reset();
+        nullBackend->AdvanceFrame();
+
+        // 和 AO 重叠的 pass 变快了，不值得再用 async compute，必须重新编译
+        graph.ApplyProfiledPassCosts(MakeFrameTiming({ { "Shadow", 5 }, { "Opaque", 5 } }));
+        BuildAsyncComputeFrame(graph, 0);
+        graph.Compile();
+        TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, uint64_t(3));
+        TEST_CHECK(!FindPass(graph, "AO").IsAsyncCompute);
+
+        graph.Reset();
+    }
+
+    // 和 RenderGraph::MinAsyncComputeOverlapMicroseconds 一致
+    static constexpr double MinAsyncComputeOverlapMicroseconds = 20.0;
+    static constexpr size_t NoPassIndex = std::numeric_limits<size_t>::max();
+
+    // 方便输出失败时的值，没有时是 NoPassIndex
+    static size_t ToIndex(const std::optional<size_t>& index)
+    {
+        return index.value_or(NoPassIndex);
+    }
+
+    // 随机生成的 pass，记录声明时的读写，参考结果只从这里计算
+    struct RandomPassDesc
+    {
+        std::string Name;
+        std::vector<size_t> Reads;  // 资源在 graph 中的索引，从小到大
+        std::vector<size_t> Writes; // 同上
+        bool HasSideEffects = false;
+        bool AllowPassCulling = true;
+        bool EnableAsyncCompute = false;
+        double Cost = 0;
+    };
+
+    // 同一个种子每次生成的 graph 完全一样，可以命中编译缓存
+    // 读写的资源偏向最近写过的，这样才有足够长的依赖链，以及能和 async compute 重叠的 pass
+    static std::vector<RandomPassDesc> BuildRandomGraph(RenderGraph& graph, uint32_t seed, size_t numPasses)
+    {
+        static constexpr size_t NumExternalTextures = 8;
+        static constexpr GfxTextureFormat Formats[] = { GfxTextureFormat::R8G8B8A8_UNorm, GfxTextureFormat::R16G16B16A16_Float, GfxTextureFormat::R8_UNorm };
+        static constexpr uint32_t Sizes[] = { 256, 512, 1024 };
+
+        std::mt19937 rng(seed);
+        std::bernoulli_distribution enableAsyncCompute(0.25);
+        std::bernoulli_distribution disallowCulling(0.03);
+        std::bernoulli_distribution useColorTargets(0.5);
+        std::bernoulli_distribution writeExternal(0.08);
+        std::bernoulli_distribution writeNew(0.7);
+        std::bernoulli_distribution readWrite(0.3);
+        std::uniform_int_distribution<size_t> numReads(0, 3);
+        std::uniform_int_distribution<size_t> numWrites(1, 3);
+        std::uniform_int_distribution<size_t> external(0, NumExternalTextures - 1);
+        std::uniform_int_distribution<size_t> format(0, 2);
+        std::uniform_int_distribution<size_t> size(0, 2);
+        std::uniform_int_distribution<int> initMode(0, 2);
+        std::uniform_real_distribution<double> cost(5, 200);
+        std::geometric_distribution<size_t> recency(0.03);
+
+        std::vector<TextureHandle> textures{};
+        std::vector<size_t> readable{}; // 有生产者的资源和外部资源，是 textures 的索引
+
+        for (size_t i = 0; i < NumExternalTextures; i++)
+        {
+            GfxTextureDesc desc = MakeTextureDesc(GfxTextureFormat::R8G8B8A8_UNorm, 256, 256);
+            textures.push_back(graph.ImportTexture("_RandomExternal" + std::to_string(i), desc));
+            readable.push_back(i);
+        }
+
+        auto pickReadable = [&]()
+        {
+            size_t offset = std::min(recency(rng), readable.size() - 1);
+            return readable[readable.size() - 1 - offset];
+        };
+
+        std::vector<RandomPassDesc> passes(numPasses);
+
+        for (size_t passIndex = 0; passIndex < numPasses; passIndex++)
+        {
+            RandomPassDesc& pass = passes[passIndex];
+            pass.Name = "RandomPass" + std::to_string(passIndex);
+            pass.EnableAsyncCompute = enableAsyncCompute(rng);
+            pass.AllowPassCulling = !disallowCulling(rng);
+            pass.Cost = cost(rng);
+
+            // 同一个 pass 里的资源不重复，second 表示资源是不是在这个 pass 中新建的
+            std::vector<size_t> reads{};
+            std::vector<std::pair<size_t, bool>> writes{};
+
+            auto isUsed = [&](size_t t)
+            {
+                return std::find(reads.begin(), reads.end(), t) != reads.end()
+                    || std::find_if(writes.begin(), writes.end(), [t](const auto& w) { return w.first == t; }) != writes.end();
+            };
+
+            for (size_t i = numReads(rng); i > 0; i--)
+            {
+                if (size_t t = pickReadable(); !isUsed(t))
+                {
+                    reads.push_back(t);
+                }
+            }
+
+            for (size_t i = numWrites(rng); i > 0; i--)
+            {
+                if (writeExternal(rng))
+                {
+                    if (size_t t = external(rng); !isUsed(t))
+                    {
+                        writes.emplace_back(t, false);
+                    }
+                }
+                else if (writeNew(rng))
+                {
+                    uint32_t width = Sizes[size(rng)];
+                    uint32_t height = Sizes[size(rng)];
+                    GfxTextureDesc desc = MakeTextureDesc(Formats[format(rng)], width, height);
+                    std::string name = "_RandomTexture" + std::to_string(textures.size());
+                    writes.emplace_back(textures.size(), true);
+                    textures.push_back(graph.RequestTexture(name, desc));
+                }
+                else if (size_t t = pickReadable(); !isUsed(t))
+                {
+                    writes.emplace_back(t, false);
+                }
+            }
+
+            RenderGraphBuilder builder = graph.AddPass(pass.Name);
+            builder.EnableAsyncCompute(pass.EnableAsyncCompute);
+            builder.AllowPassCulling(pass.AllowPassCulling);
+            builder.SetEstimatedCost(pass.Cost);
+
+            for (size_t t : reads)
+            {
+                builder.In(textures[t]);
+                pass.Reads.push_back(GetResourceIndex(graph, textures[t]));
+            }
+
+            // async compute 只用 In 和 Out，其他 pass 有一半用 render target
+            bool isRenderPass = !pass.EnableAsyncCompute && useColorTargets(rng);
+
+            for (size_t i = 0; i < writes.size(); i++)
+            {
+                auto [t, isNew] = writes[i];
+                size_t resourceIndex = GetResourceIndex(graph, textures[t]);
+                bool isRead = false;
+
+                if (isRenderPass)
+                {
+                    // 新建的资源没有内容可以 Load
+                    RenderTargetInitMode mode = isNew ? RenderTargetInitMode::Clear : static_cast<RenderTargetInitMode>(initMode(rng));
+                    builder.SetColorTarget(textures[t], static_cast<uint32_t>(i), mode);
+                    isRead = mode == RenderTargetInitMode::Load;
+                }
+                else
+                {
+                    isRead = !isNew && readWrite(rng);
+
+                    if (isRead)
+                    {
+                        builder.In(textures[t]);
+                    }
+
+                    builder.Out(textures[t]);
+                }
+
+                if (isRead)
+                {
+                    pass.Reads.push_back(resourceIndex);
+                }
+
+                pass.Writes.push_back(resourceIndex);
+                pass.HasSideEffects |= t < NumExternalTextures;
+            }
+
+            for (const auto& [t, isNew] : writes)
+            {
+                if (isNew)
+                {
+                    readable.push_back(t);
+                }
+            }
+
+            std::sort(pass.Reads.begin(), pass.Reads.end());
+            std::sort(pass.Writes.begin(), pass.Writes.end());
+        }
+
+        return passes;
+    }
+
+    static bool Intersects(const std::vector<size_t>& a, const std::vector<size_t>& b)
+    {
+        // 两个都是排好序的
+        for (size_t i = 0, j = 0; i < a.size() && j < b.size();)
+        {
+            if (a[i] == b[j])
+            {
+                return true;
+            }
+
+            if (a[i] < b[j])
+            {
+                i++;
+            }
+            else
+            {
+                j++;
+            }
+        }
+
+        return false;
+    }
+
+    // 下标都是调度后的 pass 索引
+    struct RandomGraphReference
+    {
+        std::vector<bool> IsCulled;
+        std::vector<bool> IsAsyncCompute;
+        std::vector<bool> NeedSyncPoint;
+        std::vector<size_t> PassIndexToWait;
+        std::vector<std::vector<size_t>> ResourcesBorn;
+        std::vector<std::vector<size_t>> ResourcesDead;
+    };
+
+    // 调度只能提前 pass，不能破坏写后读、读后写和写后写的顺序
+    static void CheckScheduleOrder(const std::vector<RandomPassDesc>& passes, const std::vector<size_t>& position, size_t numResources)
+    {
+        std::vector<size_t> lastWriter(numResources, NoPassIndex);
+        std::vector<std::vector<size_t>> readers(numResources);
+
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            for (size_t r : passes[p].Reads)
+            {
+                if (lastWriter[r] != NoPassIndex)
+                {
+                    TEST_CHECK(position[lastWriter[r]] < position[p]);
+                }
+
+                readers[r].push_back(p);
+            }
+
+            for (size_t r : passes[p].Writes)
+            {
+                if (lastWriter[r] != NoPassIndex)
+                {
+                    TEST_CHECK(position[lastWriter[r]] < position[p]);
+                }
+
+                for (size_t reader : readers[r])
+                {
+                    if (reader != p)
+                    {
+                        TEST_CHECK(position[reader] < position[p]);
+                    }
+                }
+
+                readers[r].clear();
+                lastWriter[r] = p;
+            }
+        }
+    }
+
+    // 只用声明时的读写，在调度后的顺序上直接按规则算一遍：
+    // 1. 没有存活的读取者、没有副作用且允许剔除的 pass 被剔除
+    // 2. async compute 一直重叠到第一个读取结果的 graphics pass，遇到读写冲突要提前等待，重叠的耗时足够多才用 async compute
+    // 3. 连续的 async compute 合批，最后一个需要 sync point
+    // 4. async compute 用到的资源要活到等待它的 pass 之前，合批后要活到第一个 async compute
+    static RandomGraphReference ComputeReference(const std::vector<RandomPassDesc>& passes, const std::vector<size_t>& order, const std::vector<size_t>& position, size_t numResources)
+    {
+        const size_t numPasses = order.size();
+
+        // 写后读的后继
+        std::vector<std::vector<size_t>> successors(numPasses);
+        std::vector<size_t> lastWriter(numResources, NoPassIndex);
+
+        for (size_t p = 0; p < numPasses; p++)
+        {
+            for (size_t r : passes[p].Reads)
+            {
+                if (lastWriter[r] != NoPassIndex)
+                {
+                    successors[position[lastWriter[r]]].push_back(position[p]);
+                }
+            }
+
+            for (size_t r : passes[p].Writes)
+            {
+                lastWriter[r] = p;
+            }
+        }
+
+        RandomGraphReference ref{};
+        ref.IsCulled.assign(numPasses, false);
+        ref.IsAsyncCompute.assign(numPasses, false);
+        ref.NeedSyncPoint.assign(numPasses, false);
+        ref.PassIndexToWait.assign(numPasses, NoPassIndex);
+
+        std::vector<std::pair<size_t, size_t>> lifetimes(numResources, std::make_pair(NoPassIndex, size_t(0)));
+
+        auto setAlive = [&](const RandomPassDesc& pass, size_t passIndex)
+        {
+            for (const std::vector<size_t>* resources : { &pass.Reads, &pass.Writes })
+            {
+                for (size_t r : *resources)
+                {
+                    lifetimes[r].first = std::min(lifetimes[r].first, passIndex);
+                    lifetimes[r].second = std::max(lifetimes[r].second, passIndex);
+                }
+            }
+        };
+
+        size_t deadline = numPasses;
+
+        for (size_t i = numPasses; i-- > 0;)
+        {
+            const RandomPassDesc& pass = passes[order[i]];
+            bool hasConsumer = false;
+            size_t passDeadline = deadline;
+
+            for (size_t s : successors[i])
+            {
+                if (!ref.IsCulled[s])
+                {
+                    hasConsumer = true;
+
+                    if (!ref.IsAsyncCompute[s])
+                    {
+                        passDeadline = std::min(passDeadline, s);
+                    }
+                }
+            }
+
+            if (!hasConsumer && !pass.HasSideEffects && pass.AllowPassCulling)
+            {
+                ref.IsCulled[i] = true;
+                continue;
+            }
+
+            if (pass.EnableAsyncCompute)
+            {
+                size_t overlappedCount = 0;
+                double overlappedCost = 0;
+                size_t lastGraphicsPass = passDeadline;
+
+                for (size_t j = i + 1; j < passDeadline; j++)
+                {
+                    if (ref.IsCulled[j])
+                    {
+                        continue;
+                    }
+
+                    const RandomPassDesc& other = passes[order[j]];
+
+                    if (!ref.IsAsyncCompute[j])
+                    {
+                        lastGraphicsPass = j;
+                    }
+
+                    // 只有两个都是读的时候可以并行
+                    if (Intersects(pass.Reads, other.Writes) || Intersects(pass.Writes, other.Reads) || Intersects(pass.Writes, other.Writes))
+                    {
+                        passDeadline = lastGraphicsPass;
+                        break;
+                    }
+
+                    if (!ref.IsAsyncCompute[j])
+                    {
+                        overlappedCount++;
+                        overlappedCost += other.Cost;
+                    }
+                }
+
+                ref.IsAsyncCompute[i] = overlappedCount > 0 && overlappedCost >= MinAsyncComputeOverlapMicroseconds;
+            }
+
+            setAlive(pass, i);
+
+            if (ref.IsAsyncCompute[i])
+            {
+                deadline = passDeadline;
+
+                // 从后往前遍历，第一个等待的 async compute 就是最后执行的
+                if (deadline < numPasses && ref.PassIndexToWait[deadline] == NoPassIndex)
+                {
+                    ref.PassIndexToWait[deadline] = i;
+                }
+
+                setAlive(pass, deadline - 1);
+            }
+        }
+
+        size_t firstAsyncCompute = NoPassIndex;
+        size_t lastAsyncCompute = NoPassIndex;
+
+        for (size_t i = 0; i <= numPasses; i++)
+        {
+            if (i < numPasses && ref.IsCulled[i])
+            {
+                continue;
+            }
+
+            if (i < numPasses && ref.IsAsyncCompute[i])
+            {
+                if (firstAsyncCompute == NoPassIndex)
+                {
+                    firstAsyncCompute = i;
+                }
+                else
+                {
+                    setAlive(passes[order[i]], firstAsyncCompute);
+                }
+
+                lastAsyncCompute = i;
+            }
+            else if (lastAsyncCompute != NoPassIndex)
+            {
+                // 最后一个 pass 之后也算作一个 graphics pass
+                ref.NeedSyncPoint[lastAsyncCompute] = true;
+                firstAsyncCompute = NoPassIndex;
+                lastAsyncCompute = NoPassIndex;
+            }
+        }
+
+        ref.ResourcesBorn.resize(numPasses);
+        ref.ResourcesDead.resize(numPasses);
+
+        for (size_t r = 0; r < numResources; r++)
+        {
+            if (lifetimes[r].first != NoPassIndex)
+            {
+                ref.ResourcesBorn[lifetimes[r].first].push_back(r);
+                ref.ResourcesDead[lifetimes[r].second].push_back(r);
+            }
+        }
+
+        return ref;
+    }
+
+    static void CheckAgainstReference(const RenderGraph& graph, const std::vector<RandomPassDesc>& descs)
+    {
+        const std::vector<RenderGraphPass>& passes = graph.GetPasses();
+        TEST_REQUIRE_EQ(passes.size(), descs.size());
+
+        std::unordered_map<std::string_view, size_t> declarationIndices{};
+
+        for (size_t i = 0; i < descs.size(); i++)
+        {
+            declarationIndices.emplace(descs[i].Name, i);
+        }
+
+        // 调度后的第 i 个 pass 是第 order[i] 个声明的，position 反过来
+        std::vector<size_t> order(passes.size());
+        std::vector<size_t> position(passes.size(), NoPassIndex);
+
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            auto it = declarationIndices.find(passes[i].Name);
+            TEST_REQUIRE(it != declarationIndices.end());
+            TEST_REQUIRE(position[it->second] == NoPassIndex);
+
+            order[i] = it->second;
+            position[it->second] = i;
+        }
+
+        size_t numResources = graph.GetResourceManager()->GetNumResources();
+        CheckScheduleOrder(descs, position, numResources);
+
+        RandomGraphReference ref = ComputeReference(descs, order, position, numResources);
+
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            const RenderGraphPass& pass = passes[i];
+            TEST_CHECK_EQ(pass.IsCulled, static_cast<bool>(ref.IsCulled[i]));
+            TEST_CHECK_EQ(pass.IsAsyncCompute, static_cast<bool>(ref.IsAsyncCompute[i]));
+            TEST_CHECK_EQ(pass.NeedSyncPoint, static_cast<bool>(ref.NeedSyncPoint[i]));
+            TEST_CHECK_EQ(ToIndex(pass.PassIndexToWait), ref.PassIndexToWait[i]);
+            TEST_CHECK(std::vector<size_t>(pass.ResourcesBorn.begin(), pass.ResourcesBorn.end()) == ref.ResourcesBorn[i]);
+            TEST_CHECK(std::vector<size_t>(pass.ResourcesDead.begin(), pass.ResourcesDead.end()) == ref.ResourcesDead[i]);
+        }
+    }
+
+    TEST_CASE(RenderGraphCompile, RandomGraphsMatchReference)
+    {
+        auto backend = std::make_unique<RenderGraphNullBackend>();
+        RenderGraphNullBackend* nullBackend = backend.get();
+        RenderGraph graph(std::move(backend));
+
+        const std::pair<uint32_t, size_t> configs[] = { { 1, 64 }, { 2, 256 }, { 3, 1536 } };
+        size_t numCulled = 0;
+        size_t numAsyncCompute = 0;
+
+        for (const auto& [seed, numPasses] : configs)
+        {
+            std::vector<RandomPassDesc> descs = BuildRandomGraph(graph, seed, numPasses);
+            graph.Compile();
+            CheckAgainstReference(graph, descs);
+
+            for (const RenderGraphPass& pass : graph.GetPasses())
+            {
+                numCulled += pass.IsCulled ? 1 : 0;
+                numAsyncCompute += pass.IsAsyncCompute ? 1 : 0;
+            }
+
+            uint64_t numCacheMisses = graph.GetCompileStats().NumCacheMisses;
+            graph.Reset();
+            nullBackend->AdvanceFrame();
+
+            // 从缓存中恢复的结果也要一样
+            BuildRandomGraph(graph, seed, numPasses);
+            graph.Compile();
+            TEST_CHECK_EQ(graph.GetCompileStats().NumCacheMisses, numCacheMisses);
+            CheckAgainstReference(graph, descs);
+
+            graph.Reset();
+            nullBackend->AdvanceFrame();
+        }
+
+        // 确认随机的 graph 覆盖到了剔除和 async compute
+        TEST_CHECK(numCulled > 0);
+        TEST_CHECK(numAsyncCompute > 0);
+    }
+}
@@ -0,0 +1,150 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphPassScheduler.h"
+#include <cmath>
+#include <vector>
+
+// 调度是纯 CPU 计算，不需要 GfxDevice
+
+namespace march::test
+{
+    using Buckets = RenderGraphPassCostBuckets;
+
+    static RenderGraphSchedulePassInfo GraphicsPass(double cost = 100)
+    {
+        return RenderGraphSchedulePassInfo{ cost, false };
+    }
+
+    static RenderGraphSchedulePassInfo AsyncComputePass(double cost)
+    {
+        return RenderGraphSchedulePassInfo{ cost, true };
+    }
+
+    static void CheckOrder(const RenderGraphPassScheduler& scheduler, const std::vector<size_t>& expected)
+    {
+        const std::vector<size_t>& order = scheduler.GetOrder();
+        TEST_REQUIRE_EQ(order.size(), expected.size());
+
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            TEST_CHECK_EQ(order[i], expected[i]);
+        }
+    }
+
+    TEST_CASE(RenderGraphPassScheduler, KeepsOrderWithoutAsyncCompute)
+    {
+        std::vector<RenderGraphSchedulePassInfo> passes = { GraphicsPass(), GraphicsPass(), GraphicsPass() };
+        std::vector<RenderGraphScheduleDependency> dependencies = { { 0, 2 } };
+
+        RenderGraphPassScheduler scheduler{};
+        scheduler.Schedule(passes, dependencies);
+
+        CheckOrder(scheduler, { 0, 1, 2 });
+        TEST_CHECK(scheduler.IsIdentity());
+        TEST_CHECK_EQ(scheduler.GetStats().NumHoistedPasses, uint32_t(0));
+        TEST_CHECK_EQ(scheduler.GetStats().CriticalPathCost, 200.0);
+    }
+
+    TEST_CASE(RenderGraphPassScheduler, HoistsAsyncComputeWithDependencies)
+    {
+        // 2 只依赖 1，1 和 2 一起提前到 0 之前
+        std::vector<RenderGraphSchedulePassInfo> passes = { GraphicsPass(), GraphicsPass(), AsyncComputePass(50), GraphicsPass() };
+        std::vector<RenderGraphScheduleDependency> dependencies = { { 1, 2 }, { 0, 3 }, { 2, 3 } };
+
+        RenderGraphPassScheduler scheduler{};
+        scheduler.Schedule(passes, dependencies);
+
+        CheckOrder(scheduler, { 1, 2, 0, 3 });
+        TEST_CHECK(!scheduler.IsIdentity());
+        TEST_CHECK_EQ(scheduler.GetStats().NumHoistedPasses, uint32_t(2));
+        TEST_CHECK_EQ(scheduler.GetStats().CriticalPathCost, 250.0);
+    }
+
+    TEST_CASE(RenderGraphPassScheduler, LongerCriticalPathGoesFirst)
+    {
+        std::vector<RenderGraphSchedulePassInfo> passes = { GraphicsPass(), AsyncComputePass(10), AsyncComputePass(40) };
+
+        RenderGraphPassScheduler scheduler{};
+        scheduler.Schedule(passes, {});
+        CheckOrder(scheduler, { 2, 1, 0 });
+
+        // 一样长时按原来的顺序
+        passes[2].Cost = 10;
+        scheduler.Schedule(passes, {});
+        CheckOrder(scheduler, { 1, 2, 0 });
+    }
+
+    TEST_CASE(RenderGraphPassScheduler, CostBucketsRoundTrip)
+    {
+        TEST_CHECK_EQ(Buckets::Quantize(0), uint32_t(0));
+        TEST_CHECK_EQ(Buckets::Quantize(-5), uint32_t(0));
+        TEST_CHECK_EQ(Buckets::Quantize(1e30), Buckets::MaxBucket);
+
+        for (double cost = 1; cost < 100000; cost *= 1.37)
+        {
+            uint32_t bucket = Buckets::Quantize(cost);
+            double bucketCost = Buckets::GetBucketCost(bucket);
+
+            // 档位内的耗时和代表耗时最多相差档位宽度的一半
+            double maxRatio = std::exp2(0.5 / Buckets::BucketsPerOctave) * 1.0001;
+            TEST_CHECK(bucketCost / cost <= maxRatio && cost / bucketCost <= maxRatio);
+            TEST_CHECK_EQ(Buckets::Quantize(bucketCost), bucket);
+        }
+    }
+
+    TEST_CASE(RenderGraphPassScheduler, CostBucketsIgnoreJitter)
+    {
+        Buckets buckets{};
+        TEST_CHECK(!buckets.GetBucket(1));
+
+        // 第一次记录一定会变
+        TEST_CHECK(buckets.Update(1, 100));
+        TEST_REQUIRE(buckets.GetBucket(1).has_value());
+        uint32_t bucket = *buckets.GetBucket(1);
+        TEST_CHECK_EQ(bucket, Buckets::Quantize(100));
+
+        // 在档位边界附近来回抖动时保持不变
+        double upperBound = std::exp2(static_cast<double>(bucket + 1) / Buckets::BucketsPerOctave);
+        double lowerBound = std::exp2(static_cast<double>(bucket) / Buckets::BucketsPerOctave);
+        TEST_CHECK(!buckets.Update(1, upperBound * 1.02));
+        TEST_CHECK(!buckets.Update(1, lowerBound * 0.98));
+        TEST_CHECK(!buckets.Update(1, 100));
+        TEST_CHECK_EQ(*buckets.GetBucket(1), bucket);
+
+        // 明显变化时换档位
+        TEST_CHECK(buckets.Update(1, 200));
+        TEST_CHECK_EQ(*buckets.GetBucket(1), Buckets::Quantize(200));
+        TEST_CHECK(buckets.Update(1, 5));
+        TEST_CHECK_EQ(*buckets.GetBucket(1), Buckets::Quantize(5));
+
+        // 不同的 pass 互不影响
+        TEST_CHECK(!buckets.GetBucket(2));
+        TEST_CHECK(buckets.Update(2, 100));
+        TEST_CHECK_EQ(*buckets.GetBucket(1), Buckets::Quantize(5));
+
+        buckets.Clear();
+        TEST_CHECK(!buckets.GetBucket(1));
+    }
+
+    TEST_CASE(RenderGraphPassScheduler, ScheduleOnlyDependsOnBuckets)
+    {
+        // 同一档位的耗时调度结果一样，跨过档位才会变
+        auto schedule = [](double cost1, double cost2)
+        {
+            std::vector<RenderGraphSchedulePassInfo> passes =
+            {
+                GraphicsPass(),
+                AsyncComputePass(Buckets::GetBucketCost(Buckets::Quantize(cost1))),
+                AsyncComputePass(Buckets::GetBucketCost(Buckets::Quantize(cost2))),
+            };
+
+            RenderGraphPassScheduler scheduler{};
+            scheduler.Schedule(passes, {});
+            return scheduler.GetOrder();
+        };
+
+        TEST_CHECK(schedule(100, 104) == (std::vector<size_t>{ 1, 2, 0 }));
+        TEST_CHECK(schedule(104, 100) == (std::vector<size_t>{ 1, 2, 0 }));
+        TEST_CHECK(schedule(100, 300) == (std::vector<size_t>{ 2, 1, 0 }));
+    }
+}
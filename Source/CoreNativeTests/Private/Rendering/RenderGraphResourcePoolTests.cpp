@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphResource.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+
+namespace march
+{
+    namespace test
+    {
+        struct FakePoolDesc
+        {
+            uint64_t Size;
+        };
+
+        // 不需要 GfxDevice 的资源，只用来测试 pool 的统计和淘汰
+        class FakePoolResource
+        {
+        public:
+            explicit FakePoolResource(const FakePoolDesc& desc) : m_Desc(desc) {}
+
+            const FakePoolDesc& GetDesc() const { return m_Desc; }
+
+        private:
+            FakePoolDesc m_Desc;
+        };
+    }
+
+    template <>
+    struct RenderGraphResourceTraits<test::FakePoolResource>
+    {
+        using DescType = test::FakePoolDesc;
+
+        static bool IsCompatibleWith(test::FakePoolResource* resource, const DescType& desc)
+        {
+            return resource->GetDesc().Size == desc.Size;
+        }
+
+        static size_t GetDescHash(const DescType& desc)
+        {
+            return static_cast<size_t>(desc.Size);
+        }
+
+        static uint64_t GetSizeInBytes(test::FakePoolResource* resource)
+        {
+            return resource->GetDesc().Size;
+        }
+
+        static std::unique_ptr<test::FakePoolResource> Allocate(const DescType& desc, uint32_t allocCounter)
+        {
+            return std::make_unique<test::FakePoolResource>(desc);
+        }
+    };
+}
+
+namespace march::test
+{
+    using FakePool = RenderGraphResourcePool<FakePoolResource>;
+
+    TEST_CASE(RenderGraphResourcePool, KeepsFreeResourceStatsAcrossFrames)
+    {
+        RenderGraphNullBackend backend{};
+        FakePool pool(&backend);
+
+        std::unique_ptr<FakePoolResource> a = pool.Request({ 100 });
+        std::unique_ptr<FakePoolResource> b = pool.Request({ 200 });
+        pool.Release(std::move(a));
+        pool.Release(std::move(b));
+        TEST_CHECK_EQ(pool.GetStats().NumFreeResources, 2u);
+        TEST_CHECK_EQ(pool.GetStats().BytesHeld, uint64_t(300));
+
+        // 新的一帧里取出之前放回的资源，BytesHeld 不能因为换帧被清零后再减成负数
+        backend.AdvanceFrame();
+        a = pool.Request({ 100 });
+        TEST_CHECK_EQ(pool.GetStats().NumFreeResources, 1u);
+        TEST_CHECK_EQ(pool.GetStats().BytesHeld, uint64_t(200));
+        pool.Release(std::move(a));
+        pool.Trim();
+        TEST_CHECK_EQ(pool.GetStats().NumFreeResources, 2u);
+        TEST_CHECK_EQ(pool.GetStats().BytesHeld, uint64_t(300));
+
+        // 没有超出预算，也没有太久没用，不会被淘汰
+        backend.AdvanceFrame();
+        pool.Trim();
+        RenderGraphResourcePoolStats stats = pool.GetStats();
+        TEST_CHECK_EQ(stats.NumHits, 1u);
+        TEST_CHECK_EQ(stats.NumMisses, 0u);
+        TEST_CHECK_EQ(stats.NumEvictions, 0u);
+        TEST_CHECK_EQ(stats.NumFreeResources, 2u);
+        TEST_CHECK_EQ(stats.BytesHeld, uint64_t(300));
+    }
+
+    TEST_CASE(RenderGraphResourcePool, EvictsUnusedResourceInSteadyState)
+    {
+        RenderGraphNullBackend backend{};
+        FakePool pool(&backend);
+        pool.SetMaxUnusedFrames(2);
+
+        // 第 0 帧用了 A 和 B，之后每帧只用 A
+        pool.Release(pool.Request({ 100 }));
+        pool.Release(pool.Request({ 200 }));
+        pool.Trim();
+
+        for (uint32_t frame = 1; frame <= 3; frame++)
+        {
+            backend.AdvanceFrame();
+            pool.Release(pool.Request({ 100 }));
+            pool.Trim();
+        }
+
+        // 第 3 帧时 B 已经 3 帧没用了，在 Trim 中被淘汰
+        TEST_CHECK_EQ(pool.GetStats().NumFreeResources, 1u);
+        TEST_CHECK_EQ(pool.GetStats().BytesHeld, uint64_t(100));
+
+        backend.AdvanceFrame();
+        pool.Trim();
+        RenderGraphResourcePoolStats stats = pool.GetStats();
+        TEST_CHECK_EQ(stats.NumHits, 1u);
+        TEST_CHECK_EQ(stats.NumMisses, 0u);
+        TEST_CHECK_EQ(stats.NumEvictions, 1u);
+        TEST_CHECK_EQ(stats.NumFreeResources, 1u);
+        TEST_CHECK_EQ(stats.BytesHeld, uint64_t(100));
+
+        // 之后的稳定状态下 A 一直命中，也不会再被淘汰
+        for (uint32_t frame = 5; frame <= 10; frame++)
+        {
+            backend.AdvanceFrame();
+            pool.Release(pool.Request({ 100 }));
+            pool.Trim();
+        }
+
+        backend.AdvanceFrame();
+        pool.Trim();
+        stats = pool.GetStats();
+        TEST_CHECK_EQ(stats.NumHits, 1u);
+        TEST_CHECK_EQ(stats.NumMisses, 0u);
+        TEST_CHECK_EQ(stats.NumEvictions, 0u);
+        TEST_CHECK_EQ(stats.NumFreeResources, 1u);
+        TEST_CHECK_EQ(stats.BytesHeld, uint64_t(100));
+    }
+
+    TEST_CASE(RenderGraphResourcePool, EvictsOverBudgetOnlyUntilWithinBudget)
+    {
+        RenderGraphNullBackend backend{};
+        FakePool pool(&backend);
+        pool.SetMemoryBudget(250);
+
+        pool.Release(pool.Request({ 100 }));
+        pool.Release(pool.Request({ 200 }));
+        backend.AdvanceFrame();
+        pool.Release(pool.Request({ 50 }));
+        pool.Trim();
+
+        // 第 0 帧的资源更久没用，先淘汰它们，直到不超过预算
+        RenderGraphResourcePoolStats stats = pool.GetStats();
+        TEST_CHECK(stats.BytesHeld <= 250);
+        TEST_CHECK(stats.BytesHeld == 150 || stats.BytesHeld == 250);
+        TEST_CHECK_EQ(stats.NumFreeResources, 2u);
+
+        // 留下的资源还能命中
+        backend.AdvanceFrame();
+        pool.Release(pool.Request({ 50 }));
+        backend.AdvanceFrame();
+        pool.Trim();
+        TEST_CHECK_EQ(pool.GetStats().NumHits, 1u);
+        TEST_CHECK_EQ(pool.GetStats().NumMisses, 0u);
+    }
+}
@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/RenderGraph.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphBackend.h"
+#include "Engine/Rendering/RenderGraphImpl/RenderGraphTransientPlanner.h"
+#include <random>
+
+// transient 资源的内存布局是纯 CPU 计算，不需要 GfxDevice
+
+namespace march::test
+{
+    static RenderGraphTransientRequest MakeRequest(uint64_t size, size_t firstPass, size_t lastPass, uint64_t alignment = 256, uint32_t group = 0)
+    {
+        return RenderGraphTransientRequest{ size, alignment, firstPass, lastPass, group };
+    }
+
+    static bool IsLifetimeOverlapped(const RenderGraphTransientRequest& a, const RenderGraphTransientRequest& b)
+    {
+        return a.FirstPassIndex <= b.LastPassIndex && b.FirstPassIndex <= a.LastPassIndex;
+    }
+
+    static bool IsMemoryOverlapped(const RenderGraphTransientRequest& a, const RenderGraphTransientPlacement& pa,
+        const RenderGraphTransientRequest& b, const RenderGraphTransientPlacement& pb)
+    {
+        return pa.Offset < pb.Offset + b.SizeInBytes && pb.Offset < pa.Offset + a.SizeInBytes;
+    }
+
+    TEST_CASE(RenderGraphTransientPlanner, SharesMemoryBetweenDisjointLifetimes)
+    {
+        std::vector<RenderGraphTransientRequest> requests{};
+        requests.push_back(MakeRequest(1024, 0, 1));
+        requests.push_back(MakeRequest(1024, 2, 3));
+        requests.push_back(MakeRequest(512, 4, 4));
+
+        RenderGraphTransientPlanner planner{};
+        planner.Plan(requests);
+
+        const std::vector<RenderGraphTransientPlacement>& placements = planner.GetPlacements();
+        TEST_REQUIRE_EQ(placements.size(), size_t(3));
+        TEST_CHECK_EQ(placements[0].Offset, uint64_t(0));
+        TEST_CHECK_EQ(placements[1].Offset, uint64_t(0));
+        TEST_CHECK_EQ(placements[2].Offset, uint64_t(0));
+        TEST_CHECK(placements[0].IsAliased);
+        TEST_CHECK(placements[1].IsAliased);
+        TEST_CHECK(placements[2].IsAliased);
+
+        TEST_REQUIRE_EQ(planner.GetHeapSizes().size(), size_t(1));
+        TEST_CHECK_EQ(planner.GetHeapSizes()[0], uint64_t(1024));
+        TEST_CHECK_EQ(planner.GetStats().BytesWithoutAliasing, uint64_t(2560));
+        TEST_CHECK_EQ(planner.GetStats().BytesWithAliasing, uint64_t(1024));
+        TEST_CHECK_EQ(planner.GetStats().NumAliasedResources, 3u);
+    }
+
+    TEST_CASE(RenderGraphTransientPlanner, KeepsOverlappingLifetimesApart)
+    {
+        std::vector<RenderGraphTransientRequest> requests{};
+        requests.push_back(MakeRequest(1000, 0, 2));
+        requests.push_back(MakeRequest(1000, 2, 3)); // 在 pass 2 和第一个资源同时存活
+        requests.push_back(MakeRequest(100, 3, 3, 4096));
+
+        RenderGraphTransientPlanner planner{};
+        planner.Plan(requests);
+
+        const std::vector<RenderGraphTransientPlacement>& placements = planner.GetPlacements();
+        TEST_CHECK(!IsMemoryOverlapped(requests[0], placements[0], requests[1], placements[1]));
+        TEST_CHECK_EQ(placements[2].Offset % 4096, uint64_t(0));
+
+        // 第三个资源只和第二个资源重叠，可以放进第一个资源的位置
+        TEST_CHECK(!IsMemoryOverlapped(requests[1], placements[1], requests[2], placements[2]));
+        TEST_CHECK(placements[2].IsAliased);
+        TEST_CHECK(!placements[1].IsAliased);
+    }
+
+    TEST_CASE(RenderGraphTransientPlanner, NeverAliasesAcrossHeapGroups)
+    {
+        std::vector<RenderGraphTransientRequest> requests{};
+        requests.push_back(MakeRequest(1024, 0, 0, 256, 0));
+        requests.push_back(MakeRequest(1024, 1, 1, 256, 1));
+
+        RenderGraphTransientPlanner planner{};
+        planner.Plan(requests);
+
+        TEST_CHECK(!planner.GetPlacements()[0].IsAliased);
+        TEST_CHECK(!planner.GetPlacements()[1].IsAliased);
+        TEST_REQUIRE_EQ(planner.GetHeapSizes().size(), size_t(2));
+        TEST_CHECK_EQ(planner.GetHeapSizes()[0], uint64_t(1024));
+        TEST_CHECK_EQ(planner.GetHeapSizes()[1], uint64_t(1024));
+    }
+
+    TEST_CASE(RenderGraphTransientPlanner, RandomRequestsProduceValidLayouts)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_int_distribution<uint32_t> count(1, 40);
+        std::uniform_int_distribution<uint64_t> size(1, 64 * 1024);
+        std::uniform_int_distribution<uint32_t> alignmentShift(8, 16);
+        std::uniform_int_distribution<size_t> pass(0, 30);
+        std::uniform_int_distribution<uint32_t> group(0, 1);
+
+        RenderGraphTransientPlanner planner{};
+        std::vector<RenderGraphTransientRequest> requests{};
+
+        for (uint32_t iteration = 0; iteration < 200; iteration++)
+        {
+            requests.clear();
+
+            for (uint32_t i = count(rng); i > 0; i--)
+            {
+                size_t a = pass(rng);
+                size_t b = pass(rng);
+                requests.push_back(MakeRequest(size(rng), std::min(a, b), std::max(a, b), uint64_t(1) << alignmentShift(rng), group(rng)));
+            }
+
+            planner.Plan(requests);
+
+            const std::vector<RenderGraphTransientPlacement>& placements = planner.GetPlacements();
+            TEST_REQUIRE_EQ(placements.size(), requests.size());
+
+            for (size_t i = 0; i < requests.size(); i++)
+            {
+                const RenderGraphTransientRequest& req = requests[i];
+                TEST_CHECK_EQ(placements[i].Offset % req.Alignment, uint64_t(0));
+                TEST_CHECK(placements[i].Offset + req.SizeInBytes <= planner.GetHeapSizes()[req.HeapGroup]);
+
+                bool isAliased = false;
+
+                for (size_t j = 0; j < requests.size(); j++)
+                {
+                    if (i == j || requests[j].HeapGroup != req.HeapGroup || !IsMemoryOverlapped(req, placements[i], requests[j], placements[j]))
+                    {
+                        continue;
+                    }
+
+                    // 同时存活的资源绝对不能共用内存
+                    TEST_CHECK(!IsLifetimeOverlapped(req, requests[j]));
+                    isAliased = true;
+                }
+
+                TEST_CHECK_EQ(placements[i].IsAliased, isAliased);
+            }
+        }
+    }
+
+    static GfxTextureDesc MakeCameraTargetDesc(GfxTextureFormat format, uint32_t width, uint32_t height)
+    {
+        GfxTextureDesc desc{};
+        desc.Format = format;
+        desc.Flags = GfxTextureFlags::None;
+        desc.Dimension = GfxTextureDimension::Tex2D;
+        desc.Width = width;
+        desc.Height = height;
+        desc.DepthOrArraySize = 1;
+        desc.MSAASamples = 1;
+        desc.Filter = GfxTextureFilterMode::Bilinear;
+        desc.Wrap = GfxTextureWrapMode::Clamp;
+        desc.MipmapBias = 0;
+        return desc;
+    }
+
+    // 一个相机的一帧，有两张中间 texture
+    static void RenderCamera(RenderGraph& graph, uint32_t width, uint32_t height)
+    {
+        GfxTextureDesc colorDesc = MakeCameraTargetDesc(GfxTextureFormat::R8G8B8A8_UNorm, width, height);
+        TextureHandle target = graph.ImportTexture("_CameraTarget", colorDesc);
+        TextureHandle color = graph.RequestTexture("_Color", colorDesc);
+        TextureHandle bloom = graph.RequestTexture("_Bloom", colorDesc);
+
+        graph.AddPass("Opaque").Out(color);
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Bloom");
+            builder.In(color);
+            builder.Out(bloom);
+        }
+
+        {
+            RenderGraphBuilder builder = graph.AddPass("Final");
+            builder.In(bloom);
+            builder.Out(target);
+        }
+
+        graph.Compile();
+        graph.Reset();
+    }
+
+    TEST_CASE(RenderGraphTransientPlanner, KeepsOneSetPerCameraResolution)
+    {
+        RenderGraph graph(std::make_unique<RenderGraphNullBackend>());
+        RenderGraphNullBackend* backend = static_cast<RenderGraphNullBackend*>(graph.GetBackend());
+        const RenderGraphResourceManager* manager = graph.GetResourceManager();
+
+        // Game View 和 Scene View 的分辨率不同，每帧交替渲染
+        for (uint32_t frame = 0; frame < 10; frame++)
+        {
+            RenderCamera(graph, 1920, 1080);
+            RenderCamera(graph, 1280, 720);
+            backend->AdvanceFrame();
+        }
+
+        TEST_CHECK_EQ(manager->GetNumTransientTextureSetBuilds(), uint64_t(2));
+        TEST_CHECK_EQ(manager->GetNumTransientTextureSets(), size_t(2));
+
+        // 关掉 Scene View 以后，它的那一套过一段时间会被释放
+        for (uint32_t frame = 0; frame < 100; frame++)
+        {
+            RenderCamera(graph, 1920, 1080);
+            backend->AdvanceFrame();
+        }
+
+        TEST_CHECK_EQ(manager->GetNumTransientTextureSetBuilds(), uint64_t(2));
+        TEST_CHECK_EQ(manager->GetNumTransientTextureSets(), size_t(1));
+    }
+}
@@ -0,0 +1,299 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Rendering/D3D12Impl/ShaderVariantLookup.h"
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+// 查找结果必须和线性查找完全一样，包括差异相同时选索引最小的 variant
+// keyword 直接用 bit 的索引表示，不需要注册到 ShaderKeywordSpace
+
+namespace march::test
+{
+    struct VariantDimension
+    {
+        std::vector<size_t> Keywords;
+        bool HasEmptyOption;
+    };
+
+    // 方便输出失败时的值，没找到时是 SIZE_MAX
+    static size_t ToIndex(const std::optional<size_t>& index)
+    {
+        return index.value_or(std::numeric_limits<size_t>::max());
+    }
+
+    static ShaderKeywordSet MakeKeywords(const ShaderKeywordSpace* space, const std::vector<size_t>& keywords)
+    {
+        ShaderKeywordSet::BitsType bits{};
+
+        for (size_t k : keywords)
+        {
+            bits.set(k);
+        }
+
+        ShaderKeywordSet ks{};
+        ks.Reset(space);
+        ks.SetBits(bits);
+        return ks;
+    }
+
+    static std::optional<size_t> FindLinearReference(const std::vector<ShaderKeywordSet>& variants, const ShaderKeywordSet& keywords)
+    {
+        std::optional<size_t> index = std::nullopt;
+        size_t minDiff = std::numeric_limits<size_t>::max();
+
+        for (size_t j = 0; j < variants.size(); j++)
+        {
+            size_t diff = keywords.GetNumEnabledKeywords() + variants[j].GetNumEnabledKeywords() - 2 * variants[j].GetNumMatchingKeywords(keywords);
+
+            if (diff < minDiff)
+            {
+                minDiff = diff;
+                index = j;
+            }
+        }
+
+        return index;
+    }
+
+    static std::vector<ShaderKeywordSet> MakeCartesianProduct(const ShaderKeywordSpace* space, const std::vector<VariantDimension>& dimensions)
+    {
+        std::vector<std::vector<size_t>> combinations(1);
+
+        for (const VariantDimension& dimension : dimensions)
+        {
+            std::vector<std::vector<size_t>> next{};
+
+            for (const std::vector<size_t>& c : combinations)
+            {
+                if (dimension.HasEmptyOption)
+                {
+                    next.push_back(c);
+                }
+
+                for (size_t k : dimension.Keywords)
+                {
+                    next.push_back(c);
+                    next.back().push_back(k);
+                }
+            }
+
+            combinations = std::move(next);
+        }
+
+        std::vector<ShaderKeywordSet> variants{};
+
+        for (const std::vector<size_t>& c : combinations)
+        {
+            variants.push_back(MakeKeywords(space, c));
+        }
+
+        return variants;
+    }
+
+    static std::vector<VariantDimension> MakeRandomDimensions(std::mt19937& rng, size_t numDimensions)
+    {
+        std::vector<VariantDimension> dimensions(numDimensions);
+        std::uniform_int_distribution<size_t> size(1, 3);
+        std::bernoulli_distribution hasEmptyOption(0.5);
+        size_t nextKeyword = 0;
+
+        for (VariantDimension& dimension : dimensions)
+        {
+            dimension.HasEmptyOption = hasEmptyOption(rng);
+
+            // 只有一个 keyword 的维度必须有 _ 选项，否则它和其他维度的 keyword 总是同时出现
+            size_t count = dimension.HasEmptyOption ? size(rng) : size(rng) + 1;
+
+            for (size_t i = 0; i < count; i++)
+            {
+                dimension.Keywords.push_back(nextKeyword++);
+            }
+        }
+
+        return dimensions;
+    }
+
+    // 目标可以在同一个维度中开启多个 keyword，也可以开启任何 variant 都没有的 keyword
+    static ShaderKeywordSet MakeRandomTarget(std::mt19937& rng, const ShaderKeywordSpace* space, size_t numKeywords)
+    {
+        std::bernoulli_distribution enabled(0.3);
+        std::vector<size_t> keywords{};
+
+        for (size_t k = 0; k < numKeywords + 2; k++)
+        {
+            if (enabled(rng))
+            {
+                keywords.push_back(k);
+            }
+        }
+
+        return MakeKeywords(space, keywords);
+    }
+
+    static void CheckAgainstReference(std::mt19937& rng, const ShaderKeywordSpace* space, const std::vector<ShaderKeywordSet>& variants, size_t numKeywords)
+    {
+        ShaderVariantLookup lookup{};
+
+        for (const ShaderKeywordSet& ks : variants)
+        {
+            lookup.Add(ks);
+        }
+
+        for (const ShaderKeywordSet& ks : variants)
+        {
+            TEST_CHECK_EQ(ToIndex(lookup.Find(ks)), ToIndex(FindLinearReference(variants, ks)));
+        }
+
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            ShaderKeywordSet target = MakeRandomTarget(rng, space, numKeywords);
+            TEST_CHECK_EQ(ToIndex(lookup.Find(target)), ToIndex(FindLinearReference(variants, target)));
+        }
+    }
+
+    TEST_CASE(ShaderVariantLookup, TieUsesFirstIndex)
+    {
+        ShaderKeywordSpace space{};
+
+        // 维度 A = { a0, a1 } 没有 _ 选项，维度 B = { _, b0 }，a1 排在 a0 前面
+        std::vector<ShaderKeywordSet> variants =
+        {
+            MakeKeywords(&space, { 1 }),
+            MakeKeywords(&space, { 0 }),
+            MakeKeywords(&space, { 1, 2 }),
+            MakeKeywords(&space, { 0, 2 }),
+        };
+
+        ShaderVariantLookup lookup{};
+
+        for (const ShaderKeywordSet& ks : variants)
+        {
+            lookup.Add(ks);
+        }
+
+        // 不包含 A 的 keyword 时 a0 和 a1 差异相同，选排在前面的 a1
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, {}))), size_t(0));
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 2 }))), size_t(2));
+
+        // 同时包含 a0 和 a1 也一样
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 0, 1 }))), size_t(0));
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 0, 1, 2 }))), size_t(2));
+
+        // 其他 space 的 keyword 都不 match
+        ShaderKeywordSpace otherSpace{};
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&otherSpace, { 0 }))), size_t(0));
+    }
+
+    TEST_CASE(ShaderVariantLookup, DuplicateUsesFirstIndex)
+    {
+        ShaderKeywordSpace space{};
+        ShaderVariantLookup lookup{};
+        lookup.Add(MakeKeywords(&space, { 0 }));
+        lookup.Add(MakeKeywords(&space, { 1 }));
+        lookup.Add(MakeKeywords(&space, { 0 }));
+
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 0 }))), size_t(0));
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 1 }))), size_t(1));
+    }
+
+    TEST_CASE(ShaderVariantLookup, EmptyAndReset)
+    {
+        ShaderKeywordSpace space{};
+        ShaderVariantLookup lookup{};
+        TEST_CHECK(!lookup.Find(MakeKeywords(&space, { 0 })));
+
+        lookup.Add(MakeKeywords(&space, { 0 }));
+        lookup.Add(MakeKeywords(&space, { 1 }));
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 1 }))), size_t(1));
+
+        // 构建过之后再修改，下次查找要重新构建
+        lookup.Reset();
+        lookup.Add(MakeKeywords(&space, { 1 }));
+        TEST_REQUIRE_EQ(lookup.GetNumVariants(), size_t(1));
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 1 }))), size_t(0));
+
+        lookup.Add(MakeKeywords(&space, {}));
+        TEST_CHECK_EQ(ToIndex(lookup.Find(MakeKeywords(&space, { 2 }))), size_t(1));
+    }
+
+    TEST_CASE(ShaderVariantLookup, ShuffledCartesianProductMatchesLinearScan)
+    {
+        std::mt19937 rng(7);
+        ShaderKeywordSpace space{};
+
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            std::vector<VariantDimension> dimensions = MakeRandomDimensions(rng, 1 + i % 4);
+            std::vector<ShaderKeywordSet> variants = MakeCartesianProduct(&space, dimensions);
+            std::shuffle(variants.begin(), variants.end(), rng);
+
+            size_t numKeywords = dimensions.back().Keywords.back() + 1;
+            CheckAgainstReference(rng, &space, variants, numKeywords);
+        }
+    }
+
+    TEST_CASE(ShaderVariantLookup, ManyTiedDimensionsMatchesLinearScan)
+    {
+        std::mt19937 rng(8);
+        ShaderKeywordSpace space{};
+
+        // 目标不包含任何 keyword 时每个维度 3 个选项都一样，组合数 3^5 会超过上限
+        std::vector<VariantDimension> dimensions{};
+
+        for (size_t d = 0; d < 5; d++)
+        {
+            dimensions.push_back({ { d * 3, d * 3 + 1, d * 3 + 2 }, false });
+        }
+
+        std::vector<ShaderKeywordSet> variants = MakeCartesianProduct(&space, dimensions);
+        std::shuffle(variants.begin(), variants.end(), rng);
+
+        ShaderVariantLookup lookup{};
+
+        for (const ShaderKeywordSet& ks : variants)
+        {
+            lookup.Add(ks);
+        }
+
+        ShaderKeywordSet empty = MakeKeywords(&space, {});
+        TEST_CHECK_EQ(ToIndex(lookup.Find(empty)), ToIndex(FindLinearReference(variants, empty)));
+
+        CheckAgainstReference(rng, &space, variants, 15);
+    }
+
+    TEST_CASE(ShaderVariantLookup, IrregularSetMatchesLinearScan)
+    {
+        std::mt19937 rng(9);
+        ShaderKeywordSpace space{};
+
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            // 从笛卡尔积中随机去掉一部分，再随机加一些重复的
+            std::vector<VariantDimension> dimensions = MakeRandomDimensions(rng, 1 + i % 4);
+            std::vector<ShaderKeywordSet> product = MakeCartesianProduct(&space, dimensions);
+            std::vector<ShaderKeywordSet> variants{};
+            std::bernoulli_distribution keep(0.6);
+
+            for (const ShaderKeywordSet& ks : product)
+            {
+                if (keep(rng))
+                {
+                    variants.push_back(ks);
+                }
+            }
+
+            if (!variants.empty())
+            {
+                variants.push_back(variants[rng() % variants.size()]);
+            }
+
+            std::shuffle(variants.begin(), variants.end(), rng);
+
+            size_t numKeywords = dimensions.back().Keywords.back() + 1;
+            CheckAgainstReference(rng, &space, variants, numKeywords);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <sstream>
+#include <type_traits>
+
+namespace march::test
+{
+    using TestFunc = void(*)();
+
+    // 用静态变量注册，main 里按注册顺序执行
+    struct TestRegistrar
+    {
+        TestRegistrar(const char* suite, const char* name, TestFunc func);
+    };
+
+    // TEST_REQUIRE 失败时抛出，结束当前测试
+    struct TestAbort {};
+
+    void ReportFailure(const char* file, int line, const std::string& message);
+
+    template <typename T>
+    std::string ToTestString(const T& value)
+    {
+        std::ostringstream ss;
+
+        if constexpr (std::is_enum_v<T>)
+        {
+            ss << static_cast<std::underlying_type_t<T>>(value);
+        }
+        else
+        {
+            ss << value;
+        }
+
+        return ss.str();
+    }
+
+    template <typename _Lhs, typename _Rhs>
+    bool CheckEqual(const _Lhs& lhs, const _Rhs& rhs, const char* lhsExpr, const char* rhsExpr, const char* file, int line)
+    {
+        if (lhs == rhs)
+        {
+            return true;
+        }
+
+        ReportFailure(file, line, std::string(lhsExpr) + " == " + rhsExpr + " (" + ToTestString(lhs) + " vs " + ToTestString(rhs) + ")");
+        return false;
+    }
+}
+
+#define MARCH_TEST_CONCAT_IMPL(a, b) a##b
+#define MARCH_TEST_CONCAT(a, b) MARCH_TEST_CONCAT_IMPL(a, b)
+
+#define TEST_CASE(suite, name) \
+    static void MARCH_TEST_CONCAT(Test_##suite##_, name)(); \
+    static ::march::test::TestRegistrar MARCH_TEST_CONCAT(g_TestRegistrar_##suite##_, name)(#suite, #name, &MARCH_TEST_CONCAT(Test_##suite##_, name)); \
+    static void MARCH_TEST_CONCAT(Test_##suite##_, name)()
+
+// 失败后继续执行
+#define TEST_CHECK(expr) \
+    do { if (!(expr)) { ::march::test::ReportFailure(__FILE__, __LINE__, #expr); } } while (false)
+
+#define TEST_CHECK_EQ(lhs, rhs) \
+    do { ::march::test::CheckEqual((lhs), (rhs), #lhs, #rhs, __FILE__, __LINE__); } while (false)
+
+// 失败后结束当前测试，用于后面的检查依赖这个条件的情况
+#define TEST_REQUIRE(expr) \
+    do { if (!(expr)) { ::march::test::ReportFailure(__FILE__, __LINE__, #expr); throw ::march::test::TestAbort{}; } } while (false)
+
+#define TEST_REQUIRE_EQ(lhs, rhs) \
+    do { if (!::march::test::CheckEqual((lhs), (rhs), #lhs, #rhs, __FILE__, __LINE__)) { throw ::march::test::TestAbort{}; } } while (false)
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <exception>
+
+namespace march::test
+{
+    struct TestCaseInfo
+    {
+        const char* Suite;
+        const char* Name;
+        TestFunc Func;
+    };
+
+    // 函数内的静态变量，保证注册时已经初始化
+    static std::vector<TestCaseInfo>& GetTestCases()
+    {
+        static std::vector<TestCaseInfo> cases{};
+        return cases;
+    }
+
+    static uint32_t g_NumFailures = 0; // 当前测试的失败次数
+
+    TestRegistrar::TestRegistrar(const char* suite, const char* name, TestFunc func)
+    {
+        GetTestCases().push_back({ suite, name, func });
+    }
+
+    void ReportFailure(const char* file, int line, const std::string& message)
+    {
+        g_NumFailures++;
+        printf("%s(%d): check failed: %s\n", file, line, message.c_str());
+    }
+
+    static bool MatchFilter(const TestCaseInfo& info, const char* filter)
+    {
+        if (filter == nullptr)
+        {
+            return true;
+        }
+
+        std::string fullName = std::string(info.Suite) + "." + info.Name;
+        return strstr(fullName.c_str(), filter) != nullptr;
+    }
+
+    static int RunTests(const char* filter)
+    {
+        uint32_t numPassed = 0;
+        uint32_t numFailed = 0;
+
+        for (const TestCaseInfo& info : GetTestCases())
+        {
+            if (!MatchFilter(info, filter))
+            {
+                continue;
+            }
+
+            printf("[ RUN      ] %s.%s\n", info.Suite, info.Name);
+            g_NumFailures = 0;
+
+            try
+            {
+                info.Func();
+            }
+            catch (const TestAbort&)
+            {
+                // 已经在 ReportFailure 里输出了
+            }
+            catch (const std::exception& e)
+            {
+                ReportFailure(__FILE__, __LINE__, std::string("unexpected exception: ") + e.what());
+            }
+
+            if (g_NumFailures == 0)
+            {
+                numPassed++;
+                printf("[       OK ] %s.%s\n", info.Suite, info.Name);
+            }
+            else
+            {
+                numFailed++;
+                printf("[  FAILED  ] %s.%s\n", info.Suite, info.Name);
+            }
+        }
+
+        printf("%u passed, %u failed\n", numPassed, numFailed);
+        return numFailed == 0 ? 0 : 1;
+    }
+}
+
+// 用法：CoreNativeTests [filter]，只运行名字（Suite.Name）包含 filter 的测试
+int main(int argc, char** argv)
+{
+    return march::test::RunTests(argc > 1 ? argv[1] : nullptr);
+}
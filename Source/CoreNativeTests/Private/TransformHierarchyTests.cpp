@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "TestFramework.h"
+#include "Engine/Transform.h"
+#include <math.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// 批量更新的结果和沿着父节点链逐个计算的结果比较，顺便检查增删节点和改父节点以后层级顺序仍然正确
+
+namespace march::test
+{
+    static constexpr float Tolerance = 1e-3f;
+
+    static XMMATRIX WalkParentChain(const Transform* transform)
+    {
+        XMMATRIX result = XMMatrixIdentity();
+
+        for (; transform != nullptr; transform = transform->GetParent())
+        {
+            XMMATRIX local = XMMatrixAffineTransformation(transform->LoadLocalScale(), XMVectorZero(), transform->LoadLocalRotation(), transform->LoadLocalPosition());
+            result = XMMatrixMultiply(result, local);
+        }
+
+        return result;
+    }
+
+    static XMVECTOR WalkParentChainRotation(const Transform* transform)
+    {
+        XMVECTOR result = XMQuaternionIdentity();
+
+        for (; transform != nullptr; transform = transform->GetParent())
+        {
+            result = XMQuaternionMultiply(result, transform->LoadLocalRotation());
+        }
+
+        return result;
+    }
+
+    static bool IsNear(FXMMATRIX a, CXMMATRIX b)
+    {
+        for (size_t row = 0; row < 4; row++)
+        {
+            // 矩阵的元素会被 scale 放大，用相对误差
+            XMVECTOR scale = XMVectorMax(XMVectorSplatOne(), XMVectorAbs(b.r[row]));
+
+            if (!XMVector4NearEqual(a.r[row], b.r[row], XMVectorScale(scale, Tolerance)))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    class RandomForest
+    {
+    public:
+        explicit RandomForest(uint32_t seed) : m_Rng(seed) {}
+
+        ~RandomForest()
+        {
+            while (!m_Transforms.empty())
+            {
+                DestroyAt(m_Transforms.size() - 1);
+            }
+        }
+
+        Transform* Create(Transform* parent)
+        {
+            std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+            std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+            std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+
+            Transform* transform = m_Transforms.emplace_back(std::make_unique<Transform>()).get();
+            TransformInternalUtility::SetParent(transform, parent);
+            TransformInternalUtility::SetLocalPosition(transform, XMFLOAT3(position(m_Rng), position(m_Rng), position(m_Rng)));
+            TransformInternalUtility::SetLocalEulerAngles(transform, XMFLOAT3(angle(m_Rng), angle(m_Rng), angle(m_Rng)));
+
+            // 偶尔有负的 scale
+            float sx = scale(m_Rng) * ((m_Rng() % 8) == 0 ? -1.0f : 1.0f);
+            TransformInternalUtility::SetLocalScale(transform, XMFLOAT3(sx, scale(m_Rng), scale(m_Rng)));
+            return transform;
+        }
+
+        // 父节点在已有节点中随机选，偶尔是根节点，深度不超过 maxDepth
+        void Grow(size_t count, uint32_t maxDepth)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                Transform* parent = nullptr;
+
+                if (!m_Transforms.empty() && (m_Rng() % 10) != 0)
+                {
+                    parent = PickRandom();
+
+                    if (GetDepth(parent) + 1 >= maxDepth)
+                    {
+                        parent = nullptr;
+                    }
+                }
+
+                Create(parent);
+            }
+        }
+
+        // 把一个节点挂到另一个不在它子树里的节点下面，或者变成根节点
+        void ReparentRandom()
+        {
+            Transform* transform = PickRandom();
+            Transform* parent = (m_Rng() % 4) == 0 ? nullptr : PickRandom();
+
+            for (Transform* p = parent; p != nullptr; p = p->GetParent())
+            {
+                if (p == transform)
+                {
+                    return;
+                }
+            }
+
+            TransformInternalUtility::SetParent(transform, parent);
+        }
+
+        // 销毁一个节点，它的子节点挂到它的父节点下面，和 C# 侧先处理子节点的顺序一致
+        void DestroyRandom()
+        {
+            DestroyAt(std::uniform_int_distribution<size_t>(0, m_Transforms.size() - 1)(m_Rng));
+        }
+
+        void MoveRandom()
+        {
+            std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+            TransformInternalUtility::SetLocalPosition(PickRandom(), XMFLOAT3(position(m_Rng), position(m_Rng), position(m_Rng)));
+        }
+
+        void Check() const
+        {
+            for (const std::unique_ptr<Transform>& t : m_Transforms)
+            {
+                // 更新完以后都不是脏的，读到的是批量更新写入的值
+                XMFLOAT4X4 localToWorld = t->GetLocalToWorldMatrix();
+                XMFLOAT4X4 worldToLocal = t->GetWorldToLocalMatrix();
+
+                XMMATRIX expected = WalkParentChain(t.get());
+                TEST_REQUIRE(IsNear(XMLoadFloat4x4(&localToWorld), expected));
+                TEST_REQUIRE(IsNear(XMLoadFloat4x4(&worldToLocal), XMMatrixInverse(nullptr, expected)));
+
+                XMVECTOR rotation = WalkParentChainRotation(t.get());
+                XMFLOAT4 actualRotation = t->GetRotation();
+                TEST_REQUIRE(XMVector4NearEqual(XMLoadFloat4(&actualRotation), rotation, XMVectorReplicate(Tolerance)));
+            }
+        }
+
+        size_t GetCount() const { return m_Transforms.size(); }
+
+    private:
+        std::mt19937 m_Rng;
+        std::vector<std::unique_ptr<Transform>> m_Transforms{};
+
+        Transform* PickRandom()
+        {
+            return m_Transforms[std::uniform_int_distribution<size_t>(0, m_Transforms.size() - 1)(m_Rng)].get();
+        }
+
+        static uint32_t GetDepth(const Transform* transform)
+        {
+            uint32_t depth = 0;
+
+            for (; transform->GetParent() != nullptr; transform = transform->GetParent())
+            {
+                depth++;
+            }
+
+            return depth;
+        }
+
+        void DestroyAt(size_t index)
+        {
+            Transform* transform = m_Transforms[index].get();
+            Transform* parent = transform->GetParent();
+
+            for (const std::unique_ptr<Transform>& t : m_Transforms)
+            {
+                if (t->GetParent() == transform)
+                {
+                    TransformInternalUtility::SetParent(t.get(), parent);
+                }
+            }
+
+            m_Transforms[index] = std::move(m_Transforms.back());
+            m_Transforms.pop_back();
+        }
+    };
+
+    TEST_CASE(TransformHierarchy, BatchUpdateMatchesParentChain)
+    {
+        RandomForest forest(1);
+        forest.Grow(3000, 7);
+
+        Transform::UpdateAllDirtyTransforms();
+        forest.Check();
+
+        // 只有部分节点脏的时候，一个 packet 里的节点分散在不同位置
+        for (uint32_t i = 0; i < 50; i++)
+        {
+            forest.MoveRandom();
+        }
+
+        Transform::UpdateAllDirtyTransforms();
+        forest.Check();
+    }
+
+    TEST_CASE(TransformHierarchy, KeepsLevelOrderAcrossEdits)
+    {
+        RandomForest forest(2);
+        forest.Grow(500, 6);
+        Transform::UpdateAllDirtyTransforms();
+
+        // 每一轮都会让节点的层级上下移动，批量更新时父节点必须已经算好
+        for (uint32_t round = 0; round < 20; round++)
+        {
+            for (uint32_t i = 0; i < 20; i++)
+            {
+                forest.ReparentRandom();
+            }
+
+            for (uint32_t i = 0; i < 10; i++)
+            {
+                forest.DestroyRandom();
+            }
+
+            forest.Grow(10, 10);
+            Transform::UpdateAllDirtyTransforms();
+            forest.Check();
+        }
+
+        TEST_CHECK_EQ(forest.GetCount(), size_t(500));
+    }
+
+    class CountingListener : public TransformChangeListener
+    {
+    public:
+        uint32_t Count = 0;
+
+        void OnTransformChanged() override { Count++; }
+    };
+
+    TEST_CASE(TransformHierarchy, NotifiesChangeListeners)
+    {
+        Transform parent{};
+        Transform child{};
+        TransformInternalUtility::SetParent(&child, &parent);
+        Transform::UpdateAllDirtyTransforms();
+
+        CountingListener listener{};
+        child.AddChangeListener(&listener);
+
+        // 父节点变化也会通知子节点的 listener
+        TransformInternalUtility::SetLocalPosition(&parent, XMFLOAT3(1.0f, 2.0f, 3.0f));
+        TEST_CHECK_EQ(listener.Count, 1u);
+
+        // 已经全脏了，不会重复通知
+        TransformInternalUtility::SetLocalPosition(&child, XMFLOAT3(4.0f, 5.0f, 6.0f));
+        TEST_CHECK_EQ(listener.Count, 1u);
+
+        Transform::UpdateAllDirtyTransforms();
+        TransformInternalUtility::SetLocalScale(&child, XMFLOAT3(2.0f, 2.0f, 2.0f));
+        TEST_CHECK_EQ(listener.Count, 2u);
+
+        child.RemoveChangeListener(&listener);
+        Transform::UpdateAllDirtyTransforms();
+        TransformInternalUtility::SetLocalPosition(&parent, XMFLOAT3(0.0f, 0.0f, 0.0f));
+        TEST_CHECK_EQ(listener.Count, 2u);
+
+        TransformInternalUtility::SetParent(&child, nullptr);
+    }
+}
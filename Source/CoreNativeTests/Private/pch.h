@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Engine/Ints.h"
+#include "Engine/Object.h"
+
+#include <d3dx12.h>
+#include <dxgi1_5.h>
+#include <DirectXCollision.h>
+#include <DirectXColors.h>
+#include <DirectXMath.h>
+#include <wrl.h>
+
+#include <vector>
+#include <string>
+#include <memory>
@@ -141,6 +141,11 @@ namespace march
                 ImGui::TextUnformatted(entry.Message.c_str());
                 ImGui::Spacing();
 
+                if (const LogSourceLocation* loc = entry.Location)
+                {
+                    ImGui::Text("%s (at %s : %d)", loc->Function, loc->Filename, loc->Line);
+                }
+
                 for (const LogStackFrame& frame : entry.StackTrace)
                 {
                     ImGui::Text("%s (at %s : %d)", frame.Function.c_str(), frame.Filename.c_str(), frame.Line);
@@ -17,6 +17,7 @@
 #include "Engine/Misc/PlatformUtils.h"
 #include "Engine/Misc/DeferFunc.h"
 #include "Engine/Scripting/DotNetRuntime.h"
+#include "Engine/JobManager.h"
 #include "Engine/Profiling/FrameDebugger.h"
 #include "Engine/Profiling/NsightAftermath.h"
 #include "Engine/Debug.h"
@@ -119,6 +120,7 @@ namespace march
         desc.OnlineSamplerDescriptorHeapSize = 2048;
 
         DotNet::InitRuntime(); // 越早越好，mixed debugger 需要 runtime 加载完后才能工作
+        JobManager::Initialize();
         GfxDevice* device = InitGfxDevice(desc);
 
         if (useNsightAftermath)
@@ -247,6 +249,7 @@ namespace march
 
         m_SwapChain.reset();
 
+        JobManager::Shutdown();
         Display::DestroyMainDisplay();
         GfxTexture::ClearSamplerCache();
         ShaderUtils::ClearRootSignatureCache();
@@ -395,6 +398,7 @@ namespace march
         GfxDevice* device = GetGfxDevice();
         device->GetCommandManager()->SignalNextFrameFence(/* waitForGpuIdle */ false);
         device->CleanupResources();
+        device->DefragmentHeaps();
     }
 
     static std::string GetFontPath(Application* app, std::string fontName)
@@ -1,11 +1,16 @@
 #include "pch.h"
 #include "RenderGraphViewerWindow.h"
 #include "Engine/Misc/StringUtils.h"
+#include "Engine/Misc/TimeUtils.h"
+#include "Engine/Application.h"
+#include "Engine/Debug.h"
 #include "IconsFontAwesome6.h"
 #include "imgui.h"
 #include <DirectXMath.h>
+#include <filesystem>
 
 using namespace DirectX;
+namespace fs = std::filesystem;
 
 namespace march
 {
@@ -13,6 +18,8 @@ namespace march
     {
         m_Passes.clear();
         m_Resources.clear();
+        m_BufferPoolStats = resourceManager->GetBufferPoolStats();
+        m_TexturePoolStats = resourceManager->GetTexturePoolStats();
 
         for (size_t resourceIndex = 0; resourceIndex < resourceManager->GetNumResources(); resourceIndex++)
         {
@@ -42,7 +49,7 @@ namespace march
             constexpr size_t maxShortNameLength = 18;
             if (pass.Name.size() > maxShortNameLength)
             {
-                data.ShortName = pass.Name.substr(0, maxShortNameLength) + "...";
+                data.ShortName = std::string(pass.Name.substr(0, maxShortNameLength)) + "...";
             }
             else
             {
@@ -70,18 +77,36 @@ namespace march
 
             for (const auto& kv : pass.ResourcesIn)
             {
-                size_t resourceIndex = kv.first;
+                size_t resourceIndex = kv.Key;
                 m_Resources[resourceIndex].PassAccessFlags[passIndex] |= ResourceAccessFlags::Read;
             }
 
             for (const auto& kv : pass.ResourcesOut)
             {
-                size_t resourceIndex = kv.first;
+                size_t resourceIndex = kv.Key;
                 m_Resources[resourceIndex].PassAccessFlags[passIndex] |= ResourceAccessFlags::Write;
             }
         }
     }
 
+    void RenderGraphViewerWindow::OnGraphProfiled(const RenderGraphFrameTiming& timing)
+    {
+        m_FrameTimings.push_back(timing);
+
+        if (m_FrameTimings.size() > RenderGraphProfiler::MaxHistoryFrames)
+        {
+            m_FrameTimings.pop_front();
+        }
+
+        // deque 只在两端增删，指针不会失效
+        m_PassTimings.clear();
+
+        for (const RenderGraphPassTiming& pass : m_FrameTimings.back().Passes)
+        {
+            m_PassTimings[pass.Name] = &pass;
+        }
+    }
+
     bool RenderGraphViewerWindow::Begin()
     {
         ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
@@ -98,6 +123,11 @@ namespace march
 
     void RenderGraphViewerWindow::OnClose()
     {
+        // profiling 只给这个窗口用，关掉以后就没有开销了
+        RenderGraph::SetProfilingEnabled(false);
+        m_FrameTimings.clear();
+        m_PassTimings.clear();
+
         RenderGraph::RemoveGraphCompiledEventListener(this);
         base::OnClose();
     }
@@ -105,6 +135,7 @@ namespace march
     void RenderGraphViewerWindow::OnDraw()
     {
         base::OnDraw();
+        DrawToolbar();
 
         if (m_Passes.empty())
         {
@@ -156,8 +187,15 @@ namespace march
 
                 if (int passIndex = i - 1; passIndex < 0)
                 {
-                    // 不是 pass 列
-                    ImGui::TableHeader("");
+                    // 不是 pass 列，显示资源池的信息
+                    ImGui::TableHeader(ICON_FA_DATABASE);
+
+                    if (ImGui::BeginItemTooltip())
+                    {
+                        DrawPoolStats("Buffer Pool", m_BufferPoolStats);
+                        DrawPoolStats("Texture Pool", m_TexturePoolStats);
+                        ImGui::EndTooltip();
+                    }
                 }
                 else
                 {
@@ -204,6 +242,17 @@ namespace march
                             ImGui::BulletText(t.c_str());
                         }
 
+                        if (auto it = m_PassTimings.find(pass.FullName); it != m_PassTimings.end())
+                        {
+                            const RenderGraphPassTiming* timing = it->second;
+                            ImGui::BulletText("CPU: %.3f ms", timing->GetCpuMilliseconds());
+
+                            if (timing->HasGpuTiming)
+                            {
+                                ImGui::BulletText("GPU: %.3f ms", timing->GetGpuMilliseconds());
+                            }
+                        }
+
                         ImGui::EndTooltip();
                     }
                 }
@@ -269,6 +318,74 @@ namespace march
         }
     }
 
+    void RenderGraphViewerWindow::DrawToolbar()
+    {
+        ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(6, 4));
+
+        bool isProfiling = RenderGraph::IsProfilingEnabled();
+        if (ImGui::Checkbox(ICON_FA_STOPWATCH " Profile", &isProfiling))
+        {
+            RenderGraph::SetProfilingEnabled(isProfiling);
+        }
+
+        ImGui::SameLine();
+        ImGui::BeginDisabled(m_FrameTimings.empty());
+
+        if (ImGui::Button(ICON_FA_FILE_EXPORT " Export Chrome Trace"))
+        {
+            ExportChromeTrace();
+        }
+
+        ImGui::EndDisabled();
+
+        if (!m_FrameTimings.empty())
+        {
+            const RenderGraphFrameTiming& frame = m_FrameTimings.back();
+            double cpuMilliseconds = 0;
+            double gpuMilliseconds = 0;
+
+            for (const RenderGraphPassTiming& pass : frame.Passes)
+            {
+                cpuMilliseconds += pass.GetCpuMilliseconds();
+                gpuMilliseconds += pass.GetGpuMilliseconds();
+            }
+
+            ImGui::SameLine();
+            ImGui::AlignTextToFramePadding();
+            ImGui::Text("Compile: %.3f ms | CPU: %.3f ms | GPU: %.3f ms", frame.GetCompileMilliseconds(), cpuMilliseconds, gpuMilliseconds);
+        }
+
+        ImGui::PopStyleVar();
+    }
+
+    void RenderGraphViewerWindow::ExportChromeTrace()
+    {
+        fs::path path = fs::u8path(GetApp()->GetDataPath() + "/Logs");
+
+        if (!fs::exists(path) && !fs::create_directories(path))
+        {
+            LOG_ERROR("Failed to create directory: {}", path.string());
+            return;
+        }
+
+        path /= fs::u8path(StringUtils::Format("RenderGraph-{:%Y-%m-%d-%H-%M-%S}.json", TimeUtils::GetLocalTime()));
+
+        if (RenderGraphProfiler::SaveChromeTrace(path.string(), m_FrameTimings))
+        {
+            LOG_INFO("Render graph trace is saved to {}", path.string());
+        }
+    }
+
+    void RenderGraphViewerWindow::DrawPoolStats(const char* label, const RenderGraphResourcePoolStats& stats)
+    {
+        ImGui::SeparatorText(label);
+        ImGui::BulletText("Hits: %u", stats.NumHits);
+        ImGui::BulletText("Misses (Allocations): %u", stats.NumMisses);
+        ImGui::BulletText("Evictions: %u", stats.NumEvictions);
+        ImGui::BulletText("Free Resources: %u", stats.NumFreeResources);
+        ImGui::BulletText("Bytes Held: %.2f MB", static_cast<double>(stats.BytesHeld) / (1024.0 * 1024.0));
+    }
+
     void RenderGraphViewerWindow::DrawAccessSquare(ResourceAccessFlags accessFlags)
     {
         constexpr ImU32 green = IM_COL32(169, 209, 54, 255);
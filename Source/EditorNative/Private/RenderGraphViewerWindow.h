@@ -7,6 +7,7 @@
 #include <vector>
 #include <unordered_map>
 #include <optional>
+#include <deque>
 
 namespace march
 {
@@ -59,10 +60,20 @@ namespace march
         std::vector<PassData> m_Passes{};
         std::vector<ResourceData> m_Resources{};
 
+        RenderGraphResourcePoolStats m_BufferPoolStats{};
+        RenderGraphResourcePoolStats m_TexturePoolStats{};
+
+        std::deque<RenderGraphFrameTiming> m_FrameTimings{}; // 用于导出 chrome trace
+        std::unordered_map<std::string, const RenderGraphPassTiming*> m_PassTimings{}; // 最近一帧的结果，key 是 pass 名
+
+        void DrawToolbar();
         void DrawAccessSquare(ResourceAccessFlags accessFlags);
+        void ExportChromeTrace();
+        static void DrawPoolStats(const char* label, const RenderGraphResourcePoolStats& stats);
 
     public:
         void OnGraphCompiled(const std::vector<RenderGraphPass>& passes, const RenderGraphResourceManager* resourceManager) override;
+        void OnGraphProfiled(const RenderGraphFrameTiming& timing) override;
 
     protected:
         bool Begin() override;
@@ -13,12 +13,11 @@
 #define HALF_MIN 6.103515625e-5  // 2^-14, the same value for 10, 11 and 16-bit: https://www.khronos.org/opengl/wiki/Small_Float_Formats
 #define HALF_MAX 65504.0
 
+// 只存仿射矩阵的前三行，最后一行是 (0, 0, 0, 1)
 struct InstanceData
 {
-    float4x4 _MatrixWorld;
-    float4x4 _MatrixWorldIT; // 逆转置
-    float4x4 _MatrixPrevWorld; // 上一帧的矩阵
-    float4 _Params; // x: OddNegativeScale
+    float4 _MatrixWorld[3];
+    float4 _MatrixPrevWorld[3]; // 上一帧的矩阵
 };
 
 StructuredBuffer<InstanceData> _InstanceBuffer;
@@ -43,22 +42,36 @@ float Square(float x)
 
 float4x4 GetObjectToWorldMatrix(uint instanceID)
 {
-    return _InstanceBuffer[instanceID]._MatrixWorld;
+    float4 r0 = _InstanceBuffer[instanceID]._MatrixWorld[0];
+    float4 r1 = _InstanceBuffer[instanceID]._MatrixWorld[1];
+    float4 r2 = _InstanceBuffer[instanceID]._MatrixWorld[2];
+    return float4x4(r0, r1, r2, float4(0.0, 0.0, 0.0, 1.0));
 }
 
-float4x4 GetObjectToWorldMatrixIT(uint instanceID)
+float4x4 GetObjectToWorldMatrixLastFrame(uint instanceID)
 {
-    return _InstanceBuffer[instanceID]._MatrixWorldIT;
+    float4 r0 = _InstanceBuffer[instanceID]._MatrixPrevWorld[0];
+    float4 r1 = _InstanceBuffer[instanceID]._MatrixPrevWorld[1];
+    float4 r2 = _InstanceBuffer[instanceID]._MatrixPrevWorld[2];
+    return float4x4(r0, r1, r2, float4(0.0, 0.0, 0.0, 1.0));
 }
 
-float4x4 GetObjectToWorldMatrixLastFrame(uint instanceID)
+float GetOddNegativeScale(uint instanceID)
 {
-    return _InstanceBuffer[instanceID]._MatrixPrevWorld;
+    // 和 C++ 的 InstanceData::HasOddNegativeScaling 一致
+    return determinant((float3x3) GetObjectToWorldMatrix(instanceID)) < 0.0 ? -1.0 : 1.0;
 }
 
-float GetOddNegativeScale(uint instanceID)
+// 逆转置，用于法线变换
+// 法线变换后会 normalize，所以不用除以行列式，伴随矩阵乘上行列式的符号就行
+float3x3 GetObjectToWorldMatrixIT(uint instanceID)
 {
-    return _InstanceBuffer[instanceID]._Params.x;
+    float3x3 m = (float3x3) GetObjectToWorldMatrix(instanceID);
+    float3 c0 = cross(m[1], m[2]);
+    float3 c1 = cross(m[2], m[0]);
+    float3 c2 = cross(m[0], m[1]);
+    float s = dot(m[0], c0) < 0.0 ? -1.0 : 1.0;
+    return float3x3(c0, c1, c2) * s;
 }
 
 float3 TransformObjectToWorld(uint instanceID, float3 positionOS)
@@ -116,7 +129,7 @@ float4 TransformWorldToHClipNonJitteredLastFrame(float3 positionWS)
 
 float3 TransformObjectToWorldNormal(uint instanceID, float3 normalOS)
 {
-    return normalize(mul((float3x3) GetObjectToWorldMatrixIT(instanceID), normalOS));
+    return normalize(mul(GetObjectToWorldMatrixIT(instanceID), normalOS));
 }
 
 float3 TransformWorldToViewNormal(float3 normalWS)